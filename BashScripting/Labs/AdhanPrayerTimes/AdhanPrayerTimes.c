@@ -0,0 +1,467 @@
+/*
+ * AdhanPrayerTimes.c - offline replacement for AdhanPrayerTimes.sh
+ *
+ * The script asks api.aladhan.com with curl and pipes the answer through
+ * json_pp and jq or python3: it needs the network and three processes per
+ * lookup. Here the times are computed locally from the position of the sun
+ * (prayertimes.c), and a date range can be precomputed once into a table
+ * file: a lookup is then an mmap and an index, no network, no subprocess.
+ *
+ * Usage: AdhanPrayerTimes [show] [location] [-f table] [-j] [date]
+ *        AdhanPrayerTimes build [location] [-y year | -d date -n days] <table>
+ *        AdhanPrayerTimes bench [location]
+ *        AdhanPrayerTimes list
+ *        location: [-c city] [-L lat,lon] [-z timezone] [-m method] [-H]
+ *        date: DD-MM-YYYY (as in the API) or YYYY-MM-DD, default today
+ *
+ * Build: gcc -O2 -Wall AdhanPrayerTimes.c prayertimes.c -o AdhanPrayerTimes -lm
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "prayertimes.h"
+
+
+#define DEFAULT_CITY "Giza"
+#define BENCH_YEARS 2000
+#define BENCH_OPENS 20000
+#define BENCH_LOOKUPS 50000000
+
+typedef struct Request
+{
+    PrayerLocation location;
+    const PrayerMethod* method;
+    int asrFactor;
+    const char* table;
+    int locationGiven;              // -c or -L on the command line
+    int methodGiven;
+    int asrGiven;
+    int timezoneGiven;
+    int json;
+    int year;
+    long firstDay;
+    int days;
+} Request;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// DD-MM-YYYY or YYYY-MM-DD. Returns 0 on success.
+static int parseDate(const char* text, long* day)
+{
+    int a, b, c;
+    if(sscanf(text, "%d-%d-%d", &a, &b, &c) != 3)
+    {
+        return -1;
+    }
+    if(a > 31)
+    {
+        int swap = a;
+        a = c;
+        c = swap;
+    }
+    if(b < 1 || b > 12 || a < 1 || a > 31)
+    {
+        return -1;
+    }
+    *day = prayerDayFromDate(c, b, a);
+    return 0;
+}
+
+static long today(void)
+{
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    return prayerDayFromDate(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage AdhanPrayerTimes [show] [location] [-f table] [-j] [date]\n"
+        "      AdhanPrayerTimes build [location] [-y year | -d date -n days] <table>\n"
+        "      AdhanPrayerTimes bench [location]\n"
+        "      AdhanPrayerTimes list\n"
+        "  -c  built-in city (default %s, see list)\n"
+        "  -L  latitude,longitude instead of a city\n"
+        "  -z  time zone: Africa/Cairo, or a fixed offset in hours: +2\n"
+        "  -m  calculation method (default: the one of the city)\n"
+        "  -H  Hanafi Asr (shadow twice the length)\n"
+        "  -f  read the times from a table made by build\n"
+        "  -j  print JSON, like jq '.data.timings'\n"
+        "  -y  build a table for this year (default: this year)\n"
+        "  -d  first date, -n days of the table\n"
+        "  date: DD-MM-YYYY or YYYY-MM-DD (default today)\n",
+        DEFAULT_CITY);
+}
+
+// Parses the options shared by all commands. Returns 0, or 2 on a usage error.
+static int parseOptions(int argc, char* argv[], Request* request)
+{
+    const PrayerLocation* city = prayerFindCity(DEFAULT_CITY);
+    const char* methodName = NULL;
+    const char* timezone = NULL;
+    double latitude = 0, longitude = 0;
+    int custom = 0;
+    int opt;
+
+    memset(request, 0, sizeof(*request));
+    request->asrFactor = 1;
+    while((opt = getopt(argc, argv, "c:L:z:m:Hf:jy:d:n:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c':
+                city = prayerFindCity(optarg);
+                if(city == NULL)
+                {
+                    fprintf(stderr, "Unknown city %s (see: AdhanPrayerTimes list)\n", optarg);
+                    return 2;
+                }
+                request->locationGiven = 1;
+                break;
+            case 'L':
+                if(sscanf(optarg, "%lf,%lf", &latitude, &longitude) != 2 || latitude < -90 || latitude > 90)
+                {
+                    fprintf(stderr, "Invalid location %s\n", optarg);
+                    return 2;
+                }
+                custom = 1;
+                request->locationGiven = 1;
+                break;
+            case 'z': timezone = optarg; request->timezoneGiven = 1; break;
+            case 'm': methodName = optarg; request->methodGiven = 1; break;
+            case 'H': request->asrFactor = 2; request->asrGiven = 1; break;
+            case 'f': request->table = optarg; break;
+            case 'j': request->json = 1; break;
+            case 'y': request->year = atoi(optarg); break;
+            case 'd':
+                if(parseDate(optarg, &request->firstDay) != 0)
+                {
+                    fprintf(stderr, "Invalid date %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'n': request->days = atoi(optarg); break;
+            default: usage(); return 2;
+        }
+    }
+
+    request->location = *city;
+    if(custom)
+    {
+        request->location.city = "custom";
+        request->location.latitude = latitude;
+        request->location.longitude = longitude;
+        request->location.elevation = 0;
+    }
+    if(timezone)
+    {
+        request->location.timezone = timezone;
+    }
+    request->method = prayerFindMethod(methodName ? methodName : request->location.method);
+    if(request->method == NULL)
+    {
+        fprintf(stderr, "Unknown method %s (see: AdhanPrayerTimes list)\n", methodName);
+        return 2;
+    }
+    return 0;
+}
+
+static void printTimes(const uint16_t* row, int json)
+{
+    if(json)
+    {
+        printf("{\n");
+    }
+    for(int p = 0; p < PRAYER_COUNT; p++)
+    {
+        char time[8];
+        snprintf(time, sizeof(time), "%02d:%02d", row[p] / 60, row[p] % 60);
+        if(json)
+        {
+            printf("  \"%s\": \"%s\"%s\n", prayerName(p), time, p + 1 < PRAYER_COUNT ? "," : "");
+        }
+        else
+        {
+            printf("%s %s\n", prayerName(p), time);
+        }
+    }
+    if(json)
+    {
+        printf("}\n");
+    }
+}
+
+// A table answers only for what it was built for: what the command line asks must match its header
+static int tableMatches(const PrayerTableHeader* header, const Request* request)
+{
+    if(request->locationGiven)
+    {
+        if(strcmp(header->city, request->location.city) != 0)
+        {
+            return 0;
+        }
+        if(strcmp(request->location.city, "custom") == 0 &&
+           (fabs(header->latitude - request->location.latitude) > 1e-6 ||
+            fabs(header->longitude - request->location.longitude) > 1e-6))
+        {
+            return 0;
+        }
+    }
+    if(request->methodGiven && strcmp(header->method, request->method->name) != 0)
+    {
+        return 0;
+    }
+    if(request->asrGiven && header->asrFactor != request->asrFactor)
+    {
+        return 0;
+    }
+    if(request->timezoneGiven && strcmp(header->timezone, request->location.timezone) != 0)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static int showCommand(int argc, char* argv[])
+{
+    Request request;
+    long day = today();
+    uint16_t row[PRAYER_COUNT];
+
+    if(parseOptions(argc, argv, &request) != 0)
+    {
+        return 2;
+    }
+    if(optind < argc && parseDate(argv[optind], &day) != 0)
+    {
+        fprintf(stderr, "Invalid date %s\n", argv[optind]);
+        return 2;
+    }
+
+    if(request.table)
+    {
+        PrayerTable* table = prayerTableOpen(request.table);
+        if(table == NULL)
+        {
+            perror(request.table);
+            return 1;
+        }
+        const PrayerTableHeader* header = prayerTableHeader(table);
+        if(!tableMatches(header, &request))
+        {
+            fprintf(stderr, "%s is a table for %s (%.4f,%.4f), method %s, %s Asr, time zone %s: "
+                "not what was asked, build a table with these options\n", request.table, header->city,
+                header->latitude, header->longitude, header->method, header->asrFactor == 2 ? "Hanafi" : "Shafi'i",
+                header->timezone);
+            prayerTableClose(table);
+            return 1;
+        }
+        if(!request.locationGiven && strcmp(header->city, request.location.city) != 0)
+        {
+            // Without -c / -L the table decides: say where the times are for
+            fprintf(stderr, "Times for %s (%s) from %s\n", header->city, header->method, request.table);
+        }
+        const uint16_t* found = prayerTableDay(table, day);
+        if(found == NULL)
+        {
+            fprintf(stderr, "%s does not cover this date, build a table for it\n", request.table);
+            prayerTableClose(table);
+            return 1;
+        }
+        memcpy(row, found, sizeof(row));
+        prayerTableClose(table);
+    }
+    else if(prayerCompute(&request.location, request.method, request.asrFactor, day, 1, &row) != 0)
+    {
+        perror(request.location.timezone);
+        return 1;
+    }
+    printTimes(row, request.json);
+    return 0;
+}
+
+static void defaultRange(Request* request)
+{
+    if(request->firstDay != 0 || request->days > 0)
+    {
+        request->days = request->days > 0 ? request->days : 1;
+        return;
+    }
+    int year = request->year, month, day;
+    if(year == 0)
+    {
+        prayerDateFromDay(today(), &year, &month, &day);
+    }
+    request->firstDay = prayerDayFromDate(year, 1, 1);
+    request->days = prayerDayFromDate(year + 1, 1, 1) - request->firstDay;
+}
+
+static int buildCommand(int argc, char* argv[])
+{
+    Request request;
+    int year, month, day;
+
+    if(parseOptions(argc, argv, &request) != 0)
+    {
+        return 2;
+    }
+    if(optind + 1 != argc)
+    {
+        usage();
+        return 2;
+    }
+    defaultRange(&request);
+
+    double start = nowSeconds();
+    if(prayerTableBuild(argv[optind], &request.location, request.method, request.asrFactor,
+                        request.firstDay, request.days) != 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    double seconds = nowSeconds() - start;
+    prayerDateFromDay(request.firstDay, &year, &month, &day);
+    printf("%s: %s, %s, %d days from %04d-%02d-%02d, %zu bytes, built in %.3f ms\n", argv[optind],
+        request.location.city, request.method->name, request.days, year, month, day,
+        sizeof(PrayerTableHeader) + sizeof(uint16_t[PRAYER_COUNT]) * request.days, seconds * 1e3);
+    return 0;
+}
+
+static int benchCommand(int argc, char* argv[])
+{
+    Request request;
+    char path[] = "/tmp/AdhanPrayerTimesXXXXXX";
+    static uint16_t rows[366][PRAYER_COUNT];
+    volatile unsigned sink = 0;
+
+    if(parseOptions(argc, argv, &request) != 0)
+    {
+        return 2;
+    }
+    defaultRange(&request);
+    if(request.days > 366)
+    {
+        request.days = 366;
+    }
+    printf("%s, %s, %d days\n", request.location.city, request.method->name, request.days);
+
+    double start = nowSeconds();
+    for(int i = 0; i < BENCH_YEARS; i++)
+    {
+        if(prayerCompute(&request.location, request.method, request.asrFactor, request.firstDay, request.days, rows) != 0)
+        {
+            perror("compute");
+            return 1;
+        }
+    }
+    double seconds = (nowSeconds() - start) / BENCH_YEARS;
+    printf("compute a year:        %8.1f us  (%.0f ns per day)\n", seconds * 1e6, seconds * 1e9 / request.days);
+
+    int fd = mkstemp(path);
+    if(fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    start = nowSeconds();
+    if(prayerTableBuild(path, &request.location, request.method, request.asrFactor, request.firstDay, request.days) != 0)
+    {
+        perror(path);
+        unlink(path);
+        return 1;
+    }
+    printf("build the table file:  %8.1f us  (with fsync)\n", (nowSeconds() - start) * 1e6);
+
+    // What one `show -f` pays: open + mmap + checksum + lookup + close
+    start = nowSeconds();
+    for(int i = 0; i < BENCH_OPENS; i++)
+    {
+        PrayerTable* table = prayerTableOpen(path);
+        if(table == NULL)
+        {
+            perror(path);
+            unlink(path);
+            return 1;
+        }
+        sink += prayerTableDay(table, request.firstDay + i % request.days)[PRAYER_FAJR];
+        prayerTableClose(table);
+    }
+    printf("open + lookup + close: %8.2f us\n", (nowSeconds() - start) / BENCH_OPENS * 1e6);
+
+    // Lookups in an open table
+    PrayerTable* table = prayerTableOpen(path);
+    unsigned random = 1;
+    start = nowSeconds();
+    for(int i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        random = random * 1103515245u + 12345u;
+        const uint16_t* row = prayerTableDay(table, request.firstDay + (random >> 8) % request.days);
+        sink += row[PRAYER_ISHA];
+    }
+    printf("lookup (open table):   %8.2f ns\n", (nowSeconds() - start) / BENCH_LOOKUPS * 1e9);
+    prayerTableClose(table);
+    unlink(path);
+    return 0;
+}
+
+static int listCommand(void)
+{
+    int count;
+    const PrayerLocation* cities = prayerCities(&count);
+    printf("Cities:\n");
+    for(int i = 0; i < count; i++)
+    {
+        printf("  %-12s %8.4f %9.4f  %-18s %s\n", cities[i].city, cities[i].latitude, cities[i].longitude,
+            cities[i].timezone, cities[i].method);
+    }
+    const PrayerMethod* methods = prayerMethods(&count);
+    printf("Methods:\n");
+    for(int i = 0; i < count; i++)
+    {
+        printf("  %-8s Fajr %4.1f, Isha ", methods[i].name, methods[i].fajrAngle);
+        if(methods[i].ishaAngle > 0)
+        {
+            printf("%4.1f", methods[i].ishaAngle);
+        }
+        else
+        {
+            printf("%d min", methods[i].ishaMinutes);
+        }
+        printf("  %s\n", methods[i].description);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "build") == 0)
+    {
+        return buildCommand(argc - 1, argv + 1);
+    }
+    if(argc >= 2 && strcmp(argv[1], "bench") == 0)
+    {
+        return benchCommand(argc - 1, argv + 1);
+    }
+    if(argc >= 2 && strcmp(argv[1], "list") == 0)
+    {
+        return listCommand();
+    }
+    if(argc >= 2 && strcmp(argv[1], "show") == 0)
+    {
+        return showCommand(argc - 1, argv + 1);
+    }
+    return showCommand(argc, argv);
+}
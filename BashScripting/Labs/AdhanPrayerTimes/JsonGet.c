@@ -0,0 +1,177 @@
+/*
+ * JsonGet.c - extract JSON paths without json_pp / jq / python3
+ *
+ * AdhanPrayerTimes.sh pipes the API answer through json_pp and then jq or a
+ * python3 one-liner: three processes and two full parse trees for nine short
+ * strings. JsonGet scans the input once (jsonscan.c) and prints the values at
+ * the given paths, e.g. the timings as "Fajr 05:03" lines like the python
+ * branch of the script.
+ *
+ * Usage: curl ... | JsonGet 'data.timings.*'
+ *        JsonGet -f response.json 'data.timings.Fajr' 'data.date.readable'
+ *        JsonGet -f big.json -b 10 'data.*.timings.Fajr'    (MB/s)
+ *
+ * Build: gcc -O2 -Wall JsonGet.c jsonscan.c -o JsonGet
+ *        (-march=native for AVX2 instead of SSE2)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jsonscan.h"
+
+
+typedef struct Output
+{
+    int raw;                        // values only
+    int countOnly;
+    long matches;
+} Output;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int printMatch(void* context, const JsonMatch* match)
+{
+    Output* output = context;
+    output->matches++;
+    if(output->countOnly)
+    {
+        return 0;
+    }
+    if(!output->raw && match->index < 0)
+    {
+        fwrite(match->key.data, 1, match->key.length, stdout);
+        putchar(' ');
+    }
+    else if(!output->raw)
+    {
+        printf("[%ld] ", match->index);
+    }
+    fwrite(match->value.data, 1, match->value.length, stdout);
+    putchar('\n');
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage JsonGet [-f file] [-r] [-c] [-S] [-b runs] path...\n"
+        "  path  components separated by '.', '*' = any member / element, a number = that element\n"
+        "  -f  mmap this file (default: stream stdin)\n"
+        "  -r  print the values only (default: key value)\n"
+        "  -c  print the number of matches only\n"
+        "  -S  scalar stage 1 (one byte at a time) instead of SIMD\n"
+        "  -b  benchmark: scan the file this many times and print MB/s (with -f)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    Output output = { 0 };
+    const char* file = NULL;
+    int flags = 0;
+    int runs = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "f:rcSb:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f': file = optarg; break;
+            case 'r': output.raw = 1; break;
+            case 'c': output.countOnly = 1; break;
+            case 'S': flags |= JSON_SCALAR_STAGE1; break;
+            case 'b': runs = atoi(optarg); break;
+            default: usage(); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if(optind == argc || (runs > 0 && file == NULL))
+    {
+        usage();
+        return 2;
+    }
+    const char* const* paths = (const char* const*)(argv + optind);
+    int pathCount = argc - optind;
+    static char outputBuffer[1 << 16];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+    int result;
+    if(file == NULL)
+    {
+        result = jsonScanStream(STDIN_FILENO, paths, pathCount, printMatch, &output, flags);
+    }
+    else
+    {
+        struct stat st;
+        int fd = open(file, O_RDONLY | O_CLOEXEC);
+        if(fd < 0 || fstat(fd, &st) != 0)
+        {
+            perror(file);
+            return 2;
+        }
+        const char* data = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : "";
+        close(fd);
+        if(data == MAP_FAILED)
+        {
+            perror("mmap");
+            return 2;
+        }
+        if(runs > 0)
+        {
+            // Page cache warm, mapping populated: the scan itself is measured
+            output.countOnly = 1;
+            double best = 1e30;
+            for(int i = 0; i < runs; i++)
+            {
+                output.matches = 0;
+                double start = nowSeconds();
+                result = jsonScanBuffer(data, st.st_size, paths, pathCount, printMatch, &output, flags);
+                double seconds = nowSeconds() - start;
+                best = seconds < best ? seconds : best;
+                if(result < 0)
+                {
+                    break;
+                }
+            }
+            if(result >= 0)
+            {
+                printf("%.1f MB in %.2f ms: %.0f MB/s, %ld matches (%s stage 1, best of %d)\n", st.st_size / 1e6, best * 1e3,
+                    st.st_size / 1e6 / best, output.matches, (flags & JSON_SCALAR_STAGE1) ? "scalar" : "SIMD", runs);
+            }
+            output.countOnly = 0;
+        }
+        else
+        {
+            result = jsonScanBuffer(data, st.st_size, paths, pathCount, printMatch, &output, flags);
+        }
+    }
+
+    if(output.countOnly)
+    {
+        printf("%ld\n", output.matches);
+    }
+    fflush(stdout);
+    if(result < 0)
+    {
+        if(errno == EBADMSG)
+        {
+            fprintf(stderr, "JsonGet: malformed JSON near offset %zu\n", jsonErrorOffset());
+        }
+        else
+        {
+            perror("JsonGet");
+        }
+        return 1;
+    }
+    return output.matches > 0 ? 0 : 1;
+}
@@ -0,0 +1,880 @@
+/*
+ * jsonscan.c - zero-copy JSON path scanner (SIMD stage 1 + structural walk)
+ *
+ * Stage 1 follows the simdjson idea: 64 input bytes become bitmasks, the
+ * backslash runs of odd length mark escaped quotes, and a prefix XOR of the
+ * remaining quotes gives the bytes inside strings. Stage 2 only sees the
+ * positions of { } [ ] : , and of the quotes.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include "jsonscan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+#define MAX_COMPONENTS 32
+#define STREAM_BLOCK (1 << 20)      // bytes read at a time in stream mode
+
+typedef struct Component
+{
+    const char* text;
+    size_t length;
+    long index;                     // array index, -1 when not a number
+    int wildcard;
+} Component;
+
+typedef struct Path
+{
+    Component components[MAX_COMPONENTS];
+    int count;
+} Path;
+
+typedef struct Level
+{
+    size_t start;                   // offset of the '{' / '['
+    uint64_t active;                // paths that go deeper than this container
+    uint64_t emit;                  // paths that end at this container
+    size_t keyStart;                // its key in the parent, for the match
+    size_t keyLength;
+    long parentIndex;
+    long index;                     // current element of an array
+    int isArray;
+} Level;
+
+typedef struct Scanner
+{
+    Path paths[JSON_MAX_PATHS];
+    int pathCount;
+    Level levels[JSON_MAX_DEPTH + 1];   // levels[0]: the document
+    int depth;
+    long skipDepth;                 // > 0 while crossing a subtree no path goes into
+
+    uint64_t member;                // paths matched by the current member / element
+    int expectKey;
+    int slotOpen;                   // a value may start here
+    int haveValue;                  // a string or container value was seen in the slot
+    size_t keyStart;
+    size_t keyLength;
+    long index;                     // index of the current element, -1 for a member
+    size_t last;                    // offset of the last structural character
+    int inString;
+    size_t stringStart;
+
+    // Stage 1 state carried from one 64-byte block to the next
+    uint64_t prevOddBackslash;
+    uint64_t prevInString;
+    int scalarEscaped;
+
+    const char* base;               // byte at offset baseOffset
+    size_t baseOffset;
+    JsonCallback callback;
+    void* context;
+    int flags;
+} Scanner;
+
+static __thread size_t errorOffset;
+
+size_t jsonErrorOffset(void)
+{
+    return errorOffset;
+}
+
+static const char* at(const Scanner* scanner, size_t offset)
+{
+    return scanner->base + (offset - scanner->baseOffset);
+}
+
+// ---- Paths ----------------------------------------------------------------
+
+static int parsePaths(Scanner* scanner, const char* const* paths, int pathCount)
+{
+    if(pathCount < 1 || pathCount > JSON_MAX_PATHS)
+    {
+        return -1;
+    }
+    for(int p = 0; p < pathCount; p++)
+    {
+        Path* path = &scanner->paths[p];
+        const char* text = paths[p];
+        path->count = 0;
+        while(*text)
+        {
+            const char* end = strchr(text, '.');
+            size_t length = end ? (size_t)(end - text) : strlen(text);
+            if(length == 0 || path->count == MAX_COMPONENTS)
+            {
+                return -1;
+            }
+            Component* component = &path->components[path->count++];
+            component->text = text;
+            component->length = length;
+            component->wildcard = length == 1 && text[0] == '*';
+            component->index = strspn(text, "0123456789") >= length ? atol(text) : -1;
+            text += length + (end != NULL);
+        }
+        if(path->count == 0)
+        {
+            return -1;
+        }
+    }
+    scanner->pathCount = pathCount;
+    return 0;
+}
+
+static int hexValue(const char* text)
+{
+    int value = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        char c = text[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+        if(digit < 0)
+        {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// Decodes the escapes of a string into `out` (never longer than the input). Returns the length, -1 if invalid.
+static long unescape(const char* text, size_t length, char* out)
+{
+    size_t used = 0;
+    for(size_t i = 0; i < length; i++)
+    {
+        if(text[i] != '\\')
+        {
+            out[used++] = text[i];
+            continue;
+        }
+        if(++i == length)
+        {
+            return -1;
+        }
+        const char* simple = strchr("\"\\/bfnrt", text[i]);
+        if(simple && text[i] != '\0')
+        {
+            out[used++] = "\"\\/\b\f\n\r\t"[simple - "\"\\/bfnrt"];
+            continue;
+        }
+        if(text[i] != 'u' || i + 4 >= length || hexValue(text + i + 1) < 0)
+        {
+            return -1;
+        }
+        long code = hexValue(text + i + 1);
+        i += 4;
+        if(code >= 0xd800 && code < 0xdc00 && i + 6 < length && text[i + 1] == '\\' && text[i + 2] == 'u' &&
+           hexValue(text + i + 3) >= 0xdc00 && hexValue(text + i + 3) < 0xe000)
+        {
+            code = 0x10000 + ((code - 0xd800) << 10) + (hexValue(text + i + 3) - 0xdc00);
+            i += 6;
+        }
+        // UTF-8
+        if(code < 0x80)
+        {
+            out[used++] = code;
+        }
+        else if(code < 0x800)
+        {
+            out[used++] = 0xc0 | (code >> 6);
+            out[used++] = 0x80 | (code & 0x3f);
+        }
+        else if(code < 0x10000)
+        {
+            out[used++] = 0xe0 | (code >> 12);
+            out[used++] = 0x80 | ((code >> 6) & 0x3f);
+            out[used++] = 0x80 | (code & 0x3f);
+        }
+        else
+        {
+            out[used++] = 0xf0 | (code >> 18);
+            out[used++] = 0x80 | ((code >> 12) & 0x3f);
+            out[used++] = 0x80 | ((code >> 6) & 0x3f);
+            out[used++] = 0x80 | (code & 0x3f);
+        }
+    }
+    return used;
+}
+
+// Paths of `candidates` whose component at `depth` matches this key / index
+static uint64_t matchSlot(const Scanner* scanner, uint64_t candidates, int depth, const char* key, size_t keyLength, long index)
+{
+    uint64_t result = 0;
+    char small[256];
+    char* decoded = NULL;
+    if(index < 0 && memchr(key, '\\', keyLength))
+    {
+        // Rare: compare the path with the decoded key ("\u00fc" is "ü")
+        decoded = keyLength <= sizeof(small) ? small : malloc(keyLength);
+        long length = decoded ? unescape(key, keyLength, decoded) : -1;
+        if(length >= 0)
+        {
+            key = decoded;
+            keyLength = length;
+        }
+    }
+    while(candidates)
+    {
+        int p = __builtin_ctzll(candidates);
+        candidates &= candidates - 1;
+        const Component* component = &scanner->paths[p].components[depth];
+        if(component->wildcard ||
+           (index < 0 && component->length == keyLength && memcmp(component->text, key, keyLength) == 0) ||
+           (index >= 0 && component->index == index))
+        {
+            result |= 1ull << p;
+        }
+    }
+    if(decoded != small)
+    {
+        free(decoded);
+    }
+    return result;
+}
+
+// Splits `member` (paths matching a value at `depth`) into the ones ending there and the ones going deeper
+static uint64_t endingAt(const Scanner* scanner, uint64_t member, int depth)
+{
+    uint64_t result = 0;
+    while(member)
+    {
+        int p = __builtin_ctzll(member);
+        member &= member - 1;
+        if(scanner->paths[p].count == depth)
+        {
+            result |= 1ull << p;
+        }
+    }
+    return result;
+}
+
+// ---- Stage 2 --------------------------------------------------------------
+
+static int emit(Scanner* scanner, uint64_t paths, JsonType type, size_t keyStart, size_t keyLength, long index,
+                const char* value, size_t valueLength)
+{
+    JsonMatch match;
+    match.type = type;
+    match.key.data = index < 0 ? at(scanner, keyStart) : "";
+    match.key.length = index < 0 ? keyLength : 0;
+    match.index = index;
+    match.value.data = value;
+    match.value.length = valueLength;
+    while(paths)
+    {
+        match.path = __builtin_ctzll(paths);
+        paths &= paths - 1;
+        if(scanner->callback(scanner->context, &match) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void startElement(Scanner* scanner)
+{
+    Level* level = &scanner->levels[scanner->depth];
+    scanner->index = level->index;
+    scanner->member = matchSlot(scanner, level->active, scanner->depth - 1, NULL, 0, level->index);
+    scanner->slotOpen = 1;
+    scanner->haveValue = 0;
+}
+
+// A scalar ends at the next structural character: its text is what lies in between
+static int finishScalar(Scanner* scanner, size_t end)
+{
+    if(!scanner->slotOpen || scanner->haveValue)
+    {
+        return 0;
+    }
+    const char* text = at(scanner, scanner->last + 1);
+    size_t length = end - (scanner->last + 1);
+    while(length > 0 && (*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r'))
+    {
+        text++;
+        length--;
+    }
+    while(length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t' || text[length - 1] == '\n' || text[length - 1] == '\r'))
+    {
+        length--;
+    }
+    if(length == 0)
+    {
+        return -1;
+    }
+    scanner->haveValue = 1;
+    uint64_t paths = endingAt(scanner, scanner->member, scanner->depth);
+    if(paths)
+    {
+        return emit(scanner, paths, JSON_SCALAR, scanner->keyStart, scanner->keyLength, scanner->index, text, length);
+    }
+    return 0;
+}
+
+static int openContainer(Scanner* scanner, size_t offset, int isArray)
+{
+    if(!scanner->slotOpen || scanner->haveValue || scanner->depth == JSON_MAX_DEPTH)
+    {
+        return -1;
+    }
+    uint64_t ending = endingAt(scanner, scanner->member, scanner->depth);
+    uint64_t deeper = scanner->member & ~ending;
+    scanner->haveValue = 1;
+    if(ending == 0 && deeper == 0)
+    {
+        // Nothing to find inside: only count brackets until it closes
+        scanner->skipDepth = 1;
+        return 0;
+    }
+
+    Level* level = &scanner->levels[++scanner->depth];
+    level->start = offset;
+    level->active = deeper;
+    level->emit = ending;
+    level->keyStart = scanner->keyStart;
+    level->keyLength = scanner->keyLength;
+    level->parentIndex = scanner->index;
+    level->index = 0;
+    level->isArray = isArray;
+    scanner->member = 0;
+    scanner->expectKey = !isArray;
+    scanner->slotOpen = 0;
+    scanner->haveValue = 0;
+    if(isArray)
+    {
+        startElement(scanner);
+    }
+    return 0;
+}
+
+static int onlySpace(const char* text, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        if(text[i] != ' ' && text[i] != '\t' && text[i] != '\n' && text[i] != '\r')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int closeContainer(Scanner* scanner, size_t offset, int isArray)
+{
+    Level* level = &scanner->levels[scanner->depth];
+    if(scanner->depth == 0 || level->isArray != isArray)
+    {
+        return -1;
+    }
+    int empty = *at(scanner, scanner->last) == (isArray ? '[' : '{') &&
+                onlySpace(at(scanner, scanner->last + 1), offset - scanner->last - 1);
+    if(!empty)
+    {
+        // `{"a"}`, `{"a":1,}` and `[1,]` are errors, a pending scalar ends here
+        if(!scanner->slotOpen)
+        {
+            return -1;
+        }
+        int result = finishScalar(scanner, offset);
+        if(result != 0)
+        {
+            return result;
+        }
+    }
+
+    scanner->depth--;
+    scanner->member = 0;
+    scanner->expectKey = 0;
+    scanner->slotOpen = 1;
+    scanner->haveValue = 1;
+    scanner->index = level->parentIndex;
+    if(level->emit)
+    {
+        return emit(scanner, level->emit, isArray ? JSON_ARRAY : JSON_OBJECT, level->keyStart, level->keyLength,
+                    level->parentIndex, at(scanner, level->start), offset + 1 - level->start);
+    }
+    return 0;
+}
+
+// One structural character. Returns 0, 1 when stopped, -1 on malformed input.
+static int structural(Scanner* scanner, size_t offset, char c)
+{
+    int result = 0;
+    if(scanner->skipDepth > 0)
+    {
+        // Strings are already masked out by stage 1: brackets are enough
+        if(c == '{' || c == '[')
+        {
+            scanner->skipDepth++;
+        }
+        else if(c == '}' || c == ']')
+        {
+            scanner->skipDepth--;
+        }
+        scanner->last = offset;
+        return 0;
+    }
+
+    switch(c)
+    {
+        case '"':
+            if(!scanner->inString)
+            {
+                scanner->inString = 1;
+                scanner->stringStart = offset + 1;
+                if(!scanner->expectKey && (!scanner->slotOpen || scanner->haveValue))
+                {
+                    return -1;
+                }
+                break;
+            }
+            scanner->inString = 0;
+            if(scanner->expectKey)
+            {
+                Level* level = &scanner->levels[scanner->depth];
+                scanner->keyStart = scanner->stringStart;
+                scanner->keyLength = offset - scanner->stringStart;
+                scanner->member = matchSlot(scanner, level->active, scanner->depth - 1,
+                                            at(scanner, scanner->keyStart), scanner->keyLength, -1);
+                scanner->expectKey = 0;
+            }
+            else
+            {
+                uint64_t paths = endingAt(scanner, scanner->member, scanner->depth);
+                scanner->haveValue = 1;
+                if(paths)
+                {
+                    result = emit(scanner, paths, JSON_STRING, scanner->keyStart, scanner->keyLength, scanner->index,
+                                  at(scanner, scanner->stringStart), offset - scanner->stringStart);
+                }
+            }
+            break;
+        case ':':
+            if(scanner->depth == 0 || scanner->levels[scanner->depth].isArray || scanner->slotOpen || scanner->expectKey)
+            {
+                return -1;
+            }
+            scanner->slotOpen = 1;
+            scanner->haveValue = 0;
+            scanner->index = -1;
+            break;
+        case ',':
+            if(scanner->depth == 0 || !scanner->slotOpen)
+            {
+                return -1;
+            }
+            result = finishScalar(scanner, offset);
+            if(result != 0)
+            {
+                return result;
+            }
+            if(scanner->levels[scanner->depth].isArray)
+            {
+                scanner->levels[scanner->depth].index++;
+                startElement(scanner);
+            }
+            else
+            {
+                scanner->expectKey = 1;
+                scanner->slotOpen = 0;
+                scanner->member = 0;
+            }
+            break;
+        case '{':
+        case '[':
+            result = openContainer(scanner, offset, c == '[');
+            break;
+        case '}':
+        case ']':
+            result = closeContainer(scanner, offset, c == ']');
+            break;
+    }
+    scanner->last = offset;
+    return result;
+}
+
+// ---- Stage 1 --------------------------------------------------------------
+
+typedef struct Masks
+{
+    uint64_t structural;            // { } [ ] : , outside strings, and the string quotes
+    uint64_t bracket;               // { } [ ] outside strings
+} Masks;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Raw character classes of 64 bytes
+static void classify(const char* block, uint64_t* quote, uint64_t* backslash, uint64_t* bracket, uint64_t* other)
+{
+#if defined(__AVX2__)
+    for(int half = 0; half < 2; half++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * half));
+        // '[' | 0x20 == '{' and ']' | 0x20 == '}': one compare finds both
+        __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        uint64_t q = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        uint64_t b = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        uint64_t k = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))));
+        uint64_t o = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        *quote |= q << (32 * half);
+        *backslash |= b << (32 * half);
+        *bracket |= k << (32 * half);
+        *other |= o << (32 * half);
+    }
+#else
+    for(int quarter = 0; quarter < 4; quarter++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * quarter));
+        __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        uint64_t q = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        uint64_t b = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        uint64_t k = (uint16_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))));
+        uint64_t o = (uint16_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        *quote |= q << (16 * quarter);
+        *backslash |= b << (16 * quarter);
+        *bracket |= k << (16 * quarter);
+        *other |= o << (16 * quarter);
+    }
+#endif
+}
+#else
+static void classify(const char* block, uint64_t* quote, uint64_t* backslash, uint64_t* bracket, uint64_t* other)
+{
+    for(int i = 0; i < 64; i++)
+    {
+        char c = block[i];
+        *quote |= (uint64_t)(c == '"') << i;
+        *backslash |= (uint64_t)(c == '\\') << i;
+        *bracket |= (uint64_t)(c == '{' || c == '}' || c == '[' || c == ']') << i;
+        *other |= (uint64_t)(c == ':' || c == ',') << i;
+    }
+}
+#endif
+
+// Bytes right after a backslash run of odd length, i.e. the escaped ones (simdjson)
+static uint64_t escapedBytes(uint64_t backslash, uint64_t* prevOddBackslash)
+{
+    const uint64_t evenBits = 0x5555555555555555ull;
+    const uint64_t oddBits = ~evenBits;
+    uint64_t startEdges = backslash & ~(backslash << 1);
+    uint64_t evenStartMask = evenBits ^ *prevOddBackslash;
+    uint64_t evenStarts = startEdges & evenStartMask;
+    uint64_t oddStarts = startEdges & ~evenStartMask;
+    uint64_t evenCarries = backslash + evenStarts;
+    uint64_t oddCarries;
+    int endsOdd = __builtin_add_overflow(backslash, oddStarts, &oddCarries);
+    oddCarries |= *prevOddBackslash;
+    *prevOddBackslash = endsOdd ? 1 : 0;
+    uint64_t evenCarryEnds = evenCarries & ~backslash;
+    uint64_t oddCarryEnds = oddCarries & ~backslash;
+    return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+}
+
+static void stage1Simd(Scanner* scanner, const char* block, Masks* masks)
+{
+    uint64_t quote = 0, backslash = 0, bracket = 0, other = 0;
+    classify(block, &quote, &backslash, &bracket, &other);
+    quote &= ~escapedBytes(backslash, &scanner->prevOddBackslash);
+
+    // Prefix XOR: bit i is set when an odd number of quotes precede or are at i
+    uint64_t inString = quote;
+    inString ^= inString << 1;
+    inString ^= inString << 2;
+    inString ^= inString << 4;
+    inString ^= inString << 8;
+    inString ^= inString << 16;
+    inString ^= inString << 32;
+    inString ^= scanner->prevInString;
+    scanner->prevInString = (uint64_t)((int64_t)inString >> 63);
+
+    masks->bracket = bracket & ~inString;
+    masks->structural = ((bracket | other) & ~inString) | quote;
+}
+
+// The same masks, one byte at a time
+static void stage1Scalar(Scanner* scanner, const char* block, Masks* masks)
+{
+    int inString = scanner->prevInString != 0;
+    int escaped = scanner->scalarEscaped;
+    masks->structural = masks->bracket = 0;
+    for(int i = 0; i < 64; i++)
+    {
+        char c = block[i];
+        if(inString)
+        {
+            if(escaped)
+            {
+                escaped = 0;
+            }
+            else if(c == '\\')
+            {
+                escaped = 1;
+            }
+            else if(c == '"')
+            {
+                inString = 0;
+                masks->structural |= 1ull << i;
+            }
+        }
+        else if(c == '"')
+        {
+            inString = 1;
+            masks->structural |= 1ull << i;
+        }
+        else if(c == '{' || c == '}' || c == '[' || c == ']')
+        {
+            masks->structural |= 1ull << i;
+            masks->bracket |= 1ull << i;
+        }
+        else if(c == ':' || c == ',')
+        {
+            masks->structural |= 1ull << i;
+        }
+    }
+    scanner->prevInString = inString ? ~0ull : 0;
+    scanner->scalarEscaped = escaped;
+}
+
+// Both stages for the 64 bytes at `offset`. Stage 1 classifies `block`, which is
+// the input itself or a padded copy of the last bytes; stage 2 reads the input.
+static int scanBlock(Scanner* scanner, size_t offset, const char* block)
+{
+    Masks masks;
+    if(scanner->flags & JSON_SCALAR_STAGE1)
+    {
+        stage1Scalar(scanner, block, &masks);
+    }
+    else
+    {
+        stage1Simd(scanner, block, &masks);
+    }
+    uint64_t bits = masks.structural;
+    while(bits)
+    {
+        if(scanner->skipDepth > 0)
+        {
+            // Commas, colons and quotes do not matter while skipping: jump to the next bracket
+            uint64_t brackets = bits & masks.bracket;
+            if(brackets == 0)
+            {
+                break;
+            }
+            bits &= ~((brackets & -brackets) - 1);
+        }
+        int bit = __builtin_ctzll(bits);
+        bits &= bits - 1;
+        int result = structural(scanner, offset + bit, block[bit]);
+        if(result != 0)
+        {
+            if(result < 0)
+            {
+                errorOffset = offset + bit;
+                errno = EBADMSG;
+            }
+            return result;
+        }
+    }
+    return 0;
+}
+
+static int scanBlocks(Scanner* scanner, size_t offset, size_t length)
+{
+    for(size_t done = 0; done < length; done += 64)
+    {
+        int result = scanBlock(scanner, offset + done, at(scanner, offset + done));
+        if(result != 0)
+        {
+            return result;
+        }
+    }
+    return 0;
+}
+
+// ---- Entry points ---------------------------------------------------------
+
+static Scanner* createScanner(const char* const* paths, int pathCount, JsonCallback callback, void* context, int flags)
+{
+    Scanner* scanner = calloc(1, sizeof(*scanner));
+    if(scanner == NULL)
+    {
+        return NULL;
+    }
+    if(parsePaths(scanner, paths, pathCount) != 0)
+    {
+        free(scanner);
+        errno = EINVAL;
+        return NULL;
+    }
+    // The document itself is the first slot; every path starts below it
+    scanner->levels[0].active = pathCount == 64 ? ~0ull : (1ull << pathCount) - 1;
+    scanner->member = scanner->levels[0].active;
+    scanner->slotOpen = 1;
+    scanner->index = -1;
+    scanner->last = (size_t)-1;
+    scanner->callback = callback;
+    scanner->context = context;
+    scanner->flags = flags;
+    return scanner;
+}
+
+// The last bytes (fewer than 64), then the end of input: a top-level scalar
+// ends here, everything else must be closed
+static int finish(Scanner* scanner, size_t offset, size_t length)
+{
+    int result = 0;
+    if(length > 0)
+    {
+        char padded[64];
+        memset(padded, ' ', sizeof(padded));
+        memcpy(padded, at(scanner, offset), length);
+        result = scanBlock(scanner, offset, padded);
+        if(result != 0)
+        {
+            return result;
+        }
+    }
+    if(scanner->inString || scanner->depth > 0 || scanner->skipDepth > 0)
+    {
+        result = -1;
+    }
+    else if(!scanner->haveValue)
+    {
+        result = finishScalar(scanner, offset + length);
+    }
+    if(result < 0)
+    {
+        errorOffset = offset + length;
+        errno = EBADMSG;
+    }
+    return result;
+}
+
+int jsonScanBuffer(const char* data, size_t size, const char* const* paths, int pathCount,
+                   JsonCallback callback, void* context, int flags)
+{
+    Scanner* scanner = createScanner(paths, pathCount, callback, context, flags);
+    if(scanner == NULL)
+    {
+        return -1;
+    }
+    scanner->base = data;
+    size_t full = size & ~(size_t)63;
+    int result = scanBlocks(scanner, 0, full);
+    if(result == 0)
+    {
+        result = finish(scanner, full, size - full);
+    }
+    free(scanner);
+    return result;
+}
+
+// First offset a pending match may still refer to: everything before it can be dropped
+static size_t keepFrom(const Scanner* scanner, size_t scanned)
+{
+    size_t keep = scanned;
+    if(scanner->last != (size_t)-1 && scanner->last < keep)
+    {
+        keep = scanner->last;
+    }
+    if(scanner->inString && scanner->stringStart - 1 < keep)
+    {
+        keep = scanner->stringStart - 1;
+    }
+    if(scanner->member != 0 && scanner->index < 0 && scanner->depth > 0 && scanner->keyStart < keep)
+    {
+        keep = scanner->keyStart;
+    }
+    for(int d = 1; d <= scanner->depth; d++)
+    {
+        const Level* level = &scanner->levels[d];
+        if(level->emit != 0)
+        {
+            size_t start = level->parentIndex < 0 && level->keyStart < level->start ? level->keyStart : level->start;
+            keep = start < keep ? start : keep;
+            break;                  // deeper levels start later
+        }
+    }
+    return keep;
+}
+
+int jsonScanStream(int fd, const char* const* paths, int pathCount,
+                   JsonCallback callback, void* context, int flags)
+{
+    Scanner* scanner = createScanner(paths, pathCount, callback, context, flags);
+    size_t capacity = 4 * STREAM_BLOCK;
+    char* buffer = scanner ? malloc(capacity) : NULL;
+    size_t have = 0;                // bytes in buffer; buffer[0] is at offset baseOffset
+    size_t scanned = 0;
+    int result = 0;
+
+    if(buffer == NULL)
+    {
+        free(scanner);
+        return -1;
+    }
+    scanner->base = buffer;
+    while(1)
+    {
+        if(capacity - have < STREAM_BLOCK)
+        {
+            size_t drop = keepFrom(scanner, scanned) - scanner->baseOffset;
+            memmove(buffer, buffer + drop, have - drop);
+            have -= drop;
+            scanner->baseOffset += drop;
+            if(capacity - have < STREAM_BLOCK)
+            {
+                // A match larger than the buffer
+                char* grown = realloc(buffer, capacity * 2);
+                if(grown == NULL)
+                {
+                    result = -1;
+                    break;
+                }
+                buffer = grown;
+                capacity *= 2;
+            }
+            scanner->base = buffer;
+        }
+        ssize_t n = read(fd, buffer + have, STREAM_BLOCK);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            result = -1;
+            break;
+        }
+        if(n == 0)
+        {
+            result = finish(scanner, scanned, scanner->baseOffset + have - scanned);
+            break;
+        }
+        have += n;
+        size_t full = (scanner->baseOffset + have - scanned) & ~(size_t)63;
+        result = scanBlocks(scanner, scanned, full);
+        scanned += full;
+        if(result != 0)
+        {
+            break;
+        }
+    }
+    free(buffer);
+    free(scanner);
+    return result;
+}
@@ -0,0 +1,72 @@
+#ifndef JSONSCAN_H
+#define JSONSCAN_H
+
+#include <stddef.h>
+
+/*
+ * Zero-copy JSON path scanner.
+ *
+ * Extracts the values at a few paths ("data.timings.*") in one pass, without
+ * building a tree and without allocating per value: every match is handed to
+ * a callback as views into the input.
+ *
+ * Stage 1 classifies 64 bytes at a time with SIMD compares (SSE2 / AVX2):
+ * quotes, backslashes and the structural characters { } [ ] : , become
+ * 64-bit masks, and the characters inside strings are masked out with a
+ * prefix XOR over the unescaped quotes. Stage 2 walks only the structural
+ * positions with a small state machine that tracks which paths can still
+ * match at each depth; subtrees no path goes into are crossed by counting
+ * brackets.
+ *
+ * Validation is structural only (brackets, strings, depth), numbers and
+ * literals are not checked.
+ *
+ * Paths: components separated by '.', '*' matches any member or element,
+ * a number matches that array element: "data.*.timings.Fajr".
+ */
+
+#define JSON_MAX_PATHS 64
+#define JSON_MAX_DEPTH 1024
+
+typedef enum JsonType
+{
+    JSON_STRING,
+    JSON_SCALAR,                // number, true, false, null
+    JSON_OBJECT,
+    JSON_ARRAY,
+} JsonType;
+
+typedef struct JsonView
+{
+    const char* data;
+    size_t length;
+} JsonView;
+
+typedef struct JsonMatch
+{
+    int path;                   // index of the matching path
+    JsonType type;
+    JsonView key;               // member name, escapes kept; empty for an array element
+    long index;                 // array element index, -1 for a member
+    JsonView value;             // string without quotes (escapes kept), scalar text, or the whole object / array
+} JsonMatch;
+
+// Views are valid during the call only. Return nonzero to stop the scan.
+typedef int (*JsonCallback)(void* context, const JsonMatch* match);
+
+// jsonScan*() flags
+#define JSON_SCALAR_STAGE1 1    // classify bytes one at a time (for comparison)
+
+// Whole buffer, e.g. an mmapped file. Returns 0, 1 when stopped by the callback,
+// -1 with errno set (EBADMSG for malformed JSON, EINVAL for a bad path).
+int jsonScanBuffer(const char* data, size_t size, const char* const* paths, int pathCount,
+                   JsonCallback callback, void* context, int flags);
+
+// Reads `fd` to the end in blocks; only the bytes of a pending match are kept.
+int jsonScanStream(int fd, const char* const* paths, int pathCount,
+                   JsonCallback callback, void* context, int flags);
+
+// Offset of the error after jsonScan*() returned -1 with EBADMSG
+size_t jsonErrorOffset(void);
+
+#endif
@@ -0,0 +1,514 @@
+/*
+ * prayertimes.c - offline prayer time engine and mmapped year tables
+ *
+ * Sun position and prayer angles follow the PrayTimes.org formulas (used by
+ * api.aladhan.com): one refinement step from fixed initial guesses, Standard
+ * midnight, angle-based high latitude rule.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "prayertimes.h"
+
+
+#define TABLE_MAGIC "APT1"
+#define TABLE_VERSION 1
+#define IMSAK_MINUTES 10            // Imsak before Fajr
+#define DEG (M_PI / 180.0)
+
+struct PrayerTable
+{
+    const PrayerTableHeader* header;
+    const uint16_t (*rows)[PRAYER_COUNT];
+    size_t size;
+};
+
+static const PrayerMethod methods[] =
+{
+    { "egypt",   "Egyptian General Authority of Survey",     19.5, 17.5, 0 },
+    { "mwl",     "Muslim World League",                      18.0, 17.0, 0 },
+    { "isna",    "Islamic Society of North America",         15.0, 15.0, 0 },
+    { "makkah",  "Umm Al-Qura University, Makkah",           18.5,  0.0, 90 },
+    { "karachi", "University of Islamic Sciences, Karachi",  18.0, 18.0, 0 },
+};
+
+static const PrayerLocation cities[] =
+{
+    { "Giza",       30.0131,  31.2089,  19, "Africa/Cairo",     "egypt" },
+    { "Cairo",      30.0444,  31.2357,  23, "Africa/Cairo",     "egypt" },
+    { "Alexandria", 31.2001,  29.9187,   5, "Africa/Cairo",     "egypt" },
+    { "Makkah",     21.3891,  39.8579, 277, "Asia/Riyadh",      "makkah" },
+    { "London",     51.5072,  -0.1276,  11, "Europe/London",    "mwl" },
+    { "Oslo",       59.9139,  10.7522,  23, "Europe/Oslo",      "mwl" },
+    { "New York",   40.7128, -74.0060,  10, "America/New_York", "isna" },
+};
+
+static const char* const names[PRAYER_COUNT] =
+{
+    "Imsak", "Fajr", "Sunrise", "Dhuhr", "Asr", "Sunset", "Maghrib", "Isha", "Midnight",
+};
+
+const PrayerLocation* prayerFindCity(const char* name)
+{
+    for(size_t i = 0; i < sizeof(cities) / sizeof(cities[0]); i++)
+    {
+        if(strcasecmp(cities[i].city, name) == 0)
+        {
+            return &cities[i];
+        }
+    }
+    return NULL;
+}
+
+const PrayerMethod* prayerFindMethod(const char* name)
+{
+    for(size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+    {
+        if(strcasecmp(methods[i].name, name) == 0)
+        {
+            return &methods[i];
+        }
+    }
+    return NULL;
+}
+
+const PrayerLocation* prayerCities(int* count)
+{
+    *count = sizeof(cities) / sizeof(cities[0]);
+    return cities;
+}
+
+const PrayerMethod* prayerMethods(int* count)
+{
+    *count = sizeof(methods) / sizeof(methods[0]);
+    return methods;
+}
+
+const char* prayerName(Prayer prayer)
+{
+    return prayer < PRAYER_COUNT ? names[prayer] : "?";
+}
+
+// Howard Hinnant's days_from_civil / civil_from_days
+long prayerDayFromDate(int year, int month, int day)
+{
+    year -= month <= 2;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yoe = year - era * 400;
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void prayerDateFromDay(long days, int* year, int* month, int* day)
+{
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long doe = days - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+static double fixHour(double hours)
+{
+    return hours - 24.0 * floor(hours / 24.0);
+}
+
+// UTC offset in hours at noon of every day: DST changes are followed
+static int loadOffsets(const char* timezone, long firstDay, int days, double* offsets)
+{
+    if(timezone[0] == '+' || timezone[0] == '-' || (timezone[0] >= '0' && timezone[0] <= '9'))
+    {
+        double fixed = atof(timezone);
+        for(int i = 0; i < days; i++)
+        {
+            offsets[i] = fixed;
+        }
+        return 0;
+    }
+
+    char path[512];
+    const char* directory = getenv("TZDIR") ? getenv("TZDIR") : "/usr/share/zoneinfo";
+    snprintf(path, sizeof(path), "%s/%s", directory, timezone);
+    if(access(path, R_OK) != 0)
+    {
+        // glibc would silently use UTC for an unknown zone
+        errno = ENOENT;
+        return -1;
+    }
+
+    char* saved = getenv("TZ") ? strdup(getenv("TZ")) : NULL;
+    setenv("TZ", timezone, 1);
+    tzset();
+    for(int i = 0; i < days; i++)
+    {
+        time_t noon = (time_t)(firstDay + i) * 86400 + 12 * 3600;
+        struct tm local;
+        localtime_r(&noon, &local);
+        offsets[i] = local.tm_gmtoff / 3600.0;
+    }
+    if(saved)
+    {
+        setenv("TZ", saved, 1);
+        free(saved);
+    }
+    else
+    {
+        unsetenv("TZ");
+    }
+    tzset();
+    return 0;
+}
+
+/*
+ * Sun declination (as sine) and equation of time at jd[i] + hours / 24 for
+ * every day. Each loop does one kind of operation over the whole range, so
+ * the compiler can vectorize it (a loop with sin() and cos() of the same
+ * value becomes sincos(), which does not vectorize).
+ */
+static void sunPosition(const double* jd, double hours, int n, double* sinDecl, double* eqt, double* scratch)
+{
+    double* meanLongitude = scratch;
+    double* longitude = scratch + n;
+    double* obliquity = scratch + 2 * n;
+    double* sinLongitude = scratch + 3 * n;
+    double* cosLongitude = scratch + 4 * n;
+
+    for(int i = 0; i < n; i++)
+    {
+        double d = jd[i] + hours / 24.0 - 2451545.0;
+        double g = (357.529 + 0.98560028 * d) * DEG;
+        meanLongitude[i] = 280.459 + 0.98564736 * d;
+        longitude[i] = (meanLongitude[i] + 1.915 * sin(g) + 0.020 * sin(2 * g)) * DEG;
+        obliquity[i] = (23.439 - 0.00000036 * d) * DEG;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        sinLongitude[i] = sin(longitude[i]);
+    }
+    for(int i = 0; i < n; i++)
+    {
+        cosLongitude[i] = cos(longitude[i]);
+    }
+    for(int i = 0; i < n; i++)
+    {
+        sinDecl[i] = sin(obliquity[i]) * sinLongitude[i];
+    }
+    for(int i = 0; i < n; i++)
+    {
+        double ascension = atan2(cos(obliquity[i]) * sinLongitude[i], cosLongitude[i]) / DEG / 15.0;
+        eqt[i] = meanLongitude[i] / 15.0 - ascension;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        // Equation of time within -12..12 hours (it is at most ~0.3)
+        eqt[i] -= 24.0 * floor(eqt[i] / 24.0 + 0.5);
+    }
+}
+
+/*
+ * Time (hours, local mean solar) when the sun is `angle` degrees below the
+ * horizon: before noon (rising) or after it. A negative angle is an elevation.
+ * When the sun never gets that low (summer twilight at high latitudes) the
+ * cosine is clamped: the result is noon / midnight, which the high latitude
+ * rule replaces. No NaN, which -ffast-math would not detect.
+ */
+static void sunAngleTime(const double* sinDecl, const double* eqt, double sinAngle, double latitude,
+                         int beforeNoon, int n, double* times)
+{
+    double sinLat = sin(latitude * DEG);
+    double cosLat = cos(latitude * DEG);
+    for(int i = 0; i < n; i++)
+    {
+        double cosDecl = sqrt(1.0 - sinDecl[i] * sinDecl[i]);
+        double cosHour = (-sinAngle - sinDecl[i] * sinLat) / (cosDecl * cosLat);
+        times[i] = acos(fmin(fmax(cosHour, -1.0), 1.0)) / DEG / 15.0;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        double noon = 12.0 - eqt[i];
+        times[i] = beforeNoon ? noon - times[i] : noon + times[i];
+    }
+}
+
+// Asr: the shadow of an object is asrFactor times its length plus its noon shadow
+static void asrTime(const double* sinDecl, const double* eqt, int asrFactor, double latitude, int n,
+                    double* times, double* scratch)
+{
+    double sinLat = sin(latitude * DEG);
+    double cosLat = cos(latitude * DEG);
+    for(int i = 0; i < n; i++)
+    {
+        scratch[i] = fabs(latitude * DEG - asin(sinDecl[i]));
+    }
+    for(int i = 0; i < n; i++)
+    {
+        // sin of the sun elevation: sin(acot(x)) = 1 / sqrt(1 + x^2)
+        double x = asrFactor + tan(scratch[i]);
+        double sinElevation = 1.0 / sqrt(1.0 + x * x);
+        double cosDecl = sqrt(1.0 - sinDecl[i] * sinDecl[i]);
+        double cosHour = (sinElevation - sinDecl[i] * sinLat) / (cosDecl * cosLat);
+        times[i] = acos(fmin(fmax(cosHour, -1.0), 1.0)) / DEG / 15.0;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        times[i] = 12.0 - eqt[i] + times[i];
+    }
+}
+
+static uint16_t toMinutes(double hours)
+{
+    // Rounded to the nearest minute
+    return (uint16_t)((int)floor(fixHour(hours + 0.5 / 60.0) * 60.0) % 1440);
+}
+
+int prayerCompute(const PrayerLocation* location, const PrayerMethod* method, int asrFactor,
+                  long firstDay, int days, uint16_t (*minutes)[PRAYER_COUNT])
+{
+    if(days <= 0 || (asrFactor != 1 && asrFactor != 2))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // One array per quantity: jd, offsets, sinDecl, eqt, 6 event times, 5 scratch
+    double* memory = malloc(sizeof(double) * days * 15);
+    if(memory == NULL)
+    {
+        return -1;
+    }
+    double* jd = memory;
+    double* offsets = memory + days;
+    double* sinDecl = memory + 2 * days;
+    double* eqt = memory + 3 * days;
+    double* fajr = memory + 4 * days;
+    double* sunrise = memory + 5 * days;
+    double* dhuhr = memory + 6 * days;
+    double* asr = memory + 7 * days;
+    double* sunset = memory + 8 * days;
+    double* isha = memory + 9 * days;
+    double* scratch = memory + 10 * days;
+
+    if(loadOffsets(location->timezone, firstDay, days, offsets) != 0)
+    {
+        free(memory);
+        return -1;
+    }
+    for(int i = 0; i < days; i++)
+    {
+        // Julian date of local midnight (mean solar time)
+        jd[i] = firstDay + i + 2440587.5 - location->longitude / (15.0 * 24.0);
+    }
+
+    // Sun angles: refraction and the visible horizon from the elevation
+    double riseSet = 0.833 + 0.0347 * sqrt(location->elevation > 0 ? location->elevation : 0);
+    double latitude = location->latitude;
+
+    // Each time is refined once from a fixed first guess of the hour (PrayTimes)
+    sunPosition(jd, 5, days, sinDecl, eqt, scratch);
+    sunAngleTime(sinDecl, eqt, sin(method->fajrAngle * DEG), latitude, 1, days, fajr);
+    sunPosition(jd, 6, days, sinDecl, eqt, scratch);
+    sunAngleTime(sinDecl, eqt, sin(riseSet * DEG), latitude, 1, days, sunrise);
+    sunPosition(jd, 12, days, sinDecl, eqt, scratch);
+    for(int i = 0; i < days; i++)
+    {
+        dhuhr[i] = 12.0 - eqt[i];
+    }
+    sunPosition(jd, 13, days, sinDecl, eqt, scratch);
+    asrTime(sinDecl, eqt, asrFactor, latitude, days, asr, scratch);
+    sunPosition(jd, 18, days, sinDecl, eqt, scratch);
+    sunAngleTime(sinDecl, eqt, sin(riseSet * DEG), latitude, 0, days, sunset);
+    if(method->ishaAngle > 0)
+    {
+        sunAngleTime(sinDecl, eqt, sin(method->ishaAngle * DEG), latitude, 0, days, isha);
+    }
+
+    for(int i = 0; i < days; i++)
+    {
+        double shift = offsets[i] - location->longitude / 15.0;
+        double rise = sunrise[i] + shift;
+        double set = sunset[i] + shift;
+        double night = fixHour(rise - set);
+        double dawn = fajr[i] + shift;
+        double dusk = method->ishaAngle > 0 ? isha[i] + shift : set + method->ishaMinutes / 60.0;
+
+        // High latitudes: twilight may last all night; bound it to a part of the night (angle / 60)
+        double portion = method->fajrAngle / 60.0 * night;
+        if(fixHour(rise - dawn) > portion)
+        {
+            dawn = rise - portion;
+        }
+        if(method->ishaAngle > 0)
+        {
+            portion = method->ishaAngle / 60.0 * night;
+            if(fixHour(dusk - set) > portion)
+            {
+                dusk = set + portion;
+            }
+        }
+
+        minutes[i][PRAYER_IMSAK] = toMinutes(dawn - IMSAK_MINUTES / 60.0);
+        minutes[i][PRAYER_FAJR] = toMinutes(dawn);
+        minutes[i][PRAYER_SUNRISE] = toMinutes(rise);
+        minutes[i][PRAYER_DHUHR] = toMinutes(dhuhr[i] + shift);
+        minutes[i][PRAYER_ASR] = toMinutes(asr[i] + shift);
+        minutes[i][PRAYER_SUNSET] = toMinutes(set);
+        minutes[i][PRAYER_MAGHRIB] = toMinutes(set);
+        minutes[i][PRAYER_ISHA] = toMinutes(dusk);
+        minutes[i][PRAYER_MIDNIGHT] = toMinutes(set + night / 2.0);
+    }
+    free(memory);
+    return 0;
+}
+
+static uint32_t checksum(const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int prayerTableBuild(const char* path, const PrayerLocation* location, const PrayerMethod* method,
+                     int asrFactor, long firstDay, int days)
+{
+    size_t rowsSize = sizeof(uint16_t[PRAYER_COUNT]) * days;
+    PrayerTableHeader header;
+    uint16_t (*rows)[PRAYER_COUNT] = days > 0 ? malloc(rowsSize) : NULL;
+    if(rows == NULL)
+    {
+        errno = days > 0 ? ENOMEM : EINVAL;
+        return -1;
+    }
+    if(prayerCompute(location, method, asrFactor, firstDay, days, rows) != 0)
+    {
+        free(rows);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_MAGIC, 4);
+    header.version = TABLE_VERSION;
+    header.firstDay = firstDay;
+    header.days = days;
+    header.latitude = location->latitude;
+    header.longitude = location->longitude;
+    header.elevation = location->elevation;
+    header.asrFactor = asrFactor;
+    header.checksum = checksum(rows, rowsSize);
+    snprintf(header.city, sizeof(header.city), "%s", location->city ? location->city : "");
+    snprintf(header.method, sizeof(header.method), "%s", method->name);
+    snprintf(header.timezone, sizeof(header.timezone), "%s", location->timezone);
+
+    // Written next to the target and renamed: a reader never sees half a table
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        free(rows);
+        return -1;
+    }
+    int ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+             write(fd, rows, rowsSize) == (ssize_t)rowsSize && fsync(fd) == 0;
+    int error = errno;
+    close(fd);
+    free(rows);
+    if(!ok || rename(temporary, path) != 0)
+    {
+        error = ok ? errno : error;
+        unlink(temporary);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+PrayerTable* prayerTableOpen(const char* path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    if((size_t)st.st_size < sizeof(PrayerTableHeader))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    const PrayerTableHeader* header = map;
+    size_t rowsSize = sizeof(uint16_t[PRAYER_COUNT]) * (size_t)header->days;
+    if(memcmp(header->magic, TABLE_MAGIC, 4) != 0 || header->version != TABLE_VERSION ||
+       (size_t)st.st_size != sizeof(*header) + rowsSize ||
+       checksum((const char*)map + sizeof(*header), rowsSize) != header->checksum)
+    {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    PrayerTable* table = malloc(sizeof(*table));
+    if(table == NULL)
+    {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    table->header = header;
+    table->rows = (const void*)((const char*)map + sizeof(*header));
+    table->size = st.st_size;
+    return table;
+}
+
+const PrayerTableHeader* prayerTableHeader(const PrayerTable* table)
+{
+    return table->header;
+}
+
+const uint16_t* prayerTableDay(const PrayerTable* table, long day)
+{
+    long index = day - table->header->firstDay;
+    if(index < 0 || index >= (long)table->header->days)
+    {
+        return NULL;
+    }
+    return table->rows[index];
+}
+
+void prayerTableClose(PrayerTable* table)
+{
+    if(table)
+    {
+        munmap((void*)table->header, table->size);
+        free(table);
+    }
+}
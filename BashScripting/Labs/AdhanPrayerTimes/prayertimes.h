@@ -0,0 +1,97 @@
+#ifndef PRAYERTIMES_H
+#define PRAYERTIMES_H
+
+#include <stdint.h>
+
+/*
+ * Offline prayer time engine.
+ *
+ * The times are computed from the position of the sun (the PrayTimes.org
+ * formulas, the ones behind api.aladhan.com): no network, no subprocess.
+ * prayerCompute() handles a whole date range in one pass, one array per
+ * quantity, so the trigonometry runs over contiguous arrays (vectorized by
+ * libmvec when built with -O3 -ffast-math and a SIMD -march).
+ *
+ * A range can be stored as a table file: a small header followed by one row
+ * of minutes per day. The file is mmapped, so a lookup is an index into it.
+ */
+
+typedef enum Prayer
+{
+    PRAYER_IMSAK,
+    PRAYER_FAJR,
+    PRAYER_SUNRISE,
+    PRAYER_DHUHR,
+    PRAYER_ASR,
+    PRAYER_SUNSET,
+    PRAYER_MAGHRIB,
+    PRAYER_ISHA,
+    PRAYER_MIDNIGHT,
+    PRAYER_COUNT,
+} Prayer;
+
+typedef struct PrayerMethod
+{
+    const char* name;
+    const char* description;
+    double fajrAngle;               // sun depression at Fajr, degrees
+    double ishaAngle;               // sun depression at Isha, 0 = use ishaMinutes
+    int ishaMinutes;                // Isha this long after Maghrib
+} PrayerMethod;
+
+typedef struct PrayerLocation
+{
+    const char* city;
+    double latitude;
+    double longitude;
+    double elevation;               // meters
+    const char* timezone;           // "Africa/Cairo", or a fixed offset in hours: "+2"
+    const char* method;             // default calculation method
+} PrayerLocation;
+
+typedef struct PrayerTableHeader
+{
+    char magic[4];                  // "APT1"
+    uint32_t version;
+    int32_t firstDay;               // days since 1970-01-01
+    uint32_t days;
+    double latitude;
+    double longitude;
+    double elevation;
+    int32_t asrFactor;              // 1 Shafi'i, 2 Hanafi
+    uint32_t checksum;              // FNV-1a of the rows
+    char city[32];
+    char method[16];
+    char timezone[48];
+} PrayerTableHeader;
+
+typedef struct PrayerTable PrayerTable;
+
+// Built-in cities and methods; NULL when unknown
+const PrayerLocation* prayerFindCity(const char* name);
+const PrayerMethod* prayerFindMethod(const char* name);
+const PrayerLocation* prayerCities(int* count);
+const PrayerMethod* prayerMethods(int* count);
+const char* prayerName(Prayer prayer);
+
+// Days since 1970-01-01 <-> calendar date
+long prayerDayFromDate(int year, int month, int day);
+void prayerDateFromDay(long days, int* year, int* month, int* day);
+
+// Local times in minutes after midnight, `days` rows starting at `firstDay`.
+// Returns 0, or -1 with errno set.
+int prayerCompute(const PrayerLocation* location, const PrayerMethod* method, int asrFactor,
+                  long firstDay, int days, uint16_t (*minutes)[PRAYER_COUNT]);
+
+// Computes the range and writes it to `path` (atomically, via a rename). Returns 0 or -1.
+int prayerTableBuild(const char* path, const PrayerLocation* location, const PrayerMethod* method,
+                     int asrFactor, long firstDay, int days);
+
+// NULL with errno set (EINVAL for a damaged or foreign file)
+PrayerTable* prayerTableOpen(const char* path);
+const PrayerTableHeader* prayerTableHeader(const PrayerTable* table);
+// The row of `day`, NULL outside the table
+const uint16_t* prayerTableDay(const PrayerTable* table, long day);
+void prayerTableClose(PrayerTable* table);
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * battery_monitor.c - event-driven replacement for battery_monitor.sh
+ *
+ * Reads /sys/class/power_supply/<supply>/ directly (no acpi), sleeps in poll() and
+ * wakes up only when:
+ *   - the timerfd fires (every -i seconds), or
+ *   - the kernel sends a power_supply uevent (charger plugged, battery
+ *     status changed) on the NETLINK_KOBJECT_UEVENT socket, or
+ *   - SIGINT / SIGTERM arrives (signalfd).
+ *
+ * Low / critical alerts use hysteresis: an alert fires once when the level
+ * drops to the threshold and is re-armed only after the level climbs back
+ * above threshold + hysteresis, so a battery hovering around 50% does not
+ * spam notifications.
+ *
+ * Build: gcc -O2 -Wall battery_monitor.c -o battery_monitor
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <dirent.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+
+#define DEFAULT_ROOT "/sys/class/power_supply"
+#define MAX_SUPPLIES 16
+#define UEVENT_BUFFER 4096
+
+extern char** environ;
+
+typedef enum Level
+{
+    LEVEL_NORMAL,
+    LEVEL_LOW,
+    LEVEL_CRITICAL,
+} Level;
+
+typedef struct Config
+{
+    const char* root;
+    double intervalSeconds;
+    int low;
+    int critical;
+    int hysteresis;
+    int desktop;            // also send notify-send notifications
+    int once;               // print the current state and exit
+} Config;
+
+typedef struct PowerState
+{
+    int batteries;
+    int capacity;           // percent, weighted over all batteries, -1 if none
+    int acOnline;           // any Mains / USB supply online, -1 if none found
+    char status[32];        // status of the first battery: Charging, Discharging, Full, ...
+} PowerState;
+
+static Config config =
+{
+    .root = DEFAULT_ROOT,
+    .intervalSeconds = 60,
+    .low = 50,
+    .critical = 10,
+    .hysteresis = 5,
+};
+
+// Reads a one-line sysfs attribute. Returns 0 on success.
+static int readAttribute(const char* supply, const char* name, char* value, size_t size)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", config.root, supply, name);
+    FILE* f = fopen(path, "r");
+    if(f == NULL)
+    {
+        return -1;
+    }
+    if(fgets(value, size, f) == NULL)
+    {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    value[strcspn(value, "\n")] = '\0';
+    return 0;
+}
+
+static long readNumber(const char* supply, const char* name)
+{
+    char value[64];
+    if(readAttribute(supply, name, value, sizeof(value)) != 0)
+    {
+        return -1;
+    }
+    return strtol(value, NULL, 10);
+}
+
+// Capacity in percent, from `capacity` or computed from energy_* / charge_*
+static int batteryCapacity(const char* supply, long* weight)
+{
+    long now = readNumber(supply, "energy_now");
+    long full = readNumber(supply, "energy_full");
+    if(now < 0 || full <= 0)
+    {
+        now = readNumber(supply, "charge_now");
+        full = readNumber(supply, "charge_full");
+    }
+    long capacity = readNumber(supply, "capacity");
+    *weight = full > 0 ? full : 1;
+    if(capacity < 0 && now >= 0 && full > 0)
+    {
+        capacity = now * 100 / full;
+    }
+    return capacity > 100 ? 100 : (int)capacity;
+}
+
+static void readPowerState(PowerState* state)
+{
+    DIR* dir = opendir(config.root);
+    struct dirent* entry;
+    long weightedSum = 0;
+    long weightTotal = 0;
+
+    memset(state, 0, sizeof(PowerState));
+    state->capacity = -1;
+    state->acOnline = -1;
+    strcpy(state->status, "Unknown");
+    if(dir == NULL)
+    {
+        return;
+    }
+    while((entry = readdir(dir)) != NULL && state->batteries < MAX_SUPPLIES)
+    {
+        char type[32];
+        if(entry->d_name[0] == '.' || readAttribute(entry->d_name, "type", type, sizeof(type)) != 0)
+        {
+            continue;
+        }
+        if(strcmp(type, "Battery") == 0)
+        {
+            long weight;
+            int capacity = batteryCapacity(entry->d_name, &weight);
+            if(capacity < 0)
+            {
+                continue;
+            }
+            if(state->batteries == 0)
+            {
+                readAttribute(entry->d_name, "status", state->status, sizeof(state->status));
+            }
+            state->batteries++;
+            weightedSum += capacity * weight;
+            weightTotal += weight;
+        }
+        else if(strcmp(type, "Mains") == 0 || strncmp(type, "USB", 3) == 0)
+        {
+            long online = readNumber(entry->d_name, "online");
+            if(online >= 0)
+            {
+                state->acOnline = state->acOnline == 1 || online == 1;
+            }
+        }
+    }
+    closedir(dir);
+    if(weightTotal > 0)
+    {
+        state->capacity = (int)((weightedSum + weightTotal / 2) / weightTotal);
+    }
+}
+
+static void notify(const char* summary, const char* body)
+{
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    printf("[%s] %s: %s\n", stamp, summary, body);
+    fflush(stdout);
+
+    if(config.desktop)
+    {
+        // Fire and forget: SIGCHLD is ignored, so the child is reaped automatically
+        pid_t pid;
+        char* argv[] = { "notify-send", (char*)summary, (char*)body, NULL };
+        if(posix_spawnp(&pid, "notify-send", NULL, NULL, argv, environ) != 0)
+        {
+            fprintf(stderr, "notify-send not available, desktop notifications disabled\n");
+            config.desktop = 0;
+        }
+    }
+}
+
+/*
+ * Hysteresis state machine:
+ *   NORMAL   -> LOW      when capacity <= low
+ *   LOW      -> CRITICAL when capacity <= critical
+ *   CRITICAL -> LOW      when capacity >= critical + hysteresis
+ *   LOW      -> NORMAL   when capacity >= low + hysteresis
+ * Alerts are sent on the way down only, and not while charging.
+ */
+static Level updateLevel(Level level, const PowerState* state)
+{
+    int charging = state->acOnline == 1 || strcmp(state->status, "Charging") == 0;
+    char body[128];
+
+    if(state->capacity < 0)
+    {
+        return level;
+    }
+    if(level == LEVEL_CRITICAL && state->capacity >= config.critical + config.hysteresis)
+    {
+        level = LEVEL_LOW;
+    }
+    if(level == LEVEL_LOW && state->capacity >= config.low + config.hysteresis)
+    {
+        level = LEVEL_NORMAL;
+    }
+    // A jump straight to critical sends only the critical alert
+    if(level != LEVEL_CRITICAL && state->capacity <= config.critical)
+    {
+        level = LEVEL_CRITICAL;
+        if(!charging)
+        {
+            snprintf(body, sizeof(body), "Battery at %d%%. Plug your charger now", state->capacity);
+            notify("Battery critical", body);
+        }
+    }
+    else if(level == LEVEL_NORMAL && state->capacity <= config.low)
+    {
+        level = LEVEL_LOW;
+        if(!charging)
+        {
+            snprintf(body, sizeof(body), "Battery at %d%% (below %d%%). Plug your charger", state->capacity, config.low);
+            notify("Battery low", body);
+        }
+    }
+    return level;
+}
+
+static int createTimer(void)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if(fd < 0)
+    {
+        perror("timerfd_create");
+        exit(1);
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = (time_t)config.intervalSeconds;
+    spec.it_interval.tv_nsec = (long)((config.intervalSeconds - spec.it_interval.tv_sec) * 1e9);
+    spec.it_value = spec.it_interval;
+    if(timerfd_settime(fd, 0, &spec, NULL) != 0)
+    {
+        perror("timerfd_settime");
+        exit(1);
+    }
+    return fd;
+}
+
+// Kernel uevents (the ones udev sees). Returns -1 when not available, e.g. in a container.
+static int createUeventSocket(void)
+{
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = 1 };
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Drains the socket; returns 1 if any message was about a power supply
+static int readUevents(int fd)
+{
+    char buffer[UEVENT_BUFFER];
+    int relevant = 0;
+    ssize_t n;
+    while((n = recv(fd, buffer, sizeof(buffer) - 1, 0)) > 0)
+    {
+        // Message: "action@devpath\0KEY=VALUE\0KEY=VALUE\0..."
+        char* p = buffer;
+        buffer[n] = '\0';
+        while(p < buffer + n)
+        {
+            if(strcmp(p, "SUBSYSTEM=power_supply") == 0)
+            {
+                relevant = 1;
+            }
+            p += strlen(p) + 1;
+        }
+    }
+    return relevant;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "Usage: %s [-r root] [-i seconds] [-l low] [-c critical] [-H hysteresis] [-d] [-1]\n"
+        "  -r  power_supply directory (default %s), e.g. a fake sysfs for testing\n"
+        "  -i  re-read cadence in seconds (default 60, fractions allowed)\n"
+        "  -l  low threshold in percent (default 50)\n"
+        "  -c  critical threshold in percent (default 10)\n"
+        "  -H  hysteresis in percent (default 5)\n"
+        "  -d  also send desktop notifications with notify-send\n"
+        "  -1  print the current state once and exit\n",
+        name, DEFAULT_ROOT);
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "r:i:l:c:H:d1h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': config.root = optarg; break;
+            case 'i': config.intervalSeconds = atof(optarg); break;
+            case 'l': config.low = atoi(optarg); break;
+            case 'c': config.critical = atoi(optarg); break;
+            case 'H': config.hysteresis = atoi(optarg); break;
+            case 'd': config.desktop = 1; break;
+            case '1': config.once = 1; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(config.intervalSeconds < 0.001)
+    {
+        fprintf(stderr, "Interval must be at least 1 ms\n");
+        return 1;
+    }
+
+    PowerState state;
+    readPowerState(&state);
+    if(state.batteries == 0)
+    {
+        fprintf(stderr, "No battery found under %s\n", config.root);
+    }
+    if(config.once)
+    {
+        printf("batteries=%d capacity=%d status=%s ac=%d\n", state.batteries, state.capacity, state.status, state.acOnline);
+        return 0;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGCHLD, SIG_IGN);
+
+    struct pollfd fds[3];
+    fds[0].fd = createTimer();
+    fds[1].fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    fds[2].fd = createUeventSocket();
+    fds[0].events = fds[1].events = fds[2].events = POLLIN;
+    if(fds[2].fd < 0)
+    {
+        fprintf(stderr, "uevents not available, relying on the %.3gs timer\n", config.intervalSeconds);
+    }
+
+    Level level = LEVEL_NORMAL;
+    int wasOnline = state.acOnline;
+    printf("Monitoring %d battery(s) under %s: %d%% %s\n", state.batteries, config.root, state.capacity, state.status);
+    fflush(stdout);
+    level = updateLevel(level, &state);
+
+    while(1)
+    {
+        // Blocks until something happens: no CPU used in between
+        if(poll(fds, fds[2].fd < 0 ? 2 : 3, -1) < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            return 1;
+        }
+        if(fds[1].revents & POLLIN)
+        {
+            printf("Stopping\n");
+            break;
+        }
+        int changed = 0;
+        if(fds[0].revents & POLLIN)
+        {
+            unsigned long long expirations;
+            if(read(fds[0].fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            {
+                changed = 1;
+            }
+        }
+        if(fds[2].fd >= 0 && (fds[2].revents & POLLIN))
+        {
+            changed |= readUevents(fds[2].fd);
+        }
+        if(!changed)
+        {
+            continue;
+        }
+
+        readPowerState(&state);
+        if(state.acOnline != wasOnline && wasOnline != -1)
+        {
+            notify(state.acOnline == 1 ? "Charger connected" : "Charger disconnected",
+                   state.acOnline == 1 ? "Thanks for charging" : "Running on battery");
+        }
+        wasOnline = state.acOnline;
+        level = updateLevel(level, &state);
+    }
+
+    close(fds[0].fd);
+    close(fds[1].fd);
+    if(fds[2].fd >= 0)
+    {
+        close(fds[2].fd);
+    }
+    return 0;
+}
@@ -0,0 +1,676 @@
+/*
+ * CheckIP.c - concurrent replacement for CheckIP.sh
+ *
+ * The script forks `ping -c 1 -W 1` for 192.168.1.1..15 one after the other:
+ * every silent host costs a full second, a /24 sweep takes minutes. Here all
+ * probes are in flight at the same time, so a sweep takes about one timeout:
+ *   - TCP probes: non-blocking connect() to each port; an accepted connection
+ *     or a refusal (RST) both prove that the host is there.
+ *   - ICMP probes: echo requests on one datagram ICMP socket (no root needed
+ *     when net.ipv4.ping_group_range allows it, skipped otherwise).
+ * Every socket is multiplexed on one epoll instance. Timeouts live in a timer
+ * wheel: starting, finishing and expiring a probe are O(1), and epoll_wait()
+ * sleeps until the next tick. At most -c probes are in flight at once.
+ *
+ * Usage: CheckIP [-p ports] [-m tcp|icmp|both] [-t ms] [-c inflight] [-a] [-v] [target ...]
+ *        target: 192.168.1.7, 192.168.1.1-15 or 192.168.1.0/24 (default 192.168.1.1-15)
+ *
+ * Build: gcc -O2 -Wall CheckIP.c -o CheckIP
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <arpa/inet.h>
+
+
+#define DEFAULT_TARGET "192.168.1.1-15"
+#define DEFAULT_PORTS "22,80,443"
+#define DEFAULT_TIMEOUT_MS 1000
+#define DEFAULT_INFLIGHT 512
+#define MAX_PORTS 64
+#define MAX_HOSTS (1 << 20)
+#define WHEEL_SLOTS 256
+#define TICK_NS 5000000LL           // 5 ms wheel resolution
+#define EVENT_BATCH 256
+#define START_BATCH 32              // probes started between two looks at the answers
+#define ICMP_PORT 0                 // Probe.port of an ICMP probe
+
+typedef enum ProbeState
+{
+    PROBE_PENDING,                  // not started yet
+    PROBE_INFLIGHT,
+    PROBE_OPEN,                     // connect() succeeded / echo reply
+    PROBE_REFUSED,                  // RST: port closed, host up
+    PROBE_UNREACHABLE,              // EHOSTUNREACH, ENETUNREACH, ...
+    PROBE_TIMEOUT,
+} ProbeState;
+
+typedef struct Probe
+{
+    uint32_t address;               // host byte order
+    int port;                       // ICMP_PORT for an echo request
+    int fd;                         // TCP socket while in flight
+    ProbeState state;
+    long long startNs;
+    long long rttNs;
+    int slot;                       // timer wheel slot while in flight
+    int rounds;                     // full wheel turns left before expiry
+    struct Probe* prev;             // timer wheel slot list
+    struct Probe* next;
+} Probe;
+
+typedef struct Config
+{
+    int ports[MAX_PORTS];
+    int portCount;
+    int tcp;
+    int icmp;
+    int timeoutMs;
+    int inflight;
+    int all;                        // also print hosts that did not answer
+    int verbose;                    // print every probe
+} Config;
+
+typedef struct Wheel
+{
+    Probe* slots[WHEEL_SLOTS];
+    long long tick;                 // last processed tick
+    long long startNs;
+} Wheel;
+
+static Config config =
+{
+    .timeoutMs = DEFAULT_TIMEOUT_MS,
+    .inflight = DEFAULT_INFLIGHT,
+    .tcp = 1,
+    .icmp = 1,
+};
+
+static uint32_t* hosts;
+static int hostCount;
+static Probe* probes;
+static int probeCount;
+static int inflight;
+static int maxInflight;
+static int finished;
+static Wheel wheel;
+static int epollFd;
+static int icmpFd = -1;
+static int icmpMarker;              // epoll data of the ICMP socket
+
+static long long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// "a.b.c.d", "a.b.c.d-e" (last octet range) or "a.b.c.d/len". Returns 0 on success.
+static int addTarget(const char* text)
+{
+    char address[64];
+    uint32_t first, last;
+    struct in_addr in;
+    const char* separator = strpbrk(text, "-/");
+    size_t length = separator ? (size_t)(separator - text) : strlen(text);
+
+    if(length >= sizeof(address))
+    {
+        return -1;
+    }
+    memcpy(address, text, length);
+    address[length] = '\0';
+    if(inet_pton(AF_INET, address, &in) != 1)
+    {
+        return -1;
+    }
+    first = last = ntohl(in.s_addr);
+    if(separator && *separator == '-')
+    {
+        int end = atoi(separator + 1);
+        if(end < (int)(first & 0xff) || end > 255)
+        {
+            return -1;
+        }
+        last = (first & ~0xffu) | end;
+    }
+    else if(separator && *separator == '/')
+    {
+        int prefix = atoi(separator + 1);
+        if(prefix < 8 || prefix > 32)
+        {
+            return -1;
+        }
+        uint32_t mask = prefix == 32 ? 0xffffffffu : ~(0xffffffffu >> prefix);
+        first &= mask;
+        last = first | ~mask;
+        if(prefix <= 30)
+        {
+            // Skip the network and broadcast addresses
+            first++;
+            last--;
+        }
+    }
+    if((long long)hostCount + (last - first + 1) > MAX_HOSTS)
+    {
+        return -1;
+    }
+    hosts = realloc(hosts, (hostCount + (last - first + 1)) * sizeof(*hosts));
+    for(uint64_t a = first; a <= last; a++)
+    {
+        hosts[hostCount++] = (uint32_t)a;
+    }
+    return 0;
+}
+
+static int parsePorts(const char* text)
+{
+    char* end;
+    config.portCount = 0;
+    while(*text)
+    {
+        long port = strtol(text, &end, 10);
+        if(end == text || port < 1 || port > 65535 || config.portCount == MAX_PORTS)
+        {
+            return -1;
+        }
+        config.ports[config.portCount++] = (int)port;
+        text = *end == ',' ? end + 1 : end;
+        if(*end != ',' && *end != '\0')
+        {
+            return -1;
+        }
+    }
+    return config.portCount > 0 ? 0 : -1;
+}
+
+// ---- Timer wheel ----------------------------------------------------------
+// Slot i holds the probes that expire at a tick == i (mod WHEEL_SLOTS);
+// timeouts longer than one turn wait `rounds` extra turns.
+
+static long long tickOf(long long ns)
+{
+    return (ns - wheel.startNs) / TICK_NS;
+}
+
+static void wheelInsert(Probe* probe, long long expiresNs)
+{
+    long long ticks = tickOf(expiresNs) - wheel.tick;
+    if(ticks < 1)
+    {
+        ticks = 1;
+    }
+    probe->slot = (wheel.tick + ticks) % WHEEL_SLOTS;
+    probe->rounds = (ticks - 1) / WHEEL_SLOTS;
+    probe->prev = NULL;
+    probe->next = wheel.slots[probe->slot];
+    if(probe->next)
+    {
+        probe->next->prev = probe;
+    }
+    wheel.slots[probe->slot] = probe;
+}
+
+static void wheelRemove(Probe* probe)
+{
+    if(probe->prev)
+    {
+        probe->prev->next = probe->next;
+    }
+    else
+    {
+        wheel.slots[probe->slot] = probe->next;
+    }
+    if(probe->next)
+    {
+        probe->next->prev = probe->prev;
+    }
+    probe->prev = probe->next = NULL;
+}
+
+// ---- Probes ---------------------------------------------------------------
+
+static void finishProbe(Probe* probe, ProbeState state, long long now)
+{
+    if(probe->state != PROBE_INFLIGHT)
+    {
+        return;
+    }
+    wheelRemove(probe);
+    probe->state = state;
+    probe->rttNs = now - probe->startNs;
+    if(probe->fd >= 0)
+    {
+        if(state == PROBE_OPEN)
+        {
+            // Reset instead of FIN: no TIME_WAIT left behind per probe
+            struct linger linger = { 1, 0 };
+            setsockopt(probe->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        }
+        close(probe->fd);
+        probe->fd = -1;
+    }
+    inflight--;
+    finished++;
+}
+
+static ProbeState stateOfError(int error)
+{
+    if(error == 0)
+    {
+        return PROBE_OPEN;
+    }
+    if(error == ECONNREFUSED)
+    {
+        return PROBE_REFUSED;
+    }
+    return PROBE_UNREACHABLE;
+}
+
+// Returns 0 when the probe was started or finished, -1 to retry later (out of descriptors / buffer space).
+static int startProbe(Probe* probe, long long now)
+{
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(probe->address);
+    // Per probe, not the batch's `now`: a batch of connect() calls takes a while
+    probe->startNs = nowNs();
+
+    if(probe->port == ICMP_PORT)
+    {
+        unsigned char packet[sizeof(struct icmphdr) + sizeof(uint32_t)];
+        struct icmphdr* header = (struct icmphdr*)packet;
+        uint32_t index = probe - probes;
+        memset(header, 0, sizeof(*header));
+        header->type = ICMP_ECHO;
+        header->un.echo.sequence = htons((uint16_t)index);
+        // The kernel sets the identifier and checksum; the probe index rides in the payload
+        memcpy(packet + sizeof(*header), &index, sizeof(index));
+        if(sendto(icmpFd, packet, sizeof(packet), 0, (struct sockaddr*)&address, sizeof(address)) < 0)
+        {
+            if(errno == EAGAIN || errno == ENOBUFS)
+            {
+                return -1;
+            }
+            probe->state = PROBE_UNREACHABLE;
+            finished++;
+            return 0;
+        }
+    }
+    else
+    {
+        address.sin_port = htons(probe->port);
+        probe->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(probe->fd < 0)
+        {
+            return -1;
+        }
+        if(connect(probe->fd, (struct sockaddr*)&address, sizeof(address)) == 0 || errno != EINPROGRESS)
+        {
+            // Answered right away (loopback) or failed locally
+            probe->state = stateOfError(errno == EINPROGRESS ? 0 : errno);
+            probe->rttNs = nowNs() - probe->startNs;
+            if(probe->state == PROBE_OPEN)
+            {
+                struct linger linger = { 1, 0 };
+                setsockopt(probe->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+            }
+            close(probe->fd);
+            probe->fd = -1;
+            finished++;
+            return 0;
+        }
+        struct epoll_event event = { .events = EPOLLOUT, .data.ptr = probe };
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, probe->fd, &event) != 0)
+        {
+            close(probe->fd);
+            probe->fd = -1;
+            return -1;
+        }
+    }
+    probe->state = PROBE_INFLIGHT;
+    wheelInsert(probe, now + config.timeoutMs * 1000000LL);
+    inflight++;
+    if(inflight > maxInflight)
+    {
+        maxInflight = inflight;
+    }
+    return 0;
+}
+
+static void readIcmpReplies(void)
+{
+    unsigned char packet[512];
+    struct sockaddr_in from;
+    socklen_t fromLength;
+    ssize_t n;
+
+    while(fromLength = sizeof(from), (n = recvfrom(icmpFd, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLength)) >= 0)
+    {
+        struct icmphdr* header = (struct icmphdr*)packet;
+        uint32_t index;
+        if(n < (ssize_t)(sizeof(*header) + sizeof(index)) || header->type != ICMP_ECHOREPLY)
+        {
+            continue;
+        }
+        memcpy(&index, packet + sizeof(*header), sizeof(index));
+        if(index < (uint32_t)probeCount && probes[index].port == ICMP_PORT &&
+           probes[index].address == ntohl(from.sin_addr.s_addr))
+        {
+            finishProbe(&probes[index], PROBE_OPEN, nowNs());
+        }
+    }
+}
+
+// Expires every probe whose tick has passed
+static void advanceWheel(long long now)
+{
+    long long target = tickOf(now);
+    while(wheel.tick < target)
+    {
+        wheel.tick++;
+        Probe* probe = wheel.slots[wheel.tick % WHEEL_SLOTS];
+        while(probe)
+        {
+            Probe* next = probe->next;
+            if(probe->rounds > 0)
+            {
+                probe->rounds--;
+            }
+            else
+            {
+                finishProbe(probe, PROBE_TIMEOUT, now);
+            }
+            probe = next;
+        }
+    }
+}
+
+static int openIcmpSocket(void)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    int size = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &icmpMarker };
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    return fd;
+}
+
+// Raises the descriptor limit as far as allowed and keeps the in-flight limit below it
+static void fitDescriptorLimit(void)
+{
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    {
+        return;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if(limit.rlim_cur != RLIM_INFINITY && (rlim_t)config.inflight > limit.rlim_cur - 16)
+    {
+        config.inflight = (int)limit.rlim_cur - 16;
+        fprintf(stderr, "in-flight limit lowered to %d (open file limit)\n", config.inflight);
+    }
+}
+
+// Each answer is stamped when it is looked at, not once per batch: handling the earlier
+// events of the batch must not count in the RTT of the later ones
+static void handleEvents(const struct epoll_event* events, int n)
+{
+    for(int i = 0; i < n; i++)
+    {
+        if(events[i].data.ptr == &icmpMarker)
+        {
+            readIcmpReplies();
+            continue;
+        }
+        Probe* probe = events[i].data.ptr;
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(probe->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        finishProbe(probe, stateOfError(error), nowNs());
+    }
+}
+
+static void scan(void)
+{
+    struct epoll_event events[EVENT_BATCH];
+    int next = 0;
+
+    wheel.startNs = nowNs();
+    while(finished < probeCount)
+    {
+        long long now = nowNs();
+        int started = 0;
+        while(next < probeCount && inflight < config.inflight)
+        {
+            if(startProbe(&probes[next], now) != 0)
+            {
+                break;
+            }
+            next++;
+            // Collect the answers that already arrived: otherwise their RTT includes
+            // every connect() started after them in this loop
+            if(++started % START_BATCH == 0)
+            {
+                handleEvents(events, epoll_wait(epollFd, events, EVENT_BATCH, 0));
+                now = nowNs();
+            }
+        }
+
+        // Sleep until the next tick at most
+        long long wait = wheel.startNs + (wheel.tick + 1) * TICK_NS - nowNs();
+        int timeout = wait > 0 ? (int)((wait + 999999) / 1000000) : 0;
+        if(inflight == 0 && next < probeCount)
+        {
+            timeout = 1;            // nothing in flight and a start failed: retry shortly
+        }
+        int n = epoll_wait(epollFd, events, EVENT_BATCH, timeout);
+        if(n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            exit(2);
+        }
+        handleEvents(events, n);
+        advanceWheel(nowNs());
+    }
+}
+
+static const char* stateName(ProbeState state)
+{
+    switch(state)
+    {
+        case PROBE_OPEN: return "open";
+        case PROBE_REFUSED: return "refused";
+        case PROBE_UNREACHABLE: return "unreachable";
+        case PROBE_TIMEOUT: return "timeout";
+        default: return "?";
+    }
+}
+
+static void printResults(int probesPerHost)
+{
+    char address[INET_ADDRSTRLEN];
+    for(int h = 0; h < hostCount; h++)
+    {
+        Probe* first = &probes[h * probesPerHost];
+        int up = 0;
+        long long rtt = 0;
+        char detail[1024] = "";
+        size_t used = 0;
+        struct in_addr in = { htonl(hosts[h]) };
+        inet_ntop(AF_INET, &in, address, sizeof(address));
+
+        for(int p = 0; p < probesPerHost; p++)
+        {
+            Probe* probe = &first[p];
+            int answered = probe->state == PROBE_OPEN || probe->state == PROBE_REFUSED;
+            if(answered && (!up || probe->rttNs < rtt))
+            {
+                rtt = probe->rttNs;
+            }
+            up |= answered;
+            if(probe->port == ICMP_PORT && (probe->state == PROBE_OPEN || config.verbose))
+            {
+                used += snprintf(detail + used, sizeof(detail) - used, " icmp %s", stateName(probe->state));
+            }
+            else if(probe->port != ICMP_PORT && (probe->state == PROBE_OPEN || config.verbose))
+            {
+                used += snprintf(detail + used, sizeof(detail) - used, " tcp/%d %s", probe->port, stateName(probe->state));
+            }
+            if(used >= sizeof(detail))
+            {
+                used = sizeof(detail) - 1;
+            }
+        }
+        if(up)
+        {
+            printf("%s is exist (%.2f ms)%s\n", address, rtt / 1e6, detail);
+        }
+        else if(config.all)
+        {
+            printf("%s is not exist%s\n", address, detail);
+        }
+    }
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "Usage: %s [-p ports] [-m tcp|icmp|both] [-t ms] [-c inflight] [-a] [-v] [target ...]\n"
+        "  target  a.b.c.d, a.b.c.d-e or a.b.c.d/len (default %s)\n"
+        "  -p  TCP ports to probe, comma separated (default %s)\n"
+        "  -m  probes to send (default both; icmp is skipped when not permitted)\n"
+        "  -t  timeout per probe in ms (default %d)\n"
+        "  -c  probes in flight at most (default %d)\n"
+        "  -a  also print hosts that did not answer\n"
+        "  -v  print the result of every probe\n",
+        name, DEFAULT_TARGET, DEFAULT_PORTS, DEFAULT_TIMEOUT_MS, DEFAULT_INFLIGHT);
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    parsePorts(DEFAULT_PORTS);
+    while((opt = getopt(argc, argv, "p:m:t:c:avh")) != -1)
+    {
+        switch(opt)
+        {
+            case 'p':
+                if(parsePorts(optarg) != 0)
+                {
+                    fprintf(stderr, "Invalid port list: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'm':
+                config.tcp = strcmp(optarg, "icmp") != 0;
+                config.icmp = strcmp(optarg, "tcp") != 0;
+                break;
+            case 't': config.timeoutMs = atoi(optarg); break;
+            case 'c': config.inflight = atoi(optarg); break;
+            case 'a': config.all = 1; break;
+            case 'v': config.verbose = 1; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if(config.timeoutMs < 1 || config.inflight < 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    for(int i = optind; i < argc || (i == optind && argc == optind); i++)
+    {
+        const char* target = i < argc ? argv[i] : DEFAULT_TARGET;
+        if(addTarget(target) != 0)
+        {
+            fprintf(stderr, "Invalid target: %s\n", target);
+            return 2;
+        }
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFd < 0)
+    {
+        perror("epoll_create1");
+        return 2;
+    }
+    if(config.icmp)
+    {
+        icmpFd = openIcmpSocket();
+        if(icmpFd < 0)
+        {
+            fprintf(stderr, "ICMP not permitted (net.ipv4.ping_group_range), %s\n", config.tcp ? "TCP probes only" : "nothing to send");
+            config.icmp = 0;
+            if(!config.tcp)
+            {
+                return 2;
+            }
+        }
+    }
+    fitDescriptorLimit();
+
+    // Probes are laid out host by host; consecutive probes go to different ports of the same host
+    int probesPerHost = (config.tcp ? config.portCount : 0) + config.icmp;
+    probeCount = hostCount * probesPerHost;
+    probes = calloc(probeCount, sizeof(*probes));
+    if(probes == NULL)
+    {
+        perror("calloc");
+        return 2;
+    }
+    for(int h = 0; h < hostCount; h++)
+    {
+        Probe* probe = &probes[h * probesPerHost];
+        if(config.icmp)
+        {
+            probe->address = hosts[h];
+            probe->port = ICMP_PORT;
+            probe->fd = -1;
+            probe++;
+        }
+        for(int p = 0; config.tcp && p < config.portCount; p++, probe++)
+        {
+            probe->address = hosts[h];
+            probe->port = config.ports[p];
+            probe->fd = -1;
+        }
+    }
+
+    long long start = nowNs();
+    scan();
+    double seconds = (nowNs() - start) / 1e9;
+
+    printResults(probesPerHost);
+    int up = 0;
+    for(int h = 0; h < hostCount; h++)
+    {
+        for(int p = 0; p < probesPerHost; p++)
+        {
+            ProbeState state = probes[h * probesPerHost + p].state;
+            if(state == PROBE_OPEN || state == PROBE_REFUSED)
+            {
+                up++;
+                break;
+            }
+        }
+    }
+    fprintf(stderr, "%d of %d hosts up, %d probes in %.3f s (timeout %d ms, %d in flight at most)\n",
+        up, hostCount, probeCount, seconds, config.timeoutMs, maxInflight);
+    return up > 0 ? 0 : 1;
+}
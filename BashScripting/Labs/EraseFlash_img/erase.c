@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <linux/falloc.h>
+#include "erase.h"
+
+
+#define ALIGNMENT 4096
+#define ERASE_STEP (256LL << 20)    // one ioctl / fallocate per step, so progress can be shown
+#define MAX_THREADS 64
+
+typedef struct ZeroWriter
+{
+    int directFd;
+    int bufferedFd;
+    const uint8_t* zeros;
+    long long offset;
+    long long length;
+    size_t chunkSize;
+    atomic_llong nextChunk;
+    atomic_llong bytesDone;
+    atomic_int error;
+    atomic_int finished;
+} ZeroWriter;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+const char* eraseMethodName(EraseMethod method)
+{
+    switch(method)
+    {
+        case ERASE_SECDISCARD: return "BLKSECDISCARD";
+        case ERASE_DISCARD: return "BLKDISCARD";
+        case ERASE_ZEROOUT: return "BLKZEROOUT";
+        case ERASE_PUNCH_HOLE: return "fallocate(PUNCH_HOLE)";
+        case ERASE_ZERO_RANGE: return "fallocate(ZERO_RANGE)";
+        case ERASE_WRITE: return "zero writes";
+        default: return "none";
+    }
+}
+
+// What a failing first call means: the method does not exist here, try the next one
+static int isUnsupported(int error)
+{
+    return error == EOPNOTSUPP || error == ENOTTY || error == EINVAL || error == ENOSYS;
+}
+
+static int eraseRange(int fd, EraseMethod method, long long offset, long long length)
+{
+    uint64_t range[2] = { (uint64_t)offset, (uint64_t)length };
+    switch(method)
+    {
+        case ERASE_SECDISCARD: return ioctl(fd, BLKSECDISCARD, range);
+        case ERASE_DISCARD: return ioctl(fd, BLKDISCARD, range);
+        case ERASE_ZEROOUT: return ioctl(fd, BLKZEROOUT, range);
+        case ERASE_PUNCH_HOLE: return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+        case ERASE_ZERO_RANGE: return fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, offset, length);
+        default: errno = EINVAL; return -1;
+    }
+}
+
+// A queue limit of the device (or of the disk a partition belongs to), -1 if unknown
+static long long queueLimit(dev_t device, const char* name)
+{
+    char path[128];
+    long long value = -1;
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/%s", major(device), minor(device), name);
+    FILE* f = fopen(path, "r");
+    if(f == NULL)
+    {
+        snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../queue/%s", major(device), minor(device), name);
+        f = fopen(path, "r");
+    }
+    if(f != NULL)
+    {
+        if(fscanf(f, "%lld", &value) != 1)
+        {
+            value = -1;
+        }
+        fclose(f);
+    }
+    return value;
+}
+
+static void printProgress(long long done, long long total, double start, const char* how)
+{
+    double seconds = nowSeconds() - start;
+    fprintf(stderr, "\r%9.1f / %.1f MB  %5.1f%%  %8.1f MB/s  %s   ", done / 1048576.0, total / 1048576.0,
+        total ? 100.0 * done / total : 100.0, done / 1048576.0 / (seconds > 0 ? seconds : 1e-9), how);
+}
+
+// Runs one cheap method over the whole range. 1 = unsupported, 0 = done, -1 = failed part way.
+static int tryMethod(int fd, EraseMethod method, const EraseOptions* options, long long length, double start)
+{
+    long long done = 0;
+    while(done < length)
+    {
+        long long step = length - done < ERASE_STEP ? length - done : ERASE_STEP;
+        if(eraseRange(fd, method, options->offset + done, step) != 0)
+        {
+            return done == 0 && isUnsupported(errno) ? 1 : -1;
+        }
+        done += step;
+        if(options->progress)
+        {
+            printProgress(done, length, start, eraseMethodName(method));
+        }
+    }
+    return 0;
+}
+
+static void * zeroWorker(void* args)
+{
+    ZeroWriter* writer = args;
+    while(!atomic_load(&writer->error))
+    {
+        long long index = atomic_fetch_add(&writer->nextChunk, 1);
+        long long position = index * (long long)writer->chunkSize;
+        if(position >= writer->length)
+        {
+            break;
+        }
+        long long offset = writer->offset + position;
+        size_t size = writer->length - position < (long long)writer->chunkSize ? (size_t)(writer->length - position) : writer->chunkSize;
+        // O_DIRECT needs aligned offset and length: an unaligned head or tail goes through the page cache
+        int fd = offset % ALIGNMENT == 0 && size % ALIGNMENT == 0 ? writer->directFd : writer->bufferedFd;
+        size_t written = 0;
+        while(written < size)
+        {
+            ssize_t n = pwrite(fd, writer->zeros, size - written, offset + written);
+            if(n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(n <= 0)
+            {
+                atomic_store(&writer->error, n < 0 ? errno : ENOSPC);
+                return NULL;
+            }
+            written += n;
+        }
+        atomic_fetch_add(&writer->bytesDone, size);
+    }
+    return NULL;
+}
+
+static int writeZeros(const EraseOptions* options, int bufferedFd, int openFlags, long long length, double start)
+{
+    ZeroWriter writer = { .bufferedFd = bufferedFd, .offset = options->offset, .length = length, .chunkSize = options->chunkSize };
+    uint8_t* zeros;
+    int threadCount = options->threads < 1 ? 1 : options->threads > MAX_THREADS ? MAX_THREADS : options->threads;
+    pthread_t th[MAX_THREADS];
+    int i;
+
+    atomic_init(&writer.nextChunk, 0);
+    atomic_init(&writer.bytesDone, 0);
+    atomic_init(&writer.error, 0);
+    atomic_init(&writer.finished, 0);
+    // One read-only buffer of zeros is shared by every thread
+    if(posix_memalign((void**)&zeros, ALIGNMENT, options->chunkSize) != 0)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(zeros, 0, options->chunkSize);
+    writer.zeros = zeros;
+    writer.directFd = open(options->target, (openFlags & ~(O_EXCL | O_CREAT)) | O_DIRECT);
+    if(writer.directFd < 0)
+    {
+        writer.directFd = bufferedFd;
+    }
+
+    for(i = 0; i < threadCount ; i++)
+    {
+        if(pthread_create(&th[i], NULL, &zeroWorker, &writer) != 0)
+        {
+            perror("Failed to Create Thread");
+            threadCount = i;
+            break;
+        }
+    }
+    if(threadCount == 0)
+    {
+        zeroWorker(&writer);
+    }
+    if(options->progress)
+    {
+        // Progress from this thread while the workers write
+        long long done;
+        while((done = atomic_load(&writer.bytesDone)) < length && !atomic_load(&writer.error))
+        {
+            struct timespec ts = { 0, 200 * 1000000L };
+            nanosleep(&ts, NULL);
+            printProgress(atomic_load(&writer.bytesDone), length, start, eraseMethodName(ERASE_WRITE));
+        }
+    }
+    for(i = 0; i < threadCount ; i++)
+    {
+        pthread_join(th[i], NULL);
+    }
+    if(!atomic_load(&writer.error) && (fdatasync(bufferedFd) != 0 || (writer.directFd != bufferedFd && fdatasync(writer.directFd) != 0)))
+    {
+        atomic_store(&writer.error, errno);
+    }
+    if(writer.directFd != bufferedFd)
+    {
+        close(writer.directFd);
+    }
+    free(zeros);
+    if(atomic_load(&writer.error))
+    {
+        errno = atomic_load(&writer.error);
+        return -1;
+    }
+    return 0;
+}
+
+int eraseTarget(const EraseOptions* options, EraseStats* stats)
+{
+    struct stat st;
+    EraseMethod methods[4];
+    int methodCount = 0;
+    long long length = options->length;
+    int flags = O_WRONLY | O_CLOEXEC;
+    int i;
+
+    memset(stats, 0, sizeof(EraseStats));
+    if(options->chunkSize == 0 || options->chunkSize % ALIGNMENT != 0 || options->offset < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(stat(options->target, &st) != 0)
+    {
+        return -1;
+    }
+    int isDevice = S_ISBLK(st.st_mode);
+    if(isDevice)
+    {
+        // Exclusive: fails while a partition of the device is mounted
+        flags |= O_EXCL;
+    }
+    else if(!S_ISREG(st.st_mode))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = open(options->target, flags);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    long long size = st.st_size;
+    if(isDevice)
+    {
+        unsigned long long deviceSize;
+        if(ioctl(fd, BLKGETSIZE64, &deviceSize) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        size = deviceSize;
+    }
+    if(length == 0)
+    {
+        length = size - options->offset;
+    }
+    if(length < 0 || (isDevice && options->offset + length > size))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(!options->forceWrite)
+    {
+        if(isDevice)
+        {
+            if(options->secure)
+            {
+                methods[methodCount++] = ERASE_SECDISCARD;
+            }
+            // After a plain discard the device may return anything: not good enough for -z
+            if(!options->zeros)
+            {
+                methods[methodCount++] = ERASE_DISCARD;
+            }
+            // Only when the device zeroes by itself; otherwise the kernel would write zeros from one thread
+            if(queueLimit(st.st_rdev, "write_zeroes_max_bytes") > 0)
+            {
+                methods[methodCount++] = ERASE_ZEROOUT;
+            }
+        }
+        else
+        {
+            methods[methodCount++] = ERASE_PUNCH_HOLE;
+            methods[methodCount++] = ERASE_ZERO_RANGE;
+        }
+    }
+
+    double start = nowSeconds();
+    int result = 1;
+    for(i = 0; i < methodCount && result == 1 ; i++)
+    {
+        result = tryMethod(fd, methods[i], options, length, start);
+        if(result == 0)
+        {
+            stats->method = methods[i];
+        }
+    }
+    if(result == 1)
+    {
+        result = writeZeros(options, fd, flags, length, start);
+        stats->method = ERASE_WRITE;
+    }
+    stats->seconds = nowSeconds() - start;
+    if(options->progress)
+    {
+        fprintf(stderr, "\n");
+    }
+    close(fd);
+    if(result != 0)
+    {
+        return -1;
+    }
+    stats->bytes = length;
+    stats->readsZero = stats->method != ERASE_SECDISCARD && stats->method != ERASE_DISCARD;
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef ERASE_H
+#define ERASE_H
+
+#include <stddef.h>
+
+/*
+ * Device / file erase.
+ *
+ * The cheap paths ask the device or the file system to forget the data,
+ * instead of streaming zeros through it:
+ *
+ *   block device:  BLKSECDISCARD (-S), BLKDISCARD, BLKZEROOUT (offloaded only)
+ *   regular file:  fallocate(PUNCH_HOLE), fallocate(ZERO_RANGE)
+ *
+ * They are tried in that order. Only when none is supported are zeros written,
+ * by several threads at different offsets with large aligned O_DIRECT writes.
+ */
+
+typedef enum EraseMethod
+{
+    ERASE_NONE,
+    ERASE_SECDISCARD,
+    ERASE_DISCARD,
+    ERASE_ZEROOUT,
+    ERASE_PUNCH_HOLE,
+    ERASE_ZERO_RANGE,
+    ERASE_WRITE,
+} EraseMethod;
+
+typedef struct EraseOptions
+{
+    const char* target;
+    long long offset;
+    long long length;           // 0 = to the end of the target
+    int secure;                 // try BLKSECDISCARD first
+    int zeros;                  // the range must read back as zeros: no plain discard
+    int threads;                // for the write fallback
+    size_t chunkSize;           // bytes per write, multiple of 4096
+    int forceWrite;             // skip the cheap paths (benchmarking)
+    int progress;
+} EraseOptions;
+
+typedef struct EraseStats
+{
+    EraseMethod method;
+    long long bytes;
+    double seconds;
+    int readsZero;              // 1 if the range now reads back as zeros
+} EraseStats;
+
+const char* eraseMethodName(EraseMethod method);
+
+// Returns 0, or -1 with errno set
+int eraseTarget(const EraseOptions* options, EraseStats* stats);
+
+#endif
@@ -0,0 +1,676 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "flash.h"
+#include "gunzip.h"
+#include "../common/fingerprint.h"
+
+
+#define ALIGNMENT 4096          // O_DIRECT buffer, offset and length alignment
+#define PROGRESS_INTERVAL_MS 1000
+#define GZIP_QUEUE_DEPTH 4      // decompressed buffers per gzip worker
+
+typedef enum ChunkState
+{
+    CHUNK_PENDING,
+    CHUNK_WRITTEN,
+    CHUNK_SKIPPED,              // hole or all zeros, not written
+} ChunkState;
+
+typedef struct Chunk
+{
+    uint64_t fingerprint;       // of the image data, checked by the readback
+    int state;
+} Chunk;
+
+typedef struct Slot
+{
+    uint8_t* data;
+    long long index;            // chunk number
+    size_t length;
+    int skip;
+} Slot;
+
+typedef struct Flash
+{
+    const FlashOptions* options;
+    int imageFd;
+    int directFd;               // O_DIRECT when supported
+    int bufferedFd;             // unaligned tail
+    int targetIsFile;
+    GzipReader* gzip;           // compressed image, NULL for a raw one
+    long long size;             // of the raw image; for gzip known once the reader is done
+    long long chunkCount;
+    long long chunkCapacity;
+    Chunk* chunks;              // written by the reader only, read by the verifier afterwards
+
+    // Ring between reader and writer
+    Slot* slots;
+    int head;
+    int count;
+    int readerDone;
+    int error;
+    pthread_mutex_t mutex;
+    pthread_cond_t condFilled;
+    pthread_cond_t condFree;
+
+    atomic_llong bytesDone;     // written or skipped, for the progress line
+    atomic_llong bytesWritten;
+    atomic_llong bytesSkipped;
+    atomic_int finished;
+} Flash;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int isZero(const uint8_t* data, size_t size)
+{
+    static const uint8_t zeros[64];
+    if(size <= sizeof(zeros))
+    {
+        return memcmp(data, zeros, size) == 0;
+    }
+    // The first 64 bytes are zero, and every byte equals the one 64 bytes before it
+    return memcmp(data, zeros, sizeof(zeros)) == 0 && memcmp(data, data + sizeof(zeros), size - sizeof(zeros)) == 0;
+}
+
+static int readFully(int fd, uint8_t* buffer, size_t size, off_t offset)
+{
+    while(size > 0)
+    {
+        ssize_t n = pread(fd, buffer, size, offset);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            if(n == 0)
+            {
+                errno = EIO;    // shorter than it was at the start
+            }
+            return -1;
+        }
+        buffer += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int writeFully(int fd, const uint8_t* buffer, size_t size, off_t offset)
+{
+    while(size > 0)
+    {
+        ssize_t n = pwrite(fd, buffer, size, offset);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            if(n == 0)
+            {
+                errno = ENOSPC;
+            }
+            return -1;
+        }
+        buffer += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static void setError(Flash* flash, int error)
+{
+    pthread_mutex_lock(&flash->mutex);
+    if(flash->error == 0)
+    {
+        flash->error = error;
+    }
+    pthread_cond_broadcast(&flash->condFilled);
+    pthread_cond_broadcast(&flash->condFree);
+    pthread_mutex_unlock(&flash->mutex);
+}
+
+// 1 if [offset, offset + length) holds no data according to the file system
+static int isHole(int fd, off_t offset, size_t length)
+{
+    off_t data = lseek(fd, offset, SEEK_DATA);
+    if(data < 0)
+    {
+        return errno == ENXIO;      // no data after offset
+    }
+    return data >= offset + (off_t)length;
+}
+
+// Room for chunk `index`: a compressed image's chunk count is only known at the end
+static int growChunks(Flash* flash, long long index)
+{
+    if(index < flash->chunkCapacity)
+    {
+        return 0;
+    }
+    long long capacity = flash->chunkCapacity * 2 > index ? flash->chunkCapacity * 2 : index + 1;
+    Chunk* chunks = realloc(flash->chunks, sizeof(Chunk) * capacity);
+    if(chunks == NULL)
+    {
+        return -1;
+    }
+    memset(chunks + flash->chunkCapacity, 0, sizeof(Chunk) * (capacity - flash->chunkCapacity));
+    flash->chunks = chunks;
+    flash->chunkCapacity = capacity;
+    return 0;
+}
+
+static void * reader(void* args)
+{
+    Flash* flash = args;
+    const FlashOptions* options = flash->options;
+    int canSkip = flash->targetIsFile || options->sparse;
+    long long total = 0;
+    long long index;
+
+    if(flash->gzip == NULL)
+    {
+        posix_fadvise(flash->imageFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    for(index = 0; flash->gzip != NULL || index < flash->chunkCount ; index++)
+    {
+        pthread_mutex_lock(&flash->mutex);
+        while(flash->count == options->bufferCount && flash->error == 0)
+        {
+            pthread_cond_wait(&flash->condFree, &flash->mutex);
+        }
+        if(flash->error != 0)
+        {
+            pthread_mutex_unlock(&flash->mutex);
+            return NULL;
+        }
+        Slot* slot = &flash->slots[(flash->head + flash->count) % options->bufferCount];
+        pthread_mutex_unlock(&flash->mutex);
+
+        // Only the reader touches a free slot: fill it without the lock
+        slot->index = index;
+        slot->skip = 0;
+        if(flash->gzip != NULL)
+        {
+            // The decompression stage fills whole chunks until the stream ends
+            ssize_t n = gzipRead(flash->gzip, slot->data, options->chunkSize);
+            if(n < 0 || (n > 0 && growChunks(flash, index) != 0))
+            {
+                setError(flash, n < 0 ? errno : ENOMEM);
+                return NULL;
+            }
+            if(n == 0)
+            {
+                break;
+            }
+            slot->length = n;
+        }
+        else
+        {
+            off_t offset = index * (off_t)options->chunkSize;
+            slot->length = flash->size - offset < (off_t)options->chunkSize ? (size_t)(flash->size - offset) : options->chunkSize;
+            if(canSkip && isHole(flash->imageFd, offset, slot->length))
+            {
+                slot->skip = 1;
+            }
+            else
+            {
+                if(readFully(flash->imageFd, slot->data, slot->length, offset) != 0)
+                {
+                    setError(flash, errno);
+                    return NULL;
+                }
+                // Read once: keep the image out of the page cache
+                posix_fadvise(flash->imageFd, offset, slot->length, POSIX_FADV_DONTNEED);
+            }
+        }
+        if(!slot->skip)
+        {
+            flash->chunks[index].fingerprint = fingerprint(slot->data, slot->length, 0);
+            slot->skip = canSkip && isZero(slot->data, slot->length);
+        }
+        flash->chunks[index].state = slot->skip ? CHUNK_SKIPPED : CHUNK_WRITTEN;
+        total += slot->length;
+
+        pthread_mutex_lock(&flash->mutex);
+        flash->count++;
+        pthread_cond_signal(&flash->condFilled);
+        pthread_mutex_unlock(&flash->mutex);
+    }
+
+    pthread_mutex_lock(&flash->mutex);
+    flash->size = total;
+    flash->chunkCount = index;
+    flash->readerDone = 1;
+    pthread_cond_signal(&flash->condFilled);
+    pthread_mutex_unlock(&flash->mutex);
+    return NULL;
+}
+
+static void * writer(void* args)
+{
+    Flash* flash = args;
+    const FlashOptions* options = flash->options;
+
+    while(1)
+    {
+        pthread_mutex_lock(&flash->mutex);
+        while(flash->count == 0 && !flash->readerDone && flash->error == 0)
+        {
+            pthread_cond_wait(&flash->condFilled, &flash->mutex);
+        }
+        if(flash->error != 0 || flash->count == 0)
+        {
+            pthread_mutex_unlock(&flash->mutex);
+            break;
+        }
+        Slot* slot = &flash->slots[flash->head];
+        pthread_mutex_unlock(&flash->mutex);
+
+        off_t offset = slot->index * (off_t)options->chunkSize;
+        if(slot->skip)
+        {
+            atomic_fetch_add(&flash->bytesSkipped, slot->length);
+        }
+        else
+        {
+            // O_DIRECT needs aligned offset and length: only the image's tail may not be
+            int aligned = offset % ALIGNMENT == 0 && slot->length % ALIGNMENT == 0;
+            if(writeFully(aligned ? flash->directFd : flash->bufferedFd, slot->data, slot->length, offset) != 0)
+            {
+                setError(flash, errno);
+                break;
+            }
+            atomic_fetch_add(&flash->bytesWritten, slot->length);
+        }
+        atomic_fetch_add(&flash->bytesDone, slot->length);
+
+        pthread_mutex_lock(&flash->mutex);
+        flash->head = (flash->head + 1) % options->bufferCount;
+        flash->count--;
+        pthread_cond_signal(&flash->condFree);
+        pthread_mutex_unlock(&flash->mutex);
+    }
+
+    // A decompressed image's size is known only now: trailing skipped chunks must exist too
+    if(flash->gzip != NULL && flash->targetIsFile && flash->error == 0 && ftruncate(flash->bufferedFd, flash->size) != 0)
+    {
+        setError(flash, errno);
+    }
+    // Everything written must be on the medium before we report success
+    if(fdatasync(flash->bufferedFd) != 0 || (flash->directFd != flash->bufferedFd && fdatasync(flash->directFd) != 0))
+    {
+        setError(flash, errno);
+    }
+    atomic_store(&flash->finished, 1);
+    return NULL;
+}
+
+static void printProgress(Flash* flash, double start, long long* lastBytes, double* lastTime)
+{
+    double now = nowSeconds();
+    long long done = atomic_load(&flash->bytesDone);
+    double rate = (done - *lastBytes) / 1048576.0 / (now - *lastTime > 0 ? now - *lastTime : 1);
+    double average = done / 1048576.0 / (now - start > 0 ? now - start : 1);
+    if(flash->gzip != NULL)
+    {
+        // Output size unknown: progress is the compressed input consumed
+        fprintf(stderr, "\r%9.1f MB  %5.1f%% of input  %7.1f MB/s (avg %.1f)   ", done / 1048576.0,
+            100.0 * gzipProgress(flash->gzip), rate, average);
+    }
+    else
+    {
+        fprintf(stderr, "\r%9.1f / %.1f MB  %5.1f%%  %7.1f MB/s (avg %.1f)   ", done / 1048576.0, flash->size / 1048576.0,
+            flash->size ? 100.0 * done / flash->size : 100.0, rate, average);
+    }
+    *lastBytes = done;
+    *lastTime = now;
+}
+
+typedef struct Verify
+{
+    Flash* flash;
+    int fd;                     // O_DIRECT when possible: read the medium, not the page cache
+    int bufferedFd;
+    atomic_llong nextChunk;
+    atomic_llong mismatch;      // lowest mismatching chunk, chunkCount if none
+    atomic_llong bytesVerified;
+    atomic_int error;
+} Verify;
+
+static void * verifier(void* args)
+{
+    Verify* verify = args;
+    Flash* flash = verify->flash;
+    size_t chunkSize = flash->options->chunkSize;
+    uint8_t* buffer;
+
+    if(posix_memalign((void**)&buffer, ALIGNMENT, chunkSize) != 0)
+    {
+        atomic_store(&verify->error, ENOMEM);
+        return NULL;
+    }
+    while(1)
+    {
+        long long index = atomic_fetch_add(&verify->nextChunk, 1);
+        if(index >= flash->chunkCount || index > atomic_load(&verify->mismatch))
+        {
+            break;
+        }
+        Chunk* chunk = &flash->chunks[index];
+        // Skipped chunks on a device keep whatever was there before: nothing to check
+        if(chunk->state == CHUNK_SKIPPED && !flash->targetIsFile)
+        {
+            continue;
+        }
+        off_t offset = index * (off_t)chunkSize;
+        size_t length = flash->size - offset < (off_t)chunkSize ? (size_t)(flash->size - offset) : chunkSize;
+        int aligned = length % ALIGNMENT == 0;
+        if(readFully(aligned ? verify->fd : verify->bufferedFd, buffer, length, offset) != 0)
+        {
+            atomic_store(&verify->error, errno);
+            break;
+        }
+        int ok = chunk->state == CHUNK_SKIPPED ? isZero(buffer, length) : fingerprint(buffer, length, 0) == chunk->fingerprint;
+        if(!ok)
+        {
+            long long known = atomic_load(&verify->mismatch);
+            while(index < known && !atomic_compare_exchange_weak(&verify->mismatch, &known, index))
+            {
+            }
+        }
+        atomic_fetch_add(&verify->bytesVerified, length);
+    }
+    free(buffer);
+    return NULL;
+}
+
+static int verifyTarget(Flash* flash, FlashStats* stats)
+{
+    const FlashOptions* options = flash->options;
+    Verify verify = { .flash = flash };
+    atomic_init(&verify.nextChunk, 0);
+    atomic_init(&verify.mismatch, flash->chunkCount);
+    atomic_init(&verify.bytesVerified, 0);
+    atomic_init(&verify.error, 0);
+
+    verify.bufferedFd = open(options->target, O_RDONLY | O_CLOEXEC);
+    verify.fd = open(options->target, O_RDONLY | O_CLOEXEC | O_DIRECT);
+    if(verify.fd < 0)
+    {
+        verify.fd = verify.bufferedFd;
+    }
+    if(verify.bufferedFd < 0)
+    {
+        return -1;
+    }
+    if(verify.fd == verify.bufferedFd)
+    {
+        // Buffered readback would only see our own page cache: drop it first
+        posix_fadvise(verify.bufferedFd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    double start = nowSeconds();
+    int threadCount = options->verifyThreads;
+    pthread_t* th = malloc(sizeof(pthread_t) * threadCount);
+    int i;
+    for(i = 0; i < threadCount ; i++)
+    {
+        if(pthread_create(&th[i], NULL, &verifier, &verify) != 0)
+        {
+            perror("Failed to Create Thread");
+            threadCount = i;
+            break;
+        }
+    }
+    if(threadCount == 0)
+    {
+        verifier(&verify);
+    }
+    for(i = 0; i < threadCount ; i++)
+    {
+        pthread_join(th[i], NULL);
+    }
+    free(th);
+    stats->verifySeconds = nowSeconds() - start;
+    stats->bytesVerified = atomic_load(&verify.bytesVerified);
+
+    if(verify.fd != verify.bufferedFd)
+    {
+        close(verify.fd);
+    }
+    close(verify.bufferedFd);
+    if(atomic_load(&verify.error))
+    {
+        errno = atomic_load(&verify.error);
+        return -1;
+    }
+    long long mismatch = atomic_load(&verify.mismatch);
+    stats->verified = mismatch == flash->chunkCount ? 1 : -1;
+    stats->mismatchOffset = mismatch * (long long)options->chunkSize;
+    return 0;
+}
+
+// Opens the target: exclusive on devices (fails while mounted), truncated when a regular file
+static int openTarget(Flash* flash)
+{
+    const FlashOptions* options = flash->options;
+    struct stat st;
+    int flags = O_WRONLY | O_CLOEXEC;
+
+    if(stat(options->target, &st) == 0 && S_ISBLK(st.st_mode))
+    {
+        flags |= O_EXCL;
+    }
+    else
+    {
+        flags |= O_CREAT | O_TRUNC;
+        flash->targetIsFile = 1;
+    }
+    flash->directFd = -1;
+    if(options->direct)
+    {
+        // Not every file system supports O_DIRECT (tmpfs): use buffered writes then
+        flash->directFd = open(options->target, flags | O_DIRECT, 0644);
+        if(flash->directFd < 0 && errno != EINVAL)
+        {
+            return -1;
+        }
+    }
+    // The direct descriptor already holds the exclusive claim and created the file
+    flash->bufferedFd = open(options->target, flash->directFd >= 0 ? flags & ~(O_EXCL | O_CREAT | O_TRUNC) : flags, 0644);
+    if(flash->bufferedFd < 0)
+    {
+        return -1;
+    }
+    if(flash->directFd < 0)
+    {
+        flash->directFd = flash->bufferedFd;
+    }
+
+    if(flash->gzip != NULL)
+    {
+        // Sizes are checked by the writes themselves (ENOSPC)
+    }
+    else if(flash->targetIsFile)
+    {
+        // Holes of the image stay holes in the target, and read back as zeros
+        if(ftruncate(flash->bufferedFd, flash->size) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        unsigned long long deviceSize;
+        if(ioctl(flash->bufferedFd, BLKGETSIZE64, &deviceSize) == 0 && (long long)deviceSize < flash->size)
+        {
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int flashImage(const FlashOptions* options, FlashStats* stats)
+{
+    Flash flash = { .options = options, .imageFd = -1, .directFd = -1, .bufferedFd = -1 };
+    struct stat st;
+    int result = -1;
+    int i;
+
+    memset(stats, 0, sizeof(FlashStats));
+    if(options->chunkSize == 0 || options->chunkSize % ALIGNMENT != 0 || options->bufferCount < 2)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    flash.imageFd = open(options->image, O_RDONLY | O_CLOEXEC);
+    if(flash.imageFd < 0 || fstat(flash.imageFd, &st) != 0)
+    {
+        return -1;
+    }
+    if(gzipDetect(flash.imageFd))
+    {
+        int threads = options->decompressThreads > 0 ? options->decompressThreads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        flash.gzip = gzipOpen(flash.imageFd, threads, options->chunkSize, GZIP_QUEUE_DEPTH);
+        if(flash.gzip == NULL)
+        {
+            close(flash.imageFd);
+            return -1;
+        }
+        stats->compressed = 1;
+    }
+    else
+    {
+        flash.size = st.st_size;
+        flash.chunkCount = (flash.size + options->chunkSize - 1) / options->chunkSize;
+    }
+    flash.chunkCapacity = flash.chunkCount ? flash.chunkCount : 64;
+    flash.chunks = calloc(flash.chunkCapacity, sizeof(Chunk));
+    flash.slots = calloc(options->bufferCount, sizeof(Slot));
+    pthread_mutex_init(&flash.mutex, NULL);
+    pthread_cond_init(&flash.condFilled, NULL);
+    pthread_cond_init(&flash.condFree, NULL);
+    atomic_init(&flash.bytesDone, 0);
+    atomic_init(&flash.bytesWritten, 0);
+    atomic_init(&flash.bytesSkipped, 0);
+    atomic_init(&flash.finished, 0);
+
+    for(i = 0; i < options->bufferCount ; i++)
+    {
+        if(posix_memalign((void**)&flash.slots[i].data, ALIGNMENT, options->chunkSize) != 0)
+        {
+            errno = ENOMEM;
+            goto out;
+        }
+    }
+    if(openTarget(&flash) != 0)
+    {
+        goto out;
+    }
+    stats->directUsed = flash.directFd != flash.bufferedFd;
+
+    double start = nowSeconds();
+    pthread_t readerThread, writerThread;
+    if(pthread_create(&readerThread, NULL, &reader, &flash) != 0)
+    {
+        perror("Failed to Create Thread");
+        goto out;
+    }
+    if(pthread_create(&writerThread, NULL, &writer, &flash) != 0)
+    {
+        perror("Failed to Create Thread");
+        setError(&flash, EAGAIN);
+        pthread_join(readerThread, NULL);
+        goto out;
+    }
+
+    // The calling thread reports progress until the writer has flushed
+    long long lastBytes = 0;
+    double lastTime = start;
+    while(!atomic_load(&flash.finished))
+    {
+        struct timespec ts = { 0, 50 * 1000000L };
+        nanosleep(&ts, NULL);
+        if(options->progress && nowSeconds() - lastTime >= PROGRESS_INTERVAL_MS / 1000.0)
+        {
+            printProgress(&flash, start, &lastBytes, &lastTime);
+        }
+    }
+    pthread_join(readerThread, NULL);
+    pthread_join(writerThread, NULL);
+    stats->seconds = nowSeconds() - start;
+    if(options->progress)
+    {
+        printProgress(&flash, start, &lastBytes, &lastTime);
+        fprintf(stderr, "\n");
+    }
+    stats->imageSize = flash.size;
+    stats->bytesWritten = atomic_load(&flash.bytesWritten);
+    stats->bytesSkipped = atomic_load(&flash.bytesSkipped);
+    if(flash.error != 0)
+    {
+        errno = flash.error;
+        goto out;
+    }
+
+    result = 0;
+    if(options->verifyThreads > 0)
+    {
+        result = verifyTarget(&flash, stats);
+    }
+
+out:
+    {
+        int savedErrno = errno;
+        if(flash.directFd >= 0 && flash.directFd != flash.bufferedFd)
+        {
+            close(flash.directFd);
+        }
+        if(flash.bufferedFd >= 0)
+        {
+            close(flash.bufferedFd);
+        }
+        if(flash.gzip != NULL)
+        {
+            GzipStats gzipStats;
+            gzipGetStats(flash.gzip, &gzipStats);
+            stats->members = gzipStats.members;
+            stats->decompressThreads = gzipStats.threads;
+            stats->compressedSize = gzipStats.compressedSize;
+            gzipClose(flash.gzip);
+        }
+        close(flash.imageFd);
+        for(i = 0; i < options->bufferCount ; i++)
+        {
+            free(flash.slots[i].data);
+        }
+        free(flash.slots);
+        free(flash.chunks);
+        pthread_mutex_destroy(&flash.mutex);
+        pthread_cond_destroy(&flash.condFilled);
+        pthread_cond_destroy(&flash.condFree);
+        errno = savedErrno;
+    }
+    return result;
+}
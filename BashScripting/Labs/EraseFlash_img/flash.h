@@ -0,0 +1,54 @@
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stddef.h>
+
+/*
+ * Pipelined image flasher.
+ *
+ *   reader thread --> ring of aligned buffers --> writer thread --> target
+ *
+ * The reader fills buffers from the image while the writer empties the
+ * previous ones into the target, so reading and writing overlap. Holes in the
+ * image (SEEK_DATA / SEEK_HOLE) and all-zero chunks are not written when that
+ * keeps the result correct: always for a regular file target (it is truncated
+ * first, so holes read back as zeros), on a device only with `sparse`.
+ *
+ * A gzip image is decompressed on the fly: the reader thread takes its chunks
+ * from the decompression stage (gunzip.c) instead of the file.
+ */
+
+typedef struct FlashOptions
+{
+    const char* image;
+    const char* target;         // block device or regular file
+    size_t chunkSize;           // bytes per ring buffer, multiple of 4096
+    int bufferCount;            // ring buffers
+    int direct;                 // O_DIRECT writes (falls back when unsupported)
+    int sparse;                 // skip holes / zero chunks on devices too
+    int decompressThreads;      // gzip workers, 0 = online CPUs
+    int verifyThreads;          // 0 = no readback verification
+    int progress;               // live MB/s on stderr
+} FlashOptions;
+
+typedef struct FlashStats
+{
+    long long imageSize;        // decompressed size for a gzip image
+    long long bytesWritten;
+    long long bytesSkipped;     // holes and zero chunks not written
+    double seconds;             // flash, including the final flush
+    int directUsed;
+    int verified;               // 1 ok, 0 not run, -1 mismatch
+    long long mismatchOffset;   // first differing chunk when verified == -1
+    long long bytesVerified;
+    double verifySeconds;
+    int compressed;             // gzip image
+    long long compressedSize;
+    int members;                // gzip members decompressed
+    int decompressThreads;
+} FlashStats;
+
+// Returns 0, or -1 with errno set
+int flashImage(const FlashOptions* options, FlashStats* stats);
+
+#endif
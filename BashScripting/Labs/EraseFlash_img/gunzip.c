@@ -0,0 +1,434 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "gunzip.h"
+
+
+#define INPUT_SIZE (256 * 1024)     // compressed bytes per pread()
+#define SCAN_SIZE (1024 * 1024)
+#define HEADER_SIZE 10
+#define MAX_THREADS 64
+
+typedef enum MemberState
+{
+    MEMBER_IDLE,
+    MEMBER_RUNNING,
+    MEMBER_DONE,
+    MEMBER_FAILED,
+    MEMBER_CANCELLED,           // not a real member start: skipped or abandoned
+} MemberState;
+
+typedef struct OutBuffer
+{
+    uint8_t* data;
+    size_t length;
+} OutBuffer;
+
+typedef struct Worker
+{
+    GzipReader* reader;
+    pthread_t thread;
+    OutBuffer* buffers;         // queueDepth buffers, lent to the member being decompressed
+} Worker;
+
+typedef struct Member
+{
+    off_t start;                // header match
+    off_t end;                  // after the trailer, once DONE
+    off_t inputDone;            // compressed bytes decompressed so far, for progress
+    int state;
+    int error;
+    Worker* worker;
+    int head;                   // queue of full buffers in worker->buffers
+    int count;
+    size_t used;                // bytes of the head buffer already handed out
+} Member;
+
+struct GzipReader
+{
+    int fd;
+    off_t fileSize;
+    size_t bufferSize;
+    int queueDepth;
+    Member* members;            // every header match, in file order
+    int memberCount;
+    int nextMember;             // next one a worker starts on
+    int current;                // the one being handed out, -1 at the end
+    int membersUsed;
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    Worker* workers;
+    int threadCount;
+};
+
+int gzipDetect(int fd)
+{
+    uint8_t magic[2];
+    return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+static int isHeader(const uint8_t* p)
+{
+    // ID1 ID2, CM = deflate, reserved flag bits clear
+    return p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && (p[3] & 0xe0) == 0;
+}
+
+// Offsets of every possible member start
+static int scanMembers(GzipReader* reader)
+{
+    uint8_t* block = malloc(SCAN_SIZE + HEADER_SIZE);
+    int capacity = 16;
+    off_t position;
+
+    reader->members = malloc(sizeof(Member) * capacity);
+    for(position = 0; position < reader->fileSize ; position += SCAN_SIZE)
+    {
+        // Read a little past the block so a header across the boundary is seen
+        ssize_t n = pread(reader->fd, block, SCAN_SIZE + HEADER_SIZE, position);
+        if(n < 0)
+        {
+            free(block);
+            return -1;
+        }
+        const uint8_t* p = block;
+        const uint8_t* last = block + (n < SCAN_SIZE ? n : SCAN_SIZE);
+        while(p < last && (p = memchr(p, 0x1f, last - p)) != NULL)
+        {
+            if(p + HEADER_SIZE <= block + n && isHeader(p))
+            {
+                if(reader->memberCount == capacity)
+                {
+                    capacity *= 2;
+                    reader->members = realloc(reader->members, sizeof(Member) * capacity);
+                }
+                Member* member = &reader->members[reader->memberCount++];
+                memset(member, 0, sizeof(Member));
+                member->start = position + (p - block);
+            }
+            p++;
+        }
+    }
+    free(block);
+    return 0;
+}
+
+// Decompresses one member into the worker's buffers, in step with the consumer
+static void decodeMember(Worker* worker, Member* member, z_stream* zs, uint8_t* input)
+{
+    GzipReader* reader = worker->reader;
+    OutBuffer* out = NULL;
+    off_t inputOffset = member->start;
+    int error = 0;
+
+    inflateReset(zs);
+    zs->avail_in = 0;
+    while(1)
+    {
+        if(out == NULL)
+        {
+            // Bounded: wait for the consumer to free a buffer of our queue
+            pthread_mutex_lock(&reader->mutex);
+            while(member->count == reader->queueDepth && member->state == MEMBER_RUNNING && !reader->stop)
+            {
+                pthread_cond_wait(&reader->changed, &reader->mutex);
+            }
+            if(member->state != MEMBER_RUNNING || reader->stop)
+            {
+                pthread_mutex_unlock(&reader->mutex);
+                return;
+            }
+            out = &worker->buffers[(member->head + member->count) % reader->queueDepth];
+            pthread_mutex_unlock(&reader->mutex);
+            out->length = 0;
+        }
+        if(zs->avail_in == 0)
+        {
+            ssize_t n = pread(reader->fd, input, INPUT_SIZE, inputOffset);
+            if(n <= 0)
+            {
+                error = n < 0 ? errno : EIO;    // truncated member
+                break;
+            }
+            zs->next_in = input;
+            zs->avail_in = n;
+            inputOffset += n;
+        }
+        zs->next_out = out->data + out->length;
+        zs->avail_out = reader->bufferSize - out->length;
+        int ret = inflate(zs, Z_NO_FLUSH);
+        out->length = reader->bufferSize - zs->avail_out;
+        if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            error = EBADMSG;    // corrupt deflate data or CRC mismatch
+            break;
+        }
+        if(ret == Z_STREAM_END || out->length == reader->bufferSize)
+        {
+            pthread_mutex_lock(&reader->mutex);
+            if(member->state != MEMBER_RUNNING)
+            {
+                pthread_mutex_unlock(&reader->mutex);
+                return;
+            }
+            member->count++;
+            member->inputDone = inputOffset - zs->avail_in;
+            pthread_cond_broadcast(&reader->changed);
+            pthread_mutex_unlock(&reader->mutex);
+            out = NULL;
+        }
+        if(ret == Z_STREAM_END)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&reader->mutex);
+    if(member->state == MEMBER_RUNNING)
+    {
+        if(error != 0)
+        {
+            member->state = MEMBER_FAILED;
+            member->error = error;
+        }
+        else
+        {
+            member->state = MEMBER_DONE;
+            member->end = member->start + zs->total_in;
+        }
+        pthread_cond_broadcast(&reader->changed);
+        // Our buffers still hold its output: wait until it is handed out, or the member is dropped
+        while((member->state == MEMBER_DONE || member->state == MEMBER_FAILED) && member->count > 0 && !reader->stop)
+        {
+            pthread_cond_wait(&reader->changed, &reader->mutex);
+        }
+    }
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+static void * worker(void* args)
+{
+    Worker* self = args;
+    GzipReader* reader = self->reader;
+    uint8_t* input = malloc(INPUT_SIZE);
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    // 16 + MAX_WBITS: expect the gzip wrapper, check its CRC-32 and length
+    if(input == NULL || inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+    {
+        free(input);
+        return NULL;
+    }
+    while(1)
+    {
+        pthread_mutex_lock(&reader->mutex);
+        // Members are started in file order, so the one being handed out is never left waiting
+        while(reader->nextMember < reader->memberCount && reader->members[reader->nextMember].state == MEMBER_CANCELLED)
+        {
+            reader->nextMember++;
+        }
+        if(reader->stop || reader->nextMember >= reader->memberCount)
+        {
+            pthread_mutex_unlock(&reader->mutex);
+            break;
+        }
+        Member* member = &reader->members[reader->nextMember++];
+        member->state = MEMBER_RUNNING;
+        member->worker = self;
+        member->head = 0;
+        member->count = 0;
+        member->used = 0;
+        pthread_mutex_unlock(&reader->mutex);
+
+        decodeMember(self, member, &zs, input);
+    }
+    inflateEnd(&zs);
+    free(input);
+    return NULL;
+}
+
+GzipReader* gzipOpen(int fd, int threads, size_t bufferSize, int queueDepth)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        return NULL;
+    }
+    GzipReader* reader = calloc(1, sizeof(GzipReader));
+    reader->fd = fd;
+    reader->fileSize = st.st_size;
+    reader->bufferSize = bufferSize;
+    reader->queueDepth = queueDepth < 2 ? 2 : queueDepth;
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    int scanned = scanMembers(reader);
+    if(scanned != 0 || reader->memberCount == 0 || reader->members[0].start != 0)
+    {
+        if(scanned == 0)
+        {
+            errno = EINVAL;     // not a gzip file
+        }
+        free(reader->members);
+        free(reader);
+        return NULL;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // More workers than members would only sit idle
+    reader->threadCount = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+    if(reader->threadCount > reader->memberCount)
+    {
+        reader->threadCount = reader->memberCount;
+    }
+    int threadCount = reader->threadCount;
+    int i, b;
+    reader->workers = calloc(threadCount, sizeof(Worker));
+    reader->threadCount = 0;
+    for(i = 0; i < threadCount ; i++)
+    {
+        Worker* w = &reader->workers[i];
+        w->reader = reader;
+        w->buffers = calloc(reader->queueDepth, sizeof(OutBuffer));
+        for(b = 0; b < reader->queueDepth ; b++)
+        {
+            w->buffers[b].data = malloc(bufferSize);
+        }
+        if(pthread_create(&w->thread, NULL, &worker, w) != 0)
+        {
+            perror("Failed to Create Thread");
+            for(b = 0; b < reader->queueDepth ; b++)
+            {
+                free(w->buffers[b].data);
+            }
+            free(w->buffers);
+            break;
+        }
+        reader->threadCount++;
+    }
+    if(reader->threadCount == 0)
+    {
+        gzipClose(reader);
+        errno = EAGAIN;
+        return NULL;
+    }
+    return reader;
+}
+
+// Called with the mutex held when the current member is finished and handed out
+static void nextMember(GzipReader* reader)
+{
+    off_t end = reader->members[reader->current].end;
+    int i;
+
+    reader->membersUsed++;
+    // Matches before the end were inside this member's compressed data
+    for(i = reader->current + 1; i < reader->memberCount && reader->members[i].start < end ; i++)
+    {
+        reader->members[i].state = MEMBER_CANCELLED;
+    }
+    // Anything after the last member that is not a member (padding) is ignored, like gzip -d
+    reader->current = i < reader->memberCount && reader->members[i].start == end ? i : -1;
+    pthread_cond_broadcast(&reader->changed);
+}
+
+ssize_t gzipRead(GzipReader* reader, void* buffer, size_t size)
+{
+    uint8_t* out = buffer;
+    size_t filled = 0;
+
+    pthread_mutex_lock(&reader->mutex);
+    while(filled < size && reader->current >= 0)
+    {
+        Member* member = &reader->members[reader->current];
+        while(member->count == 0 && (member->state == MEMBER_IDLE || member->state == MEMBER_RUNNING) && !reader->stop)
+        {
+            pthread_cond_wait(&reader->changed, &reader->mutex);
+        }
+        if(member->count > 0)
+        {
+            OutBuffer* b = &member->worker->buffers[member->head];
+            size_t take = b->length - member->used < size - filled ? b->length - member->used : size - filled;
+            // The worker does not touch a queued buffer: copy without the lock
+            pthread_mutex_unlock(&reader->mutex);
+            memcpy(out + filled, b->data + member->used, take);
+            pthread_mutex_lock(&reader->mutex);
+            filled += take;
+            member->used += take;
+            if(member->used == b->length)
+            {
+                member->head = (member->head + 1) % reader->queueDepth;
+                member->count--;
+                member->used = 0;
+                pthread_cond_broadcast(&reader->changed);
+            }
+            continue;
+        }
+        if(member->state == MEMBER_FAILED || reader->stop)
+        {
+            errno = member->error ? member->error : EIO;
+            pthread_mutex_unlock(&reader->mutex);
+            return -1;
+        }
+        nextMember(reader);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    return filled;
+}
+
+double gzipProgress(GzipReader* reader)
+{
+    pthread_mutex_lock(&reader->mutex);
+    double fraction = 1.0;
+    if(reader->current >= 0 && reader->fileSize > 0)
+    {
+        Member* member = &reader->members[reader->current];
+        fraction = (double)(member->inputDone > member->start ? member->inputDone : member->start) / reader->fileSize;
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    return fraction;
+}
+
+void gzipGetStats(GzipReader* reader, GzipStats* stats)
+{
+    pthread_mutex_lock(&reader->mutex);
+    stats->members = reader->membersUsed;
+    stats->candidates = reader->memberCount;
+    stats->threads = reader->threadCount;
+    stats->compressedSize = reader->fileSize;
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+void gzipClose(GzipReader* reader)
+{
+    int i, b;
+    pthread_mutex_lock(&reader->mutex);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->mutex);
+    for(i = 0; i < reader->threadCount ; i++)
+    {
+        pthread_join(reader->workers[i].thread, NULL);
+    }
+    for(i = 0; i < reader->threadCount ; i++)
+    {
+        for(b = 0; b < reader->queueDepth ; b++)
+        {
+            free(reader->workers[i].buffers[b].data);
+        }
+        free(reader->workers[i].buffers);
+    }
+    free(reader->workers);
+    free(reader->members);
+    pthread_mutex_destroy(&reader->mutex);
+    pthread_cond_destroy(&reader->changed);
+    free(reader);
+}
@@ -0,0 +1,49 @@
+#ifndef GUNZIP_H
+#define GUNZIP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Streaming gzip decompression stage for the flasher (zlib).
+ *
+ * A .gz file can hold several members back to back (`cat a.gz b.gz`, pigz -i,
+ * bgzip, split images). Members are independent, so each worker thread
+ * decompresses one member into its own bounded queue of buffers, and
+ * gzipRead() hands the output out in file order. A single-member file is
+ * decompressed by one worker, still concurrently with the device writes.
+ *
+ * Member starts are found by scanning for the gzip header (1f 8b 08). A match
+ * inside compressed data is only a guess: a member's output is used only when
+ * it starts exactly where the previous member ended.
+ *
+ * Memory: threads x queueDepth x bufferSize, whatever the image size.
+ */
+
+typedef struct GzipReader GzipReader;
+
+typedef struct GzipStats
+{
+    int members;                // members decompressed into the output
+    int candidates;             // header matches found by the scan
+    int threads;
+    long long compressedSize;
+} GzipStats;
+
+// 1 if the file starts with a gzip header
+int gzipDetect(int fd);
+
+// Starts the workers. NULL with errno set on failure.
+GzipReader* gzipOpen(int fd, int threads, size_t bufferSize, int queueDepth);
+
+// Fills `buffer` completely unless the stream ends. Returns bytes, 0 at the end, -1 with errno set.
+ssize_t gzipRead(GzipReader* reader, void* buffer, size_t size);
+
+// Fraction of the compressed input consumed so far, 0..1
+double gzipProgress(GzipReader* reader);
+
+void gzipGetStats(GzipReader* reader, GzipStats* stats);
+
+void gzipClose(GzipReader* reader);
+
+#endif
@@ -0,0 +1,618 @@
+/*
+ * FilesCompare.c - native, parallel, early-exit replacement for FilesCompare.sh
+ *
+ * Compare mode (both files local):
+ *   1. stat() both files: same inode -> similar, different sizes -> different.
+ *      Block devices are sized with BLKGETSIZE64. Files whose size is not
+ *      known up front (pipes, /proc and /sys files report 0) are read to EOF
+ *      side by side instead.
+ *   2. Compare the first block on its own: most differing images differ early.
+ *   3. Split the files into large chunks and compare them on several threads
+ *      with memcmp() (vectorized in glibc). Threads take chunks in increasing
+ *      order and stop as soon as a difference before their next chunk is
+ *      known, so the first differing offset is reported without reading the
+ *      rest of the files.
+ *   Files are mmap()ed; -m streams them with pread() into aligned buffers
+ *   instead (e.g. files larger than the address space on 32-bit boards).
+ *
+ * Hash mode (only one file local):
+ *   -H prints the SHA-256 of the file; with a second argument it checks the
+ *   file against a digest computed on the other machine.
+ *
+ * Cached mode (-C index):
+ *   Digests are kept in a persistent index (hashcache.c), so files compared
+ *   again unchanged are answered without reading them. Different digests are
+ *   narrowed down to the first differing block, and only that block is read.
+ *
+ * Exit status: 0 similar, 1 different, 2 error (like cmp).
+ *
+ * Build: gcc -O2 -Wall FilesCompare.c sha256.c hashcache.c -o FilesCompare -pthread
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include "sha256.h"
+#include "hashcache.h"
+
+
+#define DEFAULT_CHUNK_MB 8
+#define HEAD_CHECK_SIZE (64 * 1024)
+#define HASH_BUFFER_SIZE (1024 * 1024)
+#define BUFFER_ALIGN 4096
+#define MAX_THREADS 64
+
+typedef struct CompareJob
+{
+    int fd1, fd2;
+    const uint8_t* map1;        // NULL in streaming mode
+    const uint8_t* map2;
+    off_t size;
+    size_t chunk;
+    atomic_llong nextChunk;
+    atomic_llong firstDiff;     // == size while no difference is known
+    atomic_int error;
+} CompareJob;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int readFully(int fd, uint8_t* buffer, size_t size, off_t offset)
+{
+    while(size > 0)
+    {
+        ssize_t n = pread(fd, buffer, size, offset);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return -1;
+        }
+        buffer += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Reads up to size bytes, fewer only at EOF. Returns the byte count or -1.
+static ssize_t readUpTo(int fd, uint8_t* buffer, size_t size)
+{
+    size_t total = 0;
+    while(total < size)
+    {
+        ssize_t n = read(fd, buffer + total, size - total);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return -1;
+        }
+        if(n == 0)
+        {
+            break;
+        }
+        total += n;
+    }
+    return (ssize_t)total;
+}
+
+// Index of the first differing byte, or -1. memcmp() first: the common case is "equal".
+static long findDifference(const uint8_t* a, const uint8_t* b, size_t size)
+{
+    if(memcmp(a, b, size) == 0)
+    {
+        return -1;
+    }
+    size_t block = 0;
+    while(block + 4096 < size && memcmp(a + block, b + block, 4096) == 0)
+    {
+        block += 4096;
+    }
+    while(a[block] == b[block])
+    {
+        block++;
+    }
+    return (long)block;
+}
+
+static void recordDifference(CompareJob* job, long long offset)
+{
+    long long known = atomic_load(&job->firstDiff);
+    while(offset < known && !atomic_compare_exchange_weak(&job->firstDiff, &known, offset))
+    {
+    }
+}
+
+static void * compareWorker(void* args)
+{
+    CompareJob* job = args;
+    uint8_t* buffer1 = NULL;
+    uint8_t* buffer2 = NULL;
+    if(job->map1 == NULL &&
+       (posix_memalign((void**)&buffer1, BUFFER_ALIGN, job->chunk) != 0 ||
+        posix_memalign((void**)&buffer2, BUFFER_ALIGN, job->chunk) != 0))
+    {
+        atomic_store(&job->error, ENOMEM);
+        free(buffer1);
+        return NULL;
+    }
+
+    while(1)
+    {
+        long long index = atomic_fetch_add(&job->nextChunk, 1);
+        off_t offset = (off_t)(index * job->chunk);
+        // Chunks are handed out in order: nothing past a known difference matters
+        if(offset >= job->size || offset >= atomic_load(&job->firstDiff) || atomic_load(&job->error))
+        {
+            break;
+        }
+        size_t size = job->size - offset < (off_t)job->chunk ? (size_t)(job->size - offset) : job->chunk;
+        const uint8_t* p1;
+        const uint8_t* p2;
+        if(job->map1 != NULL)
+        {
+            p1 = job->map1 + offset;
+            p2 = job->map2 + offset;
+        }
+        else
+        {
+            if(readFully(job->fd1, buffer1, size, offset) != 0 || readFully(job->fd2, buffer2, size, offset) != 0)
+            {
+                atomic_store(&job->error, errno ? errno : EIO);
+                break;
+            }
+            p1 = buffer1;
+            p2 = buffer2;
+        }
+
+        long diff = findDifference(p1, p2, size);
+        if(diff >= 0)
+        {
+            recordDifference(job, offset + diff);
+        }
+        if(job->map1 != NULL)
+        {
+            // Done with these pages: keep our RSS small on multi-GB images
+            madvise((void*)p1, size, MADV_DONTNEED);
+            madvise((void*)p2, size, MADV_DONTNEED);
+        }
+    }
+    free(buffer1);
+    free(buffer2);
+    return NULL;
+}
+
+// Returns the first differing offset, `size` if equal, -1 on error
+static long long compareContents(int fd1, int fd2, off_t size, int threadCount, size_t chunk, int streaming)
+{
+    static uint8_t head1[HEAD_CHECK_SIZE];
+    static uint8_t head2[HEAD_CHECK_SIZE];
+    size_t headSize = size < HEAD_CHECK_SIZE ? (size_t)size : HEAD_CHECK_SIZE;
+
+    // Cheap early exit before starting threads or mapping anything
+    if(readFully(fd1, head1, headSize, 0) != 0 || readFully(fd2, head2, headSize, 0) != 0)
+    {
+        return -1;
+    }
+    long diff = findDifference(head1, head2, headSize);
+    if(diff >= 0)
+    {
+        return diff;
+    }
+    if((off_t)headSize == size)
+    {
+        return size;
+    }
+
+    CompareJob job = { .fd1 = fd1, .fd2 = fd2, .size = size, .chunk = chunk };
+    atomic_init(&job.nextChunk, 0);
+    atomic_init(&job.firstDiff, size);
+    atomic_init(&job.error, 0);
+    if(!streaming)
+    {
+        job.map1 = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd1, 0);
+        job.map2 = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd2, 0);
+        if(job.map1 == MAP_FAILED || job.map2 == MAP_FAILED)
+        {
+            // Not enough address space: fall back to streaming
+            if(job.map1 != MAP_FAILED)
+            {
+                munmap((void*)job.map1, size);
+            }
+            if(job.map2 != MAP_FAILED)
+            {
+                munmap((void*)job.map2, size);
+            }
+            job.map1 = job.map2 = NULL;
+        }
+        else
+        {
+            madvise((void*)job.map1, size, MADV_SEQUENTIAL);
+            madvise((void*)job.map2, size, MADV_SEQUENTIAL);
+        }
+    }
+    else
+    {
+        posix_fadvise(fd1, 0, size, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd2, 0, size, POSIX_FADV_SEQUENTIAL);
+    }
+
+    pthread_t th[MAX_THREADS];
+    int i;
+    for(i = 0; i < threadCount ; i++)
+    {
+        if(pthread_create(&th[i], NULL, &compareWorker, &job) != 0)
+        {
+            perror("Failed to Create Thread");
+            threadCount = i;
+            break;
+        }
+    }
+    if(threadCount == 0)
+    {
+        compareWorker(&job);
+    }
+    for(i = 0; i < threadCount ; i++)
+    {
+        pthread_join(th[i], NULL);
+    }
+
+    if(job.map1 != NULL)
+    {
+        munmap((void*)job.map1, size);
+        munmap((void*)job.map2, size);
+    }
+    if(atomic_load(&job.error))
+    {
+        errno = atomic_load(&job.error);
+        return -1;
+    }
+    return atomic_load(&job.firstDiff);
+}
+
+/*
+ * Sequential compare for files whose size is not known up front.
+ * Returns the offset where the files stop matching, -1 on error. *ended tells why:
+ * 0 the bytes differ, 1 or 2 that file ended first, 3 both ended there (equal).
+ */
+static long long compareStreams(int fd1, int fd2, int* ended)
+{
+    uint8_t* buffer1 = malloc(HASH_BUFFER_SIZE);
+    uint8_t* buffer2 = malloc(HASH_BUFFER_SIZE);
+    long long offset = 0;
+    *ended = 0;
+    if(buffer1 == NULL || buffer2 == NULL)
+    {
+        free(buffer1);
+        free(buffer2);
+        errno = ENOMEM;
+        return -1;
+    }
+    while(1)
+    {
+        ssize_t n1 = readUpTo(fd1, buffer1, HASH_BUFFER_SIZE);
+        ssize_t n2 = readUpTo(fd2, buffer2, HASH_BUFFER_SIZE);
+        if(n1 < 0 || n2 < 0)
+        {
+            offset = -1;
+            break;
+        }
+        size_t common = n1 < n2 ? (size_t)n1 : (size_t)n2;
+        long diff = findDifference(buffer1, buffer2, common);
+        if(diff >= 0)
+        {
+            offset += diff;
+            break;
+        }
+        offset += common;
+        if(n1 < HASH_BUFFER_SIZE || n2 < HASH_BUFFER_SIZE)
+        {
+            *ended = (n1 == (ssize_t)common) | (n2 == (ssize_t)common) << 1;
+            break;
+        }
+    }
+    free(buffer1);
+    free(buffer2);
+    return offset;
+}
+
+// Returns 1 and the size when it can be trusted: regular files report it, block devices through an ioctl
+static int knownSize(int fd, const struct stat* st, off_t* size)
+{
+    uint64_t bytes;
+    if(S_ISBLK(st->st_mode) && ioctl(fd, BLKGETSIZE64, &bytes) == 0)
+    {
+        *size = (off_t)bytes;
+        return 1;
+    }
+    // /proc and /sys files are regular files of size 0 whatever they contain
+    *size = st->st_size;
+    return S_ISREG(st->st_mode) && st->st_size > 0;
+}
+
+static int compareFiles(const char* path1, const char* path2, int threadCount, size_t chunk, int streaming, int verbose)
+{
+    struct stat st1, st2;
+    int fd1 = open(path1, O_RDONLY | O_CLOEXEC);
+    int fd2 = open(path2, O_RDONLY | O_CLOEXEC);
+    if(fd1 < 0 || fd2 < 0)
+    {
+        perror("open");
+        return 2;
+    }
+    if(fstat(fd1, &st1) != 0 || fstat(fd2, &st2) != 0)
+    {
+        perror("stat");
+        return 2;
+    }
+    if(st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino)
+    {
+        printf("these files are similar (same file)\n");
+        close(fd1);
+        close(fd2);
+        return 0;
+    }
+    off_t size1, size2;
+    int sized = knownSize(fd1, &st1, &size1) & knownSize(fd2, &st2, &size2);
+    if(sized && size1 != size2)
+    {
+        printf("these files are different: sizes %lld and %lld bytes\n", (long long)size1, (long long)size2);
+        close(fd1);
+        close(fd2);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    int ended = 0;
+    long long diff = sized ? compareContents(fd1, fd2, size1, threadCount, chunk, streaming)
+                           : compareStreams(fd1, fd2, &ended);
+    double seconds = nowSeconds() - start;
+    close(fd1);
+    close(fd2);
+
+    if(diff < 0)
+    {
+        perror("read");
+        return 2;
+    }
+    if(verbose)
+    {
+        double scanned = 2.0 * diff;
+        fprintf(stderr, "%.3f s, %.0f MB/s, %d threads, %zu MB chunks, %s\n", seconds,
+            scanned / (1 << 20) / (seconds > 0 ? seconds : 1e-9), sized ? threadCount : 1, chunk >> 20,
+            !sized ? "read to EOF" : streaming ? "pread" : "mmap");
+    }
+    if(ended == 1 || ended == 2)
+    {
+        printf("these files are different: %s ends at offset %lld\n", ended == 1 ? path1 : path2, diff);
+        return 1;
+    }
+    if(sized ? diff == size1 : ended == 3)
+    {
+        printf("these files are similar\n");
+        return 0;
+    }
+    printf("these files are different: first difference at offset %lld\n", diff);
+    return 1;
+}
+
+static const char* sourceName(HashCacheSource source)
+{
+    switch(source)
+    {
+        case HASHCACHE_HIT: return "cached";
+        case HASHCACHE_PARTIAL: return "partly re-hashed";
+        default: return "hashed";
+    }
+}
+
+static int compareCached(const char* path1, const char* path2, const char* indexPath, int verbose)
+{
+    HashCache* cache = hashCacheOpen(indexPath);
+    if(cache == NULL)
+    {
+        perror(indexPath);
+        return 2;
+    }
+    double start = nowSeconds();
+    FileDigest file1, file2;
+    uint32_t block;
+    if(hashCacheCompare(cache, path1, path2, &file1, &file2, &block) != 0)
+    {
+        perror("hash");
+        hashCacheClose(cache);
+        return 2;
+    }
+    if(verbose)
+    {
+        fprintf(stderr, "%s: %s (%u of %u blocks hashed)\n", path1, sourceName(file1.source), file1.rehashedBlocks, file1.blockCount);
+        fprintf(stderr, "%s: %s (%u of %u blocks hashed)\n", path2, sourceName(file2.source), file2.rehashedBlocks, file2.blockCount);
+    }
+
+    int status = 0;
+    if(file1.size != file2.size)
+    {
+        printf("these files are different: sizes %llu and %llu bytes\n", (unsigned long long)file1.size, (unsigned long long)file2.size);
+        status = 1;
+    }
+    else if(memcmp(file1.digest, file2.digest, SHA256_DIGEST_SIZE) != 0)
+    {
+        // Only the first block whose digests differ has to be read
+        off_t offset = (off_t)block * HASHCACHE_BLOCK_SIZE;
+        size_t size = file1.size - offset < HASHCACHE_BLOCK_SIZE ? (size_t)(file1.size - offset) : HASHCACHE_BLOCK_SIZE;
+        uint8_t* buffer1 = malloc(HASHCACHE_BLOCK_SIZE);
+        uint8_t* buffer2 = malloc(HASHCACHE_BLOCK_SIZE);
+        int fd1 = open(path1, O_RDONLY | O_CLOEXEC);
+        int fd2 = open(path2, O_RDONLY | O_CLOEXEC);
+        long diff = -1;
+        if(fd1 >= 0 && fd2 >= 0 && readFully(fd1, buffer1, size, offset) == 0 && readFully(fd2, buffer2, size, offset) == 0)
+        {
+            diff = findDifference(buffer1, buffer2, size);
+        }
+        if(diff >= 0)
+        {
+            printf("these files are different: first difference at offset %lld\n", (long long)(offset + diff));
+        }
+        else
+        {
+            printf("these files are different\n");
+        }
+        if(fd1 >= 0)
+        {
+            close(fd1);
+        }
+        if(fd2 >= 0)
+        {
+            close(fd2);
+        }
+        free(buffer1);
+        free(buffer2);
+        status = 1;
+    }
+    else
+    {
+        printf("these files are similar\n");
+    }
+    if(verbose)
+    {
+        fprintf(stderr, "%.3f ms\n", (nowSeconds() - start) * 1e3);
+    }
+    hashCacheClose(cache);
+    return status;
+}
+
+static int hashFile(const char* path, const char* expected)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        perror(path);
+        return 2;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint8_t* buffer = malloc(HASH_BUFFER_SIZE);
+    Sha256 ctx;
+    ssize_t n;
+    sha256Init(&ctx);
+    while((n = read(fd, buffer, HASH_BUFFER_SIZE)) > 0)
+    {
+        sha256Update(&ctx, buffer, n);
+    }
+    free(buffer);
+    close(fd);
+    if(n < 0)
+    {
+        perror(path);
+        return 2;
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    sha256Final(&ctx, digest);
+    sha256Hex(digest, hex);
+    printf("%s  %s\n", hex, path);
+    if(expected == NULL)
+    {
+        return 0;
+    }
+    if(strcasecmp(hex, expected) == 0)
+    {
+        printf("these files are similar\n");
+        return 0;
+    }
+    printf("these files are different\n");
+    return 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage FilesCompare [-j threads] [-c chunkMB] [-m] [-v] [-C index] <file1> <file2>\n"
+        "      FilesCompare -H <file> [sha256 of the other file]\n"
+        "  -j  compare threads (default: online CPUs)\n"
+        "  -c  chunk size in MB (default %d)\n"
+        "  -m  stream with pread() instead of mmap()\n"
+        "  -v  print time and throughput\n"
+        "  -C  keep digests in this index file and reuse them for unchanged files\n"
+        "  -H  strong hash (SHA-256) mode, for a file whose twin is on another machine\n",
+        DEFAULT_CHUNK_MB);
+}
+
+int main(int argc, char* argv[])
+{
+    int threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    size_t chunk = (size_t)DEFAULT_CHUNK_MB << 20;
+    int streaming = 0;
+    int verbose = 0;
+    int hashMode = 0;
+    const char* indexPath = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "j:c:mvHC:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'j': threadCount = atoi(optarg); break;
+            case 'c': chunk = (size_t)atol(optarg) << 20; break;
+            case 'm': streaming = 1; break;
+            case 'v': verbose = 1; break;
+            case 'H': hashMode = 1; break;
+            case 'C': indexPath = optarg; break;
+            default: usage(); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if(threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    if(threadCount > MAX_THREADS)
+    {
+        threadCount = MAX_THREADS;
+    }
+    if(chunk == 0)
+    {
+        chunk = 1 << 20;
+    }
+
+    if(hashMode)
+    {
+        if(optind >= argc)
+        {
+            usage();
+            return 2;
+        }
+        return hashFile(argv[optind], optind + 1 < argc ? argv[optind + 1] : NULL);
+    }
+    if(optind + 2 != argc)
+    {
+        usage();
+        return 2;
+    }
+    if(indexPath != NULL)
+    {
+        return compareCached(argv[optind], argv[optind + 1], indexPath, verbose);
+    }
+    return compareFiles(argv[optind], argv[optind + 1], threadCount, chunk, streaming, verbose);
+}
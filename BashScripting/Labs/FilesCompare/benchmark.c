@@ -0,0 +1,364 @@
+/*
+ * benchmark.c - compares of a directory tree through an empty and a filled hash cache
+ *
+ * Builds two identical trees <dir>/a and <dir>/b of random files, then compares
+ * every pair a/x <-> b/x:
+ *   direct       read both files and memcmp() them (no cache)
+ *   empty index  every file is read and hashed (still in the page cache: not a cold read)
+ *   warm         nothing changed: answered from the index
+ *   modified     one byte changed in 10% of the b files: only their changed block is re-hashed
+ *   rewarm       nothing changed since "modified"
+ *   fresh        two new files, the index grows under the second lookup: still block 1
+ *
+ * Usage: ./benchmark [dir] [files] [max file KB]
+ * Build: gcc -O2 -Wall benchmark.c sha256.c hashcache.c -o benchmark
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "hashcache.h"
+
+
+#define FILES_PER_DIR 100
+#define MODIFIED_PERCENT 10
+
+static char rootDir[512];
+static int fileCount;
+static long maxFileKb;
+static uint8_t* buffer1;
+static uint8_t* buffer2;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void filePath(char* path, size_t size, char side, int index)
+{
+    snprintf(path, size, "%s/%c/d%03d/f%05d.bin", rootDir, side, index / FILES_PER_DIR, index);
+}
+
+static uint64_t nextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int writeFile(const char* path, const uint8_t* data, size_t size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0 || write(fd, data, size) != (ssize_t)size)
+    {
+        perror(path);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static long long buildTrees(void)
+{
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    long long total = 0;
+    char path[600];
+    int i;
+
+    for(i = 0; i < fileCount ; i++)
+    {
+        if(i % FILES_PER_DIR == 0)
+        {
+            snprintf(path, sizeof(path), "%s/a/d%03d", rootDir, i / FILES_PER_DIR);
+            mkdir(path, 0755);
+            snprintf(path, sizeof(path), "%s/b/d%03d", rootDir, i / FILES_PER_DIR);
+            mkdir(path, 0755);
+        }
+        // Sizes from 4 KB to maxFileKb, skewed towards small files like a build tree
+        size_t size = 4096 + (nextRandom(&state) % (maxFileKb * 1024)) * (nextRandom(&state) % 4 == 0);
+        size += nextRandom(&state) % 65536;
+        size_t w;
+        for(w = 0; w + 8 <= size ; w += 8)
+        {
+            uint64_t v = nextRandom(&state);
+            memcpy(buffer1 + w, &v, 8);
+        }
+        filePath(path, sizeof(path), 'a', i);
+        if(writeFile(path, buffer1, size) != 0)
+        {
+            exit(1);
+        }
+        filePath(path, sizeof(path), 'b', i);
+        if(writeFile(path, buffer1, size) != 0)
+        {
+            exit(1);
+        }
+        total += size;
+    }
+    return total;
+}
+
+static int readAll(const char* path, uint8_t* buffer, size_t* size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    ssize_t n;
+    *size = 0;
+    while((n = read(fd, buffer + *size, (maxFileKb + 128) * 1024 - *size)) > 0)
+    {
+        *size += n;
+    }
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+typedef struct PhaseResult
+{
+    double seconds;
+    int different;
+    long long blocksHashed;
+    int hits;
+} PhaseResult;
+
+static PhaseResult compareDirect(void)
+{
+    PhaseResult result = { 0 };
+    char path1[600], path2[600];
+    double start = nowSeconds();
+    int i;
+    for(i = 0; i < fileCount ; i++)
+    {
+        size_t size1, size2;
+        filePath(path1, sizeof(path1), 'a', i);
+        filePath(path2, sizeof(path2), 'b', i);
+        if(readAll(path1, buffer1, &size1) != 0 || readAll(path2, buffer2, &size2) != 0)
+        {
+            perror("read");
+            exit(1);
+        }
+        result.different += size1 != size2 || memcmp(buffer1, buffer2, size1) != 0;
+    }
+    result.seconds = nowSeconds() - start;
+    return result;
+}
+
+static PhaseResult compareCached(const char* indexPath)
+{
+    PhaseResult result = { 0 };
+    char path1[600], path2[600];
+    double start = nowSeconds();
+    HashCache* cache = hashCacheOpen(indexPath);
+    if(cache == NULL)
+    {
+        perror(indexPath);
+        exit(1);
+    }
+    int i;
+    for(i = 0; i < fileCount ; i++)
+    {
+        FileDigest file1, file2;
+        filePath(path1, sizeof(path1), 'a', i);
+        filePath(path2, sizeof(path2), 'b', i);
+        if(hashCacheLookup(cache, path1, &file1) != 0 || hashCacheLookup(cache, path2, &file2) != 0)
+        {
+            perror("hash");
+            exit(1);
+        }
+        result.different += file1.size != file2.size || memcmp(file1.digest, file2.digest, SHA256_DIGEST_SIZE) != 0;
+        result.blocksHashed += file1.rehashedBlocks + file2.rehashedBlocks;
+        result.hits += (file1.source == HASHCACHE_HIT) + (file2.source == HASHCACHE_HIT);
+    }
+    hashCacheClose(cache);
+    result.seconds = nowSeconds() - start;
+    return result;
+}
+
+static uint32_t entryOf(HashCache* cache, const char* path)
+{
+    FileDigest file;
+    if(hashCacheLookup(cache, path, &file) != 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    return file.entry;
+}
+
+/*
+ * Two new files that differ only in their second block, compared when the index is one
+ * entry short of growing: the lookup of the second file moves every entry, the first
+ * file's included. The difference must still be found in block 1.
+ */
+static PhaseResult compareFresh(const char* indexPath)
+{
+    PhaseResult result = { 0 };
+    char path1[600], path2[600];
+    uint64_t state = 0x853C49E6748FEA9BULL;
+    size_t size = HASHCACHE_BLOCK_SIZE + 4096;
+    uint8_t* data = malloc(size);
+    size_t w;
+    for(w = 0; w + 8 <= size ; w += 8)
+    {
+        uint64_t v = nextRandom(&state);
+        memcpy(data + w, &v, 8);
+    }
+    snprintf(path1, sizeof(path1), "%s/fresh1.bin", rootDir);
+    snprintf(path2, sizeof(path2), "%s/fresh2.bin", rootDir);
+    if(writeFile(path1, data, size) != 0)
+    {
+        exit(1);
+    }
+    data[HASHCACHE_BLOCK_SIZE + 100] ^= 0xFF;
+    if(writeFile(path2, data, size) != 0)
+    {
+        exit(1);
+    }
+    free(data);
+
+    // Count the inserts until the index grows: the first entry moves
+    char path[600];
+    unlink(indexPath);
+    HashCache* cache = hashCacheOpen(indexPath);
+    filePath(path, sizeof(path), 'a', 0);
+    uint32_t first = entryOf(cache, path);
+    int inserts = 1;
+    while(inserts < fileCount)
+    {
+        filePath(path, sizeof(path), 'a', inserts++);
+        entryOf(cache, path);
+        filePath(path, sizeof(path), 'a', 0);
+        if(entryOf(cache, path) != first)
+        {
+            break;
+        }
+    }
+    hashCacheClose(cache);
+
+    // Again, stopping two inserts short: the fresh pair is the last two
+    unlink(indexPath);
+    cache = hashCacheOpen(indexPath);
+    int i;
+    for(i = 0; i < inserts - 2 ; i++)
+    {
+        filePath(path, sizeof(path), 'a', i);
+        entryOf(cache, path);
+    }
+    double start = nowSeconds();
+    FileDigest file1, file2;
+    uint32_t block;
+    if(hashCacheCompare(cache, path1, path2, &file1, &file2, &block) != 0)
+    {
+        perror("hash");
+        exit(1);
+    }
+    result.seconds = nowSeconds() - start;
+    result.different = block == 1;
+    result.blocksHashed = file1.rehashedBlocks + file2.rehashedBlocks;
+    result.hits = (file1.source == HASHCACHE_HIT) + (file2.source == HASHCACHE_HIT);
+    hashCacheClose(cache);
+    unlink(path1);
+    unlink(path2);
+    return result;
+}
+
+static int modifyFiles(void)
+{
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    char path[600];
+    int modified = 0;
+    int i;
+    for(i = 0; i < fileCount ; i++)
+    {
+        if((int)(nextRandom(&state) % 100) >= MODIFIED_PERCENT)
+        {
+            continue;
+        }
+        filePath(path, sizeof(path), 'b', i);
+        struct stat st;
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if(fd < 0 || fstat(fd, &st) != 0)
+        {
+            perror(path);
+            exit(1);
+        }
+        // Flip one byte so the file really differs
+        off_t offset = nextRandom(&state) % st.st_size;
+        uint8_t c;
+        if(pread(fd, &c, 1, offset) != 1 || (c ^= 0xFF, pwrite(fd, &c, 1, offset)) != 1)
+        {
+            perror(path);
+        }
+        close(fd);
+        modified++;
+    }
+    return modified;
+}
+
+static void printPhase(const char* name, PhaseResult result)
+{
+    printf("%s,%.3f,%.1f,%d,%lld,%d\n", name, result.seconds, result.seconds * 1e6 / fileCount,
+        result.different, result.blocksHashed, result.hits);
+    fflush(stdout);
+}
+
+// Timestamps newer than the cache's racy window are not trusted: let them age first
+static void letTimestampsSettle(void)
+{
+    usleep(200 * 1000);
+}
+
+int main(int argc, char* argv[])
+{
+    snprintf(rootDir, sizeof(rootDir), "%s", argc > 1 ? argv[1] : "/tmp/filescompare_bench");
+    fileCount = argc > 2 ? atoi(argv[2]) : 2000;
+    maxFileKb = argc > 3 ? atol(argv[3]) : 4096;
+    buffer1 = malloc((maxFileKb + 128) * 1024);
+    buffer2 = malloc((maxFileKb + 128) * 1024);
+
+    char path[600];
+    mkdir(rootDir, 0755);
+    snprintf(path, sizeof(path), "%s/a", rootDir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/b", rootDir);
+    mkdir(path, 0755);
+    char indexPath[600];
+    snprintf(indexPath, sizeof(indexPath), "%s/index", rootDir);
+    unlink(indexPath);
+
+    long long total = buildTrees();
+    fprintf(stderr, "%d file pairs, %.1f MB per tree\n", fileCount, total / 1048576.0);
+    letTimestampsSettle();
+
+    printf("phase,seconds,us_per_pair,different,blocks_hashed,cache_hits\n");
+    printPhase("direct", compareDirect());
+    printPhase("empty index", compareCached(indexPath));
+    printPhase("warm", compareCached(indexPath));
+    int modified = modifyFiles();
+    letTimestampsSettle();
+    PhaseResult result = compareCached(indexPath);
+    printPhase("modified", result);
+    printPhase("rewarm", compareCached(indexPath));
+    PhaseResult fresh = compareFresh(indexPath);
+    printPhase("fresh pair", fresh);
+
+    struct stat st;
+    if(stat(indexPath, &st) == 0)
+    {
+        fprintf(stderr, "%d files modified, index %lld KB\n", modified, (long long)st.st_size / 1024);
+    }
+    free(buffer1);
+    free(buffer2);
+    return result.different == modified && fresh.different == 1 ? 0 : 1;
+}
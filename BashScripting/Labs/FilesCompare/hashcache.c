@@ -0,0 +1,573 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/random.h>
+#include "hashcache.h"
+#include "../common/fingerprint.h"
+
+
+#define INDEX_MAGIC 0x31434846u     // "FHC1"
+#define INDEX_VERSION 2
+#define INITIAL_SLOTS 1024          // power of two
+#define MAX_LOAD_PERCENT 70
+#define ENTRY_USED 1u
+#define ENTRY_RACY 2u               // modified too recently to trust the timestamps
+#define RACY_WINDOW_NS 100000000L   // timestamps closer than this to the hashing are racy
+#define LOOKUP_ATTEMPTS 3           // re-reads when the file changes while it is hashed
+
+typedef struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t dirty;             // set before the first change, cleared after msync()
+    uint32_t slotCount;
+    uint32_t used;
+    uint64_t dataEnd;           // end of the block digest area
+    uint64_t garbage;           // bytes of block digests no entry points to anymore
+    uint64_t seed;              // random per index: block fingerprints cannot be collided on purpose
+} IndexHeader;
+
+typedef struct IndexEntry
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtimeNs;
+    int64_t ctimeNs;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint64_t blocksOffset;      // from the start of the index
+    uint32_t blockCount;
+    uint32_t blockCapacity;
+    uint32_t flags;
+    uint32_t reserved;
+} IndexEntry;
+
+struct HashCache
+{
+    int fd;
+    uint8_t* map;
+    size_t mapSize;
+    uint8_t* buffer;            // one block
+};
+
+static IndexHeader* header(HashCache* cache)
+{
+    return (IndexHeader*)cache->map;
+}
+
+static IndexEntry* entryAt(HashCache* cache, uint32_t slot)
+{
+    return (IndexEntry*)(cache->map + sizeof(IndexHeader)) + slot;
+}
+
+static BlockDigest* blocksOf(HashCache* cache, const IndexEntry* entry)
+{
+    return (BlockDigest*)(cache->map + entry->blocksOffset);
+}
+
+static uint64_t tableEnd(uint32_t slotCount)
+{
+    return sizeof(IndexHeader) + (uint64_t)slotCount * sizeof(IndexEntry);
+}
+
+static int64_t timeNs(const struct timespec* ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000L + ts->tv_nsec;
+}
+
+static int keyMatches(const IndexEntry* entry, const struct stat* st)
+{
+    return entry->size == (uint64_t)st->st_size &&
+           entry->mtimeNs == timeNs(&st->st_mtim) &&
+           entry->ctimeNs == timeNs(&st->st_ctim);
+}
+
+static uint64_t rotateLeft(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint32_t slotHash(uint64_t dev, uint64_t ino)
+{
+    uint64_t h = (ino ^ rotateLeft(dev, 32)) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 32);
+}
+
+// Slot of (dev, ino), or the empty slot where it would go
+static uint32_t findSlot(HashCache* cache, uint64_t dev, uint64_t ino)
+{
+    uint32_t mask = header(cache)->slotCount - 1;
+    uint32_t slot = slotHash(dev, ino) & mask;
+    while(1)
+    {
+        IndexEntry* entry = entryAt(cache, slot);
+        if(!(entry->flags & ENTRY_USED) || (entry->dev == dev && entry->ino == ino))
+        {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+static int resizeMap(HashCache* cache, size_t size)
+{
+    if(ftruncate(cache->fd, size) != 0)
+    {
+        return -1;
+    }
+    uint8_t* map;
+    if(cache->map == NULL)
+    {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    }
+    else
+    {
+        map = mremap(cache->map, cache->mapSize, size, MREMAP_MAYMOVE);
+    }
+    if(map == MAP_FAILED)
+    {
+        return -1;
+    }
+    cache->map = map;
+    cache->mapSize = size;
+    return 0;
+}
+
+// Room for `bytes` more block digests. May move the mapping: re-fetch entry pointers after it.
+static int reserveData(HashCache* cache, uint64_t bytes)
+{
+    uint64_t needed = header(cache)->dataEnd + bytes;
+    if(needed <= cache->mapSize)
+    {
+        return 0;
+    }
+    size_t size = cache->mapSize * 2;
+    while(size < needed)
+    {
+        size *= 2;
+    }
+    return resizeMap(cache, size);
+}
+
+static void markDirty(HashCache* cache)
+{
+    if(!header(cache)->dirty)
+    {
+        header(cache)->dirty = 1;
+        // Must reach the disk before any change does
+        msync(cache->map, sizeof(IndexHeader), MS_SYNC);
+    }
+}
+
+// Empty index with `slotCount` slots
+static int resetIndex(HashCache* cache, uint32_t slotCount)
+{
+    uint64_t end = tableEnd(slotCount);
+    if(cache->map != NULL)
+    {
+        munmap(cache->map, cache->mapSize);
+        cache->map = NULL;
+    }
+    if(ftruncate(cache->fd, 0) != 0 || resizeMap(cache, end + 1024 * sizeof(BlockDigest)) != 0)
+    {
+        return -1;
+    }
+    IndexHeader* h = header(cache);
+    h->magic = INDEX_MAGIC;
+    h->version = INDEX_VERSION;
+    h->blockSize = HASHCACHE_BLOCK_SIZE;
+    h->dirty = 1;
+    h->slotCount = slotCount;
+    h->used = 0;
+    h->dataEnd = end;
+    h->garbage = 0;
+    if(getrandom(&h->seed, sizeof(h->seed), 0) != sizeof(h->seed))
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        h->seed = (uint64_t)timeNs(&now) ^ ((uint64_t)getpid() << 32);
+    }
+    return 0;
+}
+
+// Re-inserts every entry into a table of `slotCount` slots and packs the block digests
+static int rebuildIndex(HashCache* cache, uint32_t slotCount)
+{
+    IndexHeader* h = header(cache);
+    uint32_t oldSlots = h->slotCount;
+    uint32_t used = h->used;
+    uint64_t blockBytes = 0;
+    uint32_t i, n = 0;
+
+    // Copy the live entries and their digests out, then lay them out again
+    IndexEntry* entries = malloc(sizeof(IndexEntry) * (used ? used : 1));
+    if(entries == NULL)
+    {
+        return -1;
+    }
+    for(i = 0; i < oldSlots ; i++)
+    {
+        IndexEntry* entry = entryAt(cache, i);
+        if(entry->flags & ENTRY_USED)
+        {
+            entries[n++] = *entry;
+            blockBytes += (uint64_t)entry->blockCount * sizeof(BlockDigest);
+        }
+    }
+    uint8_t* blocks = malloc(blockBytes ? blockBytes : 1);
+    if(blocks == NULL)
+    {
+        free(entries);
+        return -1;
+    }
+    uint64_t offset = 0;
+    for(i = 0; i < n ; i++)
+    {
+        size_t size = (size_t)entries[i].blockCount * sizeof(BlockDigest);
+        memcpy(blocks + offset, cache->map + entries[i].blocksOffset, size);
+        entries[i].blocksOffset = offset;
+        offset += size;
+    }
+
+    markDirty(cache);
+    uint64_t end = tableEnd(slotCount);
+    int result = 0;
+    if(end + blockBytes > cache->mapSize)
+    {
+        size_t size = cache->mapSize;
+        while(size < end + blockBytes)
+        {
+            size *= 2;
+        }
+        result = resizeMap(cache, size);
+    }
+    if(result == 0)
+    {
+        h = header(cache);
+        memset(cache->map + sizeof(IndexHeader), 0, end - sizeof(IndexHeader));
+        h->slotCount = slotCount;
+        h->used = n;
+        h->garbage = 0;
+        memcpy(cache->map + end, blocks, blockBytes);
+        for(i = 0; i < n ; i++)
+        {
+            IndexEntry* entry = entryAt(cache, findSlot(cache, entries[i].dev, entries[i].ino));
+            *entry = entries[i];
+            entry->blocksOffset += end;
+            entry->blockCapacity = entry->blockCount;
+        }
+        h->dataEnd = end + blockBytes;
+    }
+    free(entries);
+    free(blocks);
+    return result;
+}
+
+HashCache* hashCacheOpen(const char* path)
+{
+    HashCache* cache = calloc(1, sizeof(HashCache));
+    cache->buffer = malloc(HASHCACHE_BLOCK_SIZE);
+    cache->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(cache->fd < 0 || flock(cache->fd, LOCK_EX) != 0)
+    {
+        hashCacheClose(cache);
+        return NULL;
+    }
+
+    struct stat st;
+    int valid = 0;
+    if(fstat(cache->fd, &st) == 0 && (size_t)st.st_size >= sizeof(IndexHeader))
+    {
+        cache->map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+        if(cache->map == MAP_FAILED)
+        {
+            cache->map = NULL;
+        }
+        else
+        {
+            cache->mapSize = st.st_size;
+            IndexHeader* h = header(cache);
+            // A dirty index was left by a crash in the middle of an update
+            valid = h->magic == INDEX_MAGIC && h->version == INDEX_VERSION &&
+                    h->blockSize == HASHCACHE_BLOCK_SIZE && !h->dirty &&
+                    h->slotCount >= INITIAL_SLOTS && (h->slotCount & (h->slotCount - 1)) == 0 &&
+                    tableEnd(h->slotCount) <= h->dataEnd && h->dataEnd <= cache->mapSize;
+        }
+    }
+    if(!valid && resetIndex(cache, INITIAL_SLOTS) != 0)
+    {
+        hashCacheClose(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void hashCacheClose(HashCache* cache)
+{
+    if(cache->map != NULL)
+    {
+        IndexHeader* h = header(cache);
+        if(h->dirty)
+        {
+            // Reclaim space left by files that grew or changed block counts
+            if(h->garbage > (h->dataEnd - tableEnd(h->slotCount)) / 2)
+            {
+                rebuildIndex(cache, h->slotCount);
+                h = header(cache);
+            }
+            msync(cache->map, cache->mapSize, MS_SYNC);
+            h->dirty = 0;
+            msync(cache->map, sizeof(IndexHeader), MS_SYNC);
+        }
+        munmap(cache->map, cache->mapSize);
+    }
+    if(cache->fd >= 0)
+    {
+        close(cache->fd);
+    }
+    free(cache->buffer);
+    free(cache);
+}
+
+static int readFully(int fd, uint8_t* buffer, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = read(fd, buffer, size);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            if(n == 0)
+            {
+                errno = EAGAIN;     // file shrank while we read it
+            }
+            return -1;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static void fillResult(HashCache* cache, uint32_t slot, HashCacheSource source, uint32_t rehashed, FileDigest* result)
+{
+    IndexEntry* entry = entryAt(cache, slot);
+    memcpy(result->digest, entry->digest, SHA256_DIGEST_SIZE);
+    result->size = entry->size;
+    result->blockCount = entry->blockCount;
+    result->rehashedBlocks = rehashed;
+    result->source = source;
+    result->entry = slot;
+}
+
+// Reads the file and refreshes its entry. Only blocks whose fingerprint changed go through SHA-256.
+static int rehashFile(HashCache* cache, int fd, const struct stat* st, uint32_t slot, uint32_t* rehashed)
+{
+    IndexEntry* entry = entryAt(cache, slot);
+    uint32_t blockCount = (uint32_t)((st->st_size + HASHCACHE_BLOCK_SIZE - 1) / HASHCACHE_BLOCK_SIZE);
+    uint32_t oldCount = entry->blockCount;
+    uint32_t i;
+
+    // Entry is not valid until the end
+    entry->mtimeNs = -1;
+    if(blockCount > entry->blockCapacity)
+    {
+        uint64_t bytes = (uint64_t)blockCount * sizeof(BlockDigest);
+        if(reserveData(cache, bytes) != 0)
+        {
+            return -1;
+        }
+        IndexHeader* h = header(cache);
+        entry = entryAt(cache, slot);
+        // Keep the old digests: unchanged blocks are still reused
+        memcpy(cache->map + h->dataEnd, blocksOf(cache, entry), (size_t)oldCount * sizeof(BlockDigest));
+        h->garbage += (uint64_t)entry->blockCapacity * sizeof(BlockDigest);
+        entry->blocksOffset = h->dataEnd;
+        entry->blockCapacity = blockCount;
+        h->dataEnd += bytes;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_REALTIME, &start);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if(lseek(fd, 0, SEEK_SET) != 0)
+    {
+        return -1;
+    }
+
+    BlockDigest* blocks = blocksOf(cache, entry);
+    *rehashed = 0;
+    for(i = 0; i < blockCount ; i++)
+    {
+        uint64_t offset = (uint64_t)i * HASHCACHE_BLOCK_SIZE;
+        size_t size = st->st_size - offset < HASHCACHE_BLOCK_SIZE ? (size_t)(st->st_size - offset) : HASHCACHE_BLOCK_SIZE;
+        if(readFully(fd, cache->buffer, size) != 0)
+        {
+            entry->blockCount = i < oldCount ? oldCount : i;
+            return -1;
+        }
+        uint64_t fp = fingerprint(cache->buffer, size, header(cache)->seed);
+        if(i >= oldCount || blocks[i].fingerprint != fp)
+        {
+            sha256(cache->buffer, size, blocks[i].digest);
+            blocks[i].fingerprint = fp;
+            (*rehashed)++;
+        }
+    }
+    entry->blockCount = blockCount;
+
+    // File digest from the block digests
+    uint64_t size = st->st_size;
+    uint8_t sizeBytes[8];
+    Sha256 ctx;
+    for(i = 0; i < 8 ; i++)
+    {
+        sizeBytes[i] = (uint8_t)(size >> (8 * i));
+    }
+    sha256Init(&ctx);
+    sha256Update(&ctx, sizeBytes, sizeof(sizeBytes));
+    for(i = 0; i < blockCount ; i++)
+    {
+        sha256Update(&ctx, blocks[i].digest, SHA256_DIGEST_SIZE);
+    }
+    sha256Final(&ctx, entry->digest);
+
+    /*
+     * A write in the same timestamp tick as our read would leave mtime/ctime
+     * unchanged: trust such an entry only after it has been hashed once more.
+     */
+    int64_t changed = timeNs(&st->st_mtim) > timeNs(&st->st_ctim) ? timeNs(&st->st_mtim) : timeNs(&st->st_ctim);
+    entry->flags = ENTRY_USED | (changed + RACY_WINDOW_NS > timeNs(&start) ? ENTRY_RACY : 0);
+    entry->size = st->st_size;
+    entry->ctimeNs = timeNs(&st->st_ctim);
+    entry->mtimeNs = timeNs(&st->st_mtim);
+    return 0;
+}
+
+int hashCacheLookup(HashCache* cache, const char* path, FileDigest* result)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    uint32_t slot = findSlot(cache, st.st_dev, st.st_ino);
+    IndexEntry* entry = entryAt(cache, slot);
+    if((entry->flags & ENTRY_USED) && !(entry->flags & ENTRY_RACY) && keyMatches(entry, &st))
+    {
+        close(fd);
+        fillResult(cache, slot, HASHCACHE_HIT, 0, result);
+        return 0;
+    }
+
+    markDirty(cache);
+    HashCacheSource source = (entry->flags & ENTRY_USED) ? HASHCACHE_PARTIAL : HASHCACHE_FULL;
+    if(source == HASHCACHE_FULL)
+    {
+        IndexHeader* h = header(cache);
+        if((uint64_t)(h->used + 1) * 100 > (uint64_t)h->slotCount * MAX_LOAD_PERCENT)
+        {
+            if(rebuildIndex(cache, h->slotCount * 2) != 0)
+            {
+                close(fd);
+                return -1;
+            }
+            slot = findSlot(cache, st.st_dev, st.st_ino);
+        }
+        entry = entryAt(cache, slot);
+        memset(entry, 0, sizeof(IndexEntry));
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+        entry->flags = ENTRY_USED;
+        header(cache)->used++;
+    }
+
+    int attempt;
+    uint32_t rehashed = 0;
+    uint32_t totalRehashed = 0;
+    for(attempt = 0; attempt < LOOKUP_ATTEMPTS ; attempt++)
+    {
+        int status = rehashFile(cache, fd, &st, slot, &rehashed);
+        totalRehashed += rehashed;
+        struct stat after;
+        if(fstat(fd, &after) != 0)
+        {
+            break;
+        }
+        // Unchanged while we read it: the entry describes this version of the file
+        if(status == 0 && keyMatches(entryAt(cache, slot), &after))
+        {
+            close(fd);
+            fillResult(cache, slot, source, totalRehashed, result);
+            return 0;
+        }
+        if(status != 0 && errno != EAGAIN)
+        {
+            break;
+        }
+        st = after;
+    }
+    entryAt(cache, slot)->mtimeNs = -1;
+    close(fd);
+    if(attempt == LOOKUP_ATTEMPTS)
+    {
+        errno = EAGAIN;
+    }
+    return -1;
+}
+
+const BlockDigest* hashCacheBlocks(HashCache* cache, const FileDigest* file)
+{
+    return blocksOf(cache, entryAt(cache, file->entry));
+}
+
+int hashCacheCompare(HashCache* cache, const char* path1, const char* path2,
+                     FileDigest* file1, FileDigest* file2, uint32_t* firstBlock)
+{
+    if(hashCacheLookup(cache, path1, file1) != 0)
+    {
+        return -1;
+    }
+    // The second lookup can grow the index and move file1's entry: keep a copy of its blocks
+    BlockDigest* blocks1 = malloc((file1->blockCount + 1) * sizeof(BlockDigest));
+    if(blocks1 == NULL)
+    {
+        return -1;
+    }
+    memcpy(blocks1, hashCacheBlocks(cache, file1), file1->blockCount * sizeof(BlockDigest));
+    if(hashCacheLookup(cache, path2, file2) != 0)
+    {
+        free(blocks1);
+        return -1;
+    }
+    const BlockDigest* blocks2 = hashCacheBlocks(cache, file2);
+    uint32_t count = file1->blockCount < file2->blockCount ? file1->blockCount : file2->blockCount;
+    uint32_t block = 0;
+    while(block < count && memcmp(blocks1[block].digest, blocks2[block].digest, SHA256_DIGEST_SIZE) == 0)
+    {
+        block++;
+    }
+    free(blocks1);
+    *firstBlock = block;
+    return 0;
+}
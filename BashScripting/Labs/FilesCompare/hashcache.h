@@ -0,0 +1,71 @@
+#ifndef HASHCACHE_H
+#define HASHCACHE_H
+
+#include <stdint.h>
+#include "sha256.h"
+
+/*
+ * Persistent content-hash cache for FilesCompare.
+ *
+ * Files are keyed by (device, inode, size, mtime_ns, ctime_ns). The index is
+ * one file mmap()ed by the tool: an open-addressing table of entries followed
+ * by the per-block digests of every entry.
+ *
+ *   - Key unchanged  -> the stored digest is returned, the file is not read.
+ *   - Key changed    -> the file is read again, but a block is only re-hashed
+ *                       with SHA-256 when its 64-bit fingerprint changed.
+ *
+ * The file digest is SHA-256(size || block digests), so it can be rebuilt from
+ * the block digests alone. It is NOT the sha256sum of the file: use it only to
+ * compare files hashed with the same block size.
+ *
+ * The index is a cache: a missing, foreign or half-written index is thrown
+ * away and rebuilt. One process uses an index at a time (flock()).
+ */
+
+#define HASHCACHE_BLOCK_SIZE (1024 * 1024)
+
+typedef enum HashCacheSource
+{
+    HASHCACHE_HIT,          // key matched, nothing was read
+    HASHCACHE_PARTIAL,      // file read, only changed blocks re-hashed
+    HASHCACHE_FULL,         // file was not in the cache
+} HashCacheSource;
+
+typedef struct BlockDigest
+{
+    uint64_t fingerprint;   // cheap change detector
+    uint8_t digest[SHA256_DIGEST_SIZE];
+} BlockDigest;
+
+typedef struct FileDigest
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint64_t size;
+    uint32_t blockCount;
+    uint32_t rehashedBlocks;    // blocks that went through SHA-256 in this lookup
+    HashCacheSource source;
+    uint32_t entry;             // for hashCacheBlocks()
+} FileDigest;
+
+typedef struct HashCache HashCache;
+
+// Opens or creates the index at `path`. Returns NULL with errno set on failure.
+HashCache* hashCacheOpen(const char* path);
+
+// Flushes the index and releases it
+void hashCacheClose(HashCache* cache);
+
+// Digest of the file at `path`, from the cache when it is unchanged. 0 or -1 with errno set.
+int hashCacheLookup(HashCache* cache, const char* path, FileDigest* result);
+
+// Block digests of a looked-up file. Valid until the next hashCacheLookup(), and so is
+// `file->entry`: a lookup can grow the index and move the entries.
+const BlockDigest* hashCacheBlocks(HashCache* cache, const FileDigest* file);
+
+// Looks up both files and finds the first block whose digests differ (the shorter block
+// count when none does). 0 or -1 with errno set.
+int hashCacheCompare(HashCache* cache, const char* path1, const char* path2,
+                     FileDigest* file1, FileDigest* file2, uint32_t* firstBlock);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Self-contained SHA-256 (FIPS 180-4), so the tools build without OpenSSL on the board
+
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct Sha256
+{
+    uint32_t state[8];
+    uint64_t length;            // bytes hashed so far
+    uint8_t block[64];
+    size_t blockUsed;
+} Sha256;
+
+void sha256Init(Sha256* ctx);
+void sha256Update(Sha256* ctx, const void* data, size_t size);
+void sha256Final(Sha256* ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// One-shot helper
+void sha256(const void* data, size_t size, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// 64 hex characters + '\0'
+void sha256Hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[2 * SHA256_DIGEST_SIZE + 1]);
+
+#endif
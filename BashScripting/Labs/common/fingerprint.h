@@ -0,0 +1,52 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Fast 64-bit fingerprint (xxHash64-style: four independent lanes, several
+ * GB/s), shared by the FilesCompare hash cache and the EraseFlash_img
+ * readback check.
+ *
+ * It only spots changes: it is not cryptographic, and with a fixed seed
+ * anyone can build two blocks with the same fingerprint. Callers that keep
+ * fingerprints on disk pick a random seed for them.
+ */
+
+static inline uint64_t fingerprintRotate(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static inline uint64_t fingerprint(const uint8_t* data, size_t size, uint64_t seed)
+{
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lane[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+    size_t i = 0;
+    int l;
+
+    for(; i + 32 <= size ; i += 32)
+    {
+        for(l = 0; l < 4 ; l++)
+        {
+            uint64_t v;
+            memcpy(&v, data + i + 8 * l, 8);
+            lane[l] = fingerprintRotate(lane[l] + v * prime2, 31) * prime1;
+        }
+    }
+    uint64_t h = fingerprintRotate(lane[0], 1) + fingerprintRotate(lane[1], 7) +
+                 fingerprintRotate(lane[2], 12) + fingerprintRotate(lane[3], 18);
+    h += size;
+    for(; i < size ; i++)
+    {
+        h = fingerprintRotate(h ^ (data[i] * prime1), 11) * prime2;
+    }
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    return h;
+}
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * benchmark.c - copy engine backends: file size x page cache x file system
+ *
+ * For every size the source is created in `dir`, then copied by each backend
+ * to `dir` (same file system) and to `other` (default /dev/shm, a different
+ * one: copy_file_range gets EXDEV there and falls back). "cold" drops the
+ * source from the page cache (fdatasync + POSIX_FADV_DONTNEED) before each
+ * run, "hot" reads it from memory. The time includes open, copy and close,
+ * as a cp would see it; the destination is removed between runs.
+ *
+ * Usage: ./benchmark [-d dir] [-o other] [-r runs] [-s size,...]
+ *        ./benchmark -d /tmp -s 4k,1m,256m
+ *
+ * Build: gcc -O2 -Wall benchmark.c copyengine.c -o benchmark
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "copyengine.h"
+
+
+#define MAX_SIZES 8
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long parseSize(const char* text, char** end)
+{
+    double value = strtod(text, end);
+    switch(**end)
+    {
+        case 'k': case 'K': value *= 1 << 10; (*end)++; break;
+        case 'm': case 'M': value *= 1 << 20; (*end)++; break;
+        case 'g': case 'G': value *= 1 << 30; (*end)++; break;
+    }
+    return value;
+}
+
+static int createSource(const char* path, long long size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    // Pseudo random, so no file system can compress or dedupe it
+    static unsigned long long block[1 << 14];
+    unsigned long long x = 0x9E3779B97F4A7C15ULL;
+    for(long long done = 0; done < size; )
+    {
+        for(size_t i = 0; i < sizeof(block) / sizeof(block[0]); i++)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            block[i] = x;
+        }
+        size_t length = size - done < (long long)sizeof(block) ? (size_t)(size - done) : sizeof(block);
+        if(write(fd, block, length) != (ssize_t)length)
+        {
+            close(fd);
+            return -1;
+        }
+        done += length;
+    }
+    fdatasync(fd);
+    close(fd);
+    return 0;
+}
+
+static void dropCache(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd >= 0)
+    {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+// Best of `runs`, in MB/s; -1 on error
+static double measure(const char* source, const char* destination, CopyBackend backend, int cold, int runs,
+                      long long size, CopyStats* stats)
+{
+    CopyOptions options = { backend, 0, 0, 0 };
+    double best = 1e30;
+    for(int i = 0; i < runs; i++)
+    {
+        unlink(destination);
+        if(cold)
+        {
+            dropCache(source);
+        }
+        else
+        {
+            // Warm up the page cache (and the destination file system) once
+            copyFile(source, destination, &options, stats);
+            unlink(destination);
+        }
+        double start = nowSeconds();
+        int result = copyFile(source, destination, &options, stats);
+        double seconds = nowSeconds() - start;
+        if(result != 0 || stats->bytes != size)
+        {
+            fprintf(stderr, "benchmark: %s -> %s with %s: %s\n", source, destination, copyBackendName(backend),
+                    result != 0 ? strerror(errno) : "short copy");
+            return -1;
+        }
+        best = seconds < best ? seconds : best;
+    }
+    unlink(destination);
+    return size / 1e6 / best;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage benchmark [-d dir] [-o other] [-r runs] [-s size,...]\n"
+        "  -d  directory of the source and the same-file-system copies (default .)\n"
+        "  -o  directory on another file system (default /dev/shm)\n"
+        "  -r  runs per cell, the best one counts (default 5)\n"
+        "  -s  file sizes (default 4k,1m,256m)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* dir = ".";
+    const char* other = "/dev/shm";
+    const char* sizeList = "4k,1m,256m";
+    int runs = 5;
+    int opt;
+
+    while((opt = getopt(argc, argv, "d:o:r:s:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'd': dir = optarg; break;
+            case 'o': other = optarg; break;
+            case 'r': runs = atoi(optarg); break;
+            case 's': sizeList = optarg; break;
+            default: usage(); return opt == 'h' ? 0 : 2;
+        }
+    }
+    long long sizes[MAX_SIZES];
+    int sizeCount = 0;
+    for(char* p = (char*)sizeList; *p && sizeCount < MAX_SIZES; )
+    {
+        sizes[sizeCount++] = parseSize(p, &p);
+        p += *p == ',';
+    }
+    if(sizeCount == 0 || runs < 1)
+    {
+        usage();
+        return 2;
+    }
+
+    char source[4096];
+    char destinations[2][4096];
+    snprintf(source, sizeof(source), "%s/copybench.src", dir);
+    snprintf(destinations[0], sizeof(destinations[0]), "%s/copybench.dst", dir);
+    snprintf(destinations[1], sizeof(destinations[1]), "%s/copybench.dst", other);
+
+    printf("MB/s, best of %d (open + copy + close)\n", runs);
+    printf("%-6s %-4s %-5s", "size", "fs", "cache");
+    for(int b = COPY_AUTO; b < COPY_BACKEND_COUNT; b++)
+    {
+        printf(" %15s", copyBackendName(b));
+    }
+    printf("\n");
+
+    for(int s = 0; s < sizeCount; s++)
+    {
+        if(createSource(source, sizes[s]) != 0)
+        {
+            perror(source);
+            return 1;
+        }
+        char sizeText[24];
+        if(sizes[s] >= 1 << 20)
+        {
+            snprintf(sizeText, sizeof(sizeText), "%lldM", sizes[s] >> 20);
+        }
+        else
+        {
+            snprintf(sizeText, sizeof(sizeText), "%lldK", sizes[s] >> 10);
+        }
+        // Big files: fewer runs, each one is long enough to be stable
+        int sizeRuns = sizes[s] >= 64 << 20 && runs > 3 ? 3 : runs;
+        for(int fs = 0; fs < 2; fs++)
+        {
+            for(int cold = 1; cold >= 0; cold--)
+            {
+                printf("%-6s %-4s %-5s", sizeText, fs ? "diff" : "same", cold ? "cold" : "hot");
+                char chosen[32] = "";
+                for(int b = COPY_AUTO; b < COPY_BACKEND_COUNT; b++)
+                {
+                    CopyStats stats;
+                    double rate = measure(source, destinations[fs], b, cold, sizeRuns, sizes[s], &stats);
+                    printf(" %15.0f", rate);
+                    fflush(stdout);
+                    if(b == COPY_AUTO)
+                    {
+                        snprintf(chosen, sizeof(chosen), "%s", copyBackendName(stats.backend));
+                    }
+                }
+                printf("   auto = %s\n", chosen);
+            }
+        }
+    }
+    unlink(source);
+    return 0;
+}
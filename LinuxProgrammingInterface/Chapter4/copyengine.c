@@ -0,0 +1,794 @@
+/*
+ * copyengine.c - interchangeable copy backends with fallback (see copyengine.h)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <linux/magic.h>
+#include "copyengine.h"
+
+
+#define CHUNK_MAX (1L << 30)        // per copy_file_range / sendfile / splice call
+#define MMAP_WINDOW (64L << 20)     // bytes mapped at a time
+#define UNSUPPORTED (-2)            // backend cannot handle this pair: try the next one
+
+static const char* const names[COPY_BACKEND_COUNT] =
+{
+    "auto", "readwrite", "copy_file_range", "sendfile", "splice", "mmap", "io_uring",
+};
+
+typedef struct Copy
+{
+    int in;
+    int out;
+    struct stat inStat;
+    struct stat outStat;
+    size_t bufferSize;
+    int queueDepth;
+    long long bytes;                // copied so far, by all backends
+} Copy;
+
+const char* copyBackendName(CopyBackend backend)
+{
+    return backend < COPY_BACKEND_COUNT ? names[backend] : "?";
+}
+
+CopyBackend copyBackendFromName(const char* name)
+{
+    for(int i = 0; i < COPY_BACKEND_COUNT; i++)
+    {
+        if(strcmp(names[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return COPY_BACKEND_COUNT;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Errors meaning "not for these files / this kernel" rather than an I/O failure
+static int isUnsupported(int error)
+{
+    return error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOSYS;
+}
+
+static int fail(void)
+{
+    return isUnsupported(errno) ? UNSUPPORTED : -1;
+}
+
+// procfs, sysfs and the like report a size of 0 or 4096 whatever they hold:
+// only backends that read until EOF can copy them
+static int sizeIsKnown(const Copy* copy)
+{
+    struct statfs fs;
+    if(!S_ISREG(copy->inStat.st_mode) || copy->inStat.st_size == 0 || fstatfs(copy->in, &fs) != 0)
+    {
+        return 0;
+    }
+    switch(fs.f_type)
+    {
+        case PROC_SUPER_MAGIC:
+        case SYSFS_MAGIC:
+        case DEBUGFS_MAGIC:
+        case TRACEFS_MAGIC:
+        case SECURITYFS_MAGIC:
+        case CGROUP_SUPER_MAGIC:
+        case CGROUP2_SUPER_MAGIC:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static int writeAll(int fd, const char* data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t n = write(fd, data, length);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// ---- read() / write() -------------------------------------------------------
+
+static int copyReadWrite(Copy* copy)
+{
+    char* buffer;
+    if(posix_memalign((void**)&buffer, 4096, copy->bufferSize) != 0)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    posix_fadvise(copy->in, 0, 0, POSIX_FADV_SEQUENTIAL);
+    int result = 0;
+    while(1)
+    {
+        ssize_t n = read(copy->in, buffer, copy->bufferSize);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            result = n;
+            break;
+        }
+        if(writeAll(copy->out, buffer, n) != 0)
+        {
+            result = -1;
+            break;
+        }
+        copy->bytes += n;
+    }
+    free(buffer);
+    return result;
+}
+
+// ---- copy_file_range() / sendfile() -------------------------------------------
+
+static int copyFileRange(Copy* copy)
+{
+    while(1)
+    {
+        ssize_t n = copy_file_range(copy->in, NULL, copy->out, NULL, CHUNK_MAX, 0);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return fail();
+        }
+        if(n == 0)
+        {
+            // Files like /proc/* report 0 although they have data
+            if(copy->bytes == 0 && S_ISREG(copy->inStat.st_mode) && copy->inStat.st_size == 0)
+            {
+                errno = EINVAL;
+                return UNSUPPORTED;
+            }
+            return 0;
+        }
+        copy->bytes += n;
+    }
+}
+
+static int copySendfile(Copy* copy)
+{
+    while(1)
+    {
+        ssize_t n = sendfile(copy->out, copy->in, NULL, CHUNK_MAX);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return fail();
+        }
+        if(n == 0)
+        {
+            return 0;
+        }
+        copy->bytes += n;
+    }
+}
+
+// ---- splice() -------------------------------------------------------------------
+
+static ssize_t spliceAll(int in, int out, size_t length, int untilEnd)
+{
+    size_t moved = 0;
+    while(moved < length)
+    {
+        ssize_t n = splice(in, NULL, out, NULL, length - moved, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return -1;
+        }
+        if(n == 0 || !untilEnd)
+        {
+            return moved + n;
+        }
+        moved += n;
+    }
+    return moved;
+}
+
+static int copySplice(Copy* copy)
+{
+    // One side already a pipe: no intermediate pipe needed
+    if(S_ISFIFO(copy->inStat.st_mode) || S_ISFIFO(copy->outStat.st_mode))
+    {
+        while(1)
+        {
+            ssize_t n = spliceAll(copy->in, copy->out, CHUNK_MAX, 0);
+            if(n < 0)
+            {
+                return fail();
+            }
+            if(n == 0)
+            {
+                return 0;
+            }
+            copy->bytes += n;
+        }
+    }
+
+    int pipeFds[2];
+    if(pipe2(pipeFds, O_CLOEXEC) != 0)
+    {
+        return -1;
+    }
+    // A bigger pipe moves more pages per call (up to /proc/sys/fs/pipe-max-size)
+    long pipeSize = fcntl(pipeFds[1], F_SETPIPE_SZ, (int)copy->bufferSize);
+    if(pipeSize < 0)
+    {
+        pipeSize = fcntl(pipeFds[1], F_GETPIPE_SZ);
+    }
+    int result = 0;
+    while(1)
+    {
+        ssize_t n = spliceAll(copy->in, pipeFds[1], pipeSize, 0);
+        if(n <= 0)
+        {
+            result = n < 0 ? fail() : 0;
+            break;
+        }
+        if(spliceAll(pipeFds[0], copy->out, n, 1) != n)
+        {
+            // The pipe still holds data taken from `in`: no fallback possible from here
+            result = -1;
+            break;
+        }
+        copy->bytes += n;
+    }
+    int error = errno;
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    errno = error;
+    return result;
+}
+
+// ---- mmap() + memcpy() ------------------------------------------------------------
+
+static int copyMmap(Copy* copy)
+{
+    if(!sizeIsKnown(copy))
+    {
+        errno = EINVAL;
+        return UNSUPPORTED;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    off_t inStart = lseek(copy->in, 0, SEEK_CUR);
+    off_t outStart = lseek(copy->out, 0, SEEK_CUR);
+    off_t size = copy->inStat.st_size - inStart;
+    // A shared writable mapping needs O_RDWR; otherwise the mapped source is written out with write()
+    int mapOut = S_ISREG(copy->outStat.st_mode) && (fcntl(copy->out, F_GETFL) & O_ACCMODE) == O_RDWR;
+    if(inStart < 0 || size <= 0)
+    {
+        return 0;
+    }
+    if(mapOut && (outStart < 0 || ftruncate(copy->out, outStart + size) != 0))
+    {
+        return -1;
+    }
+
+    for(off_t done = 0; done < size; )
+    {
+        size_t length = size - done < MMAP_WINDOW ? size - done : MMAP_WINDOW;
+        // mmap offsets must be page aligned: map from the page start, copy from inside it
+        off_t inOffset = inStart + done;
+        size_t inSkew = inOffset % page;
+        char* source = mmap(NULL, length + inSkew, PROT_READ, MAP_SHARED, copy->in, inOffset - inSkew);
+        if(source == MAP_FAILED)
+        {
+            return copy->bytes == 0 ? fail() : -1;
+        }
+        madvise(source, length + inSkew, MADV_SEQUENTIAL | MADV_WILLNEED);
+        int result = 0;
+        if(mapOut)
+        {
+            off_t outOffset = outStart + done;
+            size_t outSkew = outOffset % page;
+            char* destination = mmap(NULL, length + outSkew, PROT_WRITE, MAP_SHARED, copy->out, outOffset - outSkew);
+            if(destination == MAP_FAILED)
+            {
+                result = -1;
+            }
+            else
+            {
+                memcpy(destination + outSkew, source + inSkew, length);
+                munmap(destination, length + outSkew);
+            }
+        }
+        else
+        {
+            result = writeAll(copy->out, source + inSkew, length);
+        }
+        munmap(source, length + inSkew);
+        if(result != 0)
+        {
+            return -1;
+        }
+        done += length;
+        copy->bytes += length;
+    }
+    lseek(copy->in, inStart + size, SEEK_SET);
+    if(mapOut)
+    {
+        lseek(copy->out, outStart + size, SEEK_SET);
+    }
+    return 0;
+}
+
+// ---- io_uring ------------------------------------------------------------------
+// Raw system calls (no liburing): a submission ring of linked read -> write
+// pairs, one registered buffer per pair, `queueDepth` pairs in flight.
+
+typedef struct Ring
+{
+    int fd;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_sqe* sqes;
+    void* sqMap;
+    size_t sqMapSize;
+    void* cqMap;
+    size_t cqMapSize;
+    size_t sqesSize;
+    unsigned entries;
+    unsigned queued;                // SQEs filled but not yet submitted
+} Ring;
+
+static int ringSetup(Ring* ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0)
+    {
+        return -1;
+    }
+    ring->entries = params.sq_entries;
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single)
+    {
+        ring->sqMapSize = ring->cqMapSize = ring->sqMapSize > ring->cqMapSize ? ring->sqMapSize : ring->cqMapSize;
+    }
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqMap = single ? ring->sqMap :
+                  mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        close(ring->fd);
+        return -1;
+    }
+    char* sq = ring->sqMap;
+    char* cq = ring->cqMap;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ringClose(Ring* ring)
+{
+    munmap(ring->sqes, ring->sqesSize);
+    if(ring->cqMap != ring->sqMap)
+    {
+        munmap(ring->cqMap, ring->cqMapSize);
+    }
+    munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+}
+
+static struct io_uring_sqe* ringNext(Ring* ring)
+{
+    unsigned tail = *ring->sqTail + ring->queued;
+    if(tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->entries)
+    {
+        return NULL;
+    }
+    unsigned index = tail & *ring->sqMask;
+    ring->sqArray[index] = index;
+    ring->queued++;
+    memset(&ring->sqes[index], 0, sizeof(struct io_uring_sqe));
+    return &ring->sqes[index];
+}
+
+// Submits the queued SQEs and waits for at least `wait` completions
+static int ringEnter(Ring* ring, unsigned wait)
+{
+    __atomic_store_n(ring->sqTail, *ring->sqTail + ring->queued, __ATOMIC_RELEASE);
+    unsigned submit = ring->queued;
+    ring->queued = 0;
+    while(1)
+    {
+        long n = syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if(n >= 0 || errno != EINTR)
+        {
+            return n < 0 ? -1 : 0;
+        }
+        submit = 0;
+    }
+}
+
+// Finishes a chunk the ring could not (short read, short write, cancelled link) with pread / pwrite.
+// Returns the bytes of the chunk now written, or -1.
+static ssize_t finishChunk(Copy* copy, char* buffer, off_t inOffset, off_t outOffset, size_t length, size_t written)
+{
+    while(written < length)
+    {
+        ssize_t n = pread(copy->in, buffer + written, length - written, inOffset + written);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            // The source shrank while it was copied
+            return n < 0 ? -1 : (ssize_t)written;
+        }
+        size_t done = 0;
+        while(done < (size_t)n)
+        {
+            ssize_t w = pwrite(copy->out, buffer + written + done, n - done, outOffset + written + done);
+            if(w < 0 && errno != EINTR)
+            {
+                return -1;
+            }
+            done += w > 0 ? w : 0;
+        }
+        written += n;
+    }
+    return written;
+}
+
+static int copyIoUring(Copy* copy)
+{
+    // Offsets are needed on both sides, and the chunks are cut from the source's size
+    if(!sizeIsKnown(copy) || !(S_ISREG(copy->outStat.st_mode) || S_ISBLK(copy->outStat.st_mode)))
+    {
+        errno = EINVAL;
+        return UNSUPPORTED;
+    }
+    off_t inStart = lseek(copy->in, 0, SEEK_CUR);
+    off_t outStart = lseek(copy->out, 0, SEEK_CUR);
+    off_t size = copy->inStat.st_size - inStart;
+    if(inStart < 0 || outStart < 0)
+    {
+        return -1;
+    }
+    if(size <= 0)
+    {
+        return 0;
+    }
+
+    // Small files: no more buffers (pinned memory) than the file needs
+    size_t bufferSize = copy->bufferSize;
+    if((off_t)bufferSize > size)
+    {
+        bufferSize = (size + 4095) & ~4095L;
+    }
+    off_t chunks = (size + (off_t)bufferSize - 1) / (off_t)bufferSize;
+    int depth = chunks < copy->queueDepth ? (int)chunks : copy->queueDepth;
+    Ring ring;
+    if(ringSetup(&ring, 2 * depth) != 0)
+    {
+        // ENOSYS: no io_uring, EPERM: disabled by kernel.io_uring_disabled / seccomp
+        if(errno == EPERM)
+        {
+            errno = EOPNOTSUPP;
+        }
+        return fail();
+    }
+
+    char* memory;
+    if(posix_memalign((void**)&memory, 4096, bufferSize * depth) != 0)
+    {
+        ringClose(&ring);
+        errno = ENOMEM;
+        return -1;
+    }
+    struct iovec* iovecs = calloc(depth, sizeof(*iovecs));
+    off_t* chunkOffset = calloc(depth, sizeof(*chunkOffset));
+    size_t* chunkLength = calloc(depth, sizeof(*chunkLength));
+    int* freeSlots = calloc(depth, sizeof(*freeSlots));
+    int freeCount = depth;
+    for(int i = 0; i < depth; i++)
+    {
+        iovecs[i].iov_base = memory + i * bufferSize;
+        iovecs[i].iov_len = bufferSize;
+        freeSlots[i] = depth - 1 - i;
+    }
+    // Registered buffers are pinned once instead of on every request; plain read / write when the
+    // memlock limit does not allow it
+    int fixed = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iovecs, depth) == 0;
+
+    off_t queued = 0;
+    off_t completed = 0;
+    off_t copied = 0;                   // what the completions report, not what was queued
+    int result = 0;
+    int unsupported = 0;
+    // After an error or EOPNOTSUPP nothing new is queued, but the pairs in flight still own their buffers
+    while(freeCount < depth || (completed < size && result == 0 && !unsupported))
+    {
+        while(freeCount > 0 && queued < size && result == 0 && !unsupported)
+        {
+            int slot = freeSlots[--freeCount];
+            size_t length = size - queued < (off_t)bufferSize ? (size_t)(size - queued) : bufferSize;
+            struct io_uring_sqe* read = ringNext(&ring);
+            struct io_uring_sqe* write = ringNext(&ring);
+            read->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            read->fd = copy->in;
+            read->addr = (unsigned long)iovecs[slot].iov_base;
+            read->len = length;
+            read->off = inStart + queued;
+            read->buf_index = slot;
+            read->flags = IOSQE_IO_LINK;        // the write starts when the read completed in full
+            read->user_data = slot * 2;
+            write->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            write->fd = copy->out;
+            write->addr = read->addr;
+            write->len = length;
+            write->off = outStart + queued;
+            write->buf_index = slot;
+            write->user_data = slot * 2 + 1;
+            chunkOffset[slot] = queued;
+            chunkLength[slot] = length;
+            queued += length;
+        }
+        if(ringEnter(&ring, 1) != 0)
+        {
+            result = -1;
+            break;
+        }
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++)
+        {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            int slot = cqe->user_data / 2;
+            if(cqe->user_data % 2 == 0)
+            {
+                // e.g. a file that cannot be read asynchronously; the linked write reports the pair otherwise
+                if(cqe->res < 0 && isUnsupported(-cqe->res) && completed == 0)
+                {
+                    unsupported = -cqe->res;
+                }
+                continue;
+            }
+            freeSlots[freeCount++] = slot;
+            if(result != 0 || unsupported)
+            {
+                continue;
+            }
+            if(cqe->res < 0 && cqe->res != -ECANCELED)
+            {
+                errno = -cqe->res;
+                result = -1;
+                continue;
+            }
+            // Cancelled (short read) or short write: finish the chunk synchronously
+            ssize_t written = cqe->res > 0 ? cqe->res : 0;
+            if((size_t)written < chunkLength[slot])
+            {
+                written = finishChunk(copy, iovecs[slot].iov_base, inStart + chunkOffset[slot],
+                                      outStart + chunkOffset[slot], chunkLength[slot], written);
+                if(written < 0)
+                {
+                    result = -1;
+                    continue;
+                }
+            }
+            completed += chunkLength[slot];
+            copied += written;
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+    if(unsupported && result == 0)
+    {
+        // Nothing moved the offsets: the fallback starts over from inStart / outStart
+        errno = unsupported;
+        result = UNSUPPORTED;
+    }
+    int error = errno;
+    ringClose(&ring);
+    free(memory);
+    free(iovecs);
+    free(chunkOffset);
+    free(chunkLength);
+    free(freeSlots);
+    errno = error;
+    if(result == 0)
+    {
+        lseek(copy->in, inStart + copied, SEEK_SET);
+        lseek(copy->out, outStart + copied, SEEK_SET);
+        copy->bytes += copied;
+    }
+    return result;
+}
+
+// ---- Selection -------------------------------------------------------------------
+
+CopyBackend copyChooseBackend(int in, int out)
+{
+    struct stat inStat, outStat;
+    if(fstat(in, &inStat) != 0 || fstat(out, &outStat) != 0)
+    {
+        return COPY_READ_WRITE;
+    }
+    if(S_ISREG(inStat.st_mode) && S_ISREG(outStat.st_mode) && inStat.st_dev == outStat.st_dev)
+    {
+        // In the kernel, and a reflink / server side copy where the file system supports it.
+        // Across file systems it is EXDEV on local ones: sendfile straight away.
+        return COPY_FILE_RANGE;
+    }
+    if(S_ISREG(inStat.st_mode) || S_ISBLK(inStat.st_mode))
+    {
+        return COPY_SENDFILE;
+    }
+    if(S_ISFIFO(inStat.st_mode) || S_ISFIFO(outStat.st_mode))
+    {
+        return COPY_SPLICE;
+    }
+    return COPY_READ_WRITE;
+}
+
+// Where to continue when `backend` gave up
+static CopyBackend fallbackOf(CopyBackend backend, const Copy* copy)
+{
+    switch(backend)
+    {
+        case COPY_FILE_RANGE:
+            return S_ISREG(copy->inStat.st_mode) ? COPY_SENDFILE : COPY_SPLICE;
+        case COPY_SENDFILE:
+            return COPY_SPLICE;
+        case COPY_READ_WRITE:
+            return COPY_BACKEND_COUNT;
+        default:
+            return COPY_READ_WRITE;
+    }
+}
+
+int copyFd(int in, int out, const CopyOptions* options, CopyStats* stats)
+{
+    Copy copy;
+    memset(&copy, 0, sizeof(copy));
+    memset(stats, 0, sizeof(*stats));
+    copy.in = in;
+    copy.out = out;
+    copy.bufferSize = options->bufferSize > 0 ? options->bufferSize : COPY_DEFAULT_BUFFER;
+    copy.queueDepth = options->queueDepth > 0 ? options->queueDepth : COPY_DEFAULT_QUEUE_DEPTH;
+    if(fstat(in, &copy.inStat) != 0 || fstat(out, &copy.outStat) != 0)
+    {
+        return -1;
+    }
+
+    CopyBackend backend = options->backend == COPY_AUTO ? copyChooseBackend(in, out) : options->backend;
+    stats->first = backend;
+    double start = nowSeconds();
+    int result;
+    while(1)
+    {
+        switch(backend)
+        {
+            case COPY_FILE_RANGE: result = copyFileRange(&copy); break;
+            case COPY_SENDFILE: result = copySendfile(&copy); break;
+            case COPY_SPLICE: result = copySplice(&copy); break;
+            case COPY_MMAP: result = copyMmap(&copy); break;
+            case COPY_IO_URING: result = copyIoUring(&copy); break;
+            default: result = copyReadWrite(&copy); break;
+        }
+        if(result != UNSUPPORTED)
+        {
+            break;
+        }
+        stats->fallbacks++;
+        stats->fallbackError = errno;
+        backend = fallbackOf(backend, &copy);
+    }
+    if(result == 0 && options->sync && fdatasync(out) != 0 && errno != EINVAL)
+    {
+        result = -1;                // EINVAL: pipes and terminals cannot be synced
+    }
+    stats->backend = backend;
+    stats->bytes = copy.bytes;
+    stats->seconds = nowSeconds() - start;
+    return result;
+}
+
+int copyFile(const char* source, const char* destination, const CopyOptions* options, CopyStats* stats)
+{
+    struct stat inStat, outStat;
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    if(in < 0)
+    {
+        return -1;
+    }
+    if(fstat(in, &inStat) != 0)
+    {
+        close(in);
+        return -1;
+    }
+    // O_TRUNC on the source itself would destroy it
+    if(stat(destination, &outStat) == 0 && outStat.st_dev == inStat.st_dev && outStat.st_ino == inStat.st_ino)
+    {
+        close(in);
+        errno = EINVAL;
+        return -1;
+    }
+    // mmap needs to read the pages it maps for writing
+    int access = options->backend == COPY_MMAP ? O_RDWR : O_WRONLY;
+    int out = open(destination, access | O_CREAT | O_TRUNC | O_CLOEXEC, inStat.st_mode & 0777);
+    if(out < 0 && access == O_RDWR)
+    {
+        out = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, inStat.st_mode & 0777);
+    }
+    if(out < 0)
+    {
+        close(in);
+        return -1;
+    }
+    int result = copyFd(in, out, options, stats);
+    int error = errno;
+    close(in);
+    if(close(out) != 0 && result == 0)
+    {
+        result = -1;
+        error = errno;
+    }
+    errno = error;
+    return result;
+}
@@ -0,0 +1,64 @@
+#ifndef COPYENGINE_H
+#define COPYENGINE_H
+
+#include <stddef.h>
+
+/*
+ * Copy engine: the Listing 4-1 loop (read() / write()) plus the kernel
+ * interfaces that move data without a user space round trip.
+ *
+ * Every backend continues from the current file offsets of both descriptors,
+ * so when one gives up (EXDEV, EINVAL, EOPNOTSUPP, ENOSYS: this kernel or
+ * this pair of files does not support it) the next one picks up where it
+ * stopped, even in the middle of a copy. The last resort, read() / write(),
+ * works on every file type.
+ */
+
+typedef enum CopyBackend
+{
+    COPY_AUTO,                  // chosen from the file types (copyChooseBackend)
+    COPY_READ_WRITE,            // read() / write() with a tuned buffer
+    COPY_FILE_RANGE,            // copy_file_range(): in the kernel, reflink / server side copy when the fs can
+    COPY_SENDFILE,              // sendfile(): source must be mmap-able (regular file)
+    COPY_SPLICE,                // splice() through a pipe
+    COPY_MMAP,                  // mmap() + memcpy()
+    COPY_IO_URING,              // io_uring: linked read / write pairs into registered buffers
+    COPY_BACKEND_COUNT,
+} CopyBackend;
+
+typedef struct CopyOptions
+{
+    CopyBackend backend;
+    size_t bufferSize;          // read/write buffer, splice pipe, io_uring buffers; 0 = default
+    int queueDepth;             // io_uring read/write pairs in flight; 0 = default
+    int sync;                   // fdatasync() the destination before returning
+} CopyOptions;
+
+typedef struct CopyStats
+{
+    CopyBackend backend;        // the backend that finished the copy
+    CopyBackend first;          // the first one tried
+    int fallbacks;              // backends that gave up before it
+    int fallbackError;          // errno of the last fallback
+    long long bytes;
+    double seconds;
+} CopyStats;
+
+#define COPY_DEFAULT_BUFFER (1 << 20)
+#define COPY_DEFAULT_QUEUE_DEPTH 8
+
+// Copies from the current offset of `in` to the current offset of `out` until
+// the end of `in`. Returns 0, or -1 with errno set.
+int copyFd(int in, int out, const CopyOptions* options, CopyStats* stats);
+
+// Opens (creates / truncates) `destination` with the mode of `source` and copies it
+int copyFile(const char* source, const char* destination, const CopyOptions* options, CopyStats* stats);
+
+// The first backend to try for this pair of descriptors
+CopyBackend copyChooseBackend(int in, int out);
+
+const char* copyBackendName(CopyBackend backend);
+// COPY_BACKEND_COUNT when unknown
+CopyBackend copyBackendFromName(const char* name);
+
+#endif
@@ -0,0 +1,210 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "seqlock.h"
+
+
+#define MAX_READERS 64
+#define WRITER_PERIOD_US 100
+#define DEFAULT_DURATION_MS 500
+
+typedef enum LockType
+{
+    LOCK_SEQLOCK,
+    LOCK_MUTEX,
+    LOCK_RWLOCK,
+} LockType;
+
+static const char* lockNames[] = { "seqlock", "mutex", "rwlock" };
+
+typedef struct Gauges
+{
+    long Fuel;
+    long Water;
+    long Oil;
+    long Updates;
+} Gauges;
+
+// Each reader owns one cache line for its counters so they do not false-share
+typedef struct ReaderResult
+{
+    long reads;
+    long torn;
+    char pad[64 - 2 * sizeof(long)];
+} ReaderResult;
+
+LockType lockType;
+SeqLock seqLock;
+pthread_mutex_t mutexGauges;
+pthread_rwlock_t rwlockGauges;
+Gauges gauges;
+atomic_int running;
+ReaderResult results[MAX_READERS] __attribute__((aligned(64)));
+
+static void readGauges(Gauges* out)
+{
+    switch(lockType)
+    {
+    case LOCK_SEQLOCK:
+        SEQLOCK_READ(&seqLock, *out, gauges);
+        break;
+    case LOCK_MUTEX:
+        pthread_mutex_lock(&mutexGauges);
+        *out = gauges;
+        pthread_mutex_unlock(&mutexGauges);
+        break;
+    case LOCK_RWLOCK:
+        pthread_rwlock_rdlock(&rwlockGauges);
+        *out = gauges;
+        pthread_rwlock_unlock(&rwlockGauges);
+        break;
+    }
+}
+
+static void writeGauges(void)
+{
+    switch(lockType)
+    {
+    case LOCK_SEQLOCK:
+        seqlockWriteLock(&seqLock);
+        break;
+    case LOCK_MUTEX:
+        pthread_mutex_lock(&mutexGauges);
+        break;
+    case LOCK_RWLOCK:
+        pthread_rwlock_wrlock(&rwlockGauges);
+        break;
+    }
+
+    gauges.Fuel += 50;
+    gauges.Water = gauges.Fuel;
+    gauges.Oil = gauges.Fuel * 2;
+    gauges.Updates++;
+
+    switch(lockType)
+    {
+    case LOCK_SEQLOCK:
+        seqlockWriteUnlock(&seqLock);
+        break;
+    case LOCK_MUTEX:
+        pthread_mutex_unlock(&mutexGauges);
+        break;
+    case LOCK_RWLOCK:
+        pthread_rwlock_unlock(&rwlockGauges);
+        break;
+    }
+}
+
+void * reader (void* args)
+{
+    ReaderResult* result = args;
+    long reads = 0;
+    long torn = 0;
+    Gauges snapshot = { 0 };
+
+    while(atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        readGauges(&snapshot);
+        if(snapshot.Water != snapshot.Fuel || snapshot.Oil != snapshot.Fuel * 2)
+        {
+            torn++;
+        }
+        reads++;
+    }
+    result->reads = reads;
+    result->torn = torn;
+    return NULL;
+}
+
+void * writer (void* args)
+{
+    while(atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        writeGauges();
+        usleep(WRITER_PERIOD_US);
+    }
+    return NULL;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void runOnce(LockType type, int readerCount, int durationMs)
+{
+    pthread_t th[MAX_READERS + 1];
+    int i;
+
+    lockType = type;
+    memset(&gauges, 0, sizeof(gauges));
+    memset(results, 0, sizeof(results));
+    atomic_store(&running, 1);
+
+    double start = nowSeconds();
+    for(i = 0; i < readerCount ; i++)
+    {
+        if( pthread_create(&th[i], NULL , &reader , &results[i]) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    if( pthread_create(&th[readerCount], NULL , &writer , NULL) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+
+    usleep(durationMs * 1000);
+    atomic_store(&running, 0);
+
+    for(i = 0; i <= readerCount ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    double elapsed = nowSeconds() - start;
+
+    long reads = 0;
+    long torn = 0;
+    for(i = 0; i < readerCount ; i++)
+    {
+        reads += results[i].reads;
+        torn += results[i].torn;
+    }
+    printf("%s,%d,%.0f,%.1f,%ld,%ld\n", lockNames[type], readerCount,
+        reads / elapsed, reads / elapsed / readerCount, gauges.Updates, torn);
+}
+
+
+int main(int argc, char* argv[])
+{
+    int durationMs = argc > 1 ? atoi(argv[1]) : DEFAULT_DURATION_MS;
+    int readerCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    int i, type;
+
+    seqlockInit(&seqLock);
+    pthread_mutex_init(&mutexGauges , NULL);
+    pthread_rwlock_init(&rwlockGauges , NULL);
+
+    printf("lock,readers,reads_per_sec,reads_per_sec_per_reader,writes,torn\n");
+    for(i = 0; i < (int)(sizeof(readerCounts) / sizeof(readerCounts[0])) ; i++)
+    {
+        for(type = LOCK_SEQLOCK; type <= LOCK_RWLOCK ; type++)
+        {
+            runOnce(type, readerCounts[i], durationMs);
+        }
+    }
+
+    seqlockDestroy(&seqLock);
+    pthread_mutex_destroy(&mutexGauges);
+    pthread_rwlock_destroy(&rwlockGauges);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include "seqlock.h"
+
+
+#define WRITER_NUM 2
+#define READER_NUM 6
+
+typedef struct Gauges
+{
+    int Fuel;
+    int Water;
+} Gauges;
+
+SeqLock lockGauges;
+Gauges gauges = { .Fuel = 50, .Water = 50 };
+
+void * writer (void* args)
+{
+    int i;
+    for(i = 0; i < 5 ; i++)
+    {
+        seqlockWriteLock(&lockGauges);
+        gauges.Fuel += 50;
+        usleep(1000);              // make torn reads likely if readers did not retry
+        gauges.Water = gauges.Fuel;
+        seqlockWriteUnlock(&lockGauges);
+        usleep(100000);
+    }
+    return NULL;
+}
+
+void * reader (void* args)
+{
+    int i;
+    int torn = 0;
+    Gauges snapshot;
+    for(i = 0; i < 1000 ; i++)
+    {
+        SEQLOCK_READ(&lockGauges, snapshot, gauges);
+        if(snapshot.Fuel != snapshot.Water)
+        {
+            torn++;
+        }
+        usleep(500);
+    }
+    printf("(%d) Last snapshot Fuel: %d Water: %d , torn reads: %d \n",
+        *(int*)args, snapshot.Fuel, snapshot.Water, torn);
+    free(args);
+    return NULL;
+}
+
+
+int main(void)
+{
+    pthread_t th[WRITER_NUM + READER_NUM];
+    seqlockInit(&lockGauges);
+
+    int i;
+    for(i = 0; i < WRITER_NUM + READER_NUM ; i++)
+    {
+        if(i < WRITER_NUM)
+        {
+            if( pthread_create(&th[i], NULL , &writer , NULL) != 0)
+            {
+                perror("Failed to Create Thread");
+            }
+        }
+        else
+        {
+            int* a = malloc(sizeof(int));
+            *a = i - WRITER_NUM;
+            if( pthread_create(&th[i], NULL , &reader , a) != 0)
+            {
+                perror("Failed to Create Thread");
+            }
+        }
+    }
+
+    for(i = 0; i < WRITER_NUM + READER_NUM ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    printf("Fuel :%d \n" ,gauges.Fuel);
+    printf("Water :%d \n" ,gauges.Water);
+    seqlockDestroy(&lockGauges);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+/*
+ * Sequence lock: writers bump `sequence` to an odd value, modify the data,
+ * then bump it back to even. Readers never write to shared memory, they copy
+ * the data and retry if the sequence was odd or changed while copying.
+ *
+ * Writers are serialized by `writerMutex`, so any number of threads may write.
+ */
+typedef struct SeqLock
+{
+    atomic_uint sequence;
+    pthread_mutex_t writerMutex;
+} SeqLock;
+
+static inline void seqlockInit(SeqLock* lock)
+{
+    atomic_init(&lock->sequence, 0);
+    pthread_mutex_init(&lock->writerMutex, NULL);
+}
+
+static inline void seqlockDestroy(SeqLock* lock)
+{
+    pthread_mutex_destroy(&lock->writerMutex);
+}
+
+// Returns the sequence to pass to seqlockReadRetry(), waits while a write is in progress
+static inline unsigned seqlockReadBegin(SeqLock* lock)
+{
+    unsigned seq;
+    while ((seq = atomic_load_explicit(&lock->sequence, memory_order_acquire)) & 1)
+    {
+        sched_yield();
+    }
+    return seq;
+}
+
+// Returns non-zero if the data copied since seqlockReadBegin() may be torn
+static inline int seqlockReadRetry(SeqLock* lock, unsigned start)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&lock->sequence, memory_order_relaxed) != start;
+}
+
+static inline void seqlockWriteLock(SeqLock* lock)
+{
+    pthread_mutex_lock(&lock->writerMutex);
+    atomic_store_explicit(&lock->sequence,
+        atomic_load_explicit(&lock->sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void seqlockWriteUnlock(SeqLock* lock)
+{
+    atomic_store_explicit(&lock->sequence,
+        atomic_load_explicit(&lock->sequence, memory_order_relaxed) + 1, memory_order_release);
+    pthread_mutex_unlock(&lock->writerMutex);
+}
+
+/*
+ * Copies `src` into `dst` consistently. The loads are done through a volatile
+ * pointer so the compiler re-reads the shared data on every retry.
+ */
+#define SEQLOCK_READ(lock, dst, src)                                      \
+    do                                                                    \
+    {                                                                     \
+        unsigned seqStart_;                                               \
+        do                                                                \
+        {                                                                 \
+            seqStart_ = seqlockReadBegin(lock);                           \
+            (dst) = *(volatile __typeof__(src)*)&(src);                   \
+        } while (seqlockReadRetry(lock, seqStart_));                      \
+    } while (0)
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "waitqueue.h"
+
+
+#define DEFAULT_WAITERS 400
+#define ROUNDS 10
+#define PUT_AMOUNT 300
+#define PUT_PERIOD_US 200
+#define MAX_GENERATIONS (1 << 20)
+
+typedef enum Mode
+{
+    MODE_BROADCAST,
+    MODE_WAITQUEUE,
+} Mode;
+
+static const char* modeNames[] = { "cond_broadcast", "waitqueue" };
+
+Mode mode;
+int waiterCount;
+
+// Lec11 style state
+pthread_mutex_t MutexFuel;
+pthread_cond_t CondFuel;
+int Fuel;
+unsigned long generation;
+atomic_long condWakeups;
+
+// Wait queue state
+WaitQueue queueFuel;
+
+// Time of each put, indexed by generation, to measure put-to-run latency
+long putNs[MAX_GENERATIONS];
+atomic_int doneCount;
+long* latencies;
+atomic_long latencyCount;
+
+static long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static unsigned long takeBroadcast(int need)
+{
+    unsigned long gen;
+    pthread_mutex_lock(&MutexFuel);
+    while(Fuel < need)
+    {
+        pthread_cond_wait(&CondFuel , &MutexFuel);
+        atomic_fetch_add_explicit(&condWakeups, 1, memory_order_relaxed);
+    }
+    Fuel -= need;
+    gen = generation;
+    pthread_mutex_unlock(&MutexFuel);
+    return gen;
+}
+
+static void putBroadcast(int amount)
+{
+    pthread_mutex_lock(&MutexFuel);
+    Fuel += amount;
+    generation++;
+    putNs[generation % MAX_GENERATIONS] = nowNs();
+    pthread_mutex_unlock(&MutexFuel);
+    pthread_cond_broadcast(&CondFuel);
+}
+
+static void putWaitQueue(int amount)
+{
+    // Stamp the generation this put will get before waking anyone.
+    // Only this thread changes the generation, so reading it unlocked is safe.
+    putNs[(queueFuel.generation + 1) % MAX_GENERATIONS] = nowNs();
+    waitQueuePut(&queueFuel, amount);
+}
+
+void * Car (void* arg)
+{
+    int need = 10 + (int)(long)arg % 91;
+    int i;
+    for(i = 0; i < ROUNDS ; i++)
+    {
+        unsigned long gen = mode == MODE_BROADCAST ? takeBroadcast(need)
+                                                   : waitQueueTake(&queueFuel, need);
+        long now = nowNs();
+        if(gen != 0)
+        {
+            long slot = atomic_fetch_add(&latencyCount, 1);
+            latencies[slot] = now - putNs[gen % MAX_GENERATIONS];
+        }
+    }
+    atomic_fetch_add(&doneCount, 1);
+    return NULL;
+}
+
+void * Fuel_Filling(void* arg)
+{
+    while(atomic_load(&doneCount) < waiterCount)
+    {
+        if(mode == MODE_BROADCAST)
+        {
+            putBroadcast(PUT_AMOUNT);
+        }
+        else
+        {
+            putWaitQueue(PUT_AMOUNT);
+        }
+        usleep(PUT_PERIOD_US);
+    }
+    return NULL;
+}
+
+static int compareLong(const void* a, const void* b)
+{
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static void runOnce(Mode m)
+{
+    pthread_t* th = malloc(sizeof(pthread_t) * (waiterCount + 1));
+    struct rusage before, after;
+    int i;
+
+    mode = m;
+    Fuel = 0;
+    generation = 0;
+    atomic_store(&condWakeups, 0);
+    atomic_store(&doneCount, 0);
+    atomic_store(&latencyCount, 0);
+    waitQueueInit(&queueFuel, 0);
+
+    getrusage(RUSAGE_SELF, &before);
+    long start = nowNs();
+    for(i = 0; i < waiterCount ; i++)
+    {
+        if( pthread_create(&th[i], NULL , &Car , (void*)(long)(i * 37)) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    if( pthread_create(&th[waiterCount], NULL , &Fuel_Filling , NULL) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+    for(i = 0; i < waiterCount + 1 ; i++)
+    {
+        if(pthread_join(th[i] ,NULL) != 0 )
+        {
+            perror("Erro at joining the Thread");
+        }
+    }
+    long elapsed = nowNs() - start;
+    getrusage(RUSAGE_SELF, &after);
+
+    long n = atomic_load(&latencyCount);
+    qsort(latencies, n, sizeof(long), compareLong);
+    long wakeups = m == MODE_BROADCAST ? atomic_load(&condWakeups) : (long)queueFuel.wakeups;
+    long takes = (long)waiterCount * ROUNDS;
+
+    printf("%s,%d,%.1f,%ld,%.2f,%ld,%ld,%.1f,%.1f,%.1f\n",
+        modeNames[m], waiterCount, elapsed / 1e6,
+        wakeups, (double)wakeups / takes,
+        (after.ru_nvcsw - before.ru_nvcsw), (after.ru_nivcsw - before.ru_nivcsw),
+        n ? latencies[n / 2] / 1e3 : 0.0,
+        n ? latencies[n * 99 / 100] / 1e3 : 0.0,
+        n ? latencies[n - 1] / 1e3 : 0.0);
+
+    waitQueueDestroy(&queueFuel);
+    free(th);
+}
+
+
+int main(int argc, char* argv[])
+{
+    waiterCount = argc > 1 ? atoi(argv[1]) : DEFAULT_WAITERS;
+    latencies = malloc(sizeof(long) * waiterCount * ROUNDS);
+    pthread_mutex_init(&MutexFuel , NULL);
+    pthread_cond_init(&CondFuel , NULL);
+
+    printf("mode,waiters,elapsed_ms,wakeups,wakeups_per_take,voluntary_csw,involuntary_csw,"
+           "latency_p50_us,latency_p99_us,latency_max_us\n");
+    runOnce(MODE_BROADCAST);
+    runOnce(MODE_WAITQUEUE);
+
+    pthread_mutex_destroy(&MutexFuel);
+    pthread_cond_destroy(&CondFuel);
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include "waitqueue.h"
+
+
+#define CAR_NUM 4
+
+WaitQueue Fuel;
+
+void * Fuel_Filling(void* arg)
+{
+    for(int i = 0 ; i < 5 ; i++)
+    {
+        waitQueuePut(&Fuel , 60);
+        printf("Filled 60 Fuel \n");
+        sleep(1);
+    }
+    return NULL;
+}
+
+void * Car (void* arg)
+{
+    int need = *(int*)arg;
+    printf("Car needs %d Fuel . Waiting...\n", need);
+    unsigned long generation = waitQueueTake(&Fuel , need);
+    printf("Got %d Fuel from filling #%lu \n", need, generation);
+    free(arg);
+    return NULL;
+}
+
+
+int main(void)
+{
+    pthread_t th[CAR_NUM + 1];
+    waitQueueInit(&Fuel , 0);
+
+    for(int i = 0 ; i < CAR_NUM + 1 ; i++)
+    {
+        if (i == CAR_NUM)
+        {
+            if( pthread_create(&th[i], NULL , &Fuel_Filling , NULL) != 0)
+            {
+                perror("Failed to Create Thread");
+            }
+        }
+        else
+        {
+            int* need = malloc(sizeof(int));
+            *need = 40 + 20 * (i % 2);
+            if( pthread_create(&th[i], NULL , &Car , need) != 0)
+            {
+                perror("Failed to Create Thread");
+            }
+        }
+    }
+
+    for(int i = 0 ; i < CAR_NUM + 1 ; i++)
+    {
+        if(pthread_join(th[i] ,NULL) != 0 )
+        {
+            perror("Erro at joining the Thread");
+        }
+    }
+
+    printf("Fuel left %d , wakeups %lu \n", Fuel.available, Fuel.wakeups);
+    waitQueueDestroy(&Fuel);
+    return 0;
+}
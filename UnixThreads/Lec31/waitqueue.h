@@ -0,0 +1,145 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+
+/*
+ * Predicate-aware wait queue for a counted resource (like Fuel in Lec10/Lec11).
+ *
+ * Each waiter registers how much it needs and sleeps on its own semaphore.
+ * The producer adds to the resource and hands it out to waiters in FIFO order,
+ * waking only the ones whose need is now covered. A woken waiter already owns
+ * its share, so it returns without re-taking the mutex or re-checking anything.
+ */
+typedef struct Waiter
+{
+    int need;
+    unsigned long grantedGeneration;
+    sem_t wakeup;
+    struct Waiter* next;
+} Waiter;
+
+typedef struct WaitQueue
+{
+    pthread_mutex_t mutex;
+    int available;
+    unsigned long generation;    // number of waitQueuePut() calls so far
+    unsigned long wakeups;       // number of waiters woken by waitQueuePut()
+    Waiter* head;
+    Waiter* tail;
+} WaitQueue;
+
+static inline void waitQueueInit(WaitQueue* wq, int available)
+{
+    pthread_mutex_init(&wq->mutex, NULL);
+    wq->available = available;
+    wq->generation = 0;
+    wq->wakeups = 0;
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+static inline void waitQueueDestroy(WaitQueue* wq)
+{
+    pthread_mutex_destroy(&wq->mutex);
+}
+
+/*
+ * Blocks until `need` units are granted to the caller.
+ * Returns the generation of the put that satisfied the request.
+ */
+static inline unsigned long waitQueueTake(WaitQueue* wq, int need)
+{
+    Waiter self;
+
+    pthread_mutex_lock(&wq->mutex);
+    // Only take directly if nobody is queued, otherwise we would starve the head
+    if(wq->head == NULL && wq->available >= need)
+    {
+        unsigned long generation = wq->generation;
+        wq->available -= need;
+        pthread_mutex_unlock(&wq->mutex);
+        return generation;
+    }
+
+    self.need = need;
+    self.next = NULL;
+    sem_init(&self.wakeup, 0, 0);
+    if(wq->tail == NULL)
+    {
+        wq->head = &self;
+    }
+    else
+    {
+        wq->tail->next = &self;
+    }
+    wq->tail = &self;
+    pthread_mutex_unlock(&wq->mutex);
+
+    while(sem_wait(&self.wakeup) != 0)
+    {
+        // EINTR: keep waiting, the producer will post exactly once
+    }
+    sem_destroy(&self.wakeup);
+    return self.grantedGeneration;
+}
+
+// Non-blocking variant, returns 1 if `need` units were taken
+static inline int waitQueueTryTake(WaitQueue* wq, int need)
+{
+    int taken = 0;
+    pthread_mutex_lock(&wq->mutex);
+    if(wq->head == NULL && wq->available >= need)
+    {
+        wq->available -= need;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&wq->mutex);
+    return taken;
+}
+
+// Adds `amount` units and wakes, in FIFO order, every waiter that can now proceed
+static inline void waitQueuePut(WaitQueue* wq, int amount)
+{
+    Waiter* ready = NULL;
+    Waiter* last = NULL;
+
+    pthread_mutex_lock(&wq->mutex);
+    wq->available += amount;
+    wq->generation++;
+    while(wq->head != NULL && wq->head->need <= wq->available)
+    {
+        Waiter* w = wq->head;
+        wq->head = w->next;
+        wq->available -= w->need;
+        w->grantedGeneration = wq->generation;
+        w->next = NULL;
+        if(last == NULL)
+        {
+            ready = w;
+        }
+        else
+        {
+            last->next = w;
+        }
+        last = w;
+        wq->wakeups++;
+    }
+    if(wq->head == NULL)
+    {
+        wq->tail = NULL;
+    }
+    pthread_mutex_unlock(&wq->mutex);
+
+    // Wake outside the mutex. Read `next` before posting: a woken waiter returns
+    // and its Waiter (on its stack) is gone.
+    while(ready != NULL)
+    {
+        Waiter* next = ready->next;
+        sem_post(&ready->wakeup);
+        ready = next;
+    }
+}
+
+#endif
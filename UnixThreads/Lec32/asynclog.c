@@ -0,0 +1,514 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include "asynclog.h"
+
+
+#define LOG_IOV_NUM 16
+#define LOG_CHUNK_SIZE 4096
+#define LOG_LINE_MAX 1024
+
+_Static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "LogRecord size");
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+/*
+ * Single-producer single-consumer ring owned by one thread.
+ * `head` is written only by the owner, `tail` only by the flusher.
+ */
+typedef struct LogRing
+{
+    _Alignas(64) atomic_ulong head;
+    _Alignas(64) atomic_ulong tail;
+    _Alignas(64) atomic_int closed;     // RING_OPEN, RING_EXITED or RING_DETACHED
+    struct LogRing* next;
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+// Whoever moves `closed` second frees the ring: the flusher side once the owner exited,
+// the owner itself (at exit or in its next logBegin()) once asyncLogShutdown() detached it
+enum
+{
+    RING_OPEN,
+    RING_EXITED,      // owner thread exited, the flusher drains and frees it
+    RING_DETACHED,    // logger shut down while the owner was alive, the owner frees it
+};
+
+static pthread_mutex_t mutexRings = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condFlush = PTHREAD_COND_INITIALIZER;
+static LogRing* rings = NULL;
+static pthread_key_t ringKey;
+static pthread_once_t onceKey = PTHREAD_ONCE_INIT;
+static int keyError;
+static __thread LogRing* myRing = NULL;
+
+static pthread_t flusherThread;
+static int logFd = -1;
+static LogFullPolicy fullPolicy;
+static atomic_int running;
+static atomic_int flushRequested;
+static atomic_ulong dropped;
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void ringRelease(void* arg)
+{
+    LogRing* ring = arg;
+    if(atomic_exchange_explicit(&ring->closed, RING_EXITED, memory_order_acq_rel) == RING_DETACHED)
+    {
+        free(ring);
+    }
+}
+
+// Created once and never deleted: the destructor must still run for rings detached by a shutdown
+static void createKey(void)
+{
+    keyError = pthread_key_create(&ringKey, &ringRelease);
+}
+
+static LogRing* ringRegister(void)
+{
+    LogRing* ring;
+    if(posix_memalign((void**)&ring, 64, sizeof(LogRing)) != 0)
+    {
+        return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, RING_OPEN);
+
+    pthread_mutex_lock(&mutexRings);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&mutexRings);
+
+    pthread_setspecific(ringKey, ring);
+    myRing = ring;
+    return ring;
+}
+
+static void requestFlush(void)
+{
+    if(!atomic_exchange_explicit(&flushRequested, 1, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&mutexRings);
+        pthread_cond_signal(&condFlush);
+        pthread_mutex_unlock(&mutexRings);
+    }
+}
+
+LogRecord* logBegin(const char* fmt)
+{
+    LogRing* ring = myRing;
+    if(ring != NULL && atomic_load_explicit(&ring->closed, memory_order_acquire) == RING_DETACHED)
+    {
+        // The logger was shut down: drop the message, or start over if it was initialised again
+        if(!atomic_load(&running))
+        {
+            return NULL;
+        }
+        free(ring);
+        pthread_setspecific(ringKey, NULL);
+        myRing = ring = NULL;
+    }
+    if(ring == NULL && (ring = ringRegister()) == NULL)
+    {
+        return NULL;
+    }
+
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned long used = head - atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if(used >= LOG_RING_SIZE)
+    {
+        requestFlush();
+        if(fullPolicy == LOG_FULL_DROP || !atomic_load(&running))
+        {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+        while(head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_SIZE)
+        {
+            if(!atomic_load(&running))
+            {
+                // Shut down while waiting: nobody will make room any more
+                atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+                return NULL;
+            }
+            sched_yield();
+        }
+    }
+    else if(used == LOG_RING_SIZE / 2)
+    {
+        // Half full: do not wait for the next flush interval
+        requestFlush();
+    }
+
+    LogRecord* record = &ring->records[head & (LOG_RING_SIZE - 1)];
+    record->fmt = fmt;
+    record->timestampNs = nowNs();
+    record->argCount = 0;
+    record->strUsed = 0;
+    return record;
+}
+
+void logCommit(LogRecord* record)
+{
+    LogRing* ring = myRing;
+    (void)record;
+    atomic_store_explicit(&ring->head,
+        atomic_load_explicit(&ring->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// Formats one record into `out`, returns the number of bytes written
+static size_t formatRecord(const LogRecord* r, char* out, size_t size)
+{
+    const char* p = r->fmt;
+    size_t len = 0;
+    int arg = 0;
+
+    while(*p != '\0' && len + 1 < size)
+    {
+        if(*p != '%')
+        {
+            out[len++] = *p++;
+            continue;
+        }
+        if(p[1] == '%')
+        {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Fast path for a plain %d / %s, by far the most common conversions
+        if(arg < r->argCount && (p[1] == 'd' || p[1] == 's'))
+        {
+            size_t room = size - len - 1;
+            if(p[1] == 's' && r->types[arg] == LOG_ARG_STR)
+            {
+                const char* s = r->strings + r->args[arg];
+                while(*s != '\0' && room > 0)
+                {
+                    out[len++] = *s++;
+                    room--;
+                }
+                arg++;
+                p += 2;
+                continue;
+            }
+            if(p[1] == 'd' && room >= 21)
+            {
+                long long v = (long long)r->args[arg];
+                unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+                char digits[20];
+                int n = 0;
+                do
+                {
+                    digits[n++] = '0' + u % 10;
+                    u /= 10;
+                } while(u != 0);
+                if(v < 0)
+                {
+                    out[len++] = '-';
+                }
+                while(n > 0)
+                {
+                    out[len++] = digits[--n];
+                }
+                arg++;
+                p += 2;
+                continue;
+            }
+        }
+
+        // Copy flags, width and precision, skip length modifiers
+        char spec[32];
+        int n = 0;
+        spec[n++] = *p++;
+        while(*p != '\0' && strchr("-+ #0123456789.", *p) != NULL && n < 24)
+        {
+            spec[n++] = *p++;
+        }
+        while(*p != '\0' && strchr("hlLqjzt", *p) != NULL)
+        {
+            p++;
+        }
+        char conversion = *p;
+        if(conversion == '\0')
+        {
+            break;
+        }
+        p++;
+
+        int written = 0;
+        size_t room = size - len;
+        if(arg >= r->argCount)
+        {
+            written = snprintf(out + len, room, "<missing>");
+        }
+        else if(strchr("diouxXc", conversion) != NULL)
+        {
+            if(conversion != 'c')
+            {
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+            }
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            if(conversion == 'c')
+            {
+                written = snprintf(out + len, room, spec, (int)r->args[arg]);
+            }
+            else if(conversion == 'd' || conversion == 'i')
+            {
+                written = snprintf(out + len, room, spec, (long long)r->args[arg]);
+            }
+            else
+            {
+                written = snprintf(out + len, room, spec, (unsigned long long)r->args[arg]);
+            }
+        }
+        else if(strchr("eEfFgGaA", conversion) != NULL)
+        {
+            union { double d; uint64_t u; } bits = { .u = r->args[arg] };
+            spec[n++] = conversion;
+            spec[n] = '\0';
+            written = snprintf(out + len, room, spec, bits.d);
+        }
+        else if(conversion == 's')
+        {
+            spec[n++] = 's';
+            spec[n] = '\0';
+            written = snprintf(out + len, room, spec,
+                r->types[arg] == LOG_ARG_STR ? r->strings + r->args[arg] : "<not a string>");
+        }
+        else if(conversion == 'p')
+        {
+            spec[n++] = 'p';
+            spec[n] = '\0';
+            written = snprintf(out + len, room, spec, (void*)(uintptr_t)r->args[arg]);
+        }
+        arg++;
+
+        if(written > 0)
+        {
+            len += (size_t)written < room ? (size_t)written : room - 1;
+        }
+    }
+    return len;
+}
+
+static void writeAll(struct iovec* iov, int count)
+{
+    while(count > 0)
+    {
+        ssize_t n = writev(logFd, iov, count);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        while(count > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/*
+ * Drains every ring, oldest record first, into LOG_IOV_NUM chunks and writes
+ * each full batch with a single writev(). Returns the number of records written.
+ */
+static unsigned long flushRings(void)
+{
+    static char chunks[LOG_IOV_NUM][LOG_CHUNK_SIZE];
+    struct iovec iov[LOG_IOV_NUM];
+    int chunk = 0;
+    size_t used = 0;
+    unsigned long total = 0;
+    LogRing* snapshot;
+
+    pthread_mutex_lock(&mutexRings);
+    snapshot = rings;
+    pthread_mutex_unlock(&mutexRings);
+
+    while(1)
+    {
+        // Pick the ring whose next record is the oldest
+        LogRing* oldest = NULL;
+        uint64_t oldestTs = 0;
+        LogRing* ring;
+        for(ring = snapshot; ring != NULL; ring = ring->next)
+        {
+            unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            if(tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+            {
+                continue;
+            }
+            uint64_t ts = ring->records[tail & (LOG_RING_SIZE - 1)].timestampNs;
+            if(oldest == NULL || ts < oldestTs)
+            {
+                oldest = ring;
+                oldestTs = ts;
+            }
+        }
+        if(oldest == NULL)
+        {
+            break;
+        }
+
+        if(used + LOG_LINE_MAX > LOG_CHUNK_SIZE)
+        {
+            iov[chunk].iov_base = chunks[chunk];
+            iov[chunk].iov_len = used;
+            chunk++;
+            used = 0;
+            if(chunk == LOG_IOV_NUM)
+            {
+                writeAll(iov, chunk);
+                chunk = 0;
+            }
+        }
+
+        unsigned long tail = atomic_load_explicit(&oldest->tail, memory_order_relaxed);
+        used += formatRecord(&oldest->records[tail & (LOG_RING_SIZE - 1)],
+            chunks[chunk] + used, LOG_LINE_MAX);
+        atomic_store_explicit(&oldest->tail, tail + 1, memory_order_release);
+        total++;
+    }
+
+    if(used > 0)
+    {
+        iov[chunk].iov_base = chunks[chunk];
+        iov[chunk].iov_len = used;
+        chunk++;
+    }
+    if(chunk > 0)
+    {
+        writeAll(iov, chunk);
+    }
+    return total;
+}
+
+// Frees rings whose owner exited and that have been fully drained
+static void reapClosedRings(void)
+{
+    pthread_mutex_lock(&mutexRings);
+    LogRing** link = &rings;
+    while(*link != NULL)
+    {
+        LogRing* ring = *link;
+        if(atomic_load_explicit(&ring->closed, memory_order_acquire) == RING_EXITED &&
+           atomic_load(&ring->tail) == atomic_load(&ring->head))
+        {
+            *link = ring->next;
+            free(ring);
+        }
+        else
+        {
+            link = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&mutexRings);
+}
+
+static void* flusher(void* args)
+{
+    while(atomic_load(&running))
+    {
+        flushRings();
+        reapClosedRings();
+
+        pthread_mutex_lock(&mutexRings);
+        if(!atomic_exchange(&flushRequested, 0) && atomic_load(&running))
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOG_FLUSH_INTERVAL_US * 1000L;
+            if(deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&condFlush, &mutexRings, &deadline);
+            atomic_store(&flushRequested, 0);
+        }
+        pthread_mutex_unlock(&mutexRings);
+    }
+    flushRings();
+    return NULL;
+}
+
+int asyncLogInit(int fd, LogFullPolicy policy)
+{
+    logFd = fd;
+    fullPolicy = policy;
+    atomic_store(&dropped, 0);
+    atomic_store(&flushRequested, 0);
+    pthread_once(&onceKey, &createKey);
+    if(keyError != 0)
+    {
+        return -1;
+    }
+    atomic_store(&running, 1);
+    if(pthread_create(&flusherThread, NULL, &flusher, NULL) != 0)
+    {
+        atomic_store(&running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void asyncLogShutdown(void)
+{
+    atomic_store(&running, 0);
+    pthread_mutex_lock(&mutexRings);
+    pthread_cond_signal(&condFlush);
+    pthread_mutex_unlock(&mutexRings);
+    pthread_join(flusherThread, NULL);
+
+    // Threads that are still alive may log again: their rings are left to them, not freed here
+    pthread_mutex_lock(&mutexRings);
+    while(rings != NULL)
+    {
+        LogRing* ring = rings;
+        rings = ring->next;
+        if(ring == myRing)
+        {
+            free(ring);
+            pthread_setspecific(ringKey, NULL);
+            myRing = NULL;
+        }
+        else if(atomic_exchange_explicit(&ring->closed, RING_DETACHED, memory_order_acq_rel) == RING_EXITED)
+        {
+            free(ring);
+        }
+    }
+    pthread_mutex_unlock(&mutexRings);
+}
+
+unsigned long asyncLogDropped(void)
+{
+    return atomic_load(&dropped);
+}
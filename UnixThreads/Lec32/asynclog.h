@@ -0,0 +1,167 @@
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous logger.
+ *
+ * asyncLog(fmt, ...) does not format anything: it copies the format pointer
+ * and the arguments into a record of the calling thread's own ring buffer.
+ * A background flusher thread formats the records, merges the rings by
+ * timestamp and writes them with writev().
+ *
+ * - `fmt` must be a string literal (only the pointer is stored).
+ * - Up to LOG_MAX_ARGS arguments: integers, doubles, `char*` (the string is
+ *   copied, truncated to fit the record) and pointers. A `long double` is
+ *   stored as a double: log it with %f / %g / %e, not %Lf.
+ * - Supported conversions: d i u o x X c e E f F g G a A s p %, with the
+ *   usual flags, width, precision and length modifiers. `*` is not supported.
+ */
+
+#define LOG_MAX_ARGS 8
+#define LOG_RING_SIZE 1024          // records per thread, power of two
+#define LOG_RECORD_SIZE 256
+#define LOG_FLUSH_INTERVAL_US 1000
+
+typedef enum LogFullPolicy
+{
+    LOG_FULL_DROP,    // drop the message and count it
+    LOG_FULL_BLOCK,   // wait for the flusher to make room
+} LogFullPolicy;
+
+typedef enum LogArgType
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_PTR,
+} LogArgType;
+
+typedef struct LogRecord
+{
+    const char* fmt;
+    uint64_t timestampNs;
+    uint8_t argCount;
+    uint8_t strUsed;
+    uint8_t types[LOG_MAX_ARGS];
+    uint64_t args[LOG_MAX_ARGS];
+    char strings[LOG_RECORD_SIZE - 32 - 8 * LOG_MAX_ARGS];
+} LogRecord;
+
+// Starts the flusher thread writing to `fd`. Returns 0 on success.
+int asyncLogInit(int fd, LogFullPolicy policy);
+
+// Drains every ring, stops the flusher and frees the rings of exited threads and the caller's.
+// A thread still running keeps its ring: asyncLog() there drops the message instead of writing
+// freed memory, and the ring is freed when that thread exits.
+void asyncLogShutdown(void);
+
+// Number of messages dropped because a ring was full (LOG_FULL_DROP only).
+unsigned long asyncLogDropped(void);
+
+// Used by the asyncLog() macro
+LogRecord* logBegin(const char* fmt);
+void logCommit(LogRecord* record);
+
+static inline void logArgInt(LogRecord* r, long long v)
+{
+    r->types[r->argCount] = LOG_ARG_INT;
+    r->args[r->argCount++] = (uint64_t)v;
+}
+
+static inline void logArgUint(LogRecord* r, unsigned long long v)
+{
+    r->types[r->argCount] = LOG_ARG_UINT;
+    r->args[r->argCount++] = v;
+}
+
+static inline void logArgDouble(LogRecord* r, double v)
+{
+    union { double d; uint64_t u; } bits = { .d = v };
+    r->types[r->argCount] = LOG_ARG_DOUBLE;
+    r->args[r->argCount++] = bits.u;
+}
+
+static inline void logArgPtr(LogRecord* r, const void* v)
+{
+    r->types[r->argCount] = LOG_ARG_PTR;
+    r->args[r->argCount++] = (uint64_t)(uintptr_t)v;
+}
+
+static inline void logArgStr(LogRecord* r, const char* s)
+{
+    unsigned space = sizeof(r->strings) - r->strUsed;
+    unsigned offset = r->strUsed;
+    unsigned n = 0;
+
+    if(s == NULL)
+    {
+        s = "(null)";
+    }
+    if(space == 0)
+    {
+        // No room left: point at the terminating NUL of the previous string
+        offset = r->strUsed - 1;
+    }
+    else
+    {
+        while(n + 1 < space && s[n] != '\0')
+        {
+            r->strings[offset + n] = s[n];
+            n++;
+        }
+        r->strings[offset + n] = '\0';
+        r->strUsed += n + 1;
+    }
+    r->types[r->argCount] = LOG_ARG_STR;
+    r->args[r->argCount++] = offset;
+}
+
+#define LOG_ARG(r, x) _Generic((x),                 \
+    char*: logArgStr,                               \
+    const char*: logArgStr,                         \
+    void*: logArgPtr,                               \
+    const void*: logArgPtr,                         \
+    float: logArgDouble,                            \
+    double: logArgDouble,                           \
+    long double: logArgDouble,                      \
+    unsigned char: logArgUint,                      \
+    unsigned short: logArgUint,                     \
+    unsigned int: logArgUint,                       \
+    unsigned long: logArgUint,                      \
+    unsigned long long: logArgUint,                 \
+    default: LOG_ARG_DEFAULT_(x))(r, x)
+
+// Pointers other than char* / void* (int*, struct Task*, ...) end up in `default` with the
+// integers: gcc tells them apart (pointer_type_class == 5) so they are logged for %p
+#define LOG_ARG_DEFAULT_(x) __builtin_choose_expr(__builtin_classify_type(x) == 5, logArgPtr, logArgInt)
+
+#define LOG_SELECT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, NAME, ...) NAME
+#define LOG_ARGS_0_(r)
+#define LOG_ARGS_1_(r, a) LOG_ARG(r, a);
+#define LOG_ARGS_2_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_1_(r, __VA_ARGS__)
+#define LOG_ARGS_3_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_2_(r, __VA_ARGS__)
+#define LOG_ARGS_4_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_3_(r, __VA_ARGS__)
+#define LOG_ARGS_5_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_4_(r, __VA_ARGS__)
+#define LOG_ARGS_6_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_5_(r, __VA_ARGS__)
+#define LOG_ARGS_7_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_6_(r, __VA_ARGS__)
+#define LOG_ARGS_8_(r, a, ...) LOG_ARG(r, a); LOG_ARGS_7_(r, __VA_ARGS__)
+#define LOG_ARGS_(r, fmt, ...) LOG_SELECT_(fmt, ##__VA_ARGS__,            \
+    LOG_ARGS_8_, LOG_ARGS_7_, LOG_ARGS_6_, LOG_ARGS_5_, LOG_ARGS_4_,      \
+    LOG_ARGS_3_, LOG_ARGS_2_, LOG_ARGS_1_, LOG_ARGS_0_)(r, ##__VA_ARGS__)
+
+#define asyncLog(fmt, ...)                                                \
+    do                                                                    \
+    {                                                                     \
+        LogRecord* logRecord_ = logBegin(fmt);                            \
+        if(logRecord_ != NULL)                                            \
+        {                                                                 \
+            LOG_ARGS_(logRecord_, fmt, ##__VA_ARGS__)                     \
+            logCommit(logRecord_);                                        \
+        }                                                                 \
+    } while(0)
+
+#endif
@@ -0,0 +1,145 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include "asynclog.h"
+
+
+#define MESSAGES_PER_THREAD 200000
+#define MAX_THREADS 16
+#define BURST_SIZE (LOG_RING_SIZE / 2)
+#define BURST_PAUSE_US 2000
+
+typedef enum Mode
+{
+    MODE_FPRINTF,
+    MODE_ASYNC_DROP,
+    MODE_ASYNC_BLOCK,
+    MODE_ASYNC_BURST,   // drop mode, but bursts that fit in the ring: measures the call, not the drop path
+} Mode;
+
+static const char* modeNames[] = { "fprintf", "asyncLog_drop", "asyncLog_block", "asyncLog_burst" };
+
+Mode mode;
+FILE* out;
+double perThreadNs[MAX_THREADS];
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void * routine (void* args)
+{
+    int index = *(int*)args;
+    int i;
+    double start = nowNs();
+    double paused = 0;
+    for(i = 0; i < MESSAGES_PER_THREAD ; i++)
+    {
+        int a = i & 127;
+        int b = index;
+        if(mode == MODE_FPRINTF)
+        {
+            fprintf(out, "Sum of %d and %d is %d\n", a, b, a + b);
+        }
+        else
+        {
+            asyncLog("Sum of %d and %d is %d\n", a, b, a + b);
+        }
+        if(mode == MODE_ASYNC_BURST && (i + 1) % BURST_SIZE == 0)
+        {
+            // Let the flusher drain the ring; the pause is not part of the call cost
+            double pauseStart = nowNs();
+            usleep(BURST_PAUSE_US);
+            paused += nowNs() - pauseStart;
+        }
+    }
+    perThreadNs[index] = (nowNs() - start - paused) / MESSAGES_PER_THREAD;
+    return NULL;
+}
+
+static void runOnce(Mode m, int threadCount, int fd)
+{
+    pthread_t th[MAX_THREADS];
+    int index[MAX_THREADS];
+    int i;
+
+    mode = m;
+    if(m != MODE_FPRINTF)
+    {
+        asyncLogInit(fd, m == MODE_ASYNC_BLOCK ? LOG_FULL_BLOCK : LOG_FULL_DROP);
+    }
+
+    double start = nowNs();
+    for(i = 0; i < threadCount ; i++)
+    {
+        index[i] = i;
+        if( pthread_create(&th[i], NULL , &routine , &index[i]) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    for(i = 0; i < threadCount ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    double producersDone = nowNs();
+
+    unsigned long dropped = 0;
+    if(m == MODE_FPRINTF)
+    {
+        fflush(out);
+    }
+    else
+    {
+        dropped = asyncLogDropped();
+        asyncLogShutdown();
+    }
+    double end = nowNs();
+
+    double callNs = 0;
+    for(i = 0; i < threadCount ; i++)
+    {
+        callNs += perThreadNs[i];
+    }
+    printf("%s,%d,%.1f,%.1f,%.1f,%lu\n", modeNames[m], threadCount,
+        callNs / threadCount, (producersDone - start) / 1e6, (end - start) / 1e6, dropped);
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "/dev/null";
+    int threadCounts[] = { 1, 2, 4, 8, 16 };
+    int i, m;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        perror("Failed to Open Output");
+        return 1;
+    }
+    out = fdopen(dup(fd), "w");
+
+    printf("mode,threads,ns_per_call,producers_ms,total_ms,dropped\n");
+    for(i = 0; i < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])) ; i++)
+    {
+        for(m = MODE_FPRINTF; m <= MODE_ASYNC_BURST ; m++)
+        {
+            runOnce(m, threadCounts[i], fd);
+        }
+    }
+
+    fclose(out);
+    close(fd);
+    return 0;
+}
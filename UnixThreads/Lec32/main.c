@@ -0,0 +1,134 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include "asynclog.h"
+
+
+#define THREAD_NUM 4
+#define TASK_NUM 100
+
+pthread_mutex_t mutexQueue;
+pthread_cond_t condQueue;
+
+typedef struct Task
+{
+    void (*taskFunction)(int , int  );
+    int arg1 , arg2;
+} Task;
+
+Task taskQueue [256];
+
+int taskCount = 0;
+
+void sum(int a , int b)
+{
+    int sum = a + b ;
+    asyncLog("Sum of %d and %d is %d\n", a, b, sum);
+}
+
+void prod(int a , int b)
+{
+    int prod = a * b ;
+    asyncLog("Product of %d and %d is %d\n", a, b, prod);
+}
+
+void executeTask(Task* task)
+{
+    task->taskFunction(task->arg1 , task->arg2);
+}
+
+void submitTask(Task task)
+{
+    pthread_mutex_lock(&mutexQueue);
+    taskQueue[taskCount] = task;
+    taskCount++;
+    pthread_mutex_unlock(&mutexQueue);
+    pthread_cond_signal(&condQueue);
+}
+
+void * startThread (void* args)
+{
+   while(1)
+   {
+        Task task;
+
+        pthread_mutex_lock(&mutexQueue);
+        while(taskCount == 0 )
+        {
+            pthread_cond_wait(&condQueue ,&mutexQueue);
+        }
+
+        task =taskQueue[0];
+        int i;
+        for(i = 0; i < taskCount -1 ; i++)
+        {
+            taskQueue[i] = taskQueue[i+1];
+        }
+        taskCount--;
+
+        pthread_mutex_unlock(&mutexQueue);
+
+        // A task without a function tells the worker to exit
+        if(task.taskFunction == NULL)
+        {
+            asyncLog("Worker %lu exiting\n", (unsigned long)pthread_self());
+            return NULL;
+        }
+        executeTask(&task);
+   }
+}
+
+
+int main(void)
+{
+    pthread_t th[THREAD_NUM];
+    pthread_mutex_init(&mutexQueue , NULL);
+    pthread_cond_init(&condQueue , NULL);
+
+    if(asyncLogInit(STDOUT_FILENO , LOG_FULL_BLOCK) != 0)
+    {
+        perror("Failed to Start Logger");
+        return 1;
+    }
+
+    int i;
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if( pthread_create(&th[i], NULL , &startThread , NULL) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    for(i=0 ; i < TASK_NUM; i++)
+    {
+        Task t = {
+            .taskFunction = i % 2 == 0? &sum : &prod,
+            .arg1 = rand() % 100 ,
+            .arg2 = rand() % 100
+        };
+        submitTask(t);
+    }
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        Task stop = { .taskFunction = NULL };
+        submitTask(stop);
+    }
+
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+
+    asyncLog("All %d tasks done, dropped %lu messages\n", TASK_NUM, asyncLogDropped());
+    asyncLogShutdown();
+    pthread_mutex_destroy(&mutexQueue);
+    pthread_cond_destroy(&condQueue);
+    return 0;
+}
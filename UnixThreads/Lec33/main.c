@@ -0,0 +1,145 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <semaphore.h>
+#include <time.h>
+#include "trace.h"
+
+
+#define THREAD_NUM 4
+#define TASK_NUM 100
+
+pthread_mutex_t mutexQueue;
+pthread_cond_t condQueue;
+
+typedef struct Task
+{
+    void (*taskFunction)(int , int  );
+    int arg1 , arg2;
+} Task;
+
+Task taskQueue [256];
+
+int taskCount = 0;
+
+void sum(int a , int b)
+{
+    TRACE_BEGIN("sum");
+    usleep(50000);
+    int sum = a + b ;
+    printf("Sum of %d and %d is %d\n", a, b, sum);
+    TRACE_END("sum");
+}
+
+void prod(int a , int b)
+{
+    TRACE_BEGIN("prod");
+    usleep(50000);
+    int prod = a * b ;
+    printf("Product of %d and %d is %d\n", a, b, prod);
+    TRACE_END("prod");
+}
+
+void executeTask(Task* task)
+{
+    task->taskFunction(task->arg1 , task->arg2);
+}
+
+void submitTask(Task task)
+{
+    usleep(5000);
+    TRACE_MUTEX_LOCK(&mutexQueue);
+    taskQueue[taskCount] = task;
+    taskCount++;
+    TRACE_MUTEX_UNLOCK(&mutexQueue);
+    pthread_cond_signal(&condQueue);
+    TRACE_INSTANT("submitted");
+}
+
+void * startThread (void* args)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", *(int*)args);
+    TRACE_THREAD_NAME(name);
+
+   while(1)
+   {
+        Task task;
+
+        TRACE_MUTEX_LOCK(&mutexQueue);
+        while(taskCount == 0 )
+        {
+            TRACE_COND_WAIT(&condQueue ,&mutexQueue);
+        }
+
+        task =taskQueue[0];
+        int i;
+        for(i = 0; i < taskCount -1 ; i++)
+        {
+            taskQueue[i] = taskQueue[i+1];
+        }
+        taskCount--;
+
+        TRACE_MUTEX_UNLOCK(&mutexQueue);
+
+        // A task without a function tells the worker to exit
+        if(task.taskFunction == NULL)
+        {
+            return NULL;
+        }
+        executeTask(&task);
+   }
+}
+
+
+int main(void)
+{
+    pthread_t th[THREAD_NUM];
+    int ids[THREAD_NUM];
+    pthread_mutex_init(&mutexQueue , NULL);
+    pthread_cond_init(&condQueue , NULL);
+    TRACE_THREAD_NAME("main");
+
+    int i;
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        ids[i] = i;
+        if( pthread_create(&th[i], NULL , &startThread , &ids[i]) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    for(i=0 ; i < TASK_NUM; i++)
+    {
+        Task t = {
+            .taskFunction = i % 2 == 0? &sum : &prod,
+            .arg1 = rand() % 100 ,
+            .arg2 = rand() % 100
+        };
+        submitTask(t);
+    }
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        Task stop = { .taskFunction = NULL };
+        submitTask(stop);
+    }
+
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+
+    if(TRACE_DUMP("pool_trace.json") != 0)
+    {
+        perror("Failed to Write Trace");
+    }
+    pthread_mutex_destroy(&mutexQueue);
+    pthread_cond_destroy(&condQueue);
+    return 0;
+}
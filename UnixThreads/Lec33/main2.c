@@ -0,0 +1,111 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <semaphore.h>
+#include <time.h>
+#include "trace.h"
+
+
+#define THREAD_NUM 2
+#define ITEM_NUM 100
+
+pthread_mutex_t mutexBuffer;
+pthread_barrier_t barrierStart;
+
+sem_t semEmpty;
+sem_t semFull;
+
+
+int buffer[10];
+int count = 0;
+
+void * producer (void* args)
+{
+    TRACE_THREAD_NAME("producer");
+    TRACE_BARRIER_WAIT(&barrierStart);
+    int i;
+    for(i = 0; i < ITEM_NUM ; i++)
+    {
+        // Produce
+        TRACE_BEGIN("produce");
+        int x = rand() % 100 ;
+        usleep(2000);
+        TRACE_END("produce");
+
+        // Add to the Buffer
+        TRACE_SEM_WAIT(&semEmpty);
+        TRACE_MUTEX_LOCK(&mutexBuffer);
+        buffer[count] = x ;
+        count++;
+        TRACE_MUTEX_UNLOCK(&mutexBuffer);
+        sem_post(&semFull);
+    }
+    return NULL;
+}
+
+void * consumer (void* args)
+{
+    TRACE_THREAD_NAME("consumer");
+    TRACE_BARRIER_WAIT(&barrierStart);
+    int i;
+    for(i = 0; i < ITEM_NUM ; i++)
+    {
+        int y;
+        // Remove From the Buffer
+        TRACE_SEM_WAIT(&semFull);
+        TRACE_MUTEX_LOCK(&mutexBuffer);
+
+        y  = buffer[count-1];
+        count--;
+
+        TRACE_MUTEX_UNLOCK(&mutexBuffer);
+        sem_post(&semEmpty);
+
+        // Consume
+        TRACE_BEGIN("consume");
+        printf("Got %d \n", y);
+        usleep(5000);
+        TRACE_END("consume");
+    }
+    return NULL;
+}
+
+
+int main(void)
+{
+    srand(time(NULL));
+    pthread_t th[THREAD_NUM];
+    pthread_mutex_init(&mutexBuffer , NULL);
+    pthread_barrier_init(&barrierStart , NULL , THREAD_NUM);
+    sem_init(&semEmpty , 0 , 10);
+    sem_init(&semFull , 0 , 0);
+
+    int i;
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if( pthread_create(&th[i], NULL , i % 2 == 0 ? &producer : &consumer , NULL) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+
+    if(TRACE_DUMP("pipeline_trace.json") != 0)
+    {
+        perror("Failed to Write Trace");
+    }
+    sem_destroy(&semEmpty);
+    sem_destroy(&semFull);
+    pthread_barrier_destroy(&barrierStart);
+    pthread_mutex_destroy(&mutexBuffer);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#ifdef TRACE_ENABLED
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+typedef struct TraceEvent
+{
+    uint64_t timestampNs;
+    const char* name;
+    char phase;
+} TraceEvent;
+
+// Written only by its owner thread; `head` is published with release order
+typedef struct TraceRing
+{
+    atomic_ulong head;
+    pid_t tid;
+    char threadName[32];
+    struct TraceRing* next;
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static pthread_mutex_t mutexRings = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing* rings = NULL;
+static __thread TraceRing* myRing = NULL;
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static TraceRing* ringRegister(void)
+{
+    TraceRing* ring = malloc(sizeof(TraceRing));
+    if(ring == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    ring->tid = (pid_t)syscall(SYS_gettid);
+    snprintf(ring->threadName, sizeof(ring->threadName), "thread %d", ring->tid);
+
+    // Rings are kept after the thread exits so its events can still be dumped
+    pthread_mutex_lock(&mutexRings);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&mutexRings);
+
+    myRing = ring;
+    return ring;
+}
+
+void traceEvent(char phase, const char* name)
+{
+    TraceRing* ring = myRing;
+    if(ring == NULL && (ring = ringRegister()) == NULL)
+    {
+        return;
+    }
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent* event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->timestampNs = nowNs();
+    event->name = name;
+    event->phase = phase;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void traceThreadName(const char* name)
+{
+    TraceRing* ring = myRing;
+    if(ring == NULL && (ring = ringRegister()) == NULL)
+    {
+        return;
+    }
+    snprintf(ring->threadName, sizeof(ring->threadName), "%s", name);
+}
+
+static void writeJsonString(FILE* file, const char* s)
+{
+    fputc('"', file);
+    for(; *s != '\0'; s++)
+    {
+        if(*s == '"' || *s == '\\')
+        {
+            fputc('\\', file);
+            fputc(*s, file);
+        }
+        else if((unsigned char)*s < 0x20)
+        {
+            fprintf(file, "\\u%04x", *s);
+        }
+        else
+        {
+            fputc(*s, file);
+        }
+    }
+    fputc('"', file);
+}
+
+int traceDump(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if(file == NULL)
+    {
+        return -1;
+    }
+
+    pid_t pid = getpid();
+    int first = 1;
+    TraceRing* ring;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&mutexRings);
+    for(ring = rings; ring != NULL; ring = ring->next)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+            first ? "" : ",\n", pid, ring->tid);
+        writeJsonString(file, ring->threadName);
+        fprintf(file, "}}");
+        first = 0;
+
+        unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        unsigned long i;
+        for(i = start; i < head; i++)
+        {
+            TraceEvent* event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(file, ",\n{\"name\":");
+            writeJsonString(file, event->name);
+            fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s}",
+                event->phase, event->timestampNs / 1000.0, pid, ring->tid,
+                event->phase == 'i' ? ",\"s\":\"t\"" : "");
+        }
+    }
+    pthread_mutex_unlock(&mutexRings);
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+
+/*
+ * Per-thread event tracing with Chrome trace-event JSON export.
+ *
+ * Build with -DTRACE_ENABLED to record events. Without it every TRACE_* macro
+ * compiles to nothing (or to the plain pthread call it wraps), so the
+ * instrumentation can stay in the code for free.
+ *
+ * Each thread records into its own ring (flight recorder: when full, the
+ * oldest events are overwritten). Call TRACE_DUMP() once the traced threads
+ * are idle or joined, then open the file in chrome://tracing or ui.perfetto.dev.
+ */
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 16384      // events per thread, power of two
+#endif
+
+#ifdef TRACE_ENABLED
+
+void traceEvent(char phase, const char* name);
+void traceThreadName(const char* name);
+int traceDump(const char* path);
+
+static inline int traceMutexLock(pthread_mutex_t* mutex, const char* name)
+{
+    traceEvent('B', "lock wait");
+    int ret = pthread_mutex_lock(mutex);
+    traceEvent('E', "lock wait");
+    traceEvent('B', name);
+    return ret;
+}
+
+static inline int traceMutexUnlock(pthread_mutex_t* mutex, const char* name)
+{
+    traceEvent('E', name);
+    return pthread_mutex_unlock(mutex);
+}
+
+static inline int traceCondWait(pthread_cond_t* cond, pthread_mutex_t* mutex, const char* name)
+{
+    // The lock is released while waiting, so close the "held" slice around the wait
+    traceEvent('E', name);
+    traceEvent('B', "cond wait");
+    int ret = pthread_cond_wait(cond, mutex);
+    traceEvent('E', "cond wait");
+    traceEvent('B', name);
+    return ret;
+}
+
+static inline int traceBarrierWait(pthread_barrier_t* barrier)
+{
+    traceEvent('B', "barrier");
+    int ret = pthread_barrier_wait(barrier);
+    traceEvent('E', "barrier");
+    return ret;
+}
+
+static inline int traceSemWait(sem_t* sem)
+{
+    traceEvent('B', "sem wait");
+    int ret = sem_wait(sem);
+    traceEvent('E', "sem wait");
+    return ret;
+}
+
+#define TRACE_BEGIN(name)               traceEvent('B', name)
+#define TRACE_END(name)                 traceEvent('E', name)
+#define TRACE_INSTANT(name)             traceEvent('i', name)
+#define TRACE_THREAD_NAME(name)         traceThreadName(name)
+#define TRACE_DUMP(path)                traceDump(path)
+#define TRACE_MUTEX_LOCK(m)             traceMutexLock(m, "holding " #m)
+#define TRACE_MUTEX_UNLOCK(m)           traceMutexUnlock(m, "holding " #m)
+#define TRACE_COND_WAIT(c, m)           traceCondWait(c, m, "holding " #m)
+#define TRACE_BARRIER_WAIT(b)           traceBarrierWait(b)
+#define TRACE_SEM_WAIT(s)               traceSemWait(s)
+
+#else
+
+#define TRACE_BEGIN(name)               ((void)0)
+#define TRACE_END(name)                 ((void)0)
+#define TRACE_INSTANT(name)             ((void)0)
+#define TRACE_THREAD_NAME(name)         ((void)0)
+#define TRACE_DUMP(path)                0
+#define TRACE_MUTEX_LOCK(m)             pthread_mutex_lock(m)
+#define TRACE_MUTEX_UNLOCK(m)           pthread_mutex_unlock(m)
+#define TRACE_COND_WAIT(c, m)           pthread_cond_wait(c, m)
+#define TRACE_BARRIER_WAIT(b)           pthread_barrier_wait(b)
+#define TRACE_SEM_WAIT(s)               sem_wait(s)
+
+#endif
+
+#endif
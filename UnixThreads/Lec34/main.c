@@ -0,0 +1,94 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "registry.h"
+
+
+#define THREAD_NUM 4
+#define RUN_SECONDS 3
+
+atomic_int running = 1;
+
+// Burns CPU all the time → high CPU%, few voluntary switches
+void * hotWorker (void* args)
+{
+    threadRegister("hot-worker");
+    volatile unsigned long x = 0;
+    while(atomic_load(&running))
+    {
+        x++;
+    }
+    return NULL;
+}
+
+// Sleeps most of the time → low CPU%, many voluntary switches
+void * sleepyWorker (void* args)
+{
+    threadRegister("sleepy-worker");
+    while(atomic_load(&running))
+    {
+        usleep(1000);
+    }
+    return NULL;
+}
+
+// Works 1ms, sleeps 1ms → about half a core
+void * mixedWorker (void* args)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "mixed-worker-%d", *(int*)args);
+    threadRegister(name);
+    volatile unsigned long x = 0;
+    while(atomic_load(&running))
+    {
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do
+        {
+            x++;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) < 1000000L);
+        usleep(1000);
+    }
+    return NULL;
+}
+
+
+int main(void)
+{
+    pthread_t th[THREAD_NUM];
+    int ids[THREAD_NUM];
+    threadRegister("main");
+
+    int i;
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        void* (*routine)(void*) = i == 0 ? &hotWorker : i == 1 ? &sleepyWorker : &mixedWorker;
+        ids[i] = i;
+        if( pthread_create(&th[i], NULL , routine , &ids[i]) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    threadRegistryStartDumper(1000, stdout);
+    sleep(RUN_SECONDS);
+    threadRegistryStopDumper();
+    atomic_store(&running, 0);
+
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+
+    printf("After join:\n");
+    threadRegistryDump(stdout);
+    return 0;
+}
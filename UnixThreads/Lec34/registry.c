@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include "registry.h"
+
+
+typedef struct RegistryEntry
+{
+    int used;
+    char name[REGISTRY_NAME_LEN];
+    pthread_t thread;
+    pid_t tid;
+    double lastCpuSeconds;
+    double lastSampleSeconds;
+} RegistryEntry;
+
+// Holding the mutex also keeps registered threads alive: an exiting thread
+// unregisters itself (and so waits for the mutex) before it is gone.
+static pthread_mutex_t mutexRegistry = PTHREAD_MUTEX_INITIALIZER;
+static RegistryEntry entries[REGISTRY_MAX_THREADS];
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t entryKey;
+
+static pthread_t dumperThread;
+static atomic_int dumperRunning;
+static int dumperPeriodMs;
+static FILE* dumperFile;
+
+static double nowSeconds(clockid_t clock)
+{
+    struct timespec ts;
+    if(clock_gettime(clock, &ts) != 0)
+    {
+        return 0;
+    }
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void entryRelease(void* arg)
+{
+    RegistryEntry* entry = arg;
+    pthread_mutex_lock(&mutexRegistry);
+    entry->used = 0;
+    pthread_mutex_unlock(&mutexRegistry);
+}
+
+static void keyCreate(void)
+{
+    pthread_key_create(&entryKey, &entryRelease);
+}
+
+int threadRegister(const char* name)
+{
+    int i;
+    pthread_once(&keyOnce, &keyCreate);
+    if(pthread_getspecific(entryKey) != NULL)
+    {
+        return 0;
+    }
+
+    // The kernel limits thread names to 15 characters
+    char shortName[16];
+    snprintf(shortName, sizeof(shortName), "%s", name);
+    pthread_setname_np(pthread_self(), shortName);
+
+    pthread_mutex_lock(&mutexRegistry);
+    for(i = 0; i < REGISTRY_MAX_THREADS ; i++)
+    {
+        if(!entries[i].used)
+        {
+            RegistryEntry* entry = &entries[i];
+            entry->used = 1;
+            snprintf(entry->name, sizeof(entry->name), "%s", name);
+            entry->thread = pthread_self();
+            entry->tid = (pid_t)syscall(SYS_gettid);
+            entry->lastCpuSeconds = nowSeconds(CLOCK_THREAD_CPUTIME_ID);
+            entry->lastSampleSeconds = nowSeconds(CLOCK_MONOTONIC);
+            pthread_setspecific(entryKey, entry);
+            pthread_mutex_unlock(&mutexRegistry);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&mutexRegistry);
+    return -1;
+}
+
+void threadUnregister(void)
+{
+    pthread_once(&keyOnce, &keyCreate);
+    RegistryEntry* entry = pthread_getspecific(entryKey);
+    if(entry != NULL)
+    {
+        pthread_setspecific(entryKey, NULL);
+        entryRelease(entry);
+    }
+}
+
+static void readProcStats(pid_t tid, ThreadStats* stats)
+{
+    char path[64];
+    char line[512];
+    FILE* file;
+
+    stats->voluntarySwitches = -1;
+    stats->involuntarySwitches = -1;
+    stats->lastCpu = -1;
+    stats->state = '?';
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    file = fopen(path, "r");
+    if(file != NULL)
+    {
+        while(fgets(line, sizeof(line), file) != NULL)
+        {
+            sscanf(line, "voluntary_ctxt_switches: %ld", &stats->voluntarySwitches);
+            sscanf(line, "nonvoluntary_ctxt_switches: %ld", &stats->involuntarySwitches);
+        }
+        fclose(file);
+    }
+
+    // The command name can contain spaces, so start parsing after the last ')'.
+    // The state is field 3 and the last CPU is field 39.
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    file = fopen(path, "r");
+    if(file != NULL)
+    {
+        if(fgets(line, sizeof(line), file) != NULL)
+        {
+            char* p = strrchr(line, ')');
+            if(p != NULL)
+            {
+                int field = 3;
+                p += 2;
+                stats->state = *p;
+                while(*p != '\0' && field < 39)
+                {
+                    if(*p++ == ' ')
+                    {
+                        field++;
+                    }
+                }
+                if(field == 39)
+                {
+                    stats->lastCpu = atoi(p);
+                }
+            }
+        }
+        fclose(file);
+    }
+}
+
+int threadRegistrySnapshot(ThreadStats* out, int max)
+{
+    int i;
+    int count = 0;
+    double now = nowSeconds(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&mutexRegistry);
+    for(i = 0; i < REGISTRY_MAX_THREADS ; i++)
+    {
+        RegistryEntry* entry = &entries[i];
+        if(!entry->used)
+        {
+            continue;
+        }
+        if(count < max)
+        {
+            ThreadStats* stats = &out[count];
+            clockid_t clock;
+            snprintf(stats->name, sizeof(stats->name), "%s", entry->name);
+            stats->tid = entry->tid;
+            stats->cpuSeconds = 0;
+            if(pthread_getcpuclockid(entry->thread, &clock) == 0)
+            {
+                stats->cpuSeconds = nowSeconds(clock);
+            }
+            double wall = now - entry->lastSampleSeconds;
+            stats->cpuPercent = wall > 0 ? 100.0 * (stats->cpuSeconds - entry->lastCpuSeconds) / wall : 0;
+            entry->lastCpuSeconds = stats->cpuSeconds;
+            entry->lastSampleSeconds = now;
+            readProcStats(entry->tid, stats);
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&mutexRegistry);
+    return count;
+}
+
+void threadRegistryDump(FILE* file)
+{
+    ThreadStats stats[REGISTRY_MAX_THREADS];
+    int count = threadRegistrySnapshot(stats, REGISTRY_MAX_THREADS);
+    int i;
+
+    fprintf(file, "%-16s %7s %5s %10s %6s %10s %10s %4s\n",
+        "NAME", "TID", "STATE", "CPU(s)", "CPU%", "VOLUNTARY", "INVOLUNT", "CPU");
+    for(i = 0; i < count ; i++)
+    {
+        fprintf(file, "%-16s %7d %5c %10.3f %6.1f %10ld %10ld %4d\n",
+            stats[i].name, stats[i].tid, stats[i].state, stats[i].cpuSeconds,
+            stats[i].cpuPercent, stats[i].voluntarySwitches,
+            stats[i].involuntarySwitches, stats[i].lastCpu);
+    }
+    fflush(file);
+}
+
+static void* dumper(void* args)
+{
+    threadRegister("registry-dump");
+    while(atomic_load(&dumperRunning))
+    {
+        usleep(dumperPeriodMs * 1000);
+        if(atomic_load(&dumperRunning))
+        {
+            threadRegistryDump(dumperFile);
+        }
+    }
+    return NULL;
+}
+
+int threadRegistryStartDumper(int periodMs, FILE* file)
+{
+    dumperPeriodMs = periodMs;
+    dumperFile = file;
+    atomic_store(&dumperRunning, 1);
+    return pthread_create(&dumperThread, NULL, &dumper, NULL) == 0 ? 0 : -1;
+}
+
+void threadRegistryStopDumper(void)
+{
+    atomic_store(&dumperRunning, 0);
+    pthread_join(dumperThread, NULL);
+}
@@ -0,0 +1,52 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * Live thread registry.
+ *
+ * Threads call threadRegister("name") once. The registry remembers their
+ * pthread_t and kernel TID, and can report at any time, for every registered
+ * thread:
+ *   - CPU time (pthread_getcpuclockid() + clock_gettime())
+ *   - voluntary / involuntary context switches (/proc/self/task/<tid>/status)
+ *   - state and last CPU it ran on (/proc/self/task/<tid>/stat)
+ *
+ * A thread is removed automatically when it exits.
+ */
+
+#define REGISTRY_MAX_THREADS 256
+#define REGISTRY_NAME_LEN 32
+
+typedef struct ThreadStats
+{
+    char name[REGISTRY_NAME_LEN];
+    pid_t tid;
+    double cpuSeconds;
+    double cpuPercent;          // since the previous snapshot of this thread
+    long voluntarySwitches;
+    long involuntarySwitches;
+    int lastCpu;
+    char state;                 // R running, S sleeping, D disk wait, ...
+} ThreadStats;
+
+// Registers the calling thread; the name is also set with pthread_setname_np()
+int threadRegister(const char* name);
+
+// Removes the calling thread (also done automatically when it exits)
+void threadUnregister(void);
+
+// Fills up to `max` entries, returns how many threads are registered
+int threadRegistrySnapshot(ThreadStats* out, int max);
+
+// Prints one line per registered thread
+void threadRegistryDump(FILE* file);
+
+// Starts / stops a background thread calling threadRegistryDump() every periodMs
+int threadRegistryStartDumper(int periodMs, FILE* file);
+void threadRegistryStopDumper(void);
+
+#endif
@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "pool.h"
+
+
+#define PARTITION_BYTES (16UL << 20)
+#define ROUNDS 10
+#define RANDOM_READS (1 << 18)
+
+typedef struct Partition
+{
+    uint64_t* data;
+    size_t words;
+    volatile uint64_t result;
+} Partition;
+
+Partition* partitions;
+
+// First touch from the owning worker puts the pages on its NUMA node
+void initPartition(void* args)
+{
+    Partition* p = args;
+    size_t i;
+    p->data = malloc(PARTITION_BYTES);
+    p->words = PARTITION_BYTES / sizeof(uint64_t);
+    for(i = 0; i < p->words ; i++)
+    {
+        p->data[i] = i * 2654435761UL;
+    }
+}
+
+// Bandwidth bound: stream over the whole partition
+void streamTask(void* args)
+{
+    Partition* p = args;
+    uint64_t sum = 0;
+    size_t i;
+    for(i = 0; i < p->words ; i++)
+    {
+        sum += p->data[i];
+    }
+    p->result = sum;
+}
+
+// Latency bound: dependent random reads inside the partition
+void randomTask(void* args)
+{
+    Partition* p = args;
+    uint64_t index = 1;
+    uint64_t sum = 0;
+    int i;
+    for(i = 0; i < RANDOM_READS ; i++)
+    {
+        index = (index * 6364136223846793005ULL + 1442695040888963407ULL + sum) % p->words;
+        sum += p->data[index] & 1;
+    }
+    p->result = sum;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void runOnce(PlacementPolicy policy, int workers)
+{
+    ThreadPool pool;
+    int i;
+
+    if(poolInit(&pool , workers , policy , NULL , 0) != 0)
+    {
+        fprintf(stderr, "Failed to Place Workers\n");
+        return;
+    }
+    for(i = 0; i < workers ; i++)
+    {
+        Task t = { .taskFunction = &initPartition, .arg = &partitions[i] };
+        // Pinned: a thief would first-touch the partition on its own CPU/node
+        poolSubmitPinned(&pool , i , t);
+    }
+    poolWait(&pool);
+
+    double start = nowSeconds();
+    for(i = 0; i < ROUNDS * workers ; i++)
+    {
+        // Each partition always goes back to the worker that owns it
+        Task t = {
+            .taskFunction = (i / workers) % 2 == 0 ? &streamTask : &randomTask,
+            .arg = &partitions[i % workers]
+        };
+        poolSubmitTo(&pool , i % workers , t);
+    }
+    poolWait(&pool);
+    double elapsed = nowSeconds() - start;
+
+    long stolen = 0;
+    for(i = 0; i < workers ; i++)
+    {
+        stolen += pool.workers[i].stolen;
+    }
+    double streamedGB = (double)PARTITION_BYTES * workers * (ROUNDS / 2) / 1e9;
+    printf("%s,%d,%.3f,%.2f,%ld\n", placementName(policy), workers, elapsed,
+        streamedGB / elapsed, stolen);
+
+    poolDestroy(&pool);
+    for(i = 0; i < workers ; i++)
+    {
+        free(partitions[i].data);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    Topology topo;
+    topologyDiscover(&topo);
+    int workers = argc > 1 ? atoi(argv[1]) : topo.cpuCount;
+    PlacementPolicy policies[] = { PLACE_NONE, PLACE_COMPACT, PLACE_SCATTER, PLACE_PHYSICAL_CORE };
+    int i;
+
+    topologyPrint(&topo, stdout);
+    partitions = calloc(workers, sizeof(Partition));
+
+    printf("policy,workers,seconds,stream_GB_per_s,stolen\n");
+    for(i = 0; i < (int)(sizeof(policies) / sizeof(policies[0])) ; i++)
+    {
+        runOnce(policies[i], workers);
+    }
+    free(partitions);
+    return 0;
+}
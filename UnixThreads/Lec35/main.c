@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+#include "pool.h"
+
+
+#define THREAD_NUM 12
+#define TASK_NUM 100
+
+typedef struct SumArgs
+{
+    int a , b;
+} SumArgs;
+
+void sum(void* args)
+{
+    SumArgs* s = args;
+    usleep(5000);
+    printf("Sum of %d and %d is %d (worker %d on CPU %d)\n",
+        s->a, s->b, s->a + s->b, poolCurrentWorker(), sched_getcpu());
+}
+
+static PlacementPolicy parsePolicy(const char* name)
+{
+    PlacementPolicy p;
+    for(p = PLACE_NONE; p <= PLACE_EXPLICIT ; p++)
+    {
+        if(strcmp(name, placementName(p)) == 0)
+        {
+            return p;
+        }
+    }
+    fprintf(stderr, "Unknown policy %s, using compact\n", name);
+    return PLACE_COMPACT;
+}
+
+// Usage: ./main [none|compact|scatter|physical-core|explicit] [cpu list for explicit, e.g. 0,2,4]
+int main(int argc, char* argv[])
+{
+    PlacementPolicy policy = argc > 1 ? parsePolicy(argv[1]) : PLACE_COMPACT;
+    int explicitCpus[TOPO_MAX_CPUS];
+    int explicitCount = 0;
+    ThreadPool pool;
+    SumArgs args[TASK_NUM];
+    int i;
+
+    if(argc > 2)
+    {
+        char* p = argv[2];
+        while(*p != '\0' && explicitCount < TOPO_MAX_CPUS)
+        {
+            explicitCpus[explicitCount++] = (int)strtol(p, &p, 10);
+            if(*p == ',')
+            {
+                p++;
+            }
+        }
+    }
+
+    if(poolInit(&pool , THREAD_NUM , policy , explicitCpus , explicitCount) != 0)
+    {
+        fprintf(stderr, "Failed to Place Workers\n");
+        return 1;
+    }
+    topologyPrint(&pool.topology , stdout);
+    printf("Policy %s:", placementName(policy));
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        printf(" %d", pool.workers[i].cpu);
+    }
+    printf("\n");
+
+    for(i = 0 ; i < TASK_NUM; i++)
+    {
+        args[i].a = rand() % 100;
+        args[i].b = rand() % 100;
+        Task t = {
+            .taskFunction = &sum,
+            .arg = &args[i]
+        };
+        poolSubmit(&pool , t);
+    }
+    poolWait(&pool);
+
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        printf("Worker %2d (CPU %3d): executed %ld, stolen %ld\n",
+            i, pool.workers[i].cpu, pool.workers[i].executed, pool.workers[i].stolen);
+    }
+    poolDestroy(&pool);
+    return 0;
+}
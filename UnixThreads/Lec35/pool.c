@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "pool.h"
+
+
+static __thread int currentWorker = -1;
+
+static int popLocal(Worker* w, Task* task)
+{
+    int found = 0;
+    pthread_mutex_lock(&w->mutexQueue);
+    if(w->taskCount > 0)
+    {
+        *task = w->taskQueue[w->head];
+        w->head = (w->head + 1) % POOL_QUEUE_SIZE;
+        w->taskCount--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&w->mutexQueue);
+    return found;
+}
+
+// Thieves take the newest task, the owner keeps the oldest (FIFO) end
+static int stealFrom(Worker* victim, Task* task)
+{
+    int found = 0;
+    if(victim->taskCount == 0)   // racy peek, rechecked under the lock
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&victim->mutexQueue);
+    // A pinned task at the newest end is left for its owner
+    if(victim->taskCount > 0 &&
+       !victim->taskQueue[(victim->head + victim->taskCount - 1) % POOL_QUEUE_SIZE].pinned)
+    {
+        victim->taskCount--;
+        *task = victim->taskQueue[(victim->head + victim->taskCount) % POOL_QUEUE_SIZE];
+        found = 1;
+    }
+    pthread_mutex_unlock(&victim->mutexQueue);
+    return found;
+}
+
+static int findTask(Worker* w, Task* task)
+{
+    ThreadPool* pool = w->pool;
+    int i;
+    if(popLocal(w, task))
+    {
+        return 1;
+    }
+    for(i = 0; i < pool->workerCount - 1 ; i++)
+    {
+        if(stealFrom(&pool->workers[w->victims[i]], task))
+        {
+            w->stolen++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void * startThread (void* args)
+{
+    Worker* w = args;
+    ThreadPool* pool = w->pool;
+    currentWorker = w->index;
+
+    while(1)
+    {
+        Task task;
+        if(findTask(w, &task))
+        {
+            atomic_fetch_sub(&pool->queued, 1);
+            task.taskFunction(task.arg);
+            w->executed++;
+            if(atomic_fetch_sub(&pool->outstanding, 1) == 1)
+            {
+                pthread_mutex_lock(&pool->mutexIdle);
+                pthread_cond_broadcast(&pool->condDone);
+                pthread_mutex_unlock(&pool->mutexIdle);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutexIdle);
+        while(atomic_load(&pool->queued) == 0 && !atomic_load(&pool->stop))
+        {
+            pthread_cond_wait(&pool->condIdle, &pool->mutexIdle);
+        }
+        int stopping = atomic_load(&pool->stop) && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->mutexIdle);
+        if(stopping)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int pushTo(Worker* w, Task task)
+{
+    int pushed = 0;
+    pthread_mutex_lock(&w->mutexQueue);
+    if(w->taskCount < POOL_QUEUE_SIZE)
+    {
+        w->taskQueue[(w->head + w->taskCount) % POOL_QUEUE_SIZE] = task;
+        w->taskCount++;
+        pushed = 1;
+    }
+    pthread_mutex_unlock(&w->mutexQueue);
+    return pushed;
+}
+
+static void submit(ThreadPool* pool, int worker, Task task)
+{
+    Worker* w = &pool->workers[worker];
+    int i = 0;
+
+    atomic_fetch_add(&pool->outstanding, 1);
+    // Counted before it is visible: a thief may take it and decrement `queued` before this
+    // function returns from pushTo(), and `queued` must never go below zero
+    atomic_fetch_add(&pool->queued, 1);
+    // Local queue full: fall back to its nearest neighbours, then wait for room
+    while(!pushTo(i == 0 ? w : &pool->workers[w->victims[i - 1]], task))
+    {
+        i++;
+        // A pinned task only ever waits for room in its own worker's queue
+        if(i == pool->workerCount || task.pinned)
+        {
+            i = 0;
+            sched_yield();
+        }
+    }
+
+    pthread_mutex_lock(&pool->mutexIdle);
+    pthread_cond_signal(&pool->condIdle);
+    pthread_mutex_unlock(&pool->mutexIdle);
+}
+
+void poolSubmitTo(ThreadPool* pool, int worker, Task task)
+{
+    task.pinned = 0;
+    submit(pool, worker, task);
+}
+
+void poolSubmitPinned(ThreadPool* pool, int worker, Task task)
+{
+    task.pinned = 1;
+    submit(pool, worker, task);
+}
+
+void poolSubmit(ThreadPool* pool, Task task)
+{
+    unsigned next = atomic_fetch_add(&pool->nextWorker, 1);
+    poolSubmitTo(pool, next % pool->workerCount, task);
+}
+
+void poolWait(ThreadPool* pool)
+{
+    pthread_mutex_lock(&pool->mutexIdle);
+    while(atomic_load(&pool->outstanding) != 0)
+    {
+        pthread_cond_wait(&pool->condDone, &pool->mutexIdle);
+    }
+    pthread_mutex_unlock(&pool->mutexIdle);
+}
+
+int poolCurrentWorker(void)
+{
+    return currentWorker;
+}
+
+// Orders the other workers by topology distance, ties broken by index distance
+static void buildVictims(ThreadPool* pool, Worker* w)
+{
+    int n = 0;
+    int i, j;
+    for(i = 1; i < pool->workerCount ; i++)
+    {
+        int candidate = (w->index + i) % pool->workerCount;
+        int distance = topologyDistance(&pool->topology, w->cpu, pool->workers[candidate].cpu);
+        for(j = n; j > 0; j--)
+        {
+            int other = w->victims[j - 1];
+            if(topologyDistance(&pool->topology, w->cpu, pool->workers[other].cpu) <= distance)
+            {
+                break;
+            }
+            w->victims[j] = other;
+        }
+        w->victims[j] = candidate;
+        n++;
+    }
+}
+
+int poolInit(ThreadPool* pool, int workerCount, PlacementPolicy policy,
+             const int* explicitCpus, int explicitCount)
+{
+    int* cpus = malloc(sizeof(int) * workerCount);
+    int i;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->workerCount = workerCount;
+    pool->policy = policy;
+    topologyDiscover(&pool->topology);
+    if(topologyPlace(&pool->topology, policy, explicitCpus, explicitCount, workerCount, cpus) != 0)
+    {
+        free(cpus);
+        return -1;
+    }
+
+    pool->workers = calloc(workerCount, sizeof(Worker));
+    pthread_mutex_init(&pool->mutexIdle, NULL);
+    pthread_cond_init(&pool->condIdle, NULL);
+    pthread_cond_init(&pool->condDone, NULL);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->outstanding, 0);
+    atomic_init(&pool->nextWorker, 0);
+    atomic_init(&pool->stop, 0);
+
+    for(i = 0; i < workerCount ; i++)
+    {
+        Worker* w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->cpu = cpus[i];
+        w->victims = malloc(sizeof(int) * (workerCount > 1 ? workerCount - 1 : 1));
+        pthread_mutex_init(&w->mutexQueue, NULL);
+    }
+    for(i = 0; i < workerCount ; i++)
+    {
+        buildVictims(pool, &pool->workers[i]);
+    }
+
+    for(i = 0; i < workerCount ; i++)
+    {
+        Worker* w = &pool->workers[i];
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if(w->cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(w->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        if( pthread_create(&w->thread, &attr , &startThread , w) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+        pthread_attr_destroy(&attr);
+    }
+    free(cpus);
+    return 0;
+}
+
+void poolDestroy(ThreadPool* pool)
+{
+    int i;
+    pthread_mutex_lock(&pool->mutexIdle);
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->condIdle);
+    pthread_mutex_unlock(&pool->mutexIdle);
+
+    for(i = 0; i < pool->workerCount ; i++)
+    {
+        if( pthread_join(pool->workers[i].thread, NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+        pthread_mutex_destroy(&pool->workers[i].mutexQueue);
+        free(pool->workers[i].victims);
+    }
+    free(pool->workers);
+    pthread_mutex_destroy(&pool->mutexIdle);
+    pthread_cond_destroy(&pool->condIdle);
+    pthread_cond_destroy(&pool->condDone);
+}
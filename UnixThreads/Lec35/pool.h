@@ -0,0 +1,78 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "topology.h"
+
+/*
+ * Topology-aware thread pool.
+ *
+ * Every worker is pinned according to a PlacementPolicy and owns a local
+ * queue. A worker runs its own tasks first; when it runs dry it steals from
+ * the other workers, nearest first (SMT sibling, same LLC, same node, ...).
+ */
+
+#define POOL_QUEUE_SIZE 1024
+
+typedef struct Task
+{
+    void (*taskFunction)(void*);
+    void* arg;
+    int pinned;                   // set by poolSubmitPinned(): never stolen
+} Task;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct Worker
+{
+    ThreadPool* pool;
+    int index;
+    int cpu;                      // -1 when not pinned
+    pthread_t thread;
+    pthread_mutex_t mutexQueue;
+    Task taskQueue[POOL_QUEUE_SIZE];
+    int head;
+    int taskCount;
+    int* victims;                 // other workers, nearest first
+    long executed;
+    long stolen;
+} Worker;
+
+struct ThreadPool
+{
+    int workerCount;
+    Worker* workers;
+    Topology topology;
+    PlacementPolicy policy;
+    pthread_mutex_t mutexIdle;
+    pthread_cond_t condIdle;      // workers sleep here when every queue is empty
+    pthread_cond_t condDone;      // poolWait() sleeps here
+    atomic_int queued;            // tasks sitting in queues
+    atomic_int outstanding;       // tasks submitted but not finished
+    atomic_uint nextWorker;
+    atomic_int stop;
+};
+
+// explicitCpus is only used with PLACE_EXPLICIT. Returns 0 on success.
+int poolInit(ThreadPool* pool, int workerCount, PlacementPolicy policy,
+             const int* explicitCpus, int explicitCount);
+
+// Round-robin over the local queues
+void poolSubmit(ThreadPool* pool, Task task);
+
+// Puts the task on one worker's local queue (it may still be stolen)
+void poolSubmitTo(ThreadPool* pool, int worker, Task task);
+
+// Like poolSubmitTo(), but only that worker ever runs the task (e.g. first-touch initialisation)
+void poolSubmitPinned(ThreadPool* pool, int worker, Task task);
+
+// Waits until every submitted task has finished
+void poolWait(ThreadPool* pool);
+
+void poolDestroy(ThreadPool* pool);
+
+// Index of the worker running the caller, or -1 outside the pool
+int poolCurrentWorker(void);
+
+#endif
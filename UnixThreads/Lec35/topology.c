@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
+#include "topology.h"
+
+
+#define SYS_CPU "/sys/devices/system/cpu"
+#define SYS_NODE "/sys/devices/system/node"
+
+static int readInt(const char* path, int fallback)
+{
+    FILE* file = fopen(path, "r");
+    int value;
+    if(file == NULL)
+    {
+        return fallback;
+    }
+    if(fscanf(file, "%d", &value) != 1)
+    {
+        value = fallback;
+    }
+    fclose(file);
+    return value;
+}
+
+// Parses a cpulist like "0-3,8,10-11" into mask[], returns the lowest CPU or -1
+static int readCpuList(const char* path, char* mask)
+{
+    FILE* file = fopen(path, "r");
+    char line[4096];
+    int lowest = -1;
+    if(file == NULL)
+    {
+        return -1;
+    }
+    if(fgets(line, sizeof(line), file) != NULL)
+    {
+        char* p = line;
+        while(*p != '\0' && *p != '\n')
+        {
+            char* end;
+            long first = strtol(p, &end, 10);
+            long last = first;
+            if(end == p)
+            {
+                break;
+            }
+            p = end;
+            if(*p == '-')
+            {
+                last = strtol(p + 1, &end, 10);
+                p = end;
+            }
+            for(long cpu = first; cpu <= last && cpu < TOPO_MAX_CPUS; cpu++)
+            {
+                if(mask != NULL)
+                {
+                    mask[cpu] = 1;
+                }
+                if(lowest < 0 || cpu < lowest)
+                {
+                    lowest = (int)cpu;
+                }
+            }
+            if(*p == ',')
+            {
+                p++;
+            }
+        }
+    }
+    fclose(file);
+    return lowest;
+}
+
+// Turns arbitrary keys into dense ids 0..n-1 in order of first appearance
+static int densify(Topology* topo, size_t fieldOffset)
+{
+    int keys[TOPO_MAX_CPUS];
+    int count = 0;
+    int i, j;
+    for(i = 0; i < topo->cpuCount ; i++)
+    {
+        int* field = (int*)((char*)&topo->cpus[i] + fieldOffset);
+        for(j = 0; j < count && keys[j] != *field; j++)
+        {
+        }
+        if(j == count)
+        {
+            keys[count++] = *field;
+        }
+        *field = j;
+    }
+    return count;
+}
+
+static int llcKeyOf(int cpu, int fallback)
+{
+    char path[256];
+    int bestLevel = -1;
+    int key = fallback;
+    int index;
+    for(index = 0; index < 16 ; index++)
+    {
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+        int level = readInt(path, -1);
+        if(level < 0)
+        {
+            break;
+        }
+
+        char type[32] = "";
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/type", cpu, index);
+        FILE* file = fopen(path, "r");
+        if(file != NULL)
+        {
+            if(fscanf(file, "%31s", type) != 1)
+            {
+                type[0] = '\0';
+            }
+            fclose(file);
+        }
+        if(strcmp(type, "Instruction") == 0 || level <= bestLevel)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        int lowest = readCpuList(path, NULL);
+        if(lowest >= 0)
+        {
+            bestLevel = level;
+            key = lowest;
+        }
+    }
+    return key;
+}
+
+int topologyDiscover(Topology* topo)
+{
+    static char online[TOPO_MAX_CPUS];
+    static char siblings[TOPO_MAX_CPUS];
+    char path[256];
+    cpu_set_t allowed;
+    int cpu, i;
+
+    memset(topo, 0, sizeof(*topo));
+    memset(online, 0, sizeof(online));
+    if(readCpuList(SYS_CPU "/online", online) < 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for(cpu = 0; cpu < n && cpu < TOPO_MAX_CPUS; cpu++)
+        {
+            online[cpu] = 1;
+        }
+    }
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        CPU_ZERO(&allowed);
+        for(cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+
+    for(cpu = 0; cpu < TOPO_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+    {
+        if(!online[cpu] || !CPU_ISSET(cpu, &allowed))
+        {
+            continue;
+        }
+        CpuInfo* info = &topo->cpus[topo->cpuCount++];
+        info->cpu = cpu;
+
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        info->package = readInt(path, 0);
+
+        // A core is identified by its lowest SMT sibling
+        memset(siblings, 0, sizeof(siblings));
+        snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+        int lowest = readCpuList(path, siblings);
+        info->core = lowest >= 0 ? lowest : cpu;
+        // Counted among usable siblings only, so every usable core has an smtIndex 0
+        info->smtIndex = 0;
+        for(i = 0; i < cpu; i++)
+        {
+            info->smtIndex += siblings[i] && online[i] && CPU_ISSET(i, &allowed);
+        }
+
+        info->llc = llcKeyOf(cpu, info->package);
+        info->node = 0;
+    }
+
+    DIR* dir = opendir(SYS_NODE);
+    if(dir != NULL)
+    {
+        struct dirent* entry;
+        while((entry = readdir(dir)) != NULL)
+        {
+            int node;
+            if(sscanf(entry->d_name, "node%d", &node) != 1)
+            {
+                continue;
+            }
+            static char nodeCpus[TOPO_MAX_CPUS];
+            memset(nodeCpus, 0, sizeof(nodeCpus));
+            snprintf(path, sizeof(path), SYS_NODE "/node%d/cpulist", node);
+            readCpuList(path, nodeCpus);
+            for(i = 0; i < topo->cpuCount ; i++)
+            {
+                if(nodeCpus[topo->cpus[i].cpu])
+                {
+                    topo->cpus[i].node = node;
+                }
+            }
+        }
+        closedir(dir);
+    }
+
+    topo->coreCount = densify(topo, offsetof(CpuInfo, core));
+    topo->llcCount = densify(topo, offsetof(CpuInfo, llc));
+    topo->nodeCount = densify(topo, offsetof(CpuInfo, node));
+    topo->packageCount = densify(topo, offsetof(CpuInfo, package));
+    return topo->cpuCount > 0 ? 0 : -1;
+}
+
+int topologyFind(const Topology* topo, int cpu)
+{
+    int i;
+    for(i = 0; i < topo->cpuCount ; i++)
+    {
+        if(topo->cpus[i].cpu == cpu)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int topologyDistance(const Topology* topo, int cpuA, int cpuB)
+{
+    int a = topologyFind(topo, cpuA);
+    int b = topologyFind(topo, cpuB);
+    if(a < 0 || b < 0)
+    {
+        return 5;
+    }
+    const CpuInfo* x = &topo->cpus[a];
+    const CpuInfo* y = &topo->cpus[b];
+    if(x->cpu == y->cpu)
+    {
+        return 0;
+    }
+    if(x->core == y->core)
+    {
+        return 1;
+    }
+    if(x->llc == y->llc)
+    {
+        return 2;
+    }
+    if(x->node == y->node)
+    {
+        return 3;
+    }
+    if(x->package == y->package)
+    {
+        return 4;
+    }
+    return 5;
+}
+
+// Rank of `value` among the distinct values of `field` for CPUs sharing `group`
+static int rankWithin(const Topology* topo, int index, size_t field, size_t group)
+{
+    const CpuInfo* me = &topo->cpus[index];
+    int myValue = *(const int*)((const char*)me + field);
+    int myGroup = *(const int*)((const char*)me + group);
+    char seen[TOPO_MAX_CPUS] = { 0 };
+    int rank = 0;
+    int i;
+    for(i = 0; i < topo->cpuCount ; i++)
+    {
+        const CpuInfo* other = &topo->cpus[i];
+        int value = *(const int*)((const char*)other + field);
+        if(*(const int*)((const char*)other + group) == myGroup && value < myValue && !seen[value])
+        {
+            seen[value] = 1;
+            rank++;
+        }
+    }
+    return rank;
+}
+
+int topologyPlace(const Topology* topo, PlacementPolicy policy,
+                  const int* explicitCpus, int explicitCount,
+                  int workers, int* outCpus)
+{
+    int order[TOPO_MAX_CPUS];
+    long keys[TOPO_MAX_CPUS];
+    int count = 0;
+    int i, j;
+
+    if(policy == PLACE_NONE || topo->cpuCount == 0)
+    {
+        for(i = 0; i < workers ; i++)
+        {
+            outCpus[i] = -1;
+        }
+        return 0;
+    }
+    if(policy == PLACE_EXPLICIT)
+    {
+        if(explicitCount <= 0)
+        {
+            return -1;
+        }
+        for(i = 0; i < explicitCount ; i++)
+        {
+            if(topologyFind(topo, explicitCpus[i]) < 0)
+            {
+                return -1;
+            }
+        }
+        for(i = 0; i < workers ; i++)
+        {
+            outCpus[i] = explicitCpus[i % explicitCount];
+        }
+        return 0;
+    }
+
+    // Every key field is < 1024, so pack them 10 bits apart
+    for(i = 0; i < topo->cpuCount ; i++)
+    {
+        const CpuInfo* c = &topo->cpus[i];
+        long key;
+        if(policy == PLACE_PHYSICAL_CORE && c->smtIndex != 0)
+        {
+            continue;
+        }
+        if(policy == PLACE_SCATTER)
+        {
+            long coreRank = rankWithin(topo, i, offsetof(CpuInfo, core), offsetof(CpuInfo, llc));
+            long llcRank = rankWithin(topo, i, offsetof(CpuInfo, llc), offsetof(CpuInfo, node));
+            key = ((((long)c->smtIndex << 10 | coreRank) << 10 | llcRank) << 10 | c->node) << 10 | c->cpu;
+        }
+        else
+        {
+            key = ((((long)c->node << 10 | c->llc) << 10 | c->core) << 10 | c->smtIndex) << 10 | c->cpu;
+        }
+
+        // Insertion sort, CPU counts are small
+        for(j = count; j > 0 && keys[j - 1] > key; j--)
+        {
+            keys[j] = keys[j - 1];
+            order[j] = order[j - 1];
+        }
+        keys[j] = key;
+        order[j] = c->cpu;
+        count++;
+    }
+    if(count == 0)
+    {
+        // Nothing left after the SMT filter: use every allowed CPU instead
+        return topologyPlace(topo, PLACE_COMPACT, explicitCpus, explicitCount, workers, outCpus);
+    }
+
+    for(i = 0; i < workers ; i++)
+    {
+        outCpus[i] = order[i % count];
+    }
+    return 0;
+}
+
+void topologyPrint(const Topology* topo, FILE* file)
+{
+    int i;
+    fprintf(file, "%d CPUs, %d cores, %d LLC domains, %d NUMA nodes, %d packages\n",
+        topo->cpuCount, topo->coreCount, topo->llcCount, topo->nodeCount, topo->packageCount);
+    fprintf(file, "%5s %5s %5s %5s %5s %5s\n", "CPU", "CORE", "SMT", "LLC", "NODE", "PKG");
+    for(i = 0; i < topo->cpuCount ; i++)
+    {
+        const CpuInfo* c = &topo->cpus[i];
+        fprintf(file, "%5d %5d %5d %5d %5d %5d\n",
+            c->cpu, c->core, c->smtIndex, c->llc, c->node, c->package);
+    }
+}
+
+const char* placementName(PlacementPolicy policy)
+{
+    switch(policy)
+    {
+    case PLACE_NONE:          return "none";
+    case PLACE_COMPACT:       return "compact";
+    case PLACE_SCATTER:       return "scatter";
+    case PLACE_PHYSICAL_CORE: return "physical-core";
+    case PLACE_EXPLICIT:      return "explicit";
+    }
+    return "unknown";
+}
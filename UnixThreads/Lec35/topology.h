@@ -0,0 +1,69 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdio.h>
+
+/*
+ * CPU topology read from /sys/devices/system/cpu and /sys/devices/system/node.
+ *
+ * Only CPUs that are online and allowed by the process affinity mask are
+ * listed. Every id below is dense (0..count-1) so it can index arrays.
+ */
+
+#define TOPO_MAX_CPUS 1024
+
+typedef enum PlacementPolicy
+{
+    PLACE_NONE,            // no pinning, the scheduler decides
+    PLACE_COMPACT,         // fill SMT siblings, then cores of the same LLC, then the next LLC/node
+    PLACE_SCATTER,         // spread over nodes, then LLCs, then cores; SMT siblings last
+    PLACE_PHYSICAL_CORE,   // one worker per physical core (first SMT thread only)
+    PLACE_EXPLICIT,        // caller-provided CPU list
+} PlacementPolicy;
+
+typedef struct CpuInfo
+{
+    int cpu;         // Linux CPU number
+    int core;        // physical core
+    int package;     // socket
+    int llc;         // last-level cache domain
+    int node;        // NUMA node
+    int smtIndex;    // 0 for the first hardware thread of a core, 1 for its sibling, ...
+} CpuInfo;
+
+typedef struct Topology
+{
+    int cpuCount;
+    int coreCount;
+    int llcCount;
+    int nodeCount;
+    int packageCount;
+    CpuInfo cpus[TOPO_MAX_CPUS];
+} Topology;
+
+// Returns 0 on success. Missing sysfs files fall back to "every CPU is its own core".
+int topologyDiscover(Topology* topo);
+
+// Index into topo->cpus for a Linux CPU number, or -1
+int topologyFind(const Topology* topo, int cpu);
+
+/*
+ * How far apart two CPUs are:
+ * 0 same CPU, 1 SMT siblings, 2 same LLC, 3 same NUMA node, 4 same package, 5 remote.
+ */
+int topologyDistance(const Topology* topo, int cpuA, int cpuB);
+
+/*
+ * Chooses a CPU for each of `workers` workers into outCpus (-1 = not pinned).
+ * Policies wrap around when there are more workers than eligible CPUs.
+ * Returns 0 on success, -1 if an explicit CPU is not usable.
+ */
+int topologyPlace(const Topology* topo, PlacementPolicy policy,
+                  const int* explicitCpus, int explicitCount,
+                  int workers, int* outCpus);
+
+void topologyPrint(const Topology* topo, FILE* file);
+
+const char* placementName(PlacementPolicy policy);
+
+#endif
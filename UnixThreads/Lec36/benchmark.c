@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include "threadcache.h"
+
+
+#define LATENCY_RUNS 10000
+#define THROUGHPUT_SPAWNS 100000
+
+typedef enum Mode
+{
+    MODE_PTHREAD,
+    MODE_CACHE,
+} Mode;
+
+static const char* modeNames[] = { "pthread_create+detach", "spawnDetached" };
+
+sem_t semDone;
+atomic_long finished;
+long spawnNs;
+long runNs;
+
+static long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void * latencyRoutine(void* args)
+{
+    runNs = nowNs();
+    sem_post(&semDone);
+    return NULL;
+}
+
+void * emptyRoutine(void* args)
+{
+    atomic_fetch_add_explicit(&finished, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static int spawnRaw(void* (*routine)(void*), void* arg)
+{
+    pthread_t th;
+    int ret = pthread_create(&th, NULL, routine, arg);
+    if(ret == 0)
+    {
+        pthread_detach(th);
+    }
+    return ret;
+}
+
+static void spawn(Mode mode, void* (*routine)(void*))
+{
+    int ret;
+    // Too many threads alive at once: let some finish and retry
+    while((ret = mode == MODE_PTHREAD ? spawnRaw(routine, NULL) : spawnDetached(routine, NULL)) == EAGAIN)
+    {
+        sched_yield();
+    }
+    if(ret != 0)
+    {
+        errno = ret;
+        perror("Failed to Create Thread");
+        exit(1);
+    }
+}
+
+static int compareLong(const void* a, const void* b)
+{
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static void runOnce(Mode mode)
+{
+    static long latencies[LATENCY_RUNS];
+    int i;
+
+    // Spawn-to-run latency: one spawn at a time, so a parked thread is always available
+    for(i = 0; i < LATENCY_RUNS ; i++)
+    {
+        spawnNs = nowNs();
+        spawn(mode, &latencyRoutine);
+        sem_wait(&semDone);
+        latencies[i] = runNs - spawnNs;
+    }
+    qsort(latencies, LATENCY_RUNS, sizeof(long), compareLong);
+
+    // Throughput: spawn as fast as possible, wait for all routines to finish
+    atomic_store(&finished, 0);
+    long start = nowNs();
+    for(i = 0; i < THROUGHPUT_SPAWNS ; i++)
+    {
+        spawn(mode, &emptyRoutine);
+    }
+    while(atomic_load(&finished) < THROUGHPUT_SPAWNS)
+    {
+        usleep(100);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    ThreadCacheStats stats;
+    threadCacheStats(&stats);
+    printf("%s,%.1f,%.1f,%.1f,%.0f,%lu\n", modeNames[mode],
+        latencies[LATENCY_RUNS / 2] / 1e3, latencies[LATENCY_RUNS * 99 / 100] / 1e3,
+        latencies[LATENCY_RUNS - 1] / 1e3, THROUGHPUT_SPAWNS / seconds,
+        mode == MODE_CACHE ? stats.created : (unsigned long)(LATENCY_RUNS + THROUGHPUT_SPAWNS));
+}
+
+int main(void)
+{
+    sem_init(&semDone , 0 , 0);
+    printf("mode,latency_p50_us,latency_p99_us,latency_max_us,spawns_per_sec,os_threads_created\n");
+    runOnce(MODE_PTHREAD);
+    runOnce(MODE_CACHE);
+    threadCacheShutdown();
+    sem_destroy(&semDone);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <errno.h>
+#include "threadcache.h"
+
+
+int primes[10] = {2, 3 , 5 , 7 , 11, 13 , 17 , 19 , 23 , 29};
+sem_t semDone;
+
+void * routine(void * arg)
+{
+    int index = *(int*)arg;
+    printf("%d ",primes[index]);
+    free(arg);
+    sem_post(&semDone);
+    return NULL;
+}
+
+void printStats(const char* when)
+{
+    ThreadCacheStats stats;
+    threadCacheStats(&stats);
+    printf("\n%s: created %lu , reused %lu , expired %lu , idle %d , live %d \n",
+        when, stats.created, stats.reused, stats.expired, stats.idle, stats.live);
+}
+
+void spawnBatch(void)
+{
+    int i ;
+    for(i = 0 ; i < 10 ; i++)
+    {
+        int * a = malloc(sizeof(int));
+        *a = i ;
+        // Like pthread_create(): the error is returned, errno is not set
+        int ret = spawnDetached(&routine , a);
+        if(ret != 0)
+        {
+            errno = ret;
+            perror("Failed to Spawn Thread");
+        }
+    }
+    // Detached threads cannot be joined, count their completions instead
+    for(i = 0 ; i < 10 ; i++)
+    {
+        sem_wait(&semDone);
+    }
+}
+
+int main(void)
+{
+    sem_init(&semDone , 0 , 0);
+
+    spawnBatch();
+    printStats("First batch");
+
+    spawnBatch();
+    printStats("Second batch");
+
+    threadCacheShutdown();
+    printStats("After shutdown");
+    sem_destroy(&semDone);
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "threadcache.h"
+
+
+// Lives on the stack of a parked thread while it is in the idle list
+typedef struct ParkedThread
+{
+    pthread_cond_t condWork;
+    void* (*routine)(void*);
+    void* arg;
+    struct ParkedThread* next;
+} ParkedThread;
+
+typedef struct Work
+{
+    void* (*routine)(void*);
+    void* arg;
+} Work;
+
+static pthread_mutex_t mutexCache = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condExit = PTHREAD_COND_INITIALIZER;
+static ParkedThread* idleList = NULL;      // LIFO: the most recently used thread has the warmest cache
+static int idleCount = 0;
+static int liveCount = 0;
+static int shuttingDown = 0;
+static unsigned long createdCount = 0;
+static unsigned long reusedCount = 0;
+static unsigned long expiredCount = 0;
+
+static void deadlineAfterMs(struct timespec* ts, int ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if(ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void removeFromIdle(ParkedThread* self)
+{
+    ParkedThread** link = &idleList;
+    while(*link != NULL && *link != self)
+    {
+        link = &(*link)->next;
+    }
+    if(*link == self)
+    {
+        *link = self->next;
+        idleCount--;
+    }
+}
+
+/*
+ * Parks the calling thread until it gets new work or times out.
+ * Called and returns with mutexCache held. Returns 1 with work in *work.
+ */
+static int park(Work* work)
+{
+    ParkedThread self;
+    pthread_condattr_t attr;
+    struct timespec deadline;
+    int gotWork = 0;
+
+    if(shuttingDown || idleCount >= THREAD_CACHE_MAX_IDLE)
+    {
+        return 0;
+    }
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self.condWork, &attr);
+    pthread_condattr_destroy(&attr);
+    self.routine = NULL;
+    self.next = idleList;
+    idleList = &self;
+    idleCount++;
+
+    deadlineAfterMs(&deadline, THREAD_CACHE_IDLE_MS);
+    while(self.routine == NULL && !shuttingDown)
+    {
+        if(pthread_cond_timedwait(&self.condWork, &mutexCache, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    if(self.routine != NULL)
+    {
+        // spawnDetached() already took us off the idle list
+        work->routine = self.routine;
+        work->arg = self.arg;
+        gotWork = 1;
+    }
+    else
+    {
+        removeFromIdle(&self);
+        if(!shuttingDown)
+        {
+            expiredCount++;
+        }
+    }
+    pthread_cond_destroy(&self.condWork);
+    return gotWork;
+}
+
+// Called with mutexCache held when a cached thread is about to end
+static void threadExiting(void)
+{
+    liveCount--;
+    if(liveCount == 0)
+    {
+        pthread_cond_broadcast(&condExit);
+    }
+}
+
+// Runs if the routine calls pthread_exit() or is cancelled
+static void routineExited(void* args)
+{
+    pthread_mutex_lock(&mutexCache);
+    threadExiting();
+    pthread_mutex_unlock(&mutexCache);
+}
+
+static void* cachedThread(void* args)
+{
+    Work work = *(Work*)args;
+    free(args);
+
+    while(1)
+    {
+        pthread_cleanup_push(&routineExited, NULL);
+        work.routine(work.arg);
+        pthread_cleanup_pop(0);
+
+        pthread_mutex_lock(&mutexCache);
+        if(!park(&work))
+        {
+            threadExiting();
+            pthread_mutex_unlock(&mutexCache);
+            return NULL;
+        }
+        pthread_mutex_unlock(&mutexCache);
+    }
+}
+
+int spawnDetached(void* (*routine)(void*), void* arg)
+{
+    pthread_mutex_lock(&mutexCache);
+    if(idleList != NULL)
+    {
+        ParkedThread* parked = idleList;
+        idleList = parked->next;
+        idleCount--;
+        parked->routine = routine;
+        parked->arg = arg;
+        reusedCount++;
+        pthread_cond_signal(&parked->condWork);
+        pthread_mutex_unlock(&mutexCache);
+        return 0;
+    }
+    liveCount++;
+    createdCount++;
+    pthread_mutex_unlock(&mutexCache);
+
+    Work* work = malloc(sizeof(Work));
+    if(work == NULL)
+    {
+        pthread_mutex_lock(&mutexCache);
+        liveCount--;
+        createdCount--;
+        pthread_mutex_unlock(&mutexCache);
+        return ENOMEM;
+    }
+    work->routine = routine;
+    work->arg = arg;
+
+    pthread_t th;
+    pthread_attr_t detachedThread;
+    pthread_attr_init(&detachedThread);
+    pthread_attr_setdetachstate(&detachedThread , PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&th, &detachedThread , &cachedThread , work);
+    pthread_attr_destroy(&detachedThread);
+    if(ret != 0)
+    {
+        free(work);
+        pthread_mutex_lock(&mutexCache);
+        liveCount--;
+        createdCount--;
+        pthread_mutex_unlock(&mutexCache);
+    }
+    return ret;
+}
+
+void threadCacheShutdown(void)
+{
+    pthread_mutex_lock(&mutexCache);
+    shuttingDown = 1;
+    ParkedThread* parked;
+    for(parked = idleList; parked != NULL; parked = parked->next)
+    {
+        pthread_cond_signal(&parked->condWork);
+    }
+    while(liveCount > 0)
+    {
+        pthread_cond_wait(&condExit, &mutexCache);
+    }
+    shuttingDown = 0;
+    pthread_mutex_unlock(&mutexCache);
+}
+
+void threadCacheStats(ThreadCacheStats* stats)
+{
+    pthread_mutex_lock(&mutexCache);
+    stats->created = createdCount;
+    stats->reused = reusedCount;
+    stats->expired = expiredCount;
+    stats->idle = idleCount;
+    stats->live = liveCount;
+    pthread_mutex_unlock(&mutexCache);
+}
@@ -0,0 +1,39 @@
+#ifndef THREADCACHE_H
+#define THREADCACHE_H
+
+/*
+ * Reusable thread cache for detached fire-and-forget threads.
+ *
+ * spawnDetached(routine, arg) behaves like pthread_create() with
+ * PTHREAD_CREATE_DETACHED (Lec17), but when a thread finishes its routine it
+ * parks itself instead of exiting. The next spawnDetached() hands its work to
+ * a parked thread, skipping the stack mmap, clone and TLS setup of a new one.
+ * Parked threads exit after THREAD_CACHE_IDLE_MS without work.
+ *
+ * Differences from a real new thread:
+ * - Thread-specific data and thread-local variables keep their values between
+ *   routines run on the same cached thread.
+ * - Calling pthread_exit() from the routine works, but that thread is not reused.
+ */
+
+#define THREAD_CACHE_MAX_IDLE 64         // parked threads kept at most
+#define THREAD_CACHE_IDLE_MS 2000        // a parked thread exits after this long
+
+// Returns 0 on success or an error number like pthread_create()
+int spawnDetached(void* (*routine)(void*), void* arg);
+
+// Waits for running routines to finish and for every cached thread to exit
+void threadCacheShutdown(void);
+
+typedef struct ThreadCacheStats
+{
+    unsigned long created;     // new OS threads
+    unsigned long reused;      // spawns served by a parked thread
+    unsigned long expired;     // parked threads that hit the idle timeout
+    int idle;                  // parked right now
+    int live;                  // alive right now (running or parked)
+} ThreadCacheStats;
+
+void threadCacheStats(ThreadCacheStats* stats);
+
+#endif
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "procpool.h"
+
+
+#define WORKER_NUM 4
+#define JOB_NUM 20000
+#define BATCH 200
+
+typedef struct Task
+{
+    JobFunction taskFunction;
+    long arg1 , arg2;
+    long result;
+    int done;
+} Task;
+
+// Small fixed amount of work per job
+long work(long a , long b)
+{
+    long x = a;
+    int i;
+    for(i = 0; i < 2000 ; i++)
+    {
+        x = x * 31 + b;
+    }
+    return x;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// fork() + waitpid() for every job, result returned via the exit status
+static double runForkPerJob(int jobs)
+{
+    double start = nowSeconds();
+    int i;
+    for(i = 0; i < jobs ; i++)
+    {
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            _exit(work(i, 1) & 0x7f);
+        }
+        if(pid < 0)
+        {
+            perror("Failed to Fork");
+            exit(1);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return jobs / (nowSeconds() - start);
+}
+
+static double runProcPool(int jobs)
+{
+    ProcPool* pool = procPoolCreate(WORKER_NUM);
+    long ids[BATCH];
+    double start = nowSeconds();
+    int i, j;
+    for(i = 0; i < jobs ; i += BATCH)
+    {
+        for(j = 0; j < BATCH ; j++)
+        {
+            ids[j] = procPoolSubmit(pool, &work, i + j, 1);
+        }
+        for(j = 0; j < BATCH ; j++)
+        {
+            long result;
+            procPoolResult(pool, ids[j], &result);
+        }
+    }
+    double rate = jobs / (nowSeconds() - start);
+    procPoolDestroy(pool);
+    return rate;
+}
+
+// Lec29-style thread pool with per-batch result collection, for reference
+pthread_mutex_t mutexQueue = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t condQueue = PTHREAD_COND_INITIALIZER;
+pthread_cond_t condDone = PTHREAD_COND_INITIALIZER;
+Task tasks[BATCH];
+int taskNext = 0;
+int taskCount = 0;
+int stopThreads = 0;
+
+void * startThread(void* args)
+{
+    while(1)
+    {
+        pthread_mutex_lock(&mutexQueue);
+        while(taskNext == taskCount && !stopThreads)
+        {
+            pthread_cond_wait(&condQueue, &mutexQueue);
+        }
+        if(stopThreads)
+        {
+            pthread_mutex_unlock(&mutexQueue);
+            return NULL;
+        }
+        Task* task = &tasks[taskNext++];
+        pthread_mutex_unlock(&mutexQueue);
+
+        long result = task->taskFunction(task->arg1, task->arg2);
+
+        pthread_mutex_lock(&mutexQueue);
+        task->result = result;
+        task->done = 1;
+        pthread_cond_broadcast(&condDone);
+        pthread_mutex_unlock(&mutexQueue);
+    }
+}
+
+static double runThreadPool(int jobs)
+{
+    pthread_t th[WORKER_NUM];
+    int i, j;
+    for(i = 0; i < WORKER_NUM ; i++)
+    {
+        if(pthread_create(&th[i], NULL, &startThread, NULL) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    double start = nowSeconds();
+    for(i = 0; i < jobs ; i += BATCH)
+    {
+        pthread_mutex_lock(&mutexQueue);
+        for(j = 0; j < BATCH ; j++)
+        {
+            tasks[j] = (Task){ .taskFunction = &work, .arg1 = i + j, .arg2 = 1 };
+        }
+        taskNext = 0;
+        taskCount = BATCH;
+        pthread_cond_broadcast(&condQueue);
+        for(j = 0; j < BATCH ; j++)
+        {
+            while(!tasks[j].done)
+            {
+                pthread_cond_wait(&condDone, &mutexQueue);
+            }
+        }
+        pthread_mutex_unlock(&mutexQueue);
+    }
+    double rate = jobs / (nowSeconds() - start);
+
+    pthread_mutex_lock(&mutexQueue);
+    stopThreads = 1;
+    pthread_cond_broadcast(&condQueue);
+    pthread_mutex_unlock(&mutexQueue);
+    for(i = 0; i < WORKER_NUM ; i++)
+    {
+        if(pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    return rate;
+}
+
+int main(void)
+{
+    printf("mode,workers,jobs,jobs_per_sec\n");
+    // fork() per job is slow enough that a tenth of the jobs gives a stable number
+    printf("fork_per_job,1,%d,%.0f\n", JOB_NUM / 10, runForkPerJob(JOB_NUM / 10));
+    printf("process_pool,%d,%d,%.0f\n", WORKER_NUM, JOB_NUM, runProcPool(JOB_NUM));
+    printf("thread_pool,%d,%d,%.0f\n", WORKER_NUM, JOB_NUM, runThreadPool(JOB_NUM));
+    return 0;
+}
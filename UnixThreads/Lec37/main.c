@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include "procpool.h"
+
+
+#define WORKER_NUM 4
+#define JOB_NUM 40
+
+long sum(long a , long b)
+{
+    usleep(20000);
+    return a + b;
+}
+
+long prod(long a , long b)
+{
+    usleep(20000);
+    return a * b;
+}
+
+// Simulates untrusted code with a bug: in a thread pool this would kill the whole program
+long untrusted(long a , long b)
+{
+    if(a % 7 == 0)
+    {
+        volatile int* p = NULL;
+        *p = 1;
+    }
+    return a - b;
+}
+
+void printStats(ProcPool* pool, const char* when)
+{
+    ProcPoolStats stats;
+    procPoolStats(pool, &stats);
+    printf("%s: completed %ld , crashed %ld , respawns %ld , lock recoveries %ld \n",
+        when, stats.completed, stats.crashedJobs, stats.respawns, stats.lockRecoveries);
+}
+
+int main(void)
+{
+    ProcPool* pool = procPoolCreate(WORKER_NUM);
+    if(pool == NULL)
+    {
+        perror("Failed to Create Pool");
+        return 1;
+    }
+
+    long ids[JOB_NUM];
+    long args[JOB_NUM][2];
+    int i;
+    for(i = 0; i < JOB_NUM ; i++)
+    {
+        args[i][0] = rand() % 100;
+        args[i][1] = rand() % 100;
+        JobFunction job = i % 3 == 0 ? &sum : i % 3 == 1 ? &prod : &untrusted;
+        ids[i] = procPoolSubmit(pool, job, args[i][0], args[i][1]);
+
+        if(i == JOB_NUM / 2)
+        {
+            // Kill a worker from outside while jobs are running
+            pid_t victim = procPoolWorkerPid(pool, 0);
+            if(victim > 0)
+            {
+                printf("Killing worker %d \n", victim);
+                kill(victim, SIGKILL);
+            }
+        }
+    }
+
+    for(i = 0; i < JOB_NUM ; i++)
+    {
+        long result;
+        const char* name = i % 3 == 0 ? "Sum" : i % 3 == 1 ? "Product" : "Untrusted";
+        if(procPoolResult(pool, ids[i], &result) == JOB_DONE)
+        {
+            printf("%s of %ld and %ld is %ld\n", name, args[i][0], args[i][1], result);
+        }
+        else
+        {
+            printf("%s of %ld and %ld crashed its worker\n", name, args[i][0], args[i][1]);
+        }
+    }
+
+    printStats(pool, "Done");
+    procPoolDestroy(pool);
+    return 0;
+}
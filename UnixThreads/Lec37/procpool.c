@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include "procpool.h"
+
+
+#define SUPERVISOR_POLL_MS 10    // used only when pidfd_open() is not available
+
+typedef enum SlotState
+{
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_RUNNING,
+    SLOT_DONE,
+    SLOT_CRASHED,
+} SlotState;
+
+typedef struct Job
+{
+    long id;
+    JobFunction jobFunction;
+    long arg1, arg2;
+} Job;
+
+typedef struct ResultSlot
+{
+    long id;
+    int state;
+    pid_t worker;
+    long value;
+} ResultSlot;
+
+/*
+ * Wake-up events are futex sequence words instead of pthread_cond_t: a process
+ * killed inside pthread_cond_wait() leaves a process-shared condition variable
+ * in a state that can block later signals forever. A dead futex waiter leaves
+ * nothing behind.
+ */
+typedef atomic_uint Event;
+
+// Everything here is in MAP_SHARED memory, visible to parent and workers
+typedef struct SharedPool
+{
+    pthread_mutex_t mutex;
+    Event eventJobs;       // workers wait for jobs
+    Event eventResults;    // procPoolResult() waits for results
+    Event eventSpace;      // procPoolSubmit() waits for queue / slot space
+    Job queue[PROCPOOL_QUEUE_SIZE];
+    int head;
+    int count;
+    long nextId;
+    int stop;
+    ResultSlot results[PROCPOOL_RESULT_SLOTS];
+    ProcPoolStats stats;
+} SharedPool;
+
+struct ProcPool
+{
+    SharedPool* shared;
+    int workerCount;
+    pid_t* pids;
+    int* pidfds;
+    int stopPipe[2];
+    pthread_t supervisor;
+};
+
+static void postShared(Event* event, int waiters)
+{
+    atomic_fetch_add(event, 1);
+    syscall(SYS_futex, event, FUTEX_WAKE, waiters, NULL, NULL, 0);
+}
+
+// Called with the mutex held after a previous owner died in the middle of an update
+static void repairShared(SharedPool* shared)
+{
+    if(shared->head < 0 || shared->head >= PROCPOOL_QUEUE_SIZE)
+    {
+        shared->head = 0;
+    }
+    if(shared->count < 0 || shared->count > PROCPOOL_QUEUE_SIZE)
+    {
+        shared->count = 0;
+    }
+    // A worker that died between taking a job off the queue and marking it running leaves
+    // its slot SLOT_QUEUED with nothing left to run it: report it as crashed
+    char inQueue[PROCPOOL_RESULT_SLOTS] = { 0 };
+    int i;
+    for(i = 0; i < shared->count ; i++)
+    {
+        const Job* job = &shared->queue[(shared->head + i) % PROCPOOL_QUEUE_SIZE];
+        if(job->id >= 0 && shared->results[job->id % PROCPOOL_RESULT_SLOTS].id == job->id)
+        {
+            inQueue[job->id % PROCPOOL_RESULT_SLOTS] = 1;
+        }
+    }
+    for(i = 0; i < PROCPOOL_RESULT_SLOTS ; i++)
+    {
+        if(shared->results[i].state == SLOT_QUEUED && !inQueue[i])
+        {
+            shared->results[i].state = SLOT_CRASHED;
+            shared->stats.crashedJobs++;
+            postShared(&shared->eventResults, INT_MAX);
+        }
+    }
+    shared->stats.lockRecoveries++;
+    pthread_mutex_consistent(&shared->mutex);
+}
+
+static void lockShared(SharedPool* shared)
+{
+    if(pthread_mutex_lock(&shared->mutex) == EOWNERDEAD)
+    {
+        repairShared(shared);
+    }
+}
+
+// Like pthread_cond_wait(): called and returns with the mutex held
+static void waitShared(SharedPool* shared, Event* event)
+{
+    unsigned int seen = atomic_load(event);
+    pthread_mutex_unlock(&shared->mutex);
+    // Returns at once if the event was posted after `seen` was read
+    syscall(SYS_futex, event, FUTEX_WAIT, seen, NULL, NULL, 0);
+    lockShared(shared);
+}
+
+static void workerLoop(SharedPool* shared)
+{
+    pid_t self = getpid();
+
+    // Do not outlive the parent
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    while(1)
+    {
+        Job job;
+        ResultSlot* slot;
+
+        lockShared(shared);
+        while(1)
+        {
+            while(shared->count == 0 && !shared->stop)
+            {
+                waitShared(shared, &shared->eventJobs);
+            }
+            if(shared->count == 0)
+            {
+                pthread_mutex_unlock(&shared->mutex);
+                _exit(0);
+            }
+            job = shared->queue[shared->head];
+            shared->head = (shared->head + 1) % PROCPOOL_QUEUE_SIZE;
+            shared->count--;
+            slot = &shared->results[job.id % PROCPOOL_RESULT_SLOTS];
+            // A job whose slot is no longer queued was already reported as crashed
+            if(slot->id == job.id && slot->state == SLOT_QUEUED)
+            {
+                break;
+            }
+        }
+        slot->state = SLOT_RUNNING;
+        slot->worker = self;
+        postShared(&shared->eventSpace, INT_MAX);
+        pthread_mutex_unlock(&shared->mutex);
+
+        long value = job.jobFunction(job.arg1, job.arg2);
+
+        lockShared(shared);
+        if(slot->id == job.id && slot->state == SLOT_RUNNING && slot->worker == self)
+        {
+            slot->value = value;
+            slot->state = SLOT_DONE;
+            shared->stats.completed++;
+            postShared(&shared->eventResults, INT_MAX);
+        }
+        pthread_mutex_unlock(&shared->mutex);
+    }
+}
+
+static pid_t spawnWorker(ProcPool* pool, int index)
+{
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        workerLoop(pool->shared);
+        _exit(0);
+    }
+    if(pid < 0)
+    {
+        perror("Failed to Fork Worker");
+        return -1;
+    }
+    pool->pids[index] = pid;
+    pool->pidfds[index] = (int)syscall(SYS_pidfd_open, pid, 0);
+    return pid;
+}
+
+// A worker died: fail the job it was running and fork a replacement
+static void workerDied(ProcPool* pool, int index, int status)
+{
+    SharedPool* shared = pool->shared;
+    pid_t pid = pool->pids[index];
+    int i;
+
+    lockShared(shared);
+    for(i = 0; i < PROCPOOL_RESULT_SLOTS ; i++)
+    {
+        ResultSlot* slot = &shared->results[i];
+        if(slot->state == SLOT_RUNNING && slot->worker == pid)
+        {
+            slot->state = SLOT_CRASHED;
+            shared->stats.crashedJobs++;
+        }
+    }
+    postShared(&shared->eventResults, INT_MAX);
+    // The dead worker may have taken a job wake-up with it
+    postShared(&shared->eventJobs, INT_MAX);
+    int stopping = shared->stop;
+    if(!stopping && (WIFSIGNALED(status) || WEXITSTATUS(status) != 0))
+    {
+        shared->stats.respawns++;
+    }
+    pthread_mutex_unlock(&shared->mutex);
+
+    if(pool->pidfds[index] >= 0)
+    {
+        close(pool->pidfds[index]);
+    }
+    pool->pids[index] = -1;
+    pool->pidfds[index] = -1;
+    if(!stopping)
+    {
+        spawnWorker(pool, index);
+    }
+}
+
+static void* supervisor(void* args)
+{
+    ProcPool* pool = args;
+    struct pollfd* fds = malloc(sizeof(struct pollfd) * (pool->workerCount + 1));
+
+    while(1)
+    {
+        int i;
+        int alive = 0;
+        int usePidfd = 1;
+        for(i = 0; i < pool->workerCount ; i++)
+        {
+            fds[i].fd = pool->pidfds[i];
+            fds[i].events = POLLIN;
+            usePidfd &= pool->pidfds[i] >= 0 || pool->pids[i] < 0;
+            alive += pool->pids[i] > 0;
+        }
+        fds[pool->workerCount].fd = pool->stopPipe[0];
+        fds[pool->workerCount].events = POLLIN;
+        if(alive == 0)
+        {
+            break;
+        }
+        poll(fds, pool->workerCount + 1, usePidfd ? -1 : SUPERVISOR_POLL_MS);
+
+        for(i = 0; i < pool->workerCount ; i++)
+        {
+            int status;
+            if(pool->pids[i] > 0 && waitpid(pool->pids[i], &status, WNOHANG) == pool->pids[i])
+            {
+                workerDied(pool, i, status);
+            }
+        }
+        if(fds[pool->workerCount].revents & POLLIN)
+        {
+            // Stop requested: keep reaping until every worker is gone
+            char c;
+            if(read(pool->stopPipe[0], &c, 1) <= 0)
+            {
+                fds[pool->workerCount].fd = -1;
+            }
+        }
+    }
+    free(fds);
+    return NULL;
+}
+
+ProcPool* procPoolCreate(int workerCount)
+{
+    ProcPool* pool = calloc(1, sizeof(ProcPool));
+    SharedPool* shared = mmap(NULL, sizeof(SharedPool), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED)
+    {
+        free(pool);
+        return NULL;
+    }
+    memset(shared, 0, sizeof(SharedPool));
+
+    pthread_mutexattr_t mutexAttr;
+    pthread_mutexattr_init(&mutexAttr);
+    pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared->mutex, &mutexAttr);
+    pthread_mutexattr_destroy(&mutexAttr);
+    shared->nextId = 1;
+
+    pool->shared = shared;
+    pool->workerCount = workerCount;
+    pool->pids = malloc(sizeof(pid_t) * workerCount);
+    pool->pidfds = malloc(sizeof(int) * workerCount);
+    if(pipe(pool->stopPipe) != 0)
+    {
+        perror("Failed to Create Pipe");
+    }
+
+    int i;
+    for(i = 0; i < workerCount ; i++)
+    {
+        pool->pids[i] = -1;
+        pool->pidfds[i] = -1;
+        spawnWorker(pool, i);
+    }
+    if(pthread_create(&pool->supervisor, NULL, &supervisor, pool) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+    return pool;
+}
+
+long procPoolSubmit(ProcPool* pool, JobFunction jobFunction, long arg1, long arg2)
+{
+    SharedPool* shared = pool->shared;
+    lockShared(shared);
+    while(shared->count == PROCPOOL_QUEUE_SIZE ||
+          shared->results[shared->nextId % PROCPOOL_RESULT_SLOTS].state != SLOT_FREE)
+    {
+        waitShared(shared, &shared->eventSpace);
+    }
+    long id = shared->nextId++;
+    ResultSlot* slot = &shared->results[id % PROCPOOL_RESULT_SLOTS];
+    slot->id = id;
+    slot->state = SLOT_QUEUED;
+    slot->worker = 0;
+
+    Job* job = &shared->queue[(shared->head + shared->count) % PROCPOOL_QUEUE_SIZE];
+    job->id = id;
+    job->jobFunction = jobFunction;
+    job->arg1 = arg1;
+    job->arg2 = arg2;
+    shared->count++;
+    postShared(&shared->eventJobs, 1);
+    pthread_mutex_unlock(&shared->mutex);
+    return id;
+}
+
+int procPoolResult(ProcPool* pool, long id, long* result)
+{
+    SharedPool* shared = pool->shared;
+    ResultSlot* slot = &shared->results[id % PROCPOOL_RESULT_SLOTS];
+    int status;
+
+    lockShared(shared);
+    while(slot->id == id && slot->state != SLOT_DONE && slot->state != SLOT_CRASHED)
+    {
+        waitShared(shared, &shared->eventResults);
+    }
+    if(slot->id == id && slot->state == SLOT_DONE)
+    {
+        *result = slot->value;
+        status = JOB_DONE;
+    }
+    else
+    {
+        status = JOB_CRASHED;
+    }
+    if(slot->id == id)
+    {
+        slot->state = SLOT_FREE;
+        postShared(&shared->eventSpace, INT_MAX);
+    }
+    pthread_mutex_unlock(&shared->mutex);
+    return status;
+}
+
+pid_t procPoolWorkerPid(ProcPool* pool, int index)
+{
+    return pool->pids[index];
+}
+
+void procPoolStats(ProcPool* pool, ProcPoolStats* stats)
+{
+    lockShared(pool->shared);
+    *stats = pool->shared->stats;
+    pthread_mutex_unlock(&pool->shared->mutex);
+}
+
+void procPoolDestroy(ProcPool* pool)
+{
+    SharedPool* shared = pool->shared;
+    lockShared(shared);
+    shared->stop = 1;
+    postShared(&shared->eventJobs, INT_MAX);
+    pthread_mutex_unlock(&shared->mutex);
+
+    char c = 0;
+    if(write(pool->stopPipe[1], &c, 1) != 1)
+    {
+        perror("Failed to Stop Supervisor");
+    }
+    pthread_join(pool->supervisor, NULL);
+
+    close(pool->stopPipe[0]);
+    close(pool->stopPipe[1]);
+    pthread_mutex_destroy(&shared->mutex);
+    munmap(shared, sizeof(SharedPool));
+    free(pool->pids);
+    free(pool->pidfds);
+    free(pool);
+}
@@ -0,0 +1,59 @@
+#ifndef PROCPOOL_H
+#define PROCPOOL_H
+
+#include <sys/types.h>
+
+/*
+ * Pre-forked worker process pool.
+ *
+ * The job queue and the result slots live in mmap(MAP_SHARED) memory that is
+ * shared by the parent and the forked workers. They are protected by a
+ * process-shared robust mutex: if a worker dies while holding it, the next
+ * process to lock it gets EOWNERDEAD, repairs the queue and carries on.
+ * Waiting is done on plain futex words, which a killed waiter cannot jam.
+ *
+ * A supervisor thread in the parent reaps dead workers, marks the job they
+ * were running as crashed and forks a replacement.
+ *
+ * Job functions are plain function pointers: the workers are forked from the
+ * parent without exec(), so every function has the same address in them.
+ */
+
+#define PROCPOOL_QUEUE_SIZE 256
+#define PROCPOOL_RESULT_SLOTS 1024
+
+typedef long (*JobFunction)(long, long);
+
+typedef enum JobStatus
+{
+    JOB_DONE = 0,
+    JOB_CRASHED = -1,
+} JobStatus;
+
+typedef struct ProcPoolStats
+{
+    long completed;
+    long crashedJobs;
+    long respawns;
+    long lockRecoveries;     // times a dead owner's mutex was made consistent
+} ProcPoolStats;
+
+typedef struct ProcPool ProcPool;
+
+ProcPool* procPoolCreate(int workerCount);
+
+// Queues a job, blocks while the queue is full. Returns the job id.
+long procPoolSubmit(ProcPool* pool, JobFunction jobFunction, long arg1, long arg2);
+
+// Waits for job `id`. Returns JOB_DONE with *result set, or JOB_CRASHED.
+int procPoolResult(ProcPool* pool, long id, long* result);
+
+// Pid of worker `index`, e.g. to kill it in a test
+pid_t procPoolWorkerPid(ProcPool* pool, int index);
+
+void procPoolStats(ProcPool* pool, ProcPoolStats* stats);
+
+// Lets the workers drain the queue, then stops and reaps them
+void procPoolDestroy(ProcPool* pool);
+
+#endif
@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+
+
+#define LATENCY_RUNS 200
+#define ROUNDTRIP_RUNS 500
+#define CLONE_STACK_SIZE (64 * 1024)
+#define STAMP_FD 10     // posix_spawn child writes its start time here
+#define HOLD_FD 11      // posix_spawn child blocks on this until released
+
+extern char** environ;
+
+typedef enum Kind
+{
+    KIND_FORK,
+    KIND_VFORK,
+    KIND_SPAWN,
+    KIND_CLONE,
+    KIND_THREAD,
+} Kind;
+
+typedef struct Mode
+{
+    const char* name;
+    Kind kind;
+    int cloneFlags;
+    size_t stackSize;     // pthread stack size, 0 = default
+} Mode;
+
+static const Mode modes[] =
+{
+    { "fork",                    KIND_FORK,   0, 0 },
+    { "vfork",                   KIND_VFORK,  0, 0 },
+    { "posix_spawn",             KIND_SPAWN,  0, 0 },
+    { "clone(SIGCHLD)",          KIND_CLONE,  SIGCHLD, 0 },
+    { "clone(VM)",               KIND_CLONE,  CLONE_VM | SIGCHLD, 0 },
+    { "clone(VM|FS|FILES|SIGHAND)", KIND_CLONE, CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | SIGCHLD, 0 },
+    { "clone(VM|VFORK)",         KIND_CLONE,  CLONE_VM | CLONE_VFORK | SIGCHLD, 0 },
+    { "pthread_create(16K)",     KIND_THREAD, 0, 16 * 1024 },
+    { "pthread_create(256K)",    KIND_THREAD, 0, 256 * 1024 },
+    { "pthread_create(default)", KIND_THREAD, 0, 0 },
+};
+
+// Start time written by the child, in MAP_SHARED memory so forked children can write it too
+static volatile long* childStamp;
+static int holdPipe[2];
+static int stampPipe[2];
+static int holding;
+static char* selfPath;
+
+static long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// First thing every child / thread does
+static void childStart(void)
+{
+    *childStamp = nowNs();
+    if(holding)
+    {
+        char c;
+        if(read(holdPipe[0], &c, 1) < 0)
+        {
+            _exit(1);
+        }
+    }
+}
+
+static int cloneChild(void* args)
+{
+    childStart();
+    return 0;
+}
+
+static void * threadChild(void* args)
+{
+    childStart();
+    return NULL;
+}
+
+// Sum of "<key> <n> kB" lines in a /proc file
+static long procKb(const char* path, const char* key1, const char* key2)
+{
+    FILE* f = fopen(path, "r");
+    char line[256];
+    long total = 0;
+    if(f == NULL)
+    {
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        long kb;
+        if((strncmp(line, key1, strlen(key1)) == 0 || (key2 != NULL && strncmp(line, key2, strlen(key2)) == 0)) &&
+            sscanf(strchr(line, ':') + 1, "%ld", &kb) == 1)
+        {
+            total += kb;
+        }
+    }
+    fclose(f);
+    return total;
+}
+
+// Memory a child adds: its private pages and page tables, or the growth of our own
+// process when the child shares our address space
+static long selfMemoryKb(void)
+{
+    return procKb("/proc/self/status", "VmRSS:", "VmPTE:");
+}
+
+static long childMemoryKb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    long privateKb = procKb(path, "Private_Clean:", "Private_Dirty:");
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    return privateKb + procKb(path, "VmPTE:", NULL);
+}
+
+/*
+ * Creates one child of the given mode and waits for it.
+ * With `holdKb` != NULL the child blocks until its memory has been measured.
+ */
+static void createAndWait(const Mode* mode, long* holdKb)
+{
+    static char* cloneStack;
+    pid_t pid = -1;
+    long before = 0;
+
+    // A vfork-style child suspends us until it exits: it cannot be held for measuring
+    int suspendsParent = mode->kind == KIND_VFORK || (mode->cloneFlags & CLONE_VFORK);
+    holding = holdKb != NULL && !suspendsParent;
+    if(holdKb != NULL)
+    {
+        *holdKb = -1;
+        before = selfMemoryKb();
+    }
+
+    switch(mode->kind)
+    {
+        case KIND_FORK:
+            pid = fork();
+            if(pid == 0)
+            {
+                childStart();
+                _exit(0);
+            }
+            break;
+
+        case KIND_VFORK:
+            pid = vfork();
+            if(pid == 0)
+            {
+                *childStamp = nowNs();
+                _exit(0);
+            }
+            break;
+
+        case KIND_SPAWN:
+        {
+            // The child is this program again, started with --child
+            char* argv[] = { selfPath, "--child", NULL };
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_adddup2(&actions, stampPipe[1], STAMP_FD);
+            if(holding)
+            {
+                posix_spawn_file_actions_adddup2(&actions, holdPipe[0], HOLD_FD);
+            }
+            if(posix_spawn(&pid, selfPath, &actions, NULL, argv, environ) != 0)
+            {
+                pid = -1;
+            }
+            posix_spawn_file_actions_destroy(&actions);
+            long stamp;
+            if(pid > 0 && read(stampPipe[0], &stamp, sizeof(stamp)) == sizeof(stamp))
+            {
+                *childStamp = stamp;
+            }
+            break;
+        }
+
+        case KIND_CLONE:
+            if(cloneStack == NULL)
+            {
+                cloneStack = mmap(NULL, CLONE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+            }
+            pid = clone(&cloneChild, cloneStack + CLONE_STACK_SIZE, mode->cloneFlags, NULL);
+            break;
+
+        case KIND_THREAD:
+        {
+            pthread_t th;
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            if(mode->stackSize != 0)
+            {
+                pthread_attr_setstacksize(&attr, mode->stackSize < (size_t)PTHREAD_STACK_MIN ? (size_t)PTHREAD_STACK_MIN : mode->stackSize);
+            }
+            if(pthread_create(&th, &attr, &threadChild, NULL) != 0)
+            {
+                perror("Failed to Create Thread");
+                exit(1);
+            }
+            pthread_attr_destroy(&attr);
+            if(holding)
+            {
+                while(*childStamp == 0)
+                {
+                    sched_yield();
+                }
+                *holdKb = selfMemoryKb() - before;
+                if(write(holdPipe[1], "x", 1) != 1)
+                {
+                    perror("Failed to Release Thread");
+                }
+            }
+            if(pthread_join(th, NULL) != 0)
+            {
+                perror("Failed to Join Thread");
+            }
+            return;
+        }
+    }
+
+    if(pid < 0)
+    {
+        perror("Failed to Create Process");
+        exit(1);
+    }
+    if(holding)
+    {
+        while(*childStamp == 0)
+        {
+            sched_yield();
+        }
+        *holdKb = (mode->cloneFlags & CLONE_VM) ? selfMemoryKb() - before : childMemoryKb(pid);
+        if(write(holdPipe[1], "x", 1) != 1)
+        {
+            perror("Failed to Release Child");
+        }
+    }
+    if(waitpid(pid, NULL, __WALL) != pid)
+    {
+        perror("Failed to Wait Child");
+    }
+}
+
+static int compareLong(const void* a, const void* b)
+{
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static void runMode(const Mode* mode)
+{
+    static long latencies[LATENCY_RUNS];
+    int i;
+
+    // Creation to first instruction
+    for(i = 0; i < LATENCY_RUNS ; i++)
+    {
+        *childStamp = 0;
+        long start = nowNs();
+        createAndWait(mode, NULL);
+        latencies[i] = *childStamp - start;
+    }
+    qsort(latencies, LATENCY_RUNS, sizeof(long), compareLong);
+
+    // Round trip: create + wait / join
+    long start = nowNs();
+    for(i = 0; i < ROUNDTRIP_RUNS ; i++)
+    {
+        createAndWait(mode, NULL);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    // Memory while one child is alive
+    long overheadKb;
+    *childStamp = 0;
+    createAndWait(mode, &overheadKb);
+
+    long parentRssMb = procKb("/proc/self/status", "VmRSS:", NULL) / 1024;
+    printf("%s,%ld,%.1f,%.1f,%.0f,", mode->name, parentRssMb,
+        latencies[LATENCY_RUNS / 2] / 1e3, latencies[LATENCY_RUNS * 99 / 100] / 1e3,
+        ROUNDTRIP_RUNS / seconds);
+    if(overheadKb < 0)
+    {
+        printf("NA\n");
+    }
+    else
+    {
+        printf("%ld\n", overheadKb);
+    }
+    fflush(stdout);
+}
+
+// posix_spawn target: report the start time, optionally wait to be released
+static int spawnedChild(void)
+{
+    long stamp = nowNs();
+    if(write(STAMP_FD, &stamp, sizeof(stamp)) != sizeof(stamp))
+    {
+        return 1;
+    }
+    char c;
+    if(read(HOLD_FD, &c, 1) < 0)
+    {
+        return 0;   // not held: HOLD_FD was not passed
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc > 1 && strcmp(argv[1], "--child") == 0)
+    {
+        return spawnedChild();
+    }
+
+    // Extra parent RSS in MB, from the command line or a default sweep
+    static const long defaultSizes[] = { 0, 16, 64, 256 };
+    int sizeCount = argc > 1 ? argc - 1 : (int)(sizeof(defaultSizes) / sizeof(defaultSizes[0]));
+
+    selfPath = realpath("/proc/self/exe", NULL);
+    childStamp = mmap(NULL, sizeof(long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    // Close-on-exec: only the descriptors dup2()ed by posix_spawn reach the spawned child
+    if(pipe2(holdPipe, O_CLOEXEC) != 0 || pipe2(stampPipe, O_CLOEXEC) != 0)
+    {
+        perror("Failed to Create Pipe");
+        return 1;
+    }
+
+    printf("mode,parent_rss_mb,latency_p50_us,latency_p99_us,roundtrips_per_sec,child_overhead_kb\n");
+    int s;
+    for(s = 0; s < sizeCount ; s++)
+    {
+        long sizeMb = argc > 1 ? atol(argv[s + 1]) : defaultSizes[s];
+
+        // Ballast: touched anonymous memory that fork() must copy page tables for
+        char* ballast = NULL;
+        if(sizeMb > 0)
+        {
+            ballast = mmap(NULL, sizeMb << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(ballast == MAP_FAILED)
+            {
+                perror("Failed to Allocate Ballast");
+                return 1;
+            }
+            memset(ballast, 1, sizeMb << 20);
+        }
+
+        size_t m;
+        for(m = 0; m < sizeof(modes) / sizeof(modes[0]) ; m++)
+        {
+            runMode(&modes[m]);
+        }
+
+        if(ballast != NULL)
+        {
+            munmap(ballast, sizeMb << 20);
+        }
+    }
+
+    free(selfPath);
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "snapshot.h"
+
+
+#define ACCOUNT_NUM (4 * 1024 * 1024)      // 32MB of balances
+#define INITIAL_BALANCE 100
+#define SNAPSHOT_NUM 3
+#define SNAPSHOT_PATH "accounts.snap"
+
+typedef struct SnapshotHeader
+{
+    long accountCount;
+    long total;
+} SnapshotHeader;
+
+long* accounts;
+pthread_mutex_t mutexBank;
+atomic_long transfers;
+atomic_int stopServing;
+
+// The "server": moves money between random accounts, the total never changes
+void * serveTransfers(void* args)
+{
+    unsigned int seed = 1;
+    while(!atomic_load(&stopServing))
+    {
+        int from = rand_r(&seed) % ACCOUNT_NUM;
+        int to = rand_r(&seed) % ACCOUNT_NUM;
+        long amount = rand_r(&seed) % 10;
+
+        pthread_mutex_lock(&mutexBank);
+        accounts[from] -= amount;
+        accounts[to] += amount;
+        pthread_mutex_unlock(&mutexBank);
+        atomic_fetch_add_explicit(&transfers, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// Runs in the snapshot child, on its frozen copy of `accounts`
+int writeAccounts(int fd, void* context)
+{
+    long* frozen = context;
+    SnapshotHeader header = { ACCOUNT_NUM, 0 };
+    long i;
+    for(i = 0; i < ACCOUNT_NUM ; i++)
+    {
+        header.total += frozen[i];
+    }
+    if(snapshotWriteAll(fd, &header, sizeof(header)) != 0)
+    {
+        return -1;
+    }
+    return snapshotWriteAll(fd, frozen, sizeof(long) * ACCOUNT_NUM);
+}
+
+long verifySnapshot(const char* path)
+{
+    SnapshotHeader header;
+    long* copy = malloc(sizeof(long) * ACCOUNT_NUM);
+    long total = 0;
+    long i;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0 || read(fd, &header, sizeof(header)) != sizeof(header) ||
+       read(fd, copy, sizeof(long) * ACCOUNT_NUM) != (ssize_t)(sizeof(long) * ACCOUNT_NUM))
+    {
+        perror("Failed to Read Snapshot");
+        exit(1);
+    }
+    close(fd);
+    for(i = 0; i < ACCOUNT_NUM ; i++)
+    {
+        total += copy[i];
+    }
+    free(copy);
+    return total;
+}
+
+long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+int main(void)
+{
+    pthread_t server;
+    long i;
+    accounts = malloc(sizeof(long) * ACCOUNT_NUM);
+    for(i = 0; i < ACCOUNT_NUM ; i++)
+    {
+        accounts[i] = INITIAL_BALANCE;
+    }
+    pthread_mutex_init(&mutexBank, NULL);
+    if(pthread_create(&server, NULL, &serveTransfers, NULL) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+
+    // Baseline: stop the world and write while holding the lock
+    sleep(1);
+    long start = nowMs();
+    pthread_mutex_lock(&mutexBank);
+    int fd = open(SNAPSHOT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    writeAccounts(fd, accounts);
+    fsync(fd);
+    close(fd);
+    pthread_mutex_unlock(&mutexBank);
+    printf("Locked write: server paused %ld ms \n", nowMs() - start);
+
+    int s;
+    for(s = 0; s < SNAPSHOT_NUM ; s++)
+    {
+        SnapshotStats stats;
+        sleep(1);
+
+        // The lock is held only across fork(): the child gets a consistent copy
+        long before = atomic_load(&transfers);
+        start = nowMs();
+        pthread_mutex_lock(&mutexBank);
+        if(snapshotStart(SNAPSHOT_PATH, &writeAccounts, accounts) != 0)
+        {
+            perror("Failed to Start Snapshot");
+        }
+        pthread_mutex_unlock(&mutexBank);
+
+        // Keep doing other work while the child writes
+        while(snapshotPoll(&stats) == 0)
+        {
+            usleep(1000);
+        }
+        double seconds = (nowMs() - start) / 1e3;
+
+        printf("Snapshot %d: %s , fork pause %ld us , %ld COW faults (%ld KB) , %ld ms , %ld bytes , %.0f transfers/s meanwhile \n",
+            s, stats.ok ? "ok" : "FAILED", stats.forkPauseUs, stats.cowFaults, stats.cowBytes / 1024,
+            stats.durationMs, stats.bytesWritten, (atomic_load(&transfers) - before) / seconds);
+        printf("Snapshot %d total: %ld (expected %ld) \n", s, verifySnapshot(SNAPSHOT_PATH), (long)ACCOUNT_NUM * INITIAL_BALANCE);
+    }
+
+    atomic_store(&stopServing, 1);
+    if(pthread_join(server, NULL) != 0)
+    {
+        perror("Failed to Join Thread");
+    }
+    pthread_mutex_destroy(&mutexBank);
+    free(accounts);
+    unlink(SNAPSHOT_PATH);
+    return 0;
+}
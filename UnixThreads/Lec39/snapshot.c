@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "snapshot.h"
+
+
+// State of the running snapshot, owned by the thread that called snapshotStart()
+static pid_t childPid = -1;
+static char finalPath[PATH_MAX];
+static long startNs;
+static long startFaults;
+static long forkPauseUs;
+
+static long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Minor faults of the whole process: after fork() they are mostly copy-on-write copies
+static long minorFaults(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+int snapshotWriteAll(int fd, const void* buffer, size_t size)
+{
+    const char* p = buffer;
+    while(size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Runs in the child: write to "<path>.tmp", then rename so readers never see half a file
+static void childMain(const char* path, SnapshotWriter writer, void* context)
+{
+    char tmpPath[PATH_MAX + 8];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    // The parent is the one serving requests
+    setpriority(PRIO_PROCESS, 0, 10);
+
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        _exit(1);
+    }
+    if(writer(fd, context) != 0 || fsync(fd) != 0)
+    {
+        close(fd);
+        unlink(tmpPath);
+        _exit(1);
+    }
+    close(fd);
+    if(rename(tmpPath, path) != 0)
+    {
+        unlink(tmpPath);
+        _exit(1);
+    }
+    _exit(0);
+}
+
+int snapshotStart(const char* path, SnapshotWriter writer, void* context)
+{
+    if(childPid > 0)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    if(strlen(path) >= sizeof(finalPath))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(finalPath, path);
+
+    startFaults = minorFaults();
+    startNs = nowNs();
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        childMain(path, writer, context);
+    }
+    forkPauseUs = (nowNs() - startNs) / 1000;
+    if(pid < 0)
+    {
+        return -1;
+    }
+    childPid = pid;
+    return 0;
+}
+
+static int finish(int status, SnapshotStats* stats)
+{
+    struct stat st;
+    stats->forkPauseUs = forkPauseUs;
+    stats->cowFaults = minorFaults() - startFaults;
+    stats->cowBytes = stats->cowFaults * sysconf(_SC_PAGESIZE);
+    stats->durationMs = (nowNs() - startNs) / 1000000;
+    stats->ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    stats->bytesWritten = stats->ok && stat(finalPath, &st) == 0 ? st.st_size : 0;
+    childPid = -1;
+    return 1;
+}
+
+int snapshotPoll(SnapshotStats* stats)
+{
+    int status;
+    if(childPid <= 0)
+    {
+        return -1;
+    }
+    pid_t pid = waitpid(childPid, &status, WNOHANG);
+    if(pid == 0)
+    {
+        return 0;
+    }
+    if(pid < 0)
+    {
+        status = -1;
+    }
+    return finish(status, stats);
+}
+
+int snapshotWait(SnapshotStats* stats)
+{
+    int status;
+    if(childPid <= 0)
+    {
+        return -1;
+    }
+    while(waitpid(childPid, &status, 0) < 0)
+    {
+        if(errno != EINTR)
+        {
+            status = -1;
+            break;
+        }
+    }
+    return finish(status, stats);
+}
@@ -0,0 +1,50 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+
+/*
+ * Fork-based copy-on-write snapshots (Processes2.2.c, at scale).
+ *
+ * snapshotStart() forks. The child sees the memory exactly as it was at the
+ * moment of fork() and serializes it to `path` with the writer callback, while
+ * the parent keeps modifying its own copy. The kernel copies a page only when
+ * the parent writes to it for the first time, so the parent is only paused for
+ * the fork() itself plus one page fault per page it touches.
+ *
+ * For a consistent image, call snapshotStart() at a point where the data is
+ * not half-updated: e.g. while holding the data's lock. The lock is needed only
+ * for the duration of fork(), not for the serialization.
+ *
+ * The writer runs in a forked copy of a possibly multi-threaded process: it
+ * should only use write()-style system calls, not malloc() or stdio.
+ *
+ * One snapshot can be in progress at a time.
+ */
+
+// Serializes the state to `fd`. Returns 0 on success, -1 on failure.
+typedef int (*SnapshotWriter)(int fd, void* context);
+
+typedef struct SnapshotStats
+{
+    long forkPauseUs;       // time the caller spent inside fork()
+    long cowFaults;         // parent page faults while the child was running
+    long cowBytes;          // cowFaults * page size: upper bound of memory copied
+    long durationMs;        // fork() until the child finished
+    long bytesWritten;      // size of the snapshot file
+    int ok;                 // 1 if the snapshot was written and renamed into place
+} SnapshotStats;
+
+// Returns 0, or -1 with errno set (EBUSY if a snapshot is already running)
+int snapshotStart(const char* path, SnapshotWriter writer, void* context);
+
+// 1 = finished and *stats filled, 0 = still running, -1 = no snapshot running
+int snapshotPoll(SnapshotStats* stats);
+
+// Blocks until the running snapshot finishes. Returns -1 if none was running.
+int snapshotWait(SnapshotStats* stats);
+
+// write() until all of `buffer` is written, for use in writers
+int snapshotWriteAll(int fd, const void* buffer, size_t size);
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include "timerpool.h"
+
+
+#define WHEEL_TIMERS 1000000
+#define POOL_TIMERS 20000
+#define THREAD_TIMERS 2000
+#define MAX_DELAY_MS 1000
+
+long* lateness;
+long* dueNs;
+atomic_int firedCount;
+
+static long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int compareLong(const void* a, const void* b)
+{
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+void noFire(Task* task, void* context)
+{
+}
+
+void recordLateness(int index , int unused)
+{
+    lateness[index] = nowNs() - dueNs[index];
+    atomic_fetch_add(&firedCount, 1);
+}
+
+void * sleepingThread(void* args)
+{
+    int index = (int)(long)args;
+    long delay = dueNs[index] - nowNs();
+    if(delay > 0)
+    {
+        usleep(delay / 1000);
+    }
+    recordLateness(index, 0);
+    return NULL;
+}
+
+static void printLateness(const char* mode, int count, double insertNs, int threads)
+{
+    qsort(lateness, count, sizeof(long), compareLong);
+    printf("%s,%d,%.0f,,,%.0f,%.0f,%.0f,%d\n", mode, count, insertNs,
+        lateness[count / 2] / 1e3, lateness[count * 99 / 100] / 1e3, lateness[count - 1] / 1e3, threads);
+}
+
+// Raw data structure cost: no threads, no clock
+static void benchWheel(void)
+{
+    TimerWheel wheel;
+    static TimerId ids[WHEEL_TIMERS];
+    int i;
+    timerWheelInit(&wheel, 0);
+
+    long start = nowNs();
+    for(i = 0; i < WHEEL_TIMERS ; i++)
+    {
+        ids[i] = timerWheelAdd(&wheel, 1 + rand() % 60000, 0, (Task){ 0 });
+    }
+    double insertNs = (double)(nowNs() - start) / WHEEL_TIMERS;
+
+    start = nowNs();
+    for(i = 0; i < WHEEL_TIMERS ; i += 2)
+    {
+        timerWheelCancel(&wheel, ids[i]);
+    }
+    double cancelNs = (double)(nowNs() - start) / (WHEEL_TIMERS / 2);
+
+    start = nowNs();
+    timerWheelAdvance(&wheel, 60000, &noFire, NULL);
+    double fireNs = (double)(nowNs() - start) / (WHEEL_TIMERS / 2);
+    timerWheelDestroy(&wheel);
+
+    printf("wheel_only,%d,%.0f,%.0f,%.0f,,,,0\n",
+        WHEEL_TIMERS, insertNs, cancelNs, fireNs);
+}
+
+static void benchPool(void)
+{
+    int i;
+    atomic_store(&firedCount, 0);
+    poolStart(4);
+    long start = nowNs();
+    for(i = 0; i < POOL_TIMERS ; i++)
+    {
+        long delayMs = rand() % MAX_DELAY_MS;
+        dueNs[i] = nowNs() + delayMs * 1000000L;
+        submitAfter(delayMs, (Task){ .taskFunction = &recordLateness, .arg1 = i });
+    }
+    double insertNs = (double)(nowNs() - start) / POOL_TIMERS;
+    while(atomic_load(&firedCount) < POOL_TIMERS)
+    {
+        usleep(10000);
+    }
+    poolStop();
+    printLateness("timer_wheel_pool", POOL_TIMERS, insertNs, 4 + 1);
+}
+
+// The old way: a thread that sleeps for every delay
+static void benchThreads(void)
+{
+    static pthread_t th[THREAD_TIMERS];
+    int i;
+    atomic_store(&firedCount, 0);
+    long start = nowNs();
+    for(i = 0; i < THREAD_TIMERS ; i++)
+    {
+        dueNs[i] = nowNs() + (rand() % MAX_DELAY_MS) * 1000000L;
+        if(pthread_create(&th[i], NULL, &sleepingThread, (void*)(long)i) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    double insertNs = (double)(nowNs() - start) / THREAD_TIMERS;
+    for(i = 0; i < THREAD_TIMERS ; i++)
+    {
+        if(pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    printLateness("thread_per_timer", THREAD_TIMERS, insertNs, THREAD_TIMERS);
+}
+
+int main(void)
+{
+    lateness = malloc(sizeof(long) * POOL_TIMERS);
+    dueNs = malloc(sizeof(long) * POOL_TIMERS);
+
+    printf("mode,timers,insert_ns,cancel_ns,fire_ns,lateness_p50_us,lateness_p99_us,lateness_max_us,threads\n");
+    benchWheel();
+    benchPool();
+    benchThreads();
+
+    free(lateness);
+    free(dueNs);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include "timerpool.h"
+
+
+#define THREAD_NUM 4
+
+int Fuel = 0;
+pthread_mutex_t MutexFuel;
+struct timespec startTime;
+
+long elapsedMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - startTime.tv_sec) * 1000 + (ts.tv_nsec - startTime.tv_nsec) / 1000000;
+}
+
+// Lec10's Fuel_Filling without the sleep(1): the pool calls it every period
+void fuelFilling(int amount , int unused)
+{
+    pthread_mutex_lock(&MutexFuel);
+    Fuel += amount;
+    printf("[%4ld ms] Filling Fuel %d \n", elapsedMs(), Fuel);
+    pthread_mutex_unlock(&MutexFuel);
+}
+
+void car(int need , int unused)
+{
+    pthread_mutex_lock(&MutexFuel);
+    if(Fuel >= need)
+    {
+        Fuel -= need;
+        printf("[%4ld ms] Got Fuel . Now Left %d \n", elapsedMs(), Fuel);
+    }
+    else
+    {
+        printf("[%4ld ms] No Fuel for %d \n", elapsedMs(), need);
+    }
+    pthread_mutex_unlock(&MutexFuel);
+}
+
+void sum(int a , int b)
+{
+    printf("[%4ld ms] Sum of %d and %d is %d\n", elapsedMs(), a, b, a + b);
+}
+
+int main(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    pthread_mutex_init(&MutexFuel, NULL);
+    poolStart(THREAD_NUM);
+
+    // Periodic: no thread is blocked in sleep() between fills
+    TimerId filler = submitEvery(200, (Task){ .taskFunction = &fuelFilling, .arg1 = 15 });
+
+    // Delayed
+    submitAfter(450, (Task){ .taskFunction = &car, .arg1 = 40 });
+    submitAfter(700, (Task){ .taskFunction = &car, .arg1 = 40 });
+    submitAfter(100, (Task){ .taskFunction = &sum, .arg1 = 1, .arg2 = 2 });
+    TimerId never = submitAfter(300, (Task){ .taskFunction = &sum, .arg1 = 3, .arg2 = 4 });
+    submitTask((Task){ .taskFunction = &sum, .arg1 = 5, .arg2 = 6 });
+
+    usleep(50000);
+    printf("[%4ld ms] Cancel the 300 ms task: %s \n", elapsedMs(), cancelTimer(never) == 0 ? "ok" : "too late");
+
+    usleep(950000);
+    printf("[%4ld ms] Stop filling: %s \n", elapsedMs(), cancelTimer(filler) == 0 ? "ok" : "too late");
+    usleep(300000);
+
+    poolStop();
+    pthread_mutex_destroy(&MutexFuel);
+    return 0;
+}
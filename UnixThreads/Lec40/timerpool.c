@@ -0,0 +1,245 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include "timerpool.h"
+
+
+#define MAX_THREADS 64
+
+pthread_mutex_t mutexQueue;
+pthread_cond_t condQueue;
+
+// Growable circular task queue: a burst of expiring timers must never block the timer thread
+static Task* taskQueue;
+static int queueCapacity;
+static int queueHead;
+static int taskCount;
+
+static TimerWheel wheel;
+static uint64_t armedTick = UINT64_MAX;     // tick the timerfd fires at, UINT64_MAX = disarmed
+static int timerFd;
+static struct timespec startTime;
+static int stopping;
+
+static pthread_t workers[MAX_THREADS];
+static int workerCount;
+static pthread_t timerThread;
+
+static long elapsedNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - startTime.tv_sec) * 1000000000L + (ts.tv_nsec - startTime.tv_nsec);
+}
+
+static uint64_t nowTick(void)
+{
+    return elapsedNs() / (TIMER_TICK_MS * 1000000L);
+}
+
+// Called with mutexQueue held
+static void pushTask(Task task)
+{
+    if(taskCount == queueCapacity)
+    {
+        int newCapacity = queueCapacity == 0 ? 256 : queueCapacity * 2;
+        Task* queue = malloc(sizeof(Task) * newCapacity);
+        int i;
+        for(i = 0; i < taskCount ; i++)
+        {
+            queue[i] = taskQueue[(queueHead + i) % queueCapacity];
+        }
+        free(taskQueue);
+        taskQueue = queue;
+        queueCapacity = newCapacity;
+        queueHead = 0;
+    }
+    taskQueue[(queueHead + taskCount) % queueCapacity] = task;
+    taskCount++;
+    pthread_cond_signal(&condQueue);
+}
+
+static void fireTimer(Task* task, void* context)
+{
+    pushTask(*task);
+}
+
+// Points the timerfd at the next wheel event. Called with mutexQueue held.
+static void armTimer(void)
+{
+    struct itimerspec spec = { 0 };
+    long next = timerWheelNextTicks(&wheel);
+    uint64_t tick = next < 0 ? UINT64_MAX : wheel.current + next;
+    if(tick == armedTick)
+    {
+        return;
+    }
+    if(next >= 0)
+    {
+        long ms = tick * TIMER_TICK_MS;
+        spec.it_value.tv_sec = startTime.tv_sec + ms / 1000;
+        spec.it_value.tv_nsec = startTime.tv_nsec + (ms % 1000) * 1000000;
+        if(spec.it_value.tv_nsec >= 1000000000)
+        {
+            spec.it_value.tv_sec++;
+            spec.it_value.tv_nsec -= 1000000000;
+        }
+    }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+    armedTick = tick;
+}
+
+static void * startTimerThread(void* args)
+{
+    while(1)
+    {
+        uint64_t expirations;
+        if(read(timerFd, &expirations, sizeof(expirations)) < 0)
+        {
+            perror("Failed to Read Timer");
+        }
+        pthread_mutex_lock(&mutexQueue);
+        if(stopping)
+        {
+            pthread_mutex_unlock(&mutexQueue);
+            return NULL;
+        }
+        armedTick = UINT64_MAX;
+        timerWheelAdvance(&wheel, nowTick(), &fireTimer, NULL);
+        armTimer();
+        pthread_mutex_unlock(&mutexQueue);
+    }
+}
+
+static void * startThread(void* args)
+{
+    while(1)
+    {
+        Task task;
+
+        pthread_mutex_lock(&mutexQueue);
+        while(taskCount == 0 && !stopping)
+        {
+            pthread_cond_wait(&condQueue, &mutexQueue);
+        }
+        if(taskCount == 0)
+        {
+            pthread_mutex_unlock(&mutexQueue);
+            return NULL;
+        }
+        task = taskQueue[queueHead];
+        queueHead = (queueHead + 1) % queueCapacity;
+        taskCount--;
+        pthread_mutex_unlock(&mutexQueue);
+
+        task.taskFunction(task.arg1, task.arg2);
+    }
+}
+
+void poolStart(int threadCount)
+{
+    pthread_mutex_init(&mutexQueue, NULL);
+    pthread_cond_init(&condQueue, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    timerWheelInit(&wheel, 0);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if(timerFd < 0)
+    {
+        perror("Failed to Create Timer");
+    }
+    stopping = 0;
+
+    workerCount = threadCount > MAX_THREADS ? MAX_THREADS : threadCount;
+    int i;
+    for(i = 0; i < workerCount ; i++)
+    {
+        if(pthread_create(&workers[i], NULL, &startThread, NULL) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    if(pthread_create(&timerThread, NULL, &startTimerThread, NULL) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+}
+
+void submitTask(Task task)
+{
+    pthread_mutex_lock(&mutexQueue);
+    pushTask(task);
+    pthread_mutex_unlock(&mutexQueue);
+}
+
+static TimerId addTimer(long delayMs, long periodMs, Task task)
+{
+    long tickNs = TIMER_TICK_MS * 1000000L;
+    pthread_mutex_lock(&mutexQueue);
+    long now = elapsedNs();
+    // Catch the wheel up first so the delay counts from now, not from the last timer event
+    timerWheelAdvance(&wheel, now / tickNs, &fireTimer, NULL);
+    // Round up: a timer never fires before its delay has passed
+    uint64_t expires = (now + delayMs * 1000000L + tickNs - 1) / tickNs;
+    uint32_t periodTicks = (periodMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    TimerId id = timerWheelAdd(&wheel, expires, periodTicks, task);
+    armTimer();
+    pthread_mutex_unlock(&mutexQueue);
+    return id;
+}
+
+TimerId submitAfter(long delayMs, Task task)
+{
+    return addTimer(delayMs, 0, task);
+}
+
+TimerId submitEvery(long periodMs, Task task)
+{
+    return addTimer(periodMs, periodMs > 0 ? periodMs : TIMER_TICK_MS, task);
+}
+
+int cancelTimer(TimerId id)
+{
+    pthread_mutex_lock(&mutexQueue);
+    int ret = timerWheelCancel(&wheel, id);
+    pthread_mutex_unlock(&mutexQueue);
+    return ret;
+}
+
+void poolStop(void)
+{
+    pthread_mutex_lock(&mutexQueue);
+    stopping = 1;
+    pthread_cond_broadcast(&condQueue);
+    // Fire the timerfd right away so the timer thread sees `stopping`
+    struct itimerspec spec = { .it_value = { 0, 1 } };
+    timerfd_settime(timerFd, 0, &spec, NULL);
+    pthread_mutex_unlock(&mutexQueue);
+
+    int i;
+    if(pthread_join(timerThread, NULL) != 0)
+    {
+        perror("Failed to Join Thread");
+    }
+    for(i = 0; i < workerCount ; i++)
+    {
+        if(pthread_join(workers[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+
+    close(timerFd);
+    timerWheelDestroy(&wheel);
+    free(taskQueue);
+    taskQueue = NULL;
+    queueCapacity = 0;
+    queueHead = 0;
+    taskCount = 0;
+    armedTick = UINT64_MAX;
+    pthread_mutex_destroy(&mutexQueue);
+    pthread_cond_destroy(&condQueue);
+}
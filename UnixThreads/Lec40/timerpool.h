@@ -0,0 +1,34 @@
+#ifndef TIMERPOOL_H
+#define TIMERPOOL_H
+
+#include "timerwheel.h"
+
+/*
+ * Lec29 thread pool with delayed and periodic tasks.
+ *
+ * Instead of a thread sleeping for every delay, all timers sit in one
+ * hierarchical timing wheel (1 tick = TIMER_TICK_MS). A single timer thread
+ * blocks on a timerfd armed for the next wheel event; expired timers are
+ * pushed to the task queue and run by the worker threads.
+ */
+
+#define TIMER_TICK_MS 1
+
+void poolStart(int threadCount);
+
+// Runs the task as soon as a worker is free
+void submitTask(Task task);
+
+// Runs the task once after delayMs
+TimerId submitAfter(long delayMs, Task task);
+
+// Runs the task every periodMs, first run after periodMs
+TimerId submitEvery(long periodMs, Task task);
+
+// Stops a pending timer. A run already queued still happens. Returns 0 if the timer was pending.
+int cancelTimer(TimerId id);
+
+// Drops pending timers, finishes queued tasks and joins all threads
+void poolStop(void);
+
+#endif
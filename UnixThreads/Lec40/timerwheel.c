@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+#include "timerwheel.h"
+
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define INITIAL_CAPACITY 1024
+
+void timerWheelInit(TimerWheel* wheel, uint64_t nowTick)
+{
+    memset(wheel, 0, sizeof(TimerWheel));
+    memset(wheel->heads, 0xff, sizeof(wheel->heads));
+    wheel->current = nowTick;
+    wheel->freeList = -1;
+}
+
+void timerWheelDestroy(TimerWheel* wheel)
+{
+    free(wheel->timers);
+    wheel->timers = NULL;
+    wheel->capacity = 0;
+}
+
+static int32_t allocTimer(TimerWheel* wheel)
+{
+    if(wheel->freeList < 0)
+    {
+        int32_t newCapacity = wheel->capacity == 0 ? INITIAL_CAPACITY : wheel->capacity * 2;
+        Timer* timers = realloc(wheel->timers, sizeof(Timer) * newCapacity);
+        if(timers == NULL)
+        {
+            return -1;
+        }
+        int32_t i;
+        for(i = newCapacity - 1; i >= wheel->capacity ; i--)
+        {
+            timers[i].generation = 0;
+            timers[i].next = wheel->freeList;
+            wheel->freeList = i;
+        }
+        wheel->timers = timers;
+        wheel->capacity = newCapacity;
+    }
+    int32_t index = wheel->freeList;
+    wheel->freeList = wheel->timers[index].next;
+    return index;
+}
+
+static void freeTimer(TimerWheel* wheel, int32_t index)
+{
+    wheel->timers[index].generation++;
+    wheel->timers[index].next = wheel->freeList;
+    wheel->freeList = index;
+}
+
+// Links a timer into the slot matching its distance from the next tick to process
+static void place(TimerWheel* wheel, int32_t index)
+{
+    Timer* timer = &wheel->timers[index];
+    uint64_t base = wheel->current + 1;
+    uint64_t expires = timer->expires < base ? base : timer->expires;
+    uint64_t delta = expires - base;
+    int level = 0;
+    while(level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1))))
+    {
+        level++;
+    }
+    // Beyond the last level: park in its furthest slot, it is re-placed when cascaded
+    uint64_t maxDelta = (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    if(delta > maxDelta)
+    {
+        expires = base + maxDelta;
+    }
+    int slot = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = -1;
+    timer->next = wheel->heads[level][slot];
+    if(timer->next >= 0)
+    {
+        wheel->timers[timer->next].prev = index;
+    }
+    wheel->heads[level][slot] = index;
+    if(level == 0)
+    {
+        wheel->occupied[slot / 64] |= 1ULL << (slot % 64);
+    }
+    else
+    {
+        wheel->upper++;
+    }
+}
+
+static void unlinkTimer(TimerWheel* wheel, int32_t index)
+{
+    Timer* timer = &wheel->timers[index];
+    if(timer->prev >= 0)
+    {
+        wheel->timers[timer->prev].next = timer->next;
+    }
+    else
+    {
+        wheel->heads[timer->level][timer->slot] = timer->next;
+    }
+    if(timer->next >= 0)
+    {
+        wheel->timers[timer->next].prev = timer->prev;
+    }
+    if(timer->level != 0)
+    {
+        wheel->upper--;
+    }
+    else if(wheel->heads[0][timer->slot] < 0)
+    {
+        wheel->occupied[timer->slot / 64] &= ~(1ULL << (timer->slot % 64));
+    }
+}
+
+TimerId timerWheelAdd(TimerWheel* wheel, uint64_t expires, uint32_t period, Task task)
+{
+    int32_t index = allocTimer(wheel);
+    if(index < 0)
+    {
+        return 0;
+    }
+    Timer* timer = &wheel->timers[index];
+    timer->expires = expires;
+    timer->period = period;
+    timer->task = task;
+    place(wheel, index);
+    wheel->active++;
+    return ((TimerId)timer->generation << 32) | (uint32_t)(index + 1);
+}
+
+int timerWheelCancel(TimerWheel* wheel, TimerId id)
+{
+    int64_t index = (int64_t)(id & 0xffffffff) - 1;
+    if(index < 0 || index >= wheel->capacity || wheel->timers[index].generation != (uint32_t)(id >> 32))
+    {
+        return -1;
+    }
+    unlinkTimer(wheel, index);
+    freeTimer(wheel, index);
+    wheel->active--;
+    return 0;
+}
+
+// Re-places every timer of a higher-level slot; they move down one or more levels
+static void cascade(TimerWheel* wheel, int level, int slot)
+{
+    int32_t index = wheel->heads[level][slot];
+    wheel->heads[level][slot] = -1;
+    while(index >= 0)
+    {
+        int32_t next = wheel->timers[index].next;
+        wheel->upper--;
+        place(wheel, index);
+        index = next;
+    }
+}
+
+void timerWheelAdvance(TimerWheel* wheel, uint64_t nowTick, void (*fire)(Task* task, void* context), void* context)
+{
+    while(wheel->current < nowTick)
+    {
+        uint64_t tick = wheel->current + 1;
+        int slot = tick & WHEEL_MASK;
+
+        // Level 0 wrapped: pull the next slot of each higher level that wrapped too.
+        // `current` is still tick - 1, so the cascaded timers are placed relative to `tick`.
+        int level;
+        for(level = 1; level < WHEEL_LEVELS && slot == 0 ; level++)
+        {
+            int upper = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+            cascade(wheel, level, upper);
+            if(upper != 0)
+            {
+                break;
+            }
+        }
+        wheel->current = tick;
+
+        int32_t index = wheel->heads[0][slot];
+        wheel->heads[0][slot] = -1;
+        wheel->occupied[slot / 64] &= ~(1ULL << (slot % 64));
+        while(index >= 0)
+        {
+            Timer* timer = &wheel->timers[index];
+            int32_t next = timer->next;
+            Task task = timer->task;
+            if(timer->period != 0)
+            {
+                timer->expires += timer->period;
+                place(wheel, index);
+            }
+            else
+            {
+                freeTimer(wheel, index);
+                wheel->active--;
+            }
+            fire(&task, context);
+            index = next;
+        }
+    }
+}
+
+long timerWheelNextTicks(TimerWheel* wheel)
+{
+    if(wheel->active == 0)
+    {
+        return -1;
+    }
+    // A cascade may bring down timers due before anything now on level 0
+    long limit = wheel->upper > 0 ? WHEEL_SLOTS - (long)(wheel->current & WHEEL_MASK) : WHEEL_SLOTS;
+    long distance;
+    for(distance = 1; distance <= limit ; distance++)
+    {
+        int slot = (wheel->current + distance) & WHEEL_MASK;
+        uint64_t word = wheel->occupied[slot / 64] >> (slot % 64);
+        if(word == 0)
+        {
+            // Nothing else in this 64-slot word: jump to the next word
+            distance += 63 - slot % 64;
+            continue;
+        }
+        if(word & 1)
+        {
+            return distance;
+        }
+    }
+    // Nothing on level 0 before the next cascade
+    return limit;
+}
@@ -0,0 +1,72 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+/*
+ * Hierarchical timing wheel (the classic Linux kernel timer layout).
+ *
+ * 4 levels of 256 slots. Level 0 holds timers due in the next 256 ticks, one
+ * slot per tick; level 1 timers due in the next 256*256 ticks, one slot per
+ * 256 ticks; and so on. When level 0 wraps around, the next level-1 slot is
+ * "cascaded": its timers are re-inserted into level 0. Adding and cancelling
+ * a timer is O(1): one slot index computation and a doubly-linked list update.
+ *
+ * Timers live in one growable array and are linked by index, so a TimerId
+ * (index + generation) stays valid while the array is reallocated, and a
+ * stale id of an expired or cancelled timer is detected.
+ *
+ * The wheel is not thread-safe: the caller protects it with its own lock.
+ */
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+typedef uint64_t TimerId;
+
+typedef struct Task
+{
+    void (*taskFunction)(int , int);
+    int arg1 , arg2;
+} Task;
+
+typedef struct Timer
+{
+    uint64_t expires;           // absolute tick
+    uint32_t period;            // ticks, 0 = one-shot
+    uint32_t generation;        // bumped on every reuse of this entry
+    int32_t prev, next;         // slot list, or free list (next only)
+    uint16_t level, slot;
+    Task task;
+} Timer;
+
+typedef struct TimerWheel
+{
+    uint64_t current;                               // last processed tick
+    int32_t heads[WHEEL_LEVELS][WHEEL_SLOTS];       // -1 = empty slot
+    uint64_t occupied[WHEEL_SLOTS / 64];            // level-0 slots in use
+    Timer* timers;
+    int32_t capacity;
+    int32_t freeList;
+    long active;
+    long upper;                                     // timers on levels above 0
+} TimerWheel;
+
+void timerWheelInit(TimerWheel* wheel, uint64_t nowTick);
+void timerWheelDestroy(TimerWheel* wheel);
+
+// Fires at tick `expires` (next tick if already past), then every `period` ticks if non-zero.
+// Returns 0 if out of memory.
+TimerId timerWheelAdd(TimerWheel* wheel, uint64_t expires, uint32_t period, Task task);
+
+// Returns 0 if the timer was pending, -1 if it already fired (one-shot) or was cancelled
+int timerWheelCancel(TimerWheel* wheel, TimerId id);
+
+// Processes every tick up to `nowTick`, calling fire() for each expired timer
+void timerWheelAdvance(TimerWheel* wheel, uint64_t nowTick, void (*fire)(Task* task, void* context), void* context);
+
+// Ticks until advancing may fire or cascade something, -1 if the wheel is empty
+long timerWheelNextTicks(TimerWheel* wheel);
+
+#endif
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <time.h>
+#include "fiber.h"
+
+
+#define WORKER_NUM 4
+#define LOGIN_LIMIT 50000
+#define FIBER_SESSIONS 100000
+#define THREAD_SESSIONS 10000
+
+FiberSemaphore fiberLogin;
+FiberMutex fiberCounterMutex;
+sem_t threadLogin;
+pthread_mutex_t threadCounterMutex;
+long loggedIn;
+long peakLoggedIn;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Peak resident memory of this process, in MB
+static long peakRssMb(void)
+{
+    FILE* f = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = 0;
+    while(f != NULL && fgets(line, sizeof(line), f) != NULL)
+    {
+        if(strncmp(line, "VmHWM:", 6) == 0)
+        {
+            sscanf(line + 6, "%ld", &kb);
+        }
+    }
+    if(f != NULL)
+    {
+        fclose(f);
+    }
+    return kb / 1024;
+}
+
+static long sessionMs(long id)
+{
+    return 1000 + (id * 7919) % 4000;      // 1..5 s, like rand() % 5 + 1
+}
+
+void fiberSession(void* args)
+{
+    long id = (long)args;
+    fiberSemWait(&fiberLogin);
+    fiberMutexLock(&fiberCounterMutex);
+    if(++loggedIn > peakLoggedIn)
+    {
+        peakLoggedIn = loggedIn;
+    }
+    fiberMutexUnlock(&fiberCounterMutex);
+
+    fiberSleep(sessionMs(id));
+
+    fiberMutexLock(&fiberCounterMutex);
+    loggedIn--;
+    fiberMutexUnlock(&fiberCounterMutex);
+    fiberSemPost(&fiberLogin);
+}
+
+void * threadSession(void* args)
+{
+    long id = (long)args;
+    sem_wait(&threadLogin);
+    pthread_mutex_lock(&threadCounterMutex);
+    if(++loggedIn > peakLoggedIn)
+    {
+        peakLoggedIn = loggedIn;
+    }
+    pthread_mutex_unlock(&threadCounterMutex);
+
+    usleep(sessionMs(id) * 1000);
+
+    pthread_mutex_lock(&threadCounterMutex);
+    loggedIn--;
+    pthread_mutex_unlock(&threadCounterMutex);
+    sem_post(&threadLogin);
+    return NULL;
+}
+
+static void runFibers(long sessions)
+{
+    long i;
+    loggedIn = 0;
+    peakLoggedIn = 0;
+    fiberSemInit(&fiberLogin, LOGIN_LIMIT);
+    fiberMutexInit(&fiberCounterMutex);
+    double start = nowSeconds();
+    fiberSchedulerStart(WORKER_NUM);
+    for(i = 0; i < sessions ; i++)
+    {
+        if(fiberSpawn(&fiberSession, (void*)i) != 0)
+        {
+            perror("Failed to Spawn Fiber");
+            break;
+        }
+    }
+    fiberSchedulerWait();
+
+    FiberStats stats;
+    fiberStats(&stats);
+    printf("fibers,%ld,%d,%ld,%.2f,%ld,%ld\n", sessions, WORKER_NUM, peakLoggedIn,
+        nowSeconds() - start, peakRssMb(), stats.switches);
+    fiberSemDestroy(&fiberLogin);
+    fiberMutexDestroy(&fiberCounterMutex);
+}
+
+static void runThreads(long sessions)
+{
+    pthread_t* th = malloc(sizeof(pthread_t) * sessions);
+    long i, created = 0;
+    loggedIn = 0;
+    peakLoggedIn = 0;
+    sem_init(&threadLogin, 0, LOGIN_LIMIT);
+    pthread_mutex_init(&threadCounterMutex, NULL);
+    double start = nowSeconds();
+    for(i = 0; i < sessions ; i++)
+    {
+        if(pthread_create(&th[i], NULL, &threadSession, (void*)i) != 0)
+        {
+            perror("Failed to Create Thread");
+            break;
+        }
+        created++;
+    }
+    for(i = 0; i < created ; i++)
+    {
+        if(pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    printf("threads,%ld,%ld,%ld,%.2f,%ld,\n", created, created, peakLoggedIn, nowSeconds() - start, peakRssMb());
+    sem_destroy(&threadLogin);
+    pthread_mutex_destroy(&threadCounterMutex);
+    free(th);
+}
+
+int main(int argc, char* argv[])
+{
+    // VmHWM is a process-wide peak: run each mode in a separate process
+    const char* mode = argc > 1 ? argv[1] : "fibers";
+    long sessions = argc > 2 ? atol(argv[2]) : (strcmp(mode, "threads") == 0 ? THREAD_SESSIONS : FIBER_SESSIONS);
+
+    printf("mode,sessions,os_threads,peak_logged_in,seconds,peak_rss_mb,fiber_switches\n");
+    if(strcmp(mode, "threads") == 0)
+    {
+        runThreads(sessions);
+    }
+    else
+    {
+        runFibers(sessions);
+    }
+    return 0;
+}
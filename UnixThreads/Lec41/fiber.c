@@ -0,0 +1,512 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "fiber.h"
+
+
+#define MAX_WORKERS 64
+#define GUARD_SIZE 4096
+#define STACK_STRIDE (FIBER_STACK_SIZE + GUARD_SIZE)
+
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102      // Linux 6.13
+#endif
+
+// What the scheduler does with a fiber once it is off its stack
+typedef enum AfterSwitch
+{
+    AFTER_READY,        // fiberYield: back on the run queue
+    AFTER_SLEEP,        // fiberSleep: into the sleep heap
+    AFTER_UNLOCK,       // waiting on a semaphore: release the semaphore's lock
+    AFTER_EXIT,         // routine returned: free the fiber
+} AfterSwitch;
+
+struct Fiber
+{
+    ucontext_t context;
+    char* stack;                // lowest usable byte, a guard page sits below
+    void (*routine)(void*);
+    void* arg;
+    long wakeNs;                // for AFTER_SLEEP
+    Fiber* next;                // run queue or semaphore wait list
+};
+
+typedef struct Worker
+{
+    pthread_t thread;
+    ucontext_t context;         // the scheduler loop of this carrier thread
+    Fiber* current;
+    AfterSwitch after;
+    pthread_mutex_t* afterMutex;
+} Worker;
+
+static pthread_mutex_t mutexScheduler = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t condDone = PTHREAD_COND_INITIALIZER;
+static Fiber* runHead;
+static Fiber* runTail;
+static Fiber** sleepHeap;           // min-heap on wakeNs
+static int sleepCount;
+static int sleepCapacity;
+static char** freeStacks;           // stacks not in use, from any slab
+static int freeCount;
+static int freeCapacity;
+static char** slabs;
+static int slabCount;
+static int guardsWork = 1;
+static Worker workers[MAX_WORKERS];
+static int workerCount;
+static int stopping;
+static FiberStats stats;
+
+static __thread Worker* currentWorker;
+
+static long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Not inlined: after a switch the fiber may be running on another carrier thread,
+// so the thread-local variable has to be read again every time
+__attribute__((noinline)) static Worker* thisWorker(void)
+{
+    Worker* worker = currentWorker;
+    __asm__ volatile("" ::: "memory");
+    return worker;
+}
+
+// Called with mutexScheduler held
+static void pushReady(Fiber* fiber)
+{
+    fiber->next = NULL;
+    if(runTail != NULL)
+    {
+        runTail->next = fiber;
+    }
+    else
+    {
+        runHead = fiber;
+    }
+    runTail = fiber;
+    pthread_cond_signal(&condWork);
+}
+
+static void heapPush(Fiber* fiber)
+{
+    if(sleepCount == sleepCapacity)
+    {
+        sleepCapacity = sleepCapacity == 0 ? 1024 : sleepCapacity * 2;
+        sleepHeap = realloc(sleepHeap, sizeof(Fiber*) * sleepCapacity);
+    }
+    int i = sleepCount++;
+    while(i > 0 && sleepHeap[(i - 1) / 2]->wakeNs > fiber->wakeNs)
+    {
+        sleepHeap[i] = sleepHeap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sleepHeap[i] = fiber;
+}
+
+static Fiber* heapPop(void)
+{
+    Fiber* top = sleepHeap[0];
+    Fiber* last = sleepHeap[--sleepCount];
+    int i = 0;
+    while(1)
+    {
+        int child = 2 * i + 1;
+        if(child >= sleepCount)
+        {
+            break;
+        }
+        if(child + 1 < sleepCount && sleepHeap[child + 1]->wakeNs < sleepHeap[child]->wakeNs)
+        {
+            child++;
+        }
+        if(sleepHeap[child]->wakeNs >= last->wakeNs)
+        {
+            break;
+        }
+        sleepHeap[i] = sleepHeap[child];
+        i = child;
+    }
+    sleepHeap[i] = last;
+    return top;
+}
+
+// Called with mutexScheduler held
+static void freeStack(char* stack)
+{
+    freeStacks[freeCount++] = stack;
+}
+
+// Called with mutexScheduler held
+static int addSlab(void)
+{
+    // Only touched pages use memory: a sleeping session needs one or two per stack
+    char* slab = mmap(NULL, (size_t)STACK_STRIDE * FIBER_SLAB_STACKS, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if(slab == MAP_FAILED)
+    {
+        return -1;
+    }
+    slabs = realloc(slabs, sizeof(char*) * (slabCount + 1));
+    slabs[slabCount++] = slab;
+    // Room for every stack ever made, so freeStack() never has to grow the list
+    if(freeCapacity < slabCount * FIBER_SLAB_STACKS)
+    {
+        freeCapacity = slabCount * FIBER_SLAB_STACKS * 2;
+        freeStacks = realloc(freeStacks, sizeof(char*) * freeCapacity);
+    }
+    int i;
+    for(i = FIBER_SLAB_STACKS - 1; i >= 0 ; i--)
+    {
+        char* base = slab + (size_t)i * STACK_STRIDE;
+        // A guard region, unlike mprotect(), does not split the mapping in two
+        if(guardsWork && madvise(base, GUARD_SIZE, MADV_GUARD_INSTALL) != 0)
+        {
+            guardsWork = 0;
+        }
+        freeStacks[freeCount++] = base + GUARD_SIZE;
+    }
+    return 0;
+}
+
+static char* allocStack(void)
+{
+    char* stack = NULL;
+    pthread_mutex_lock(&mutexScheduler);
+    if(freeCount > 0 || addSlab() == 0)
+    {
+        stack = freeStacks[--freeCount];
+    }
+    pthread_mutex_unlock(&mutexScheduler);
+    return stack;
+}
+
+// Leaves the fiber's stack for the scheduler; returns when the fiber is resumed
+static void switchToScheduler(AfterSwitch after, pthread_mutex_t* afterMutex)
+{
+    Worker* worker = thisWorker();
+    Fiber* fiber = worker->current;
+    // Without guard pages (older kernels) at least catch a stack that is nearly full
+    if((char*)&fiber < fiber->stack + 1024)
+    {
+        fprintf(stderr, "Fiber stack overflow: raise FIBER_STACK_SIZE\n");
+        abort();
+    }
+    worker->after = after;
+    worker->afterMutex = afterMutex;
+    swapcontext(&fiber->context, &worker->context);
+}
+
+static void fiberMain(void)
+{
+    Fiber* fiber = thisWorker()->current;
+    fiber->routine(fiber->arg);
+    switchToScheduler(AFTER_EXIT, NULL);
+}
+
+// Runs on the carrier thread's own stack, after the fiber switched away
+static void afterSwitch(Worker* worker, Fiber* fiber)
+{
+    switch(worker->after)
+    {
+        case AFTER_READY:
+            pthread_mutex_lock(&mutexScheduler);
+            pushReady(fiber);
+            pthread_mutex_unlock(&mutexScheduler);
+            break;
+
+        case AFTER_SLEEP:
+            pthread_mutex_lock(&mutexScheduler);
+            heapPush(fiber);
+            // A worker may be sleeping until a later deadline
+            pthread_cond_signal(&condWork);
+            pthread_mutex_unlock(&mutexScheduler);
+            break;
+
+        case AFTER_UNLOCK:
+            // The fiber is now safely parked on the wait list: let fiberSemPost() see it
+            pthread_mutex_unlock(worker->afterMutex);
+            break;
+
+        case AFTER_EXIT:
+            pthread_mutex_lock(&mutexScheduler);
+            freeStack(fiber->stack);
+            free(fiber);
+            stats.live--;
+            if(stats.live == 0)
+            {
+                pthread_cond_broadcast(&condDone);
+                pthread_cond_broadcast(&condWork);
+            }
+            pthread_mutex_unlock(&mutexScheduler);
+            break;
+    }
+}
+
+static void * startWorker(void* args)
+{
+    Worker* worker = args;
+    currentWorker = worker;
+
+    while(1)
+    {
+        pthread_mutex_lock(&mutexScheduler);
+        while(1)
+        {
+            long now = nowNs();
+            while(sleepCount > 0 && sleepHeap[0]->wakeNs <= now)
+            {
+                pushReady(heapPop());
+            }
+            if(runHead != NULL || (stopping && stats.live == 0))
+            {
+                break;
+            }
+            if(sleepCount > 0)
+            {
+                // Sleep until the earliest fiber wakes up
+                long wake = sleepHeap[0]->wakeNs;
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                long deadline = ts.tv_sec * 1000000000L + ts.tv_nsec + (wake - now);
+                ts.tv_sec = deadline / 1000000000L;
+                ts.tv_nsec = deadline % 1000000000L;
+                pthread_cond_timedwait(&condWork, &mutexScheduler, &ts);
+            }
+            else
+            {
+                pthread_cond_wait(&condWork, &mutexScheduler);
+            }
+        }
+        if(runHead == NULL)
+        {
+            pthread_mutex_unlock(&mutexScheduler);
+            return NULL;
+        }
+        Fiber* fiber = runHead;
+        runHead = fiber->next;
+        if(runHead == NULL)
+        {
+            runTail = NULL;
+        }
+        stats.switches++;
+        pthread_mutex_unlock(&mutexScheduler);
+
+        worker->current = fiber;
+        swapcontext(&worker->context, &fiber->context);
+        worker->current = NULL;
+        afterSwitch(worker, fiber);
+    }
+}
+
+int fiberSchedulerStart(int count)
+{
+    workerCount = count > MAX_WORKERS ? MAX_WORKERS : count;
+    stopping = 0;
+    int i;
+    for(i = 0; i < workerCount ; i++)
+    {
+        if(pthread_create(&workers[i].thread, NULL, &startWorker, &workers[i]) != 0)
+        {
+            perror("Failed to Create Thread");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void fiberSchedulerWait(void)
+{
+    pthread_mutex_lock(&mutexScheduler);
+    while(stats.live > 0)
+    {
+        pthread_cond_wait(&condDone, &mutexScheduler);
+    }
+    stopping = 1;
+    pthread_cond_broadcast(&condWork);
+    pthread_mutex_unlock(&mutexScheduler);
+
+    int i;
+    for(i = 0; i < workerCount ; i++)
+    {
+        if(pthread_join(workers[i].thread, NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    while(slabCount > 0)
+    {
+        munmap(slabs[--slabCount], (size_t)STACK_STRIDE * FIBER_SLAB_STACKS);
+    }
+    free(slabs);
+    free(freeStacks);
+    slabs = NULL;
+    freeStacks = NULL;
+    freeCount = 0;
+    freeCapacity = 0;
+    free(sleepHeap);
+    sleepHeap = NULL;
+    sleepCapacity = 0;
+}
+
+int fiberSpawn(void (*routine)(void*), void* arg)
+{
+    Fiber* fiber = malloc(sizeof(Fiber));
+    if(fiber == NULL)
+    {
+        return ENOMEM;
+    }
+    fiber->stack = allocStack();
+    if(fiber->stack == NULL)
+    {
+        free(fiber);
+        return ENOMEM;
+    }
+    fiber->routine = routine;
+    fiber->arg = arg;
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = fiber->stack;
+    fiber->context.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, &fiberMain, 0);
+
+    pthread_mutex_lock(&mutexScheduler);
+    stats.spawned++;
+    stats.live++;
+    if(stats.live > stats.peakLive)
+    {
+        stats.peakLive = stats.live;
+    }
+    pushReady(fiber);
+    pthread_mutex_unlock(&mutexScheduler);
+    return 0;
+}
+
+void fiberYield(void)
+{
+    if(thisWorker() == NULL)
+    {
+        sched_yield();
+        return;
+    }
+    switchToScheduler(AFTER_READY, NULL);
+}
+
+void fiberSleep(long ms)
+{
+    Worker* worker = thisWorker();
+    if(worker == NULL)
+    {
+        usleep(ms * 1000);
+        return;
+    }
+    worker->current->wakeNs = nowNs() + ms * 1000000L;
+    switchToScheduler(AFTER_SLEEP, NULL);
+}
+
+void fiberSemInit(FiberSemaphore* sem, int value)
+{
+    pthread_mutex_init(&sem->lock, NULL);
+    sem->value = value;
+    sem->head = NULL;
+    sem->tail = NULL;
+}
+
+void fiberSemWait(FiberSemaphore* sem)
+{
+    Worker* worker = thisWorker();
+    pthread_mutex_lock(&sem->lock);
+    // Not a fiber: poll, there is no context to park
+    while(worker == NULL && sem->value <= 0)
+    {
+        pthread_mutex_unlock(&sem->lock);
+        usleep(1000);
+        pthread_mutex_lock(&sem->lock);
+    }
+    if(sem->value > 0)
+    {
+        sem->value--;
+        pthread_mutex_unlock(&sem->lock);
+        return;
+    }
+    Fiber* fiber = worker->current;
+    fiber->next = NULL;
+    if(sem->tail != NULL)
+    {
+        sem->tail->next = fiber;
+    }
+    else
+    {
+        sem->head = fiber;
+    }
+    sem->tail = fiber;
+    // sem->lock is released by the scheduler once this fiber's context is saved;
+    // fiberSemPost() hands the unit directly to us, so no recheck is needed
+    switchToScheduler(AFTER_UNLOCK, &sem->lock);
+}
+
+void fiberSemPost(FiberSemaphore* sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    Fiber* fiber = sem->head;
+    if(fiber == NULL)
+    {
+        sem->value++;
+        pthread_mutex_unlock(&sem->lock);
+        return;
+    }
+    sem->head = fiber->next;
+    if(sem->head == NULL)
+    {
+        sem->tail = NULL;
+    }
+    pthread_mutex_unlock(&sem->lock);
+
+    pthread_mutex_lock(&mutexScheduler);
+    pushReady(fiber);
+    pthread_mutex_unlock(&mutexScheduler);
+}
+
+void fiberSemDestroy(FiberSemaphore* sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+}
+
+void fiberMutexInit(FiberMutex* mutex)
+{
+    fiberSemInit(mutex, 1);
+}
+
+void fiberMutexLock(FiberMutex* mutex)
+{
+    fiberSemWait(mutex);
+}
+
+void fiberMutexUnlock(FiberMutex* mutex)
+{
+    fiberSemPost(mutex);
+}
+
+void fiberMutexDestroy(FiberMutex* mutex)
+{
+    fiberSemDestroy(mutex);
+}
+
+void fiberStats(FiberStats* result)
+{
+    pthread_mutex_lock(&mutexScheduler);
+    *result = stats;
+    pthread_mutex_unlock(&mutexScheduler);
+}
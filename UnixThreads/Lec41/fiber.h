@@ -0,0 +1,76 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <pthread.h>
+
+/*
+ * M:N fiber executor.
+ *
+ * Fibers are user-space threads with their own small stack, switched with
+ * ucontext (getcontext / makecontext / swapcontext). Many fibers run on a few
+ * carrier threads ("workers"). When a fiber sleeps or waits on a fiber
+ * semaphore / mutex it gives its worker back to the scheduler instead of
+ * blocking it, so 100k sleeping fibers cost 100k small stacks, not 100k OS
+ * threads.
+ *
+ * Rules for fiber code:
+ * - Use fiberSleep / fiberSem* / fiberMutex* instead of sleep / sem_* /
+ *   pthread_mutex_* around anything that can block for long.
+ * - A fiber may continue on another worker after it blocks or yields: do not
+ *   keep pointers to thread-local data across those calls.
+ * - Stacks are FIBER_STACK_SIZE bytes, carved out of large slabs (one
+ *   mapping per FIBER_SLAB_STACKS stacks): an mprotect() guard page per stack
+ *   would cost two mappings per fiber and vm.max_map_count (65530 by default)
+ *   would cap us near 32k fibers. Guard pages are installed with
+ *   MADV_GUARD_INSTALL, which does not split mappings (Linux 6.13+). On older
+ *   kernels the stack depth is only checked when a fiber switches out.
+ */
+
+#define FIBER_STACK_SIZE (64 * 1024)
+#define FIBER_SLAB_STACKS 256
+
+typedef struct Fiber Fiber;
+
+typedef struct FiberSemaphore
+{
+    pthread_mutex_t lock;
+    int value;
+    Fiber* head;             // waiting fibers, FIFO
+    Fiber* tail;
+} FiberSemaphore;
+
+typedef FiberSemaphore FiberMutex;
+
+// Starts the carrier threads
+int fiberSchedulerStart(int workerCount);
+
+// Waits until every fiber has finished, then stops the carrier threads
+void fiberSchedulerWait(void);
+
+// Creates a runnable fiber. Can be called from main or from a fiber. Returns 0 on success.
+int fiberSpawn(void (*routine)(void*), void* arg);
+
+void fiberYield(void);
+void fiberSleep(long ms);
+
+void fiberSemInit(FiberSemaphore* sem, int value);
+void fiberSemWait(FiberSemaphore* sem);
+void fiberSemPost(FiberSemaphore* sem);
+void fiberSemDestroy(FiberSemaphore* sem);
+
+void fiberMutexInit(FiberMutex* mutex);
+void fiberMutexLock(FiberMutex* mutex);
+void fiberMutexUnlock(FiberMutex* mutex);
+void fiberMutexDestroy(FiberMutex* mutex);
+
+typedef struct FiberStats
+{
+    long spawned;
+    long live;
+    long peakLive;
+    long switches;
+} FiberStats;
+
+void fiberStats(FiberStats* stats);
+
+#endif
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "fiber.h"
+
+
+#define SESSION_NUM 16
+#define WORKER_NUM 2
+
+FiberSemaphore semaphore;
+
+
+// Lec22's routine as a fiber: waiting and sleeping park the fiber, not the thread
+void routine(void* args)
+{
+    printf("(%d) Waiting in the login Queue\n", *(int*)args);
+    fiberSemWait(&semaphore);
+    printf("(%d) Logged in\n", *(int*)args);
+    fiberSleep((rand() % 5 + 1) * 1000);
+    printf("(%d) Logged out\n", *(int*)args);
+    fiberSemPost(&semaphore);
+    free(args);
+}
+
+
+int main(void)
+{
+    fiberSemInit(&semaphore, 8);
+    fiberSchedulerStart(WORKER_NUM);
+
+    int i;
+    for(i = 0; i < SESSION_NUM ; i++)
+    {
+        int* a = malloc(sizeof(int));
+        *a = i;
+        if(fiberSpawn(&routine, a) != 0)
+        {
+            perror("Failed to Spawn Fiber");
+        }
+    }
+
+    fiberSchedulerWait();
+
+    FiberStats stats;
+    fiberStats(&stats);
+    printf("%ld sessions on %d threads , %ld context switches \n", stats.spawned, WORKER_NUM, stats.switches);
+    fiberSemDestroy(&semaphore);
+    return 0;
+}
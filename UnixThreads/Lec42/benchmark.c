@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "filereader.h"
+
+
+#define FILE_SIZE (1L << 30)
+
+typedef struct Mode
+{
+    const char* name;
+    ReaderBackend backend;
+    int threads;
+    int depth;
+} Mode;
+
+static const Mode modes[] =
+{
+    { "pread x1 (Lec23 producer)", READER_PREAD, 1, 0 },
+    { "pread x4", READER_PREAD, 4, 0 },
+    { "pread x16", READER_PREAD, 16, 0 },
+    { "io_uring depth 1", READER_IO_URING, 0, 1 },
+    { "io_uring depth 4", READER_IO_URING, 0, 4 },
+    { "io_uring depth 16", READER_IO_URING, 0, 16 },
+    { "io_uring depth 64", READER_IO_URING, 0, 64 },
+};
+
+FileReader* reader;
+
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpuSeconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Order independent checksum, so every mode must agree
+void * consumer (void* args)
+{
+    uint64_t sum = 0;
+    ReadBlock* block;
+    while((block = fileReaderNext(reader)) != NULL)
+    {
+        const uint64_t* words = (const uint64_t*)block->data;
+        size_t i;
+        for(i = 0; i < block->length / 8; i++)
+        {
+            sum += words[i] ^ (block->offset + i * 8);
+        }
+        fileReaderRelease(reader, block);
+    }
+    *(uint64_t*)args = sum;
+    return NULL;
+}
+
+static int createFile(const char* path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    static uint64_t block[1 << 16];
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    long done;
+    for(done = 0; done < FILE_SIZE; done += sizeof(block))
+    {
+        size_t i;
+        for(i = 0; i < sizeof(block) / 8; i++)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            block[i] = x;
+        }
+        if(write(fd, block, sizeof(block)) != sizeof(block))
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    fsync(fd);
+    close(fd);
+    return 0;
+}
+
+static void dropCache(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "filereader.bench";
+    size_t blockSize = argc > 2 ? atol(argv[2]) * 1024 : 64 * 1024;
+    int created = 0;
+    if(access(path, R_OK) != 0)
+    {
+        if(createFile(path) != 0)
+        {
+            perror(path);
+            return 1;
+        }
+        created = 1;
+    }
+
+    printf("mode,cache,block_kb,mb_per_s,cpu_percent,submits,checksum\n");
+    int direct;
+    for(direct = 0; direct < 2; direct++)
+    {
+        size_t m;
+        for(m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+        {
+            ReaderOptions options = { modes[m].backend, blockSize, modes[m].depth, modes[m].threads, direct };
+            dropCache(path);
+            double cpuStart = cpuSeconds();
+            double start = nowSeconds();
+            reader = fileReaderStart(&path, 1, &options);
+            if(reader == NULL)
+            {
+                perror(modes[m].name);
+                continue;
+            }
+            pthread_t th;
+            uint64_t sum = 0;
+            if(pthread_create(&th, NULL, &consumer, &sum) != 0)
+            {
+                perror("Failed to Create Thread");
+                return 1;
+            }
+            pthread_join(th, NULL);
+            ReaderStats stats;
+            if(fileReaderStop(reader, &stats) != 0)
+            {
+                perror(modes[m].name);
+            }
+            double seconds = nowSeconds() - start;
+            double cpu = cpuSeconds() - cpuStart;
+            printf("%s,%s,%zu,%.0f,%.0f,%ld,%016llx\n", modes[m].name, direct ? "O_DIRECT" : "cold", blockSize / 1024,
+                   stats.bytes / 1e6 / seconds, 100 * cpu / seconds, stats.submits, (unsigned long long)sum);
+            fflush(stdout);
+        }
+    }
+    if(created)
+    {
+        unlink(path);
+    }
+    return 0;
+}
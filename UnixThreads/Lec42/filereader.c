@@ -0,0 +1,601 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "filereader.h"
+
+
+#define ALIGNMENT 4096              // O_DIRECT buffers, lengths and offsets
+
+// io_uring without liburing: the shared rings mapped from the ring fd
+typedef struct Ring
+{
+    int fd;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_sqe* sqes;
+    void* sqMap;
+    size_t sqMapSize;
+    void* cqMap;
+    size_t cqMapSize;
+    size_t sqesSize;
+    unsigned queued;                // SQEs filled but not yet submitted
+} Ring;
+
+struct FileReader
+{
+    ReaderOptions options;
+    int fileCount;
+    int* fds;
+    off_t* sizes;
+
+    // Next block to read, shared by the pread threads
+    pthread_mutex_t mutexCursor;
+    int cursorFile;
+    off_t cursorOffset;
+
+    // Buffers not in flight and not held by a consumer
+    char* memory;
+    ReadBlock* blocks;
+    int slotCount;
+    int* freeSlots;
+    int freeCount;
+    pthread_mutex_t mutexFree;
+    sem_t semFree;
+
+    // Lec23's buffer, FIFO: semEmpty counts free places, semFull queued blocks
+    ReadBlock** buffer;
+    int first;
+    int count;
+    int producersLeft;
+    pthread_mutex_t mutexBuffer;
+    sem_t semEmpty;
+    sem_t semFull;
+
+    Ring ring;
+    int fixedFiles;
+    int fixedBuffers;
+    pthread_t* threads;
+    int threadCount;
+    atomic_int stopping;
+    atomic_int error;
+    ReaderStats stats;              // blocks / bytes under mutexBuffer
+};
+
+const char* readerBackendName(ReaderBackend backend)
+{
+    static const char* const names[] = { "auto", "io_uring", "pread" };
+    return names[backend];
+}
+
+// ---- io_uring ------------------------------------------------------------------
+
+static int ringSetup(Ring* ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0)
+    {
+        return -1;
+    }
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single)
+    {
+        ring->sqMapSize = ring->cqMapSize = ring->sqMapSize > ring->cqMapSize ? ring->sqMapSize : ring->cqMapSize;
+    }
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqMap = single ? ring->sqMap :
+                  mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        close(ring->fd);
+        return -1;
+    }
+    char* sq = ring->sqMap;
+    char* cq = ring->cqMap;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ringClose(Ring* ring)
+{
+    munmap(ring->sqes, ring->sqesSize);
+    if(ring->cqMap != ring->sqMap)
+    {
+        munmap(ring->cqMap, ring->cqMapSize);
+    }
+    munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+}
+
+// The ring has as many entries as reads in flight, so a free SQE always exists here
+static struct io_uring_sqe* ringNext(Ring* ring)
+{
+    unsigned index = (*ring->sqTail + ring->queued) & *ring->sqMask;
+    ring->sqArray[index] = index;
+    ring->queued++;
+    memset(&ring->sqes[index], 0, sizeof(struct io_uring_sqe));
+    return &ring->sqes[index];
+}
+
+// Submits the queued SQEs and waits for at least `wait` completions
+static int ringEnter(Ring* ring, unsigned wait)
+{
+    __atomic_store_n(ring->sqTail, *ring->sqTail + ring->queued, __ATOMIC_RELEASE);
+    unsigned submit = ring->queued;
+    ring->queued = 0;
+    while(1)
+    {
+        long n = syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if(n >= 0 || errno != EINTR)
+        {
+            return n < 0 ? -1 : 0;
+        }
+        submit = 0;
+    }
+}
+
+// ---- Blocks, buffers and the consumer queue ----------------------------------------
+
+static void setError(FileReader* reader, int error)
+{
+    int expected = 0;
+    atomic_compare_exchange_strong(&reader->error, &expected, error);
+    atomic_store(&reader->stopping, 1);
+}
+
+// Claims the next block of the input; 0 when everything was handed out
+static int nextBlock(FileReader* reader, ReadBlock* block)
+{
+    int found = 0;
+    pthread_mutex_lock(&reader->mutexCursor);
+    while(reader->cursorFile < reader->fileCount && reader->cursorOffset >= reader->sizes[reader->cursorFile])
+    {
+        reader->cursorFile++;
+        reader->cursorOffset = 0;
+    }
+    if(reader->cursorFile < reader->fileCount)
+    {
+        off_t left = reader->sizes[reader->cursorFile] - reader->cursorOffset;
+        block->file = reader->cursorFile;
+        block->offset = reader->cursorOffset;
+        block->length = left < (off_t)reader->options.blockSize ? (size_t)left : reader->options.blockSize;
+        reader->cursorOffset += block->length;
+        found = 1;
+    }
+    pthread_mutex_unlock(&reader->mutexCursor);
+    return found;
+}
+
+// A free buffer slot, -1 when stopping (or none free and `wait` is 0)
+static int takeFree(FileReader* reader, int wait)
+{
+    if(wait ? sem_wait(&reader->semFree) != 0 : sem_trywait(&reader->semFree) != 0)
+    {
+        return -1;
+    }
+    if(atomic_load(&reader->stopping))
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&reader->mutexFree);
+    int slot = reader->freeSlots[--reader->freeCount];
+    pthread_mutex_unlock(&reader->mutexFree);
+    return slot;
+}
+
+static void giveFree(FileReader* reader, int slot)
+{
+    pthread_mutex_lock(&reader->mutexFree);
+    reader->freeSlots[reader->freeCount++] = slot;
+    pthread_mutex_unlock(&reader->mutexFree);
+    sem_post(&reader->semFree);
+}
+
+// Lec23's producer side
+static void push(FileReader* reader, ReadBlock* block)
+{
+    sem_wait(&reader->semEmpty);
+    pthread_mutex_lock(&reader->mutexBuffer);
+    reader->buffer[(reader->first + reader->count) % reader->slotCount] = block;
+    reader->count++;
+    reader->stats.blocks++;
+    reader->stats.bytes += block->length;
+    pthread_mutex_unlock(&reader->mutexBuffer);
+    sem_post(&reader->semFull);
+}
+
+static void producerDone(FileReader* reader)
+{
+    pthread_mutex_lock(&reader->mutexBuffer);
+    // Decided under the lock: exactly one producer posts the end of input
+    int last = --reader->producersLeft == 0;
+    pthread_mutex_unlock(&reader->mutexBuffer);
+    if(last)
+    {
+        sem_post(&reader->semFull);     // wakes one consumer, which passes it on
+    }
+}
+
+ReadBlock* fileReaderNext(FileReader* reader)
+{
+    sem_wait(&reader->semFull);
+    pthread_mutex_lock(&reader->mutexBuffer);
+    if(reader->count == 0)
+    {
+        // Only the end-of-input post is left: keep it for the next consumer
+        pthread_mutex_unlock(&reader->mutexBuffer);
+        sem_post(&reader->semFull);
+        return NULL;
+    }
+    ReadBlock* block = reader->buffer[reader->first];
+    reader->first = (reader->first + 1) % reader->slotCount;
+    reader->count--;
+    pthread_mutex_unlock(&reader->mutexBuffer);
+    sem_post(&reader->semEmpty);
+    return block;
+}
+
+void fileReaderRelease(FileReader* reader, ReadBlock* block)
+{
+    giveFree(reader, block->slot);
+}
+
+// Reads what is left of a block synchronously (short read). 0, or -1 with errno set.
+static int finishBlock(FileReader* reader, ReadBlock* block, size_t done)
+{
+    while(done < block->length)
+    {
+        size_t want = block->length - done;
+        if(reader->options.direct)
+        {
+            want = (want + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+        }
+        ssize_t n = pread(reader->fds[block->file], block->data + done, want, block->offset + done);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return -1;
+        }
+        if(n == 0)
+        {
+            block->length = done;       // the file shrank after fileReaderStart()
+            break;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// ---- Producers -------------------------------------------------------------------
+
+static void* uringReader(void* args)
+{
+    FileReader* reader = args;
+    Ring* ring = &reader->ring;
+    int inflight = 0;
+    int more = 1;
+    while(1)
+    {
+        // Fill the ring; block for a buffer only when nothing is in flight
+        while(more && inflight < reader->options.queueDepth && !atomic_load(&reader->stopping))
+        {
+            int slot = takeFree(reader, inflight == 0);
+            if(slot < 0)
+            {
+                break;
+            }
+            ReadBlock* block = &reader->blocks[slot];
+            if(!nextBlock(reader, block))
+            {
+                giveFree(reader, slot);
+                more = 0;
+                break;
+            }
+            size_t length = block->length;
+            if(reader->options.direct)
+            {
+                length = (length + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+            }
+            struct io_uring_sqe* sqe = ringNext(ring);
+            sqe->opcode = reader->fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = reader->fixedFiles ? block->file : reader->fds[block->file];
+            sqe->flags = reader->fixedFiles ? IOSQE_FIXED_FILE : 0;
+            sqe->addr = (unsigned long)block->data;
+            sqe->len = length;
+            sqe->off = block->offset;
+            sqe->buf_index = slot;
+            sqe->user_data = slot;
+            inflight++;
+        }
+        if(inflight == 0)
+        {
+            break;
+        }
+
+        // One system call submits the whole batch and waits for the first completion
+        if(ringEnter(ring, 1) != 0)
+        {
+            setError(reader, errno);
+            break;                      // buffers in flight are not reused: fileReaderStop() closes the ring first
+        }
+        reader->stats.submits++;
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++)
+        {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            ReadBlock* block = &reader->blocks[cqe->user_data];
+            inflight--;
+            int res = cqe->res;
+            if(res == -EAGAIN || res == -EINTR)
+            {
+                res = 0;                // let finishBlock() read it
+            }
+            if(res < 0 || atomic_load(&reader->stopping))
+            {
+                if(res < 0)
+                {
+                    setError(reader, -res);
+                }
+                giveFree(reader, block->slot);
+                continue;
+            }
+            if((size_t)res < block->length && finishBlock(reader, block, res) != 0)
+            {
+                setError(reader, errno);
+                giveFree(reader, block->slot);
+                continue;
+            }
+            push(reader, block);
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+    producerDone(reader);
+    return NULL;
+}
+
+static void* preadReader(void* args)
+{
+    FileReader* reader = args;
+    while(1)
+    {
+        int slot = takeFree(reader, 1);
+        if(slot < 0)
+        {
+            break;
+        }
+        ReadBlock* block = &reader->blocks[slot];
+        if(!nextBlock(reader, block))
+        {
+            giveFree(reader, slot);
+            break;
+        }
+        // Blocks this thread only; the other threads keep their reads going
+        if(finishBlock(reader, block, 0) != 0)
+        {
+            setError(reader, errno);
+            giveFree(reader, slot);
+            break;
+        }
+        push(reader, block);
+    }
+    producerDone(reader);
+    return NULL;
+}
+
+// ---- Start / stop ------------------------------------------------------------------
+
+static void freeReader(FileReader* reader)
+{
+    for(int i = 0; i < reader->fileCount; i++)
+    {
+        if(reader->fds[i] >= 0)
+        {
+            close(reader->fds[i]);
+        }
+    }
+    free(reader->fds);
+    free(reader->sizes);
+    free(reader->memory);
+    free(reader->blocks);
+    free(reader->freeSlots);
+    free(reader->buffer);
+    free(reader->threads);
+    free(reader);
+}
+
+FileReader* fileReaderStart(const char* const* paths, int count, const ReaderOptions* options)
+{
+    FileReader* reader = calloc(1, sizeof(FileReader));
+    if(reader == NULL)
+    {
+        return NULL;
+    }
+    reader->options = *options;
+    ReaderOptions* o = &reader->options;
+    o->blockSize = o->blockSize > 0 ? (o->blockSize + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1) : READER_DEFAULT_BLOCK;
+    o->queueDepth = o->queueDepth > 0 ? o->queueDepth : READER_DEFAULT_DEPTH;
+    o->threads = o->threads > 0 ? o->threads : READER_DEFAULT_THREADS;
+
+    reader->fileCount = count;
+    reader->fds = malloc(count * sizeof(int));
+    reader->sizes = calloc(count, sizeof(off_t));
+    if(reader->fds == NULL || reader->sizes == NULL)
+    {
+        freeReader(reader);
+        return NULL;
+    }
+    memset(reader->fds, -1, count * sizeof(int));
+    for(int i = 0; i < count; i++)
+    {
+        struct stat st;
+        reader->fds[i] = open(paths[i], O_RDONLY | O_CLOEXEC | (o->direct ? O_DIRECT : 0));
+        if(reader->fds[i] < 0 || fstat(reader->fds[i], &st) != 0)
+        {
+            int error = errno;
+            freeReader(reader);
+            errno = error;
+            return NULL;
+        }
+        reader->sizes[i] = st.st_size;
+        posix_fadvise(reader->fds[i], 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    // io_uring unless told otherwise or unavailable
+    ReaderBackend backend = o->backend;
+    if(backend != READER_PREAD)
+    {
+        if(ringSetup(&reader->ring, o->queueDepth) == 0)
+        {
+            backend = READER_IO_URING;
+        }
+        else if(backend == READER_IO_URING)
+        {
+            int error = errno;
+            freeReader(reader);
+            errno = error;
+            return NULL;
+        }
+        else
+        {
+            backend = READER_PREAD;
+        }
+    }
+    reader->stats.backend = backend;
+    reader->threadCount = backend == READER_IO_URING ? 1 : o->threads;
+
+    // As many buffers again as can be in flight, for the consumers to hold
+    reader->slotCount = 2 * (backend == READER_IO_URING ? o->queueDepth : o->threads);
+    reader->blocks = calloc(reader->slotCount, sizeof(ReadBlock));
+    reader->freeSlots = malloc(reader->slotCount * sizeof(int));
+    reader->buffer = calloc(reader->slotCount, sizeof(ReadBlock*));
+    reader->threads = calloc(reader->threadCount, sizeof(pthread_t));
+    if(posix_memalign((void**)&reader->memory, ALIGNMENT, reader->slotCount * o->blockSize) != 0)
+    {
+        reader->memory = NULL;
+    }
+    if(reader->blocks == NULL || reader->freeSlots == NULL || reader->buffer == NULL || reader->threads == NULL ||
+       reader->memory == NULL)
+    {
+        if(backend == READER_IO_URING)
+        {
+            ringClose(&reader->ring);
+        }
+        freeReader(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for(int i = 0; i < reader->slotCount; i++)
+    {
+        reader->blocks[i].data = reader->memory + i * o->blockSize;
+        reader->blocks[i].slot = i;
+        reader->freeSlots[i] = reader->slotCount - 1 - i;
+    }
+    reader->freeCount = reader->slotCount;
+
+    if(backend == READER_IO_URING)
+    {
+        // Registered once: no fd lookup and no page pinning per read. Optional, plain reads work too.
+        struct iovec* iovecs = malloc(reader->slotCount * sizeof(struct iovec));
+        for(int i = 0; iovecs != NULL && i < reader->slotCount; i++)
+        {
+            iovecs[i].iov_base = reader->blocks[i].data;
+            iovecs[i].iov_len = o->blockSize;
+        }
+        reader->fixedBuffers = iovecs != NULL &&
+            syscall(__NR_io_uring_register, reader->ring.fd, IORING_REGISTER_BUFFERS, iovecs, reader->slotCount) == 0;
+        reader->fixedFiles =
+            syscall(__NR_io_uring_register, reader->ring.fd, IORING_REGISTER_FILES, reader->fds, count) == 0;
+        free(iovecs);
+    }
+
+    pthread_mutex_init(&reader->mutexCursor, NULL);
+    pthread_mutex_init(&reader->mutexFree, NULL);
+    pthread_mutex_init(&reader->mutexBuffer, NULL);
+    sem_init(&reader->semFree, 0, reader->slotCount);
+    sem_init(&reader->semEmpty, 0, reader->slotCount);
+    sem_init(&reader->semFull, 0, 0);
+    reader->producersLeft = reader->threadCount;
+
+    for(int i = 0; i < reader->threadCount; i++)
+    {
+        if(pthread_create(&reader->threads[i], NULL, backend == READER_IO_URING ? &uringReader : &preadReader, reader) != 0)
+        {
+            perror("Failed to Create Thread");
+            setError(reader, EAGAIN);
+            producerDone(reader);       // for the thread that does not exist
+            reader->threads[i] = 0;
+        }
+    }
+    return reader;
+}
+
+int fileReaderStop(FileReader* reader, ReaderStats* stats)
+{
+    // Wake producers waiting for a buffer the consumers will not give back
+    atomic_store(&reader->stopping, 1);
+    for(int i = 0; i < reader->threadCount; i++)
+    {
+        sem_post(&reader->semFree);
+    }
+    for(int i = 0; i < reader->threadCount; i++)
+    {
+        if(reader->threads[i] != 0 && pthread_join(reader->threads[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    if(reader->stats.backend == READER_IO_URING)
+    {
+        ringClose(&reader->ring);       // also cancels reads still in flight after an io_uring_enter() error
+    }
+    int error = atomic_load(&reader->error);
+    if(stats != NULL)
+    {
+        *stats = reader->stats;
+        stats->error = error;
+    }
+    sem_destroy(&reader->semFree);
+    sem_destroy(&reader->semEmpty);
+    sem_destroy(&reader->semFull);
+    pthread_mutex_destroy(&reader->mutexCursor);
+    pthread_mutex_destroy(&reader->mutexFree);
+    pthread_mutex_destroy(&reader->mutexBuffer);
+    freeReader(reader);
+    errno = error;
+    return error ? -1 : 0;
+}
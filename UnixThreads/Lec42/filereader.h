@@ -0,0 +1,77 @@
+#ifndef FILEREADER_H
+#define FILEREADER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Lec23 producer that reads files instead of calling rand().
+ *
+ * One reader thread keeps up to `queueDepth` reads in flight with io_uring
+ * (fixed files, registered buffers, one io_uring_enter() per batch) and
+ * pushes every completed block into the Lec23 buffer: semEmpty / semFull
+ * and a mutex. Consumers take blocks with fileReaderNext() and give the
+ * buffer back with fileReaderRelease().
+ *
+ * Without io_uring (ENOSYS, or EPERM from kernel.io_uring_disabled / a
+ * seccomp filter) the same blocks are read by `threads` pread() threads.
+ *
+ * Blocks arrive in completion order, not file order: `offset` says where
+ * the data belongs.
+ */
+
+#define READER_DEFAULT_BLOCK (256 * 1024)
+#define READER_DEFAULT_DEPTH 32
+#define READER_DEFAULT_THREADS 8
+
+typedef enum ReaderBackend
+{
+    READER_AUTO,            // io_uring, pread threads when unavailable
+    READER_IO_URING,
+    READER_PREAD,
+} ReaderBackend;
+
+typedef struct ReaderOptions
+{
+    ReaderBackend backend;
+    size_t blockSize;       // multiple of 4096; 0 = default
+    int queueDepth;         // io_uring reads in flight; 0 = default
+    int threads;            // pread threads; 0 = default
+    int direct;             // O_DIRECT: bypass the page cache
+} ReaderOptions;
+
+typedef struct ReadBlock
+{
+    int file;               // index into the paths given to fileReaderStart()
+    off_t offset;
+    size_t length;          // less than blockSize only at the end of a file
+    char* data;
+    int slot;               // buffer index, used by fileReaderRelease()
+} ReadBlock;
+
+typedef struct ReaderStats
+{
+    ReaderBackend backend;  // the one actually used
+    long blocks;
+    long long bytes;
+    long submits;           // io_uring_enter() calls (io_uring only)
+    int error;              // errno of the first failed read, 0 if none
+} ReaderStats;
+
+typedef struct FileReader FileReader;
+
+// Opens the files and starts reading. NULL with errno set on failure.
+FileReader* fileReaderStart(const char* const* paths, int count, const ReaderOptions* options);
+
+// Next completed block, waits while none is ready. NULL when every block was delivered (or after an error).
+ReadBlock* fileReaderNext(FileReader* reader);
+
+// Gives the block's buffer back for the next read
+void fileReaderRelease(FileReader* reader, ReadBlock* block);
+
+// Waits for the reader threads, closes the files, frees everything. Returns 0, or -1 with errno of the first error.
+int fileReaderStop(FileReader* reader, ReaderStats* stats);
+
+const char* readerBackendName(ReaderBackend backend);
+
+#endif
@@ -0,0 +1,84 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filereader.h"
+
+
+#define CONSUMER_NUM 2
+
+FileReader* reader;
+const char** paths;
+
+
+// Lec23's consumer: takes a block from the buffer, uses it, gives the buffer back
+void * consumer (void* args)
+{
+    long lines = 0;
+    ReadBlock* block;
+    while((block = fileReaderNext(reader)) != NULL)
+    {
+        // Consume
+        size_t i;
+        long n = 0;
+        for(i = 0; i < block->length; i++)
+        {
+            n += block->data[i] == '\n';
+        }
+        printf("(%d) Got %zu bytes of %s at offset %ld , %ld lines \n", *(int*)args, block->length,
+               paths[block->file], (long)block->offset, n);
+        lines += n;
+        fileReaderRelease(reader, block);
+    }
+    free(args);
+    return (void*)lines;
+}
+
+
+int main(int argc, char* argv[])
+{
+    static const char* defaults[] = { "main.c", "filereader.c", "filereader.h" };
+    paths = argc > 1 ? (const char**)argv + 1 : defaults;
+    int count = argc > 1 ? argc - 1 : 3;
+
+    // Small blocks so even these sources make a few of them
+    ReaderOptions options = { READER_AUTO, 4096, 8, 0, 0 };
+    reader = fileReaderStart(paths, count, &options);
+    if(reader == NULL)
+    {
+        perror("Failed to Start Reader");
+        return 1;
+    }
+
+    pthread_t th[CONSUMER_NUM];
+    int i;
+    for(i = 0; i < CONSUMER_NUM ; i++)
+    {
+        int* a = malloc(sizeof(int));
+        *a = i;
+        if(pthread_create(&th[i], NULL , &consumer , a) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    long total = 0;
+    for(i = 0; i < CONSUMER_NUM ; i++)
+    {
+        void* lines;
+        if(pthread_join(th[i], &lines) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+        total += (long)lines;
+    }
+
+    ReaderStats stats;
+    if(fileReaderStop(reader, &stats) != 0)
+    {
+        perror("Read Failed");
+    }
+    printf("%ld blocks , %lld bytes , %ld lines with %s (%ld submits) \n", stats.blocks, stats.bytes, total,
+           readerBackendName(stats.backend), stats.submits);
+    return 0;
+}
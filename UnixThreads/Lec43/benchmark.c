@@ -0,0 +1,129 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spillqueue.h"
+
+
+#define RECORDS 4000000
+#define DIR "benchmark.spill"
+
+typedef struct Task
+{
+    int taskFunction;
+    int arg1 , arg2;
+} Task;
+
+SpillQueue* queue;
+
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* mode, long records, double seconds)
+{
+    printf("%s,%ld,%.3f,%.2f\n", mode, records, seconds, records / seconds / 1e6);
+}
+
+void * producer (void* args)
+{
+    Task task = { 0, 0, 0 };
+    int i;
+    for(i = 0; i < RECORDS; i++)
+    {
+        task.arg1 = i;
+        if(spillQueuePush(queue, &task) != 0)
+        {
+            perror("Failed to Push");
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+// Pops until every record arrived, checking the FIFO order on the way
+void * consumer (void* args)
+{
+    Task task;
+    int i;
+    for(i = 0; i < RECORDS; i++)
+    {
+        if(spillQueuePop(queue, &task) != 0 || task.arg1 != i)
+        {
+            fprintf(stderr, "Out of order at %d\n", i);
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+static void drain(const char* mode)
+{
+    pthread_t th;
+    double start = nowSeconds();
+    pthread_create(&th, NULL, &consumer, NULL);
+    pthread_join(th, NULL);
+    report(mode, RECORDS, nowSeconds() - start);
+}
+
+static void burst(const char* mode, int flags)
+{
+    queue = spillQueueOpen(DIR, sizeof(Task), 256, flags);
+    pthread_t th;
+    double start = nowSeconds();
+    pthread_create(&th, NULL, &producer, NULL);
+    pthread_join(th, NULL);
+    report(mode, RECORDS, nowSeconds() - start);
+}
+
+
+int main(void)
+{
+    if(system("rm -rf " DIR) != 0)
+    {
+        return 1;
+    }
+    printf("mode,records,seconds,mrecords_per_s\n");
+
+    // 1. In memory: the ring never fills, producer and consumer run together
+    queue = spillQueueOpen(DIR, sizeof(Task), RECORDS, 0);
+    pthread_t th[2];
+    double start = nowSeconds();
+    pthread_create(&th[0], NULL, &producer, NULL);
+    pthread_create(&th[1], NULL, &consumer, NULL);
+    pthread_join(th[0], NULL);
+    pthread_join(th[1], NULL);
+    report("memory push+pop", RECORDS, nowSeconds() - start);
+    spillQueueClose(queue);
+
+    // 2. A burst with no consumer: all but 256 records spill, then a consumer drains them
+    burst("spill push", 0);
+    drain("spill pop (from disk)");
+    spillQueueClose(queue);
+
+    burst("spill push SPILL_SYNC", SPILL_SYNC);
+    drain("spill pop SPILL_SYNC");
+    spillQueueClose(queue);
+
+    // 3. Restart: close with everything queued, reopen, drain
+    burst("spill push", 0);
+    start = nowSeconds();
+    spillQueueClose(queue);
+    report("close (persist the 256 in memory)", 256, nowSeconds() - start);
+
+    start = nowSeconds();
+    queue = spillQueueOpen(DIR, sizeof(Task), 256, 0);
+    double seconds = nowSeconds() - start;
+    SpillStats stats;
+    spillQueueStats(queue, &stats);
+    report("recovery (open + checksums)", stats.recovered, seconds);
+    drain("recovered pop");
+
+    spillQueueClose(queue);
+    return 0;
+}
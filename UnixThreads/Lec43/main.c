@@ -0,0 +1,125 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "spillqueue.h"
+
+
+#define THREAD_NUM 4
+#define MEMORY_TASKS 256
+#define BURST_TASKS 1000
+
+// Lec29's task, but the function is an index: a pointer means nothing to the next run
+typedef struct Task
+{
+    int taskFunction;
+    int arg1 , arg2;
+} Task;
+
+SpillQueue* queue;
+
+
+void sum(int a , int b)
+{
+    usleep(10000);
+    int sum = a + b ;
+    printf("Sum of %d and %d is %d\n", a, b, sum);
+}
+
+void prod(int a , int b)
+{
+    usleep(10000);
+    int prod = a * b ;
+    printf("Product of %d and %d is %d\n", a, b, prod);
+}
+
+void (*const taskFunctions[])(int , int) = { &sum, &prod };
+
+void executeTask(Task* task)
+{
+    taskFunctions[task->taskFunction](task->arg1 , task->arg2);
+}
+
+void submitTask(Task task)
+{
+    // Never blocks and never overflows: past MEMORY_TASKS the task goes to disk
+    if(spillQueuePush(queue, &task) != 0)
+    {
+        perror("Failed to Queue Task");
+    }
+}
+
+void * startThread (void* args)
+{
+    Task task;
+    while(spillQueuePop(queue, &task) == 0)
+    {
+        executeTask(&task);
+    }
+    return NULL;
+}
+
+
+int main(void)
+{
+    queue = spillQueueOpen("tasks.spill", sizeof(Task), MEMORY_TASKS, 0);
+    if(queue == NULL)
+    {
+        perror("Failed to Open Queue");
+        return 1;
+    }
+    SpillStats stats;
+    spillQueueStats(queue, &stats);
+    int resumed = stats.recovered > 0;
+    printf("Recovered %ld tasks from the last run (%ld corrupt)\n", stats.recovered, stats.corrupt);
+
+    pthread_t th[THREAD_NUM];
+    int i;
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if(pthread_create(&th[i], NULL , &startThread , NULL) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+
+    if(resumed)
+    {
+        // Second run: finish what the first one left
+        do
+        {
+            usleep(100000);
+            spillQueueStats(queue, &stats);
+        } while(stats.size > 0);
+    }
+    else
+    {
+        // First run: a burst 4x bigger than Lec29's taskQueue[256], then stop after one second
+        for(i = 0; i < BURST_TASKS; i++)
+        {
+            Task t = {
+                .taskFunction = i % 2,
+                .arg1 = rand() % 100 ,
+                .arg2 = rand() % 100
+            };
+            submitTask(t);
+        }
+        sleep(1);
+    }
+
+    spillQueueStop(queue);
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if(pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    spillQueueStats(queue, &stats);
+    printf("Ran %ld tasks , %ld spilled to disk , %ld left for the next run\n", stats.popped, stats.spilled, stats.size);
+    if(spillQueueClose(queue) != 0)
+    {
+        perror("Failed to Close Queue");
+    }
+    return 0;
+}
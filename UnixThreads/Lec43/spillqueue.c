@@ -0,0 +1,597 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spillqueue.h"
+
+
+#define SEGMENT_MAGIC "SPQ1"
+#define SEGMENT_VERSION 1
+#define FIRST_KEY (1LL << 40)       // room below it for segments written at close
+
+// First 64 bytes of every segment file
+typedef struct SegmentHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;              // record slots
+    int64_t key;                    // segments are replayed in key order
+    uint32_t headerChecksum;        // of the fields above
+    uint32_t sealedCount;           // records in the segment once full / closed, 0 while being written
+    uint32_t consumed;              // records already popped
+    char pad[28];
+} SegmentHeader;
+
+// In front of every record
+typedef struct RecordHeader
+{
+    uint32_t index;                 // slot number: stale or zeroed slots do not match
+    uint32_t checksum;              // of the key, the index and the payload
+} RecordHeader;
+
+_Static_assert(sizeof(SegmentHeader) == 64, "SegmentHeader size");
+
+typedef struct Segment
+{
+    int64_t key;
+    int fd;
+    char* map;
+    uint32_t capacity;
+    uint32_t written;
+    uint32_t read;
+    int sealed;                     // no more appends
+    struct Segment* next;
+} Segment;
+
+struct SpillQueue
+{
+    char* dir;
+    size_t recordSize;
+    size_t slotSize;                // RecordHeader + record, 8-byte aligned
+    int flags;
+
+    // In-memory ring: always older than everything on disk
+    char* ring;
+    int capacity;
+    int first;
+    int count;
+
+    // Segments, oldest first; appends go to the last one
+    Segment* head;
+    Segment* tail;
+    long onDisk;
+    int64_t nextKey;
+
+    pthread_mutex_t mutexQueue;
+    pthread_cond_t condQueue;
+    int stopped;
+    SpillStats stats;
+};
+
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t length)
+{
+    const unsigned char* p = data;
+    for(size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t recordChecksum(int64_t key, uint32_t index, const void* record, size_t length)
+{
+    uint32_t hash = fnv1a(2166136261u, &key, sizeof(key));
+    hash = fnv1a(hash, &index, sizeof(index));
+    return fnv1a(hash, record, length);
+}
+
+static SegmentHeader* headerOf(Segment* segment)
+{
+    return (SegmentHeader*)segment->map;
+}
+
+static char* slotOf(SpillQueue* queue, Segment* segment, uint32_t index)
+{
+    return segment->map + sizeof(SegmentHeader) + (size_t)index * queue->slotSize;
+}
+
+static void segmentPath(SpillQueue* queue, int64_t key, char* path, size_t size)
+{
+    snprintf(path, size, "%s/%016llx.seg", queue->dir, (unsigned long long)key);
+}
+
+static void syncDir(SpillQueue* queue)
+{
+    if(queue->flags & SPILL_SYNC)
+    {
+        int fd = open(queue->dir, O_RDONLY | O_DIRECTORY);
+        if(fd >= 0)
+        {
+            fsync(fd);
+            close(fd);
+        }
+    }
+}
+
+// ---- Segment files -------------------------------------------------------------------
+
+static Segment* segmentCreate(SpillQueue* queue, int64_t key)
+{
+    char path[4096];
+    segmentPath(queue, key, path, sizeof(path));
+    Segment* segment = calloc(1, sizeof(Segment));
+    if(segment == NULL)
+    {
+        return NULL;
+    }
+    segment->key = key;
+    segment->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(segment->fd < 0)
+    {
+        free(segment);
+        return NULL;
+    }
+    // Blocks reserved now: a full disk is ENOSPC here, not SIGBUS on a store into the mapping
+    int error = posix_fallocate(segment->fd, 0, SPILL_SEGMENT_SIZE);
+    if(error == 0)
+    {
+        segment->map = mmap(NULL, SPILL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        error = segment->map == MAP_FAILED ? errno : 0;
+    }
+    if(error != 0)
+    {
+        close(segment->fd);
+        unlink(path);
+        free(segment);
+        errno = error;
+        return NULL;
+    }
+    madvise(segment->map, SPILL_SEGMENT_SIZE, MADV_SEQUENTIAL);
+
+    SegmentHeader* header = headerOf(segment);
+    memcpy(header->magic, SEGMENT_MAGIC, 4);
+    header->version = SEGMENT_VERSION;
+    header->recordSize = queue->recordSize;
+    header->capacity = (SPILL_SEGMENT_SIZE - sizeof(SegmentHeader)) / queue->slotSize;
+    header->key = key;
+    header->headerChecksum = fnv1a(2166136261u, header, offsetof(SegmentHeader, headerChecksum));
+    segment->capacity = header->capacity;
+    queue->stats.segments++;
+    syncDir(queue);
+    return segment;
+}
+
+static void segmentSeal(SpillQueue* queue, Segment* segment)
+{
+    headerOf(segment)->sealedCount = segment->written;
+    segment->sealed = 1;
+    if(queue->flags & SPILL_SYNC)
+    {
+        msync(segment->map, SPILL_SEGMENT_SIZE, MS_SYNC);
+    }
+}
+
+static void segmentFree(Segment* segment)
+{
+    munmap(segment->map, SPILL_SEGMENT_SIZE);
+    close(segment->fd);
+    free(segment);
+}
+
+static void segmentRemove(SpillQueue* queue, Segment* segment)
+{
+    char path[4096];
+    segmentPath(queue, segment->key, path, sizeof(path));
+    unlink(path);
+    segmentFree(segment);
+}
+
+static void segmentAppend(SpillQueue* queue, Segment* segment)
+{
+    segment->next = NULL;
+    if(queue->tail != NULL)
+    {
+        queue->tail->next = segment;
+    }
+    else
+    {
+        queue->head = segment;
+    }
+    queue->tail = segment;
+}
+
+static void writeRecord(SpillQueue* queue, Segment* segment, const void* record)
+{
+    char* slot = slotOf(queue, segment, segment->written);
+    RecordHeader header = { segment->written, recordChecksum(segment->key, segment->written, record, queue->recordSize) };
+    memcpy(slot + sizeof(RecordHeader), record, queue->recordSize);
+    memcpy(slot, &header, sizeof(header));
+    segment->written++;
+}
+
+static int spill(SpillQueue* queue, const void* record)
+{
+    Segment* tail = queue->tail;
+    if(tail == NULL || tail->sealed || tail->written == tail->capacity)
+    {
+        if(tail != NULL && !tail->sealed)
+        {
+            segmentSeal(queue, tail);
+        }
+        tail = segmentCreate(queue, queue->nextKey);
+        if(tail == NULL)
+        {
+            return -1;
+        }
+        queue->nextKey++;
+        segmentAppend(queue, tail);
+    }
+    writeRecord(queue, tail, record);
+    queue->onDisk++;
+    queue->stats.spilled++;
+    return 0;
+}
+
+// Moves the oldest records on disk into the (empty) ring
+static void refill(SpillQueue* queue)
+{
+    while(queue->count < queue->capacity && queue->head != NULL)
+    {
+        Segment* segment = queue->head;
+        while(queue->count < queue->capacity && segment->read < segment->written)
+        {
+            char* slot = slotOf(queue, segment, segment->read);
+            memcpy(queue->ring + (size_t)((queue->first + queue->count) % queue->capacity) * queue->recordSize,
+                   slot + sizeof(RecordHeader), queue->recordSize);
+            queue->count++;
+            segment->read++;
+            queue->onDisk--;
+            queue->stats.unspilled++;
+        }
+        headerOf(segment)->consumed = segment->read;
+        // The tail can still take appends unless it is full
+        if(segment->read < segment->written || (!segment->sealed && segment->written < segment->capacity))
+        {
+            break;
+        }
+        queue->head = segment->next;
+        if(queue->head == NULL)
+        {
+            queue->tail = NULL;
+        }
+        segmentRemove(queue, segment);
+    }
+}
+
+// ---- Queue ------------------------------------------------------------------------
+
+int spillQueuePush(SpillQueue* queue, const void* record)
+{
+    int result = 0;
+    pthread_mutex_lock(&queue->mutexQueue);
+    // Once anything is on disk, new records go behind it
+    if(queue->onDisk == 0 && queue->count < queue->capacity)
+    {
+        memcpy(queue->ring + (size_t)((queue->first + queue->count) % queue->capacity) * queue->recordSize,
+               record, queue->recordSize);
+        queue->count++;
+    }
+    else
+    {
+        result = spill(queue, record);
+    }
+    if(result == 0)
+    {
+        queue->stats.pushed++;
+    }
+    pthread_mutex_unlock(&queue->mutexQueue);
+    if(result == 0)
+    {
+        pthread_cond_signal(&queue->condQueue);
+    }
+    return result;
+}
+
+static int take(SpillQueue* queue, void* record)
+{
+    if(queue->count == 0)
+    {
+        refill(queue);
+        if(queue->count == 0)
+        {
+            return -1;
+        }
+    }
+    memcpy(record, queue->ring + (size_t)queue->first * queue->recordSize, queue->recordSize);
+    queue->first = (queue->first + 1) % queue->capacity;
+    queue->count--;
+    queue->stats.popped++;
+    return 0;
+}
+
+int spillQueuePop(SpillQueue* queue, void* record)
+{
+    pthread_mutex_lock(&queue->mutexQueue);
+    while(!queue->stopped && queue->count == 0 && queue->onDisk == 0)
+    {
+        pthread_cond_wait(&queue->condQueue, &queue->mutexQueue);
+    }
+    int result = queue->stopped ? -1 : take(queue, record);
+    pthread_mutex_unlock(&queue->mutexQueue);
+    return result;
+}
+
+int spillQueueTryPop(SpillQueue* queue, void* record)
+{
+    pthread_mutex_lock(&queue->mutexQueue);
+    int result = take(queue, record);
+    pthread_mutex_unlock(&queue->mutexQueue);
+    return result;
+}
+
+void spillQueueStop(SpillQueue* queue)
+{
+    pthread_mutex_lock(&queue->mutexQueue);
+    queue->stopped = 1;
+    pthread_mutex_unlock(&queue->mutexQueue);
+    pthread_cond_broadcast(&queue->condQueue);
+}
+
+void spillQueueStats(SpillQueue* queue, SpillStats* stats)
+{
+    pthread_mutex_lock(&queue->mutexQueue);
+    *stats = queue->stats;
+    stats->onDisk = queue->onDisk;
+    stats->size = queue->onDisk + queue->count;
+    pthread_mutex_unlock(&queue->mutexQueue);
+}
+
+// ---- Open / close -------------------------------------------------------------------
+
+static int compareKeys(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Maps one segment left by an earlier run and finds its valid records. -1 only when out of memory.
+static int recoverSegment(SpillQueue* queue, int64_t key)
+{
+    char path[4096];
+    segmentPath(queue, key, path, sizeof(path));
+    Segment* segment = calloc(1, sizeof(Segment));
+    struct stat st;
+    if(segment == NULL)
+    {
+        return -1;
+    }
+    segment->key = key;
+    segment->fd = open(path, O_RDWR | O_CLOEXEC);
+    segment->map = MAP_FAILED;
+    if(segment->fd >= 0 && fstat(segment->fd, &st) == 0 && st.st_size == SPILL_SEGMENT_SIZE)
+    {
+        segment->map = mmap(NULL, SPILL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    }
+    SegmentHeader* header = segment->map != MAP_FAILED ? headerOf(segment) : NULL;
+    if(header == NULL || memcmp(header->magic, SEGMENT_MAGIC, 4) != 0 || header->version != SEGMENT_VERSION ||
+       header->recordSize != queue->recordSize || header->key != key ||
+       header->headerChecksum != fnv1a(2166136261u, header, offsetof(SegmentHeader, headerChecksum)) ||
+       header->capacity != (SPILL_SEGMENT_SIZE - sizeof(SegmentHeader)) / queue->slotSize)
+    {
+        // Not ours, or the header itself is damaged: keep it for a human, out of the way
+        char bad[4200];
+        snprintf(bad, sizeof(bad), "%s.bad", path);
+        rename(path, bad);
+        if(segment->map != MAP_FAILED)
+        {
+            munmap(segment->map, SPILL_SEGMENT_SIZE);
+        }
+        if(segment->fd >= 0)
+        {
+            close(segment->fd);
+        }
+        free(segment);
+        return 0;
+    }
+
+    // sealedCount and consumed are outside the header checksum (they change after it is written):
+    // out of range means damaged. An unknown sealedCount is found again from the record checksums;
+    // an unknown consumed replays the segment from its first record, duplicates rather than loss.
+    uint32_t sealedCount = header->sealedCount <= header->capacity ? header->sealedCount : 0;
+    uint32_t limit = sealedCount > 0 ? sealedCount : header->capacity;
+    uint32_t consumed = header->consumed <= limit ? header->consumed : 0;
+    segment->capacity = header->capacity;
+    uint32_t i;
+    for(i = consumed; i < limit; i++)
+    {
+        // The first bad record ends the segment: a torn write, or the end of what was written
+        char* slot = slotOf(queue, segment, i);
+        RecordHeader record;
+        memcpy(&record, slot, sizeof(record));
+        if(record.index != i || record.checksum != recordChecksum(key, i, slot + sizeof(RecordHeader), queue->recordSize))
+        {
+            break;
+        }
+    }
+    if(sealedCount > 0)
+    {
+        queue->stats.corrupt += sealedCount - i;
+    }
+    segment->read = consumed < i ? consumed : i;
+    segment->written = i;
+    segment->sealed = 1;                // recovered segments only get read
+    header->sealedCount = i;
+    header->consumed = segment->read;
+    if(segment->read == segment->written)
+    {
+        segmentRemove(queue, segment);
+        return 0;
+    }
+    queue->onDisk += segment->written - segment->read;
+    queue->stats.recovered += segment->written - segment->read;
+    segmentAppend(queue, segment);
+    return 0;
+}
+
+static int recover(SpillQueue* queue)
+{
+    DIR* dir = opendir(queue->dir);
+    if(dir == NULL)
+    {
+        return -1;
+    }
+    int64_t* keys = NULL;
+    int keyCount = 0;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        unsigned long long key;
+        int length = 0;
+        if(strlen(entry->d_name) == 20 && sscanf(entry->d_name, "%16llx.seg%n", &key, &length) == 1 && length == 20)
+        {
+            int64_t* grown = realloc(keys, (keyCount + 1) * sizeof(int64_t));
+            if(grown == NULL)
+            {
+                break;
+            }
+            keys = grown;
+            keys[keyCount++] = key;
+        }
+    }
+    closedir(dir);
+
+    if(keyCount > 1)
+    {
+        qsort(keys, keyCount, sizeof(int64_t), compareKeys);
+    }
+    for(int i = 0; i < keyCount; i++)
+    {
+        if(recoverSegment(queue, keys[i]) != 0)
+        {
+            free(keys);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    queue->nextKey = keyCount > 0 && keys[keyCount - 1] >= FIRST_KEY ? keys[keyCount - 1] + 1 : FIRST_KEY;
+    free(keys);
+    return 0;
+}
+
+SpillQueue* spillQueueOpen(const char* dir, size_t recordSize, int memoryCapacity, int flags)
+{
+    if(recordSize == 0 || recordSize > SPILL_MAX_RECORD || memoryCapacity < 1)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if(mkdir(dir, 0700) != 0 && errno != EEXIST)
+    {
+        return NULL;
+    }
+    SpillQueue* queue = calloc(1, sizeof(SpillQueue));
+    if(queue == NULL)
+    {
+        return NULL;
+    }
+    queue->dir = strdup(dir);
+    queue->recordSize = recordSize;
+    queue->slotSize = (sizeof(RecordHeader) + recordSize + 7) & ~(size_t)7;
+    queue->flags = flags;
+    queue->capacity = memoryCapacity;
+    queue->ring = malloc((size_t)memoryCapacity * recordSize);
+    if(queue->dir == NULL || queue->ring == NULL || recover(queue) != 0)
+    {
+        int error = errno;
+        free(queue->dir);
+        free(queue->ring);
+        free(queue);
+        errno = error;
+        return NULL;
+    }
+    pthread_mutex_init(&queue->mutexQueue, NULL);
+    pthread_cond_init(&queue->condQueue, NULL);
+    return queue;
+}
+
+int spillQueueClose(SpillQueue* queue)
+{
+    int result = 0;
+    // The ring is older than every segment: its records go to keys in front of them
+    if(queue->count > 0)
+    {
+        uint32_t perSegment = (SPILL_SEGMENT_SIZE - sizeof(SegmentHeader)) / queue->slotSize;
+        int64_t segments = (queue->count + perSegment - 1) / perSegment;
+        int64_t key = (queue->head != NULL ? queue->head->key : queue->nextKey) - segments;
+        Segment* flushed = NULL;
+        Segment* last = NULL;
+        while(queue->count > 0 && result == 0)
+        {
+            Segment* segment = segmentCreate(queue, key++);
+            if(segment == NULL)
+            {
+                result = -1;
+                break;
+            }
+            while(queue->count > 0 && segment->written < segment->capacity)
+            {
+                writeRecord(queue, segment, queue->ring + (size_t)queue->first * queue->recordSize);
+                queue->first = (queue->first + 1) % queue->capacity;
+                queue->count--;
+            }
+            segmentSeal(queue, segment);
+            if(last != NULL)
+            {
+                last->next = segment;
+            }
+            else
+            {
+                flushed = segment;
+            }
+            last = segment;
+        }
+        if(last != NULL)
+        {
+            last->next = queue->head;
+            queue->head = flushed;
+        }
+    }
+
+    int error = errno;
+    Segment* segment = queue->head;
+    while(segment != NULL)
+    {
+        Segment* next = segment->next;
+        if(segment->read == segment->written)
+        {
+            segmentRemove(queue, segment);
+        }
+        else
+        {
+            if(!segment->sealed)
+            {
+                segmentSeal(queue, segment);
+            }
+            segmentFree(segment);
+        }
+        segment = next;
+    }
+    syncDir(queue);
+    pthread_mutex_destroy(&queue->mutexQueue);
+    pthread_cond_destroy(&queue->condQueue);
+    free(queue->ring);
+    free(queue->dir);
+    free(queue);
+    errno = error;
+    return result;
+}
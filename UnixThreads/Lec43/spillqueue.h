@@ -0,0 +1,73 @@
+#ifndef SPILLQUEUE_H
+#define SPILLQUEUE_H
+
+#include <stddef.h>
+
+/*
+ * FIFO task queue that spills to disk instead of overflowing.
+ *
+ * Records sit in an in-memory ring while it has room. When a burst fills
+ * it, the overflow is appended to segment files in `dir`: fixed-size files,
+ * mmap(MAP_SHARED), one checksummed record after another. As long as any
+ * record is on disk, new pushes go behind it, so FIFO order holds; pops
+ * refill the ring from the oldest segment. A fully consumed segment is
+ * deleted.
+ *
+ * Producers never wait for consumers: a push is a memcpy into the ring or
+ * into a mapped segment.
+ *
+ * Restarts: spillQueueClose() writes what is left in the ring to a segment
+ * that sorts before the others, and spillQueueOpen() finds all segments again.
+ * Crashes: segments survive a killed process (they are page cache),
+ * recovery keeps every record up to the first bad checksum; records that
+ * were in the ring are lost. SPILL_SYNC msync()s each full segment, for
+ * power loss.
+ *
+ * Records are plain bytes (no pointers): they may be read by another process
+ * with other addresses.
+ */
+
+#define SPILL_SEGMENT_SIZE (4 << 20)    // bytes per segment file
+#define SPILL_MAX_RECORD 240
+
+// spillQueueOpen() flags
+#define SPILL_SYNC 1                    // msync(MS_SYNC) full segments and at close
+
+typedef struct SpillStats
+{
+    long pushed;
+    long popped;
+    long spilled;           // records written to segments
+    long unspilled;         // records read back from segments
+    long segments;          // segment files created
+    long recovered;         // records found by spillQueueOpen()
+    long corrupt;           // records dropped by spillQueueOpen() (bad checksum / torn write)
+    long size;              // records queued now, memory + disk
+    long onDisk;            // of which in segments
+} SpillStats;
+
+typedef struct SpillQueue SpillQueue;
+
+// Opens (creates) the queue in `dir` and recovers the records left there.
+// recordSize <= SPILL_MAX_RECORD. NULL with errno set on failure.
+SpillQueue* spillQueueOpen(const char* dir, size_t recordSize, int memoryCapacity, int flags);
+
+// Copies the record in. 0, or -1 with errno set (ENOSPC, EIO, ... from the segment files).
+int spillQueuePush(SpillQueue* queue, const void* record);
+
+// Waits for a record. 0, or -1 once the queue was stopped.
+int spillQueuePop(SpillQueue* queue, void* record);
+
+// 0, or -1 when the queue is empty
+int spillQueueTryPop(SpillQueue* queue, void* record);
+
+// Wakes every spillQueuePop(); later pops return -1. Records stay queued.
+void spillQueueStop(SpillQueue* queue);
+
+// Persists the records still queued (for the next spillQueueOpen()) and frees the queue.
+// Call after the threads using it are joined. 0, or -1 with errno set.
+int spillQueueClose(SpillQueue* queue);
+
+void spillQueueStats(SpillQueue* queue, SpillStats* stats);
+
+#endif
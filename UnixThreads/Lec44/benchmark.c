@@ -0,0 +1,240 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "epoch.h"
+
+
+#define MAX_READERS 64
+#define WRITER_PERIOD_US 100
+#define DEFAULT_DURATION_MS 500
+
+typedef enum ReadMode
+{
+    MODE_EPOCH,
+    MODE_MUTEX,
+    MODE_RWLOCK,
+    MODE_UNSAFE,
+} ReadMode;
+
+static const char* modeNames[] = { "epoch", "mutex", "rwlock", "unprotected" };
+
+// Each reader owns one cache line for its counters so they do not false-share
+typedef struct ReaderResult
+{
+    long reads;
+    long checksum;
+    double cpuSeconds;
+    char pad[64 - 2 * sizeof(long) - sizeof(double)];
+} ReaderResult;
+
+ReadMode readMode;
+pthread_mutex_t mutexFuel;
+pthread_rwlock_t rwlockFuel;
+_Atomic(int*) Fuel;
+long writes;
+atomic_int running;
+ReaderResult results[MAX_READERS] __attribute__((aligned(64)));
+
+static int readFuel(void)
+{
+    int value = 0;
+    switch(readMode)
+    {
+    case MODE_EPOCH:
+        epochEnter();
+        value = *atomic_load_explicit(&Fuel, memory_order_acquire);
+        epochExit();
+        break;
+    case MODE_MUTEX:
+        pthread_mutex_lock(&mutexFuel);
+        value = *atomic_load_explicit(&Fuel, memory_order_relaxed);
+        pthread_mutex_unlock(&mutexFuel);
+        break;
+    case MODE_RWLOCK:
+        pthread_rwlock_rdlock(&rwlockFuel);
+        value = *atomic_load_explicit(&Fuel, memory_order_relaxed);
+        pthread_rwlock_unlock(&rwlockFuel);
+        break;
+    case MODE_UNSAFE:
+        // The floor: what the read costs with no protection (the writer never frees here)
+        value = *atomic_load_explicit(&Fuel, memory_order_acquire);
+        break;
+    }
+    return value;
+}
+
+// Swaps in a new Fuel and disposes of the old one the way each mode allows
+static void writeFuel(void)
+{
+    int* newFuel = malloc(sizeof(int));
+    int* oldFuel;
+    switch(readMode)
+    {
+    case MODE_EPOCH:
+        oldFuel = atomic_load(&Fuel);
+        *newFuel = *oldFuel + 50;
+        atomic_store(&Fuel, newFuel);
+        epochRetire(oldFuel, free);
+        break;
+    case MODE_MUTEX:
+        pthread_mutex_lock(&mutexFuel);
+        oldFuel = atomic_load(&Fuel);
+        *newFuel = *oldFuel + 50;
+        atomic_store(&Fuel, newFuel);
+        pthread_mutex_unlock(&mutexFuel);
+        free(oldFuel);
+        break;
+    case MODE_RWLOCK:
+        pthread_rwlock_wrlock(&rwlockFuel);
+        oldFuel = atomic_load(&Fuel);
+        *newFuel = *oldFuel + 50;
+        atomic_store(&Fuel, newFuel);
+        pthread_rwlock_unlock(&rwlockFuel);
+        free(oldFuel);
+        break;
+    case MODE_UNSAFE:
+        // Leaked on purpose: freeing it would be Lec24's use-after-free
+        oldFuel = atomic_load(&Fuel);
+        *newFuel = *oldFuel + 50;
+        atomic_store(&Fuel, newFuel);
+        break;
+    }
+    writes++;
+}
+
+static double cpuSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void * reader (void* args)
+{
+    ReaderResult* result = args;
+    long reads = 0;
+    long checksum = 0;
+
+    epochRegister();
+    double start = cpuSeconds();
+    while(atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        checksum += readFuel();
+        reads++;
+    }
+    result->cpuSeconds = cpuSeconds() - start;
+    result->reads = reads;
+    result->checksum = checksum;
+    epochUnregister();
+    return NULL;
+}
+
+void * writer (void* args)
+{
+    epochRegister();
+    while(atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        writeFuel();
+        usleep(WRITER_PERIOD_US);
+    }
+    epochUnregister();
+    return NULL;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void runOnce(ReadMode mode, int readerCount, int durationMs)
+{
+    pthread_t th[MAX_READERS + 1];
+    int i;
+
+    readMode = mode;
+    writes = 0;
+    memset(results, 0, sizeof(results));
+    int* fuel = malloc(sizeof(int));
+    *fuel = 50;
+    atomic_store(&Fuel, fuel);
+    EpochStats before;
+    epochStats(&before);
+    atomic_store(&running, 1);
+
+    double start = nowSeconds();
+    for(i = 0; i < readerCount ; i++)
+    {
+        if( pthread_create(&th[i], NULL , &reader , &results[i]) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    if( pthread_create(&th[readerCount], NULL , &writer , NULL) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+
+    usleep(durationMs * 1000);
+    atomic_store(&running, 0);
+
+    for(i = 0; i <= readerCount ; i++)
+    {
+        if( pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+    double elapsed = nowSeconds() - start;
+
+    long reads = 0;
+    double readerSeconds = 0;
+    for(i = 0; i < readerCount ; i++)
+    {
+        reads += results[i].reads;
+        readerSeconds += results[i].cpuSeconds;
+    }
+    EpochStats after;
+    epochStats(&after);
+    // ns_per_read is reader CPU time per read: it does not drop just because readers share one CPU
+    printf("%s,%d,%.0f,%.2f,%ld,%ld\n", modeNames[mode], readerCount, reads / elapsed,
+        readerSeconds * 1e9 / reads, writes, after.freed - before.freed);
+    free(atomic_load(&Fuel));
+}
+
+
+int main(int argc, char* argv[])
+{
+    int durationMs = argc > 1 ? atoi(argv[1]) : DEFAULT_DURATION_MS;
+    // ./benchmark <ms> fence: epoch readers use a full fence instead of relying on membarrier()
+    if(argc > 2 && strcmp(argv[2], "fence") == 0)
+    {
+        epochSetMembarrier(0);
+    }
+    int readerCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    int i, mode;
+
+    pthread_mutex_init(&mutexFuel , NULL);
+    pthread_rwlock_init(&rwlockFuel , NULL);
+    epochRegister();
+
+    fprintf(stderr, "membarrier: %s\n", epochUseMembarrier ? "on" : "off");
+    printf("mode,readers,reads_per_sec,ns_per_read,writes,freed\n");
+    for(i = 0; i < (int)(sizeof(readerCounts) / sizeof(readerCounts[0])) ; i++)
+    {
+        for(mode = MODE_EPOCH; mode <= MODE_UNSAFE ; mode++)
+        {
+            runOnce(mode, readerCounts[i], durationMs);
+        }
+    }
+
+    epochUnregister();
+    pthread_mutex_destroy(&mutexFuel);
+    pthread_rwlock_destroy(&rwlockFuel);
+    return 0;
+}
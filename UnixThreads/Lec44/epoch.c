@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include "epoch.h"
+
+
+struct EpochRetired
+{
+    void* object;
+    void (*destructor)(void*);
+    unsigned long epoch;                // global epoch when it was retired
+    EpochRetired* next;
+};
+
+atomic_ulong epochGlobal = 1;
+int epochUseMembarrier = 0;
+__thread EpochThread* epochSelf = NULL;
+
+static _Atomic(EpochThread*) registry = NULL;
+static pthread_once_t onceInit = PTHREAD_ONCE_INIT;
+static int membarrierAllowed = 1;
+
+static void initOnce(void)
+{
+    if(!membarrierAllowed)
+    {
+        return;
+    }
+    // Registered once per process; afterwards an expedited membarrier() costs an IPI to the
+    // CPUs running our threads instead of a fence in every epochEnter()
+    long commands = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+    if(commands > 0 && (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+       syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0)
+    {
+        epochUseMembarrier = 1;
+    }
+}
+
+// Makes every reader's state store visible before the writer looks at it
+static void heavyFence(void)
+{
+    if(epochUseMembarrier)
+    {
+        syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+    }
+    else
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+}
+
+void epochSetMembarrier(int enable)
+{
+    membarrierAllowed = enable;
+}
+
+int epochRegister(void)
+{
+    pthread_once(&onceInit, initOnce);
+    if(epochSelf != NULL)
+    {
+        return 0;
+    }
+    // Reuse the record of a thread that unregistered
+    EpochThread* record;
+    for(record = atomic_load(&registry); record != NULL; record = record->next)
+    {
+        int expected = 0;
+        if(atomic_compare_exchange_strong(&record->inUse, &expected, 1))
+        {
+            epochSelf = record;
+            return 0;
+        }
+    }
+    if(posix_memalign((void**)&record, 64, sizeof(EpochThread)) != 0)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(record, 0, sizeof(EpochThread));
+    atomic_init(&record->state, 0);
+    atomic_init(&record->inUse, 1);
+    atomic_init(&record->retired, 0);
+    atomic_init(&record->freed, 0);
+    record->next = atomic_load(&registry);
+    while(!atomic_compare_exchange_weak(&registry, &record->next, record))
+    {
+    }
+    epochSelf = record;
+    return 0;
+}
+
+// Moves the global epoch on if no reader is still in an older one. Returns the global epoch.
+static unsigned long tryAdvance(void)
+{
+    unsigned long epoch = atomic_load_explicit(&epochGlobal, memory_order_acquire);
+    heavyFence();
+    EpochThread* record;
+    for(record = atomic_load_explicit(&registry, memory_order_acquire); record != NULL; record = record->next)
+    {
+        unsigned long state = atomic_load_explicit(&record->state, memory_order_acquire);
+        if((state & 1) && (state >> 1) != epoch)
+        {
+            return epoch;
+        }
+    }
+    // Readers that enter from here on see the swapped pointers
+    atomic_compare_exchange_strong_explicit(&epochGlobal, &epoch, epoch + 1, memory_order_acq_rel, memory_order_acquire);
+    return atomic_load_explicit(&epochGlobal, memory_order_acquire);
+}
+
+// Frees this thread's objects retired at least two epochs ago
+static void reclaim(EpochThread* self, unsigned long epoch)
+{
+    long freed = 0;
+    while(self->retiredHead != NULL && self->retiredHead->epoch + 2 <= epoch)
+    {
+        EpochRetired* retired = self->retiredHead;
+        self->retiredHead = retired->next;
+        retired->destructor(retired->object);
+        free(retired);
+        freed++;
+    }
+    if(self->retiredHead == NULL)
+    {
+        self->retiredTail = NULL;
+    }
+    self->pending -= freed;
+    atomic_store_explicit(&self->freed, atomic_load_explicit(&self->freed, memory_order_relaxed) + freed,
+                          memory_order_relaxed);
+}
+
+void epochRetire(void* object, void (*destructor)(void*))
+{
+    EpochThread* self = epochSelf;
+    EpochRetired* retired = malloc(sizeof(EpochRetired));
+    if(retired == NULL)
+    {
+        // No memory to remember it: wait out the grace period right here
+        epochSynchronize();
+        destructor(object);
+        return;
+    }
+    retired->object = object;
+    retired->destructor = destructor;
+    retired->next = NULL;
+    // Read after the caller's pointer swap: a reader that saw the old pointer is in this epoch or an older one
+    atomic_thread_fence(memory_order_seq_cst);
+    retired->epoch = atomic_load_explicit(&epochGlobal, memory_order_acquire);
+    if(self->retiredTail != NULL)
+    {
+        self->retiredTail->next = retired;
+    }
+    else
+    {
+        self->retiredHead = retired;
+    }
+    self->retiredTail = retired;
+    self->pending++;
+    atomic_store_explicit(&self->retired, atomic_load_explicit(&self->retired, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+
+    // Batched: one heavy fence and registry scan per EPOCH_RETIRE_BATCH retires
+    if(self->pending % EPOCH_RETIRE_BATCH == 0 && self->nesting == 0)
+    {
+        reclaim(self, tryAdvance());
+    }
+}
+
+void epochSynchronize(void)
+{
+    EpochThread* self = epochSelf;
+    unsigned long target = atomic_load_explicit(&epochGlobal, memory_order_acquire) + 2;
+    while(tryAdvance() < target)
+    {
+        sched_yield();
+    }
+    if(self != NULL)
+    {
+        reclaim(self, atomic_load_explicit(&epochGlobal, memory_order_acquire));
+    }
+}
+
+void epochUnregister(void)
+{
+    EpochThread* self = epochSelf;
+    if(self == NULL)
+    {
+        return;
+    }
+    if(self->pending > 0)
+    {
+        epochSynchronize();
+    }
+    epochSelf = NULL;
+    atomic_store(&self->inUse, 0);
+}
+
+void epochStats(EpochStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->epoch = atomic_load(&epochGlobal);
+    stats->membarrier = epochUseMembarrier;
+    EpochThread* record;
+    for(record = atomic_load(&registry); record != NULL; record = record->next)
+    {
+        stats->retired += atomic_load_explicit(&record->retired, memory_order_relaxed);
+        stats->freed += atomic_load_explicit(&record->freed, memory_order_relaxed);
+    }
+    stats->pending = stats->retired - stats->freed;
+}
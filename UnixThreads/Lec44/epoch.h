@@ -0,0 +1,106 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdatomic.h>
+
+/*
+ * Epoch-based reclamation: lock-free readers of heap objects that writers
+ * replace and free.
+ *
+ * A reader brackets its accesses with epochEnter() / epochExit(). That only
+ * stores the current global epoch into the reader's own cache line: no
+ * shared write, no lock, the same cost with 1 or 64 readers.
+ *
+ * A writer publishes a new version with an atomic pointer swap and hands the
+ * old one to epochRetire(). It is freed once the global epoch has moved on
+ * twice: the epoch only advances when every reader inside a read section
+ * has seen the current one, so after two steps no reader can still hold a
+ * pointer it loaded before the swap (the grace period).
+ *
+ * The store-load fence a reader would need at epochEnter() is moved to the
+ * writer side with membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) when the
+ * kernel has it (Linux 4.14+); otherwise readers use a full fence.
+ *
+ * Every thread that reads or retires calls epochRegister() first.
+ * Read sections nest; do not block for long inside them, that stalls
+ * reclamation (memory grows, readers are never blocked).
+ */
+
+#define EPOCH_RETIRE_BATCH 64       // retires between attempts to advance and free
+
+typedef struct EpochRetired EpochRetired;
+
+typedef struct EpochThread
+{
+    _Alignas(64) atomic_ulong state;    // (epoch << 1) | 1 inside a read section, 0 outside
+    unsigned nesting;
+    atomic_int inUse;
+    struct EpochThread* next;           // registry, never unlinked
+    EpochRetired* retiredHead;          // oldest first
+    EpochRetired* retiredTail;
+    long pending;                       // retired, not freed yet
+    atomic_long retired;                // written by the owner only, read by epochStats()
+    atomic_long freed;
+} EpochThread;
+
+typedef struct EpochStats
+{
+    unsigned long epoch;
+    long retired;                       // by all threads, registered now or before
+    long freed;
+    long pending;
+    int membarrier;                     // readers skip the fence
+} EpochStats;
+
+extern atomic_ulong epochGlobal;
+extern int epochUseMembarrier;
+extern __thread EpochThread* epochSelf;
+
+// 0: readers use a full fence even when the kernel has membarrier(). Before the first epochRegister().
+void epochSetMembarrier(int enable);
+
+// Makes the calling thread a reader / writer. 0, or -1 with errno set.
+int epochRegister(void);
+
+// Waits for a grace period and frees what this thread retired. Not inside a read section.
+void epochUnregister(void);
+
+static inline void epochEnter(void)
+{
+    EpochThread* self = epochSelf;
+    if(self->nesting++ == 0)
+    {
+        // Acquire: on weakly ordered CPUs the pointer load below must not move above this one
+        unsigned long epoch = atomic_load_explicit(&epochGlobal, memory_order_acquire);
+        atomic_store_explicit(&self->state, (epoch << 1) | 1, memory_order_relaxed);
+        // The state must be visible before the protected pointer is loaded
+        if(epochUseMembarrier)
+        {
+            atomic_signal_fence(memory_order_seq_cst);
+        }
+        else
+        {
+            atomic_thread_fence(memory_order_seq_cst);
+        }
+    }
+}
+
+static inline void epochExit(void)
+{
+    EpochThread* self = epochSelf;
+    if(--self->nesting == 0)
+    {
+        atomic_store_explicit(&self->state, 0, memory_order_release);
+    }
+}
+
+// Frees `object` with `destructor` (e.g. free) once no reader can reference it
+void epochRetire(void* object, void (*destructor)(void*));
+
+// Waits until every read section that started before the call has ended, then frees
+// what this thread retired. Not inside a read section.
+void epochSynchronize(void);
+
+void epochStats(EpochStats* stats);
+
+#endif
@@ -0,0 +1,115 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "epoch.h"
+
+
+#define THREAD_NUM 4
+#define REFUELS 10
+
+sem_t semFuel;
+
+// Lec24's Fuel, but readers never lock it and nobody frees it under them
+_Atomic(int*) Fuel;
+
+
+void * reader (void* args)
+{
+    epochRegister();
+    long reads = 0;
+    int last = 0;
+    while(1)
+    {
+        epochEnter();
+        int* fuel = atomic_load_explicit(&Fuel, memory_order_acquire);
+        if(fuel == NULL)
+        {
+            epochExit();
+            break;
+        }
+        // Safe until epochExit(), even if the writer swaps and retires it right now
+        int value = *fuel;
+        epochExit();
+        if(value != last)
+        {
+            printf("Current Value is %d \n", value);
+            last = value;
+        }
+        reads++;
+    }
+    printf("Reader done after %ld reads \n", reads);
+    epochUnregister();
+    return NULL;
+}
+
+void * writer (void* args)
+{
+    epochRegister();
+    int i;
+    for(i = 0; i < REFUELS; i++)
+    {
+        // Copy, update, swap: readers see the old or the new value, never a half-written one
+        int* newFuel = malloc(sizeof(int));
+        int* oldFuel = atomic_load(&Fuel);
+        do
+        {
+            *newFuel = *oldFuel + 50;
+        } while(!atomic_compare_exchange_weak(&Fuel, &oldFuel, newFuel));
+        epochRetire(oldFuel, free);
+        usleep(1000);
+    }
+    sem_post(&semFuel);
+    epochUnregister();
+    return NULL;
+}
+
+
+int main(void)
+{
+    pthread_t th[THREAD_NUM + 1];
+    sem_init(&semFuel , 0 , 0);
+    if(epochRegister() != 0)
+    {
+        perror("Failed to Register");
+        return 1;
+    }
+    int* fuel = malloc(sizeof(int));
+    *fuel = 50;
+    atomic_store(&Fuel, fuel);
+    int i;
+    for(i = 0; i < THREAD_NUM ; i++)
+    {
+        if(pthread_create(&th[i], NULL , &reader , NULL) != 0)
+        {
+            perror("Failed to Create Thread");
+        }
+    }
+    if(pthread_create(&th[THREAD_NUM], NULL , &writer , NULL) != 0)
+    {
+        perror("Failed to Create Thread");
+    }
+
+    sem_wait(&semFuel);
+    // Lec24 freed Fuel here while readers could still use it; retire it instead
+    printf("Retiring Fuel \n");
+    epochRetire(atomic_exchange(&Fuel, NULL), free);
+    for(i = 0; i <= THREAD_NUM ; i++)
+    {
+        if(pthread_join(th[i], NULL) != 0)
+        {
+            perror("Failed to Join Thread");
+        }
+    }
+
+    epochSynchronize();
+    EpochStats stats;
+    epochStats(&stats);
+    printf("Retired %ld , freed %ld , pending %ld , epoch %lu (membarrier %s) \n",
+        stats.retired, stats.freed, stats.pending, stats.epoch, stats.membarrier ? "on" : "off");
+    epochUnregister();
+    sem_destroy(&semFuel);
+    return 0;
+}